@@ -0,0 +1,123 @@
+/*
+ * Cutting input frames into engine chunks: AudioChunker against the std::vector insert + erase
+ * buffer it replaced in the AFE processor and the wake words. It reports the time per input
+ * sample, the samples copied per input sample and the heap allocations of each.
+ */
+#include "audio_chunker.h"
+#include "host_tasks.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Case {
+    const char* name;
+    size_t input_samples;   // Per Feed(), interleaved
+    size_t chunk_samples;
+    size_t step;
+};
+
+struct Result {
+    double ns_per_sample;
+    double copied_per_sample;
+    uint64_t allocs;
+    int64_t checksum;
+};
+
+static Result RunInsertErase(const Case& test, const std::vector<int16_t>& input, int rounds) {
+    std::vector<int16_t> buffer;
+    int64_t checksum = 0;
+    uint64_t copied = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        if (test.step == 1) {
+            buffer.insert(buffer.end(), input.begin(), input.end());
+        } else {
+            for (size_t i = 0; i < input.size(); i += test.step) {
+                buffer.push_back(input[i]);
+            }
+        }
+        copied += input.size() / test.step;
+        while (buffer.size() >= test.chunk_samples) {
+            checksum += buffer[0] + buffer[test.chunk_samples - 1];
+            buffer.erase(buffer.begin(), buffer.begin() + test.chunk_samples);
+            copied += buffer.size();
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t samples = (uint64_t)rounds * input.size();
+    return {seconds * 1e9 / samples, (double)copied / samples, HostGetAllocations() - allocs, checksum};
+}
+
+static Result RunChunker(const Case& test, const std::vector<int16_t>& input, int rounds) {
+    AudioChunker chunker;
+    chunker.Configure(test.chunk_samples, test.step);
+    int64_t checksum = 0;
+    uint64_t copied = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        chunker.Feed(std::span<const int16_t>(input), [&](std::span<const int16_t> chunk) {
+            checksum += chunk[0] + chunk[test.chunk_samples - 1];
+            if (chunk.data() < input.data() || chunk.data() >= input.data() + input.size()) {
+                copied += test.chunk_samples;
+            }
+            return true;
+        });
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t samples = (uint64_t)rounds * input.size();
+    return {seconds * 1e9 / samples, (double)copied / samples, HostGetAllocations() - allocs, checksum};
+}
+
+int main(int argc, char** argv) {
+    int rounds = 20000;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            printf("Usage: audio_chunker_bench [--rounds N] [--check]\n"
+                "  --check fails when the outputs differ or the chunker allocates\n");
+            return 2;
+        }
+    }
+
+    const Case cases[] = {
+        { "afe 60ms/512", 960, 512, 1 },
+        { "afe 20ms/256", 320, 256, 1 },
+        { "afe stereo 60ms/512", 1920, 512, 2 },
+        { "multinet 60ms/480", 960, 480, 1 },
+        { "multinet 10ms/480", 160, 480, 1 },
+    };
+
+    int failures = 0;
+    printf("%-22s %24s %24s %18s\n", "", "ns/sample", "copied/sample", "allocs");
+    printf("%-22s %12s %11s %12s %11s %9s %8s\n", "case", "insert+erase", "chunker", "insert+erase", "chunker",
+        "ins+erase", "chunker");
+    for (auto& test : cases) {
+        std::vector<int16_t> input(test.input_samples);
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = (int16_t)(i * 7);
+        }
+        auto reference = RunInsertErase(test, input, rounds);
+        auto chunker = RunChunker(test, input, rounds);
+        printf("%-22s %12.2f %11.2f %12.2f %11.2f %9llu %8llu\n", test.name, reference.ns_per_sample,
+            chunker.ns_per_sample, reference.copied_per_sample, chunker.copied_per_sample,
+            (unsigned long long)reference.allocs, (unsigned long long)chunker.allocs);
+        // Configure() reserves the carry buffer before the clock starts, Feed() never allocates
+        if (reference.checksum != chunker.checksum || chunker.allocs != 0) {
+            fprintf(stderr, "%s: checksum %lld / %lld, %llu chunker allocations\n", test.name,
+                (long long)reference.checksum, (long long)chunker.checksum, (unsigned long long)chunker.allocs);
+            failures++;
+        }
+    }
+    return check && failures > 0 ? 1 : 0;
+}
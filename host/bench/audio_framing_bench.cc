@@ -0,0 +1,189 @@
+/*
+ * Framing the websocket audio: the v2 / v3 header written into the packet headroom against the
+ * std::string per frame that SendAudio() built before. Each frame is first written into the packet,
+ * as the encoder does, then framed. It reports the time, the Opus bytes copied and the heap
+ * allocations per frame, and the message bytes that go to the websocket. The receive side reads
+ * the header in place and copies the payload once into a pooled packet.
+ */
+#include "audio_framing.h"
+#include "audio_pool.h"
+#include "host_tasks.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    double ns_per_frame;
+    double copied_per_frame;    // Opus bytes moved or copied after the encoder wrote them
+    double allocs_per_frame;
+    size_t message_bytes;
+    uint64_t checksum;
+};
+
+static std::vector<uint8_t> Opus(size_t size) {
+    std::vector<uint8_t> opus(size);
+    for (size_t i = 0; i < size; i++) {
+        opus[i] = i * 13 + 5;
+    }
+    return opus;
+}
+
+static uint64_t Checksum(const uint8_t* data, size_t size) {
+    return size + data[0] + data[size - 1] * 256;
+}
+
+// The message the old SendAudio() built
+static std::string Serialize(const AudioStreamPacket& packet, int version) {
+    std::string serialized;
+    if (version == 2) {
+        serialized.resize(sizeof(BinaryProtocol2) + packet.size());
+        auto bp2 = (BinaryProtocol2*)serialized.data();
+        bp2->version = htons(version);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(packet.size());
+        memcpy(bp2->payload, packet.data(), packet.size());
+    } else {
+        serialized.resize(sizeof(BinaryProtocol3) + packet.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(packet.size());
+        memcpy(bp3->payload, packet.data(), packet.size());
+    }
+    return serialized;
+}
+
+// Headroom as the encoder leaves it, 0 for the wake word packets
+static void Encode(AudioStreamPacket& packet, const std::vector<uint8_t>& opus, uint16_t headroom, uint32_t timestamp) {
+    packet.payload.resize(headroom + opus.size());
+    memcpy(packet.payload.data() + headroom, opus.data(), opus.size());
+    packet.headroom = headroom;
+    packet.timestamp = timestamp;
+}
+
+static Result RunString(const std::vector<uint8_t>& opus, int version, int frames) {
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->payload.reserve(AUDIO_PACKET_HEADROOM + opus.size());
+    uint64_t checksum = 0;
+    size_t message_bytes = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int i = 0; i < frames; i++) {
+        Encode(*packet, opus, AUDIO_PACKET_HEADROOM, i * 60);
+        auto message = Serialize(*packet, version);
+        message_bytes = message.size();
+        checksum += Checksum((const uint8_t*)message.data(), message.size());
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return {seconds * 1e9 / frames, (double)opus.size(), (double)(HostGetAllocations() - allocs) / frames,
+        message_bytes, checksum};
+}
+
+static Result RunInPlace(const std::vector<uint8_t>& opus, int version, uint16_t headroom, int frames) {
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->payload.reserve(AUDIO_PACKET_HEADROOM + opus.size());
+    uint64_t checksum = 0;
+    uint64_t copied = 0;
+    size_t message_bytes = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int i = 0; i < frames; i++) {
+        Encode(*packet, opus, headroom, i * 60);
+        const uint8_t* data = packet->data();
+        auto message = audio_framing::WriteHeader(*packet, version, message_bytes);
+        if (packet->data() != data) {
+            copied += opus.size();
+        }
+        checksum += Checksum(message, message_bytes);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return {seconds * 1e9 / frames, (double)copied / frames, (double)(HostGetAllocations() - allocs) / frames,
+        message_bytes, checksum};
+}
+
+// Header read in place, the payload copied into a pooled packet, as OnData() does
+static Result RunReceive(const std::string& message, int version, int frames) {
+    uint64_t checksum = 0;
+    uint64_t copied = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int i = 0; i < frames; i++) {
+        audio_framing::Frame frame;
+        if (!audio_framing::ReadFrame((const uint8_t*)message.data(), message.size(), version, frame)) {
+            continue;
+        }
+        auto packet = std::make_unique<AudioStreamPacket>();
+        packet->timestamp = frame.timestamp;
+        AssignBuffer(packet->payload, frame.payload, frame.size);
+        copied += frame.size;
+        checksum += Checksum(packet->data(), packet->size());
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return {seconds * 1e9 / frames, (double)copied / frames, (double)(HostGetAllocations() - allocs) / frames,
+        message.size(), checksum};
+}
+
+int main(int argc, char** argv) {
+    int frames = 200000;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            printf("Usage: audio_framing_bench [--frames N] [--check]\n"
+                "  --check fails when a message differs from the old one or the headroom path copies or allocates\n");
+            return 2;
+        }
+    }
+    if (frames <= 0) {
+        return 2;
+    }
+
+    // The pool holds the packets, as on the device, so a packet taken and released is not an allocation
+    AudioPacketPool::GetInstance().Initialize(4, AUDIO_PACKET_HEADROOM + 1275, MALLOC_CAP_8BIT);
+
+    // 60 ms at 16 and 32 kbps, a 20 ms frame, and the largest Opus frame
+    const size_t sizes[] = { 120, 240, 40, 1275 };
+    int failures = 0;
+    printf("%-6s %-3s %-22s %9s %10s %11s %10s\n", "opus", "v", "path", "ns/frame", "copied B", "allocs", "message B");
+    for (size_t size : sizes) {
+        auto opus = Opus(size);
+        for (int version : { 2, 3 }) {
+            auto reference = RunString(opus, version, frames);
+            auto headroom = RunInPlace(opus, version, AUDIO_PACKET_HEADROOM, frames);
+            auto no_headroom = RunInPlace(opus, version, 0, frames);
+            auto packet = std::make_unique<AudioStreamPacket>();
+            Encode(*packet, opus, AUDIO_PACKET_HEADROOM, 0x12345678);
+            auto message = Serialize(*packet, version);
+            auto receive = RunReceive(message, version, frames);
+            size_t message_bytes = 0;
+            auto in_place = audio_framing::WriteHeader(*packet, version, message_bytes);
+            bool identical = message_bytes == message.size() && memcmp(in_place, message.data(), message_bytes) == 0;
+            const std::pair<const char*, Result*> rows[] = { { "send, std::string", &reference },
+                { "send, headroom", &headroom }, { "send, no headroom", &no_headroom }, { "receive", &receive } };
+            for (auto& [name, result] : rows) {
+                printf("%-6zu %-3d %-22s %9.1f %10.1f %11.3f %10zu\n", size, version, name, result->ns_per_frame,
+                    result->copied_per_frame, result->allocs_per_frame, result->message_bytes);
+            }
+            if (!identical || headroom.checksum != reference.checksum || no_headroom.checksum != reference.checksum ||
+                    headroom.message_bytes != reference.message_bytes || headroom.copied_per_frame != 0 ||
+                    headroom.allocs_per_frame != 0) {
+                fprintf(stderr, "%zu bytes v%d: the headroom path differs, copies or allocates\n", size, version);
+                failures++;
+            }
+        }
+    }
+    return check && failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Drives AudioService end to end on the host: WAV microphone -> processor -> encoder -> send queue,
+ * looped back as if the server echoed it -> decode queue -> jitter buffer -> decoder -> WAV speaker.
+ * The codec stress mode runs StartCodecStressTest() instead. It reports the frame rates, the CPU time
+ * and allocations of each task, the queue depths and the per-stage latencies.
+ *
+ * The codec is a stand-in for Opus (shims/esp_opus_enc.h), so the encode / decode times measure the
+ * pipeline around the codec, not Opus itself.
+ */
+#include "audio_service.h"
+#include "wav_audio_codec.h"
+#include "host_tasks.h"
+
+#include <esp_log.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define TAG "AudioPipelineBench"
+
+struct Options {
+    std::string mode = "loopback";
+    std::string input;
+    std::string output;
+    int seconds = 5;
+    int output_rate = 0;
+    bool realtime = false;
+    bool check = false;
+    bool verbose = false;
+};
+
+static void Usage() {
+    printf("Usage: audio_pipeline_bench [options]\n"
+        "  --mode loopback|stress  Voice processing with the uplink looped back to the downlink (default),\n"
+        "                          or the codec stress test\n"
+        "  --input FILE.wav        16-bit PCM microphone input, looped; a generated test signal by default\n"
+        "  --output FILE.wav       Speaker output\n"
+        "  --seconds N             Run time (default 5)\n"
+        "  --output-rate HZ        Speaker sample rate, the downlink is resampled to it (default: input rate)\n"
+        "  --realtime              Read and play at the sample rate instead of as fast as possible\n"
+        "  --check                 Exit with an error when a direction moved no frames, or the input task\n"
+        "                          allocated in steady state\n"
+        "  --verbose               Show the AudioService logs\n");
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* {
+            return i + 1 < argc ? argv[++i] : "";
+        };
+        if (arg == "--mode") {
+            options.mode = value();
+        } else if (arg == "--input") {
+            options.input = value();
+        } else if (arg == "--output") {
+            options.output = value();
+        } else if (arg == "--seconds") {
+            options.seconds = atoi(value());
+        } else if (arg == "--output-rate") {
+            options.output_rate = atoi(value());
+        } else if (arg == "--realtime") {
+            options.realtime = true;
+        } else if (arg == "--check") {
+            options.check = true;
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            return false;
+        }
+    }
+    return options.seconds > 0 && (options.mode == "loopback" || options.mode == "stress");
+}
+
+static std::map<std::string, HostTaskInfo> SnapshotTasks() {
+    std::map<std::string, HostTaskInfo> tasks;
+    for (auto& task : HostGetTasks()) {
+        tasks[task.name] = task;
+    }
+    return tasks;
+}
+
+static int GetInt(cJSON* json, const char* object, const char* name) {
+    cJSON* item = cJSON_GetObjectItem(cJSON_GetObjectItem(json, object), name);
+    return cJSON_IsNumber(item) ? item->valueint : 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        Usage();
+        return 2;
+    }
+    esp_log_level_set("*", options.verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+
+    if (options.input.empty()) {
+        options.input = (std::filesystem::temp_directory_path() / "audio_pipeline_bench_input.wav").string();
+        if (!WavAudioCodec::WriteTestSignal(options.input, 16000, 10)) {
+            fprintf(stderr, "Cannot write %s\n", options.input.c_str());
+            return 1;
+        }
+    }
+    WavAudioCodec codec(options.input, options.output, options.realtime, options.output_rate);
+    if (!codec.ok()) {
+        return 1;
+    }
+
+    AudioService audio_service;
+    audio_service.Initialize(&codec);
+    audio_service.Start();
+
+    /* The network side: packets leave the send queue and come back as server audio */
+    std::mutex mutex;
+    std::condition_variable send_cv;
+    bool send_ready = false;
+    std::atomic<bool> running = true;
+    AudioServiceCallbacks callbacks;
+    callbacks.on_send_queue_available = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        send_ready = true;
+        send_cv.notify_one();
+    };
+    audio_service.SetCallbacks(callbacks);
+
+    uint32_t looped_packets = 0;
+    std::thread network([&]() {
+        uint32_t sequence = 0;
+        while (running) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                send_cv.wait_for(lock, std::chrono::milliseconds(20), [&] { return send_ready; });
+                send_ready = false;
+            }
+            while (auto packet = audio_service.PopPacketFromSendQueue()) {
+                audio_service.RecordPacketSent(packet->origin_time_us, packet->stage_time_us);
+                /* In real time the packets go through the jitter buffer like server audio. As fast as
+                 * possible they are decoded in arrival order, the jitter buffer would pace them. */
+                packet->sequence = options.realtime ? ++sequence : 0;
+                packet->origin_time_us = 0;
+                audio_service.PushPacketToDecodeQueue(std::move(packet), true);
+                looped_packets++;
+            }
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    if (options.mode == "stress") {
+        audio_service.StartCodecStressTest(options.seconds * 1000);
+    } else {
+        audio_service.EnableVoiceProcessing(true);
+    }
+
+    /* Steady state from the end of the first quarter, after the pools, queues and decoders warmed up */
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.seconds * 250));
+    auto warm_time = std::chrono::steady_clock::now();
+    auto warm_tasks = SnapshotTasks();
+    uint64_t warm_allocs = HostGetAllocations();
+    cJSON* warm_stats = audio_service.GetStatsJson();
+
+    std::this_thread::sleep_until(start + std::chrono::seconds(options.seconds));
+    if (options.mode == "stress") {
+        /* The input task ends the test after its next read */
+        while (cJSON* stats = audio_service.GetStatsJson()) {
+            bool done = !cJSON_IsTrue(cJSON_GetObjectItem(cJSON_GetObjectItem(stats, "stress"), "running"));
+            cJSON_Delete(stats);
+            if (done) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    auto end_time = std::chrono::steady_clock::now();
+    auto end_tasks = SnapshotTasks();
+    uint64_t end_allocs = HostGetAllocations();
+    cJSON* stats = audio_service.GetStatsJson();
+    cJSON* latency = audio_service.GetLatencyJson();
+
+    uint64_t input_allocs = end_tasks["audio_input"].allocs - warm_tasks["audio_input"].allocs;
+    double elapsed = std::chrono::duration<double>(end_time - start).count();
+    double window = std::chrono::duration<double>(end_time - warm_time).count();
+    int uplink_frames = GetInt(stats, "encode", "frames");
+    int downlink_frames = GetInt(stats, "decode", "frames");
+    int window_uplink = uplink_frames - GetInt(warm_stats, "encode", "frames");
+    int window_downlink = downlink_frames - GetInt(warm_stats, "decode", "frames");
+    int frame_ms = audio_service.GetFrameDuration();
+
+    printf("Mode %s%s, %.2f s, %.2f s of audio captured (%.1fx real time), %d ms frames\n", options.mode.c_str(),
+        options.realtime ? " (real time)" : "", elapsed, (double)codec.input_frames() / codec.input_sample_rate(),
+        codec.input_frames() / (double)codec.input_sample_rate() / elapsed, frame_ms);
+    printf("Uplink %d frames, %.1f frames/s steady; downlink %d frames, %.1f frames/s steady; %u packets looped back\n",
+        uplink_frames, window_uplink / window, downlink_frames, window_downlink / window, looped_packets);
+
+    printf("\n%-14s %12s %8s %14s %10s %12s\n", "task", "cpu ms", "cpu %", "cpu us/frame", "allocs", "allocs/s");
+    for (auto& [name, task] : end_tasks) {
+        auto& before = warm_tasks[name];
+        double cpu_ms = (task.cpu_time_us - before.cpu_time_us) / 1000.0;
+        /* Per uplink frame for the input and encode tasks, per downlink frame for the others */
+        bool uplink = name == "audio_input" || name == "opus_encode";
+        int frames = uplink ? window_uplink : window_downlink;
+        printf("%-14s %12.1f %8.1f %14.1f %10llu %12.1f\n", name.c_str(), cpu_ms, cpu_ms / 10.0 / window,
+            frames > 0 ? cpu_ms * 1000 / frames : 0.0, (unsigned long long)(task.allocs - before.allocs),
+            (task.allocs - before.allocs) / window);
+    }
+    printf("%-14s %12s %8s %14s %10llu %12.1f\n", "all threads", "", "", "",
+        (unsigned long long)(end_allocs - warm_allocs), (end_allocs - warm_allocs) / window);
+
+    char* text = cJSON_Print(stats);
+    printf("\nself.audio.get_stats:\n%s\n", text);
+    cJSON_free(text);
+    text = cJSON_Print(latency);
+    printf("\nLatency per stage:\n%s\n", text);
+    cJSON_free(text);
+    cJSON_Delete(latency);
+    cJSON_Delete(warm_stats);
+    cJSON_Delete(stats);
+
+    if (options.mode != "stress") {
+        audio_service.EnableVoiceProcessing(false);
+    }
+    audio_service.Stop();
+    running = false;
+    network.join();
+    if (!HostJoinTasks(2000)) {
+        ESP_LOGE(TAG, "The audio tasks did not stop");
+        return 1;
+    }
+
+    if (options.check && (uplink_frames == 0 || downlink_frames == 0)) {
+        ESP_LOGE(TAG, "No frames moved: uplink %d, downlink %d", uplink_frames, downlink_frames);
+        return 1;
+    }
+    /* The capture path reuses its buffers, once warm the input task does not touch the heap */
+    if (options.check && options.mode == "loopback" && input_allocs != 0) {
+        ESP_LOGE(TAG, "The audio input task allocated %llu times in steady state", (unsigned long long)input_allocs);
+        return 1;
+    }
+    return 0;
+}
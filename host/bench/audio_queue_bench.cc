@@ -0,0 +1,211 @@
+/*
+ * Hand-off between two pipeline stages: the AudioQueue ring with its per-boundary event bits,
+ * against the single mutex + std::deque + shared condition variable the pipeline used before.
+ * Besides the producer and the consumer, idle tasks wait the way the other pipeline stages do:
+ * on the shared condition variable in the old scheme, on their own event bits in the new one.
+ * It reports the items per second, the push-to-pop latency and the wakeups of the idle tasks.
+ */
+#include "audio_queue.h"
+
+#include <freertos/event_groups.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int items = 100000;
+    int capacity = 4;
+    int idle_tasks = 3;
+    int interval_us = 0;
+};
+
+struct Result {
+    double seconds = 0;
+    std::vector<int64_t> latencies_ns;
+    uint64_t idle_wakeups = 0;
+};
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static void Pace(const Options& options, Clock::time_point start, int i) {
+    if (options.interval_us > 0) {
+        std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t)options.interval_us * i));
+    }
+}
+
+static Result RunSharedCondition(const Options& options) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<int64_t> queue;
+    bool stopped = false;
+    std::atomic<uint64_t> idle_wakeups = 0;
+    Result result;
+    result.latencies_ns.reserve(options.items);
+
+    std::vector<std::thread> idle;
+    for (int i = 0; i < options.idle_tasks; i++) {
+        idle.emplace_back([&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() {
+                idle_wakeups++;
+                return stopped;
+            });
+        });
+    }
+    std::thread consumer([&]() {
+        for (int i = 0; i < options.items; i++) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return !queue.empty(); });
+            int64_t pushed = queue.front();
+            queue.pop_front();
+            cv.notify_all();
+            lock.unlock();
+            result.latencies_ns.push_back(NowNs() - pushed);
+        }
+    });
+
+    // Let the idle tasks block before counting
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    idle_wakeups = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < options.items; i++) {
+        Pace(options, start, i);
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return queue.size() < (size_t)options.capacity; });
+        queue.push_back(NowNs());
+        cv.notify_all();
+    }
+    consumer.join();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.idle_wakeups = idle_wakeups;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+        cv.notify_all();
+    }
+    for (auto& thread : idle) {
+        thread.join();
+    }
+    return result;
+}
+
+static Result RunAudioQueue(const Options& options) {
+    constexpr EventBits_t kNotEmpty = 1 << 0;
+    constexpr EventBits_t kNotFull = 1 << 1;
+    constexpr EventBits_t kStopped = 1 << 2;
+    EventGroupHandle_t group = xEventGroupCreate();
+    AudioQueue<int64_t> queue(options.capacity);
+    queue.SetEventBits(group, kNotEmpty, kNotFull);
+    std::atomic<uint64_t> idle_wakeups = 0;
+    Result result;
+    result.latencies_ns.reserve(options.items);
+
+    std::vector<std::thread> idle;
+    for (int i = 0; i < options.idle_tasks; i++) {
+        idle.emplace_back([&]() {
+            while (true) {
+                EventBits_t bits = xEventGroupWaitBits(group, kStopped, pdFALSE, pdFALSE, portMAX_DELAY);
+                if (bits & kStopped) {
+                    break;
+                }
+                idle_wakeups++;
+            }
+        });
+    }
+    std::thread consumer([&]() {
+        int64_t pushed;
+        for (int i = 0; i < options.items; i++) {
+            while (!queue.Pop(pushed)) {
+                xEventGroupWaitBits(group, kNotEmpty, pdTRUE, pdFALSE, portMAX_DELAY);
+            }
+            result.latencies_ns.push_back(NowNs() - pushed);
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto start = Clock::now();
+    for (int i = 0; i < options.items; i++) {
+        Pace(options, start, i);
+        while (!queue.Push(NowNs())) {
+            xEventGroupWaitBits(group, kNotFull, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
+    }
+    consumer.join();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.idle_wakeups = idle_wakeups;
+
+    xEventGroupSetBits(group, kStopped);
+    for (auto& thread : idle) {
+        thread.join();
+    }
+    vEventGroupDelete(group);
+    return result;
+}
+
+static void Report(const char* name, const Options& options, Result& result) {
+    auto& latencies = result.latencies_ns;
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (auto latency : latencies) {
+        mean += latency;
+    }
+    mean /= std::max<size_t>(latencies.size(), 1);
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(latencies.size() * p))] / 1000.0;
+    };
+    printf("%-18s %12.0f %10.1f %10.1f %10.1f %14.2f\n", name, options.items / result.seconds, mean / 1000.0,
+        percentile(0.5), percentile(0.99), (double)result.idle_wakeups / options.items);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        auto value = [&]() { return i + 1 < argc ? atoi(argv[++i]) : 0; };
+        if (strcmp(argv[i], "--items") == 0) {
+            options.items = value();
+        } else if (strcmp(argv[i], "--capacity") == 0) {
+            options.capacity = value();
+        } else if (strcmp(argv[i], "--idle-tasks") == 0) {
+            options.idle_tasks = value();
+        } else if (strcmp(argv[i], "--interval-us") == 0) {
+            options.interval_us = value();
+        } else {
+            printf("Usage: audio_queue_bench [--items N] [--capacity N] [--idle-tasks N] [--interval-us US]\n"
+                "  --interval-us paces the producer, 0 pushes as fast as the queue allows\n");
+            return 2;
+        }
+    }
+    if (options.items <= 0 || options.capacity <= 0 || options.idle_tasks < 0) {
+        return 2;
+    }
+
+    printf("%d items, capacity %d, %d idle tasks, %s\n", options.items, options.capacity, options.idle_tasks,
+        options.interval_us > 0 ? (std::to_string(options.interval_us) + " us apart").c_str() : "unpaced");
+    printf("%-18s %12s %10s %10s %10s %14s\n", "", "items/s", "mean us", "p50 us", "p99 us", "idle wake/item");
+    auto shared = RunSharedCondition(options);
+    Report("mutex+deque+cv", options, shared);
+    auto ring = RunAudioQueue(options);
+    Report("AudioQueue", options, ring);
+
+    // The point of the ring: the tasks that wait on other boundaries are never woken
+    if (ring.idle_wakeups != 0 || ring.latencies_ns.size() != (size_t)options.items) {
+        fprintf(stderr, "AudioQueue woke %llu idle tasks\n", (unsigned long long)ring.idle_wakeups);
+        return 1;
+    }
+    return 0;
+}
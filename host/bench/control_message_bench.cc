@@ -0,0 +1,268 @@
+/*
+ * Reading the server control messages: ControlMessageParser, with cJSON for what it leaves, against
+ * the cJSON tree the application built for every message. Replays a trace, one message per line as
+ * the device receives them, or a generated one: the messages of a spoken reply (stt, llm emotion,
+ * tts start, a sentence_start per sentence, tts stop) and some mcp calls. It reports the time and
+ * the heap allocations per message, cJSON's counted through cJSON_InitHooks.
+ */
+#include "control_message.h"
+#include "host_tasks.h"
+
+#include <cJSON.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t cjson_allocs = 0;
+
+static void* CountingMalloc(size_t size) {
+    cjson_allocs++;
+    return malloc(size);
+}
+
+static uint64_t Allocations() {
+    return cjson_allocs + HostGetAllocations();
+}
+
+// Sentences as the server sends them, some escaped to ASCII like Python's json.dumps does by default
+static std::string JsonString(const std::string& text, bool ascii) {
+    std::string out = "\"";
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = text[i];
+        if (!ascii || c < 0x80) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += (char)c;
+            i++;
+            continue;
+        }
+        int length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+        uint32_t code = c & (0xFF >> (length + 1));
+        for (int k = 1; k < length; k++) {
+            code = (code << 6) | (text[i + k] & 0x3F);
+        }
+        i += length;
+        char hex[16];
+        if (code >= 0x10000) {
+            snprintf(hex, sizeof(hex), "\\u%04x\\u%04x", 0xD800 + ((code - 0x10000) >> 10),
+                0xDC00 + ((code - 0x10000) & 0x3FF));
+        } else {
+            snprintf(hex, sizeof(hex), "\\u%04x", code);
+        }
+        out += hex;
+    }
+    return out + "\"";
+}
+
+static std::vector<std::string> GenerateTrace(int replies) {
+    static const char* sentences[] = {
+        "好的，我来帮你查一下明天的天气。",
+        "明天北京晴，最高气温二十六度，最低气温十五度。",
+        "早晚温差比较大，出门记得带一件外套。",
+        "Sure, here is a short story about a little fox who wanted to see the sea.",
+        "音量已经调到百分之五十了。",
+        "这首歌叫《小星星》，我们一起来唱吧！😊",
+        "I set a timer for ten minutes.",
+        "如果还有别的问题，随时叫我哦。",
+    };
+    static const char* emotions[][2] = { { "😊", "happy" }, { "🤔", "thinking" }, { "😆", "laughing" },
+        { "🙂", "neutral" } };
+    std::mt19937 random(18);
+    std::vector<std::string> trace;
+    std::string session = "\"session_id\":\"b0c2a6f1-6c4e-4f7e-9d1e-3a5b7c9d2e4f\"";
+    for (int reply = 0; reply < replies; reply++) {
+        bool ascii = reply % 2 == 1;
+        trace.push_back("{" + session + ",\"type\":\"stt\",\"text\":" + JsonString(sentences[random() % 8], ascii) + "}");
+        auto& emotion = emotions[random() % 4];
+        trace.push_back("{\"type\":\"llm\",\"text\":" + JsonString(emotion[0], ascii) + ",\"emotion\":\"" + emotion[1] +
+            "\"," + session + "}");
+        trace.push_back("{\"type\":\"tts\",\"state\":\"start\",\"sample_rate\":24000," + session + "}");
+        for (int count = 1 + random() % 6; count > 0; count--) {
+            trace.push_back("{\"type\":\"tts\",\"state\":\"sentence_start\",\"text\":" +
+                JsonString(sentences[random() % 8], ascii) + "," + session + "}");
+        }
+        trace.push_back("{\"type\":\"tts\",\"state\":\"stop\"," + session + "}");
+        if (random() % 4 == 0) {
+            trace.push_back("{" + session + ",\"type\":\"mcp\",\"payload\":{\"jsonrpc\":\"2.0\",\"id\":" +
+                std::to_string(reply) + ",\"method\":\"tools/call\",\"params\":{\"name\":\"self.audio_speaker.set_volume\","
+                "\"arguments\":{\"volume\":50}}}}");
+        }
+    }
+    return trace;
+}
+
+static int64_t Checksum(const ControlMessage& message) {
+    return message.type.size() + message.state.size() + message.text.size() + message.emotion.size();
+}
+
+// What the application read from the tree, the views are used before the tree is released
+static bool ReadTree(const std::string& json, int64_t& checksum) {
+    ControlMessage message;
+    cJSON* root = cJSON_ParseWithLength(json.data(), json.size());
+    if (root == nullptr) {
+        return false;
+    }
+    const char* names[] = { "type", "state", "text", "emotion" };
+    std::string_view* fields[] = { &message.type, &message.state, &message.text, &message.emotion };
+    for (int i = 0; i < 4; i++) {
+        cJSON* item = cJSON_GetObjectItem(root, names[i]);
+        *fields[i] = cJSON_IsString(item) ? std::string_view(item->valuestring) : std::string_view();
+    }
+    bool ok = !message.type.empty();
+    if (ok) {
+        checksum += Checksum(message);
+    }
+    cJSON_Delete(root);
+    return ok;
+}
+
+struct Result {
+    double ns_per_message;
+    double allocs_per_message;
+    size_t fallbacks;
+    uint64_t parse_allocs;      // Made inside Parse() itself
+    int64_t checksum;
+};
+
+static Result RunTree(const std::vector<std::string>& trace, int rounds) {
+    int64_t checksum = 0;
+    uint64_t allocs = Allocations();
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (auto& json : trace) {
+            ReadTree(json, checksum);
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t messages = (uint64_t)rounds * trace.size();
+    return {seconds * 1e9 / messages, (double)(Allocations() - allocs) / messages, 0, 0, checksum};
+}
+
+static Result RunParser(const std::vector<std::string>& trace, int rounds) {
+    ControlMessageParser parser;
+    int64_t checksum = 0;
+    size_t fallbacks = 0;
+    uint64_t parse_allocs = 0;
+    uint64_t allocs = Allocations();
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (auto& json : trace) {
+            ControlMessage message;
+            uint64_t before = Allocations();
+            bool parsed = parser.Parse(json.data(), json.size(), message);
+            parse_allocs += Allocations() - before;
+            if (parsed) {
+                checksum += Checksum(message);
+            } else {
+                fallbacks++;
+                ReadTree(json, checksum);
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t messages = (uint64_t)rounds * trace.size();
+    return {seconds * 1e9 / messages, (double)(Allocations() - allocs) / messages, fallbacks / rounds, parse_allocs,
+        checksum};
+}
+
+// The parser reads what the tree holds, for every message it does not leave to cJSON
+static size_t CountMismatches(const std::vector<std::string>& trace) {
+    ControlMessageParser parser;
+    size_t mismatches = 0;
+    for (auto& json : trace) {
+        ControlMessage parsed;
+        if (!parser.Parse(json.data(), json.size(), parsed)) {
+            continue;
+        }
+        cJSON* root = cJSON_ParseWithLength(json.data(), json.size());
+        const char* names[] = { "type", "state", "text", "emotion" };
+        std::string_view fields[] = { parsed.type, parsed.state, parsed.text, parsed.emotion };
+        bool match = root != nullptr;
+        for (int i = 0; i < 4 && match; i++) {
+            cJSON* item = cJSON_GetObjectItem(root, names[i]);
+            match = cJSON_IsString(item) ? fields[i] == item->valuestring : fields[i].data() == nullptr;
+        }
+        cJSON_Delete(root);
+        if (!match) {
+            fprintf(stderr, "mismatch: %s\n", json.c_str());
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv) {
+    int rounds = 200;
+    int replies = 200;
+    const char* trace_path = nullptr;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--replies") == 0 && i + 1 < argc) {
+            replies = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            printf("Usage: control_message_bench [--rounds N] [--replies N | --trace FILE] [--check]\n"
+                "  --trace replays FILE, one JSON message per line, instead of N generated replies\n"
+                "  --check fails when the parser reads a field cJSON does not or allocates\n");
+            return 2;
+        }
+    }
+
+    std::vector<std::string> trace;
+    if (trace_path != nullptr) {
+        std::ifstream file(trace_path);
+        if (!file) {
+            fprintf(stderr, "Cannot read %s\n", trace_path);
+            return 2;
+        }
+        for (std::string line; std::getline(file, line);) {
+            if (!line.empty()) {
+                trace.push_back(line);
+            }
+        }
+    } else {
+        trace = GenerateTrace(replies);
+    }
+    if (trace.empty() || rounds <= 0) {
+        fprintf(stderr, "Nothing to replay\n");
+        return 2;
+    }
+
+    cJSON_Hooks hooks = { CountingMalloc, free };
+    cJSON_InitHooks(&hooks);
+    size_t bytes = 0;
+    for (auto& json : trace) {
+        bytes += json.size();
+    }
+    printf("%zu messages, %zu bytes on average, %d rounds, cJSON %s\n", trace.size(), bytes / trace.size(), rounds,
+        cJSON_Version());
+
+    auto tree = RunTree(trace, rounds);
+    auto parser = RunParser(trace, rounds);
+    printf("%-18s %10s %12s %10s\n", "", "ns/msg", "allocs/msg", "to cJSON");
+    printf("%-18s %10.1f %12.2f %10zu\n", "cJSON tree", tree.ns_per_message, tree.allocs_per_message, trace.size());
+    printf("%-18s %10.1f %12.2f %10zu\n", "parser + cJSON", parser.ns_per_message, parser.allocs_per_message,
+        parser.fallbacks);
+
+    size_t mismatches = CountMismatches(trace);
+    if (mismatches > 0 || parser.parse_allocs != 0 || tree.checksum != parser.checksum) {
+        fprintf(stderr, "%zu mismatches, %llu allocations in Parse(), checksum %lld / %lld\n", mismatches,
+            (unsigned long long)parser.parse_allocs, (long long)tree.checksum, (long long)parser.checksum);
+        return check ? 1 : 0;
+    }
+    return 0;
+}
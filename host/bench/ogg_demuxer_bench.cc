@@ -0,0 +1,209 @@
+/*
+ * Reading Opus packets out of large Ogg files: OggDemuxer handing out views into the input
+ * against copying every packet into packet_buf. The callback does what AudioService does with
+ * the packets, a view is queued as it is, a copy goes into a pooled packet. The input is the
+ * whole file, as a sound in flash, or 4 KB reads, as from HTTP. It reports the input MB/s, ns,
+ * bytes copied and heap allocations per packet, and the share of packets read as views.
+ *
+ * Without --file two streams are generated from the same packets: pages cut at 4 KB of body as
+ * libogg does, and pages of 6 segments, where about three times as many packets span pages.
+ */
+#include "ogg_demuxer.h"
+#include "audio_pool.h"
+#include "protocol.h"
+#include "host_tasks.h"
+
+#include <esp_log.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    double mb_per_second;
+    double ns_per_packet;
+    double copied_per_packet;   // Bytes copied into packet_buf and into the packet
+    double allocs_per_packet;
+    double view_share;
+    uint64_t packets;
+    uint64_t checksum;
+};
+
+// Segments go into pages until max_body bytes or max_segments, a packet may be cut anywhere
+static std::vector<uint8_t> WriteStream(const std::vector<std::vector<uint8_t>>& packets, size_t max_body,
+    size_t max_segments) {
+    struct Segment { const uint8_t* data; uint8_t size; };
+    std::vector<Segment> segments;
+    for (auto& packet : packets) {
+        size_t offset = 0;
+        while (true) {
+            size_t size = std::min<size_t>(packet.size() - offset, 255);
+            segments.push_back({ packet.data() + offset, (uint8_t)size });
+            offset += size;
+            if (size < 255) {
+                break;
+            }
+        }
+    }
+    std::vector<uint8_t> data;
+    uint32_t sequence = 0;
+    bool continued = false;
+    for (size_t s = 0; s < segments.size();) {
+        size_t count = 0;
+        size_t body = 0;
+        while (s + count < segments.size() && count < max_segments && body < max_body) {
+            body += segments[s + count++].size;
+        }
+        uint8_t header[27] = { 'O', 'g', 'g', 'S', 0 };
+        header[5] = (continued ? 0x01 : 0) | (s == 0 ? 0x02 : 0) | (s + count == segments.size() ? 0x04 : 0);
+        memcpy(header + 18, &sequence, 4);
+        sequence++;
+        header[26] = (uint8_t)count;
+        data.insert(data.end(), header, header + 27);
+        for (size_t i = s; i < s + count; i++) {
+            data.push_back(segments[i].size);
+        }
+        for (size_t i = s; i < s + count; i++) {
+            data.insert(data.end(), segments[i].data, segments[i].data + segments[i].size);
+        }
+        continued = segments[s + count - 1].size == 255;
+        s += count;
+    }
+    return data;
+}
+
+// 60 ms Opus frames at 16 to 48 kbps behind OpusHead and OpusTags
+static std::vector<std::vector<uint8_t>> GeneratePackets(int seconds) {
+    std::mt19937 random(17);
+    std::vector<std::vector<uint8_t>> packets;
+    std::vector<uint8_t> head(19, 0);
+    memcpy(head.data(), "OpusHead", 8);
+    head[8] = 1;
+    head[9] = 1;
+    head[12] = 16000 & 0xff;
+    head[13] = 16000 >> 8;
+    packets.push_back(head);
+    std::vector<uint8_t> tags(16, 0);
+    memcpy(tags.data(), "OpusTags", 8);
+    packets.push_back(tags);
+    for (int i = 0; i < seconds * 1000 / 60; i++) {
+        std::vector<uint8_t> packet(120 + random() % 241);
+        for (auto& byte : packet) {
+            byte = 0x80 | (random() & 0x7f);
+        }
+        packets.push_back(std::move(packet));
+    }
+    return packets;
+}
+
+static Result Run(const std::vector<uint8_t>& data, bool views, size_t chunk, int rounds) {
+    OggDemuxer demuxer;
+    demuxer.EnableViews(views);
+    uint64_t packets = 0;
+    uint64_t copied = 0;
+    uint64_t view_packets = 0;
+    uint64_t checksum = 0;
+    std::unique_ptr<AudioStreamPacket> queued;
+    std::span<const uint8_t> queued_view;
+    demuxer.OnDemuxerFinished([&](const uint8_t* packet, int sample_rate, size_t len, bool view) {
+        packets++;
+        if (view) {
+            view_packets++;
+            queued_view = std::span<const uint8_t>(packet, len);
+        } else {
+            queued = std::make_unique<AudioStreamPacket>();
+            queued->sample_rate = sample_rate;
+            AssignBuffer(queued->payload, packet, len);
+            copied += len * 2;
+        }
+        checksum += len + packet[0] + packet[len - 1] * 256;
+    });
+
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        demuxer.Reset();
+        for (size_t offset = 0; offset < data.size(); offset += chunk) {
+            demuxer.Process(data.data() + offset, std::min(chunk, data.size() - offset));
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    allocs = HostGetAllocations() - allocs;
+    return { (double)data.size() * rounds / seconds / 1e6, seconds * 1e9 / packets, (double)copied / packets,
+        (double)allocs / packets, (double)view_packets / packets, packets / rounds, checksum / rounds };
+}
+
+int main(int argc, char** argv) {
+    int seconds = 600;
+    int rounds = 5;
+    const char* file_path = nullptr;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            file_path = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            printf("Usage: ogg_demuxer_bench [--seconds N | --file FILE] [--rounds N] [--check]\n"
+                "  --file reads an Ogg/Opus file instead of two generated streams of N seconds\n"
+                "  --check fails when views change the packets read or a read allocates\n");
+            return 2;
+        }
+    }
+    if (seconds <= 0 || rounds <= 0) {
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    AudioPacketPool::GetInstance().Initialize(4, AUDIO_PACKET_HEADROOM + 8192, MALLOC_CAP_8BIT);
+
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> streams;
+    if (file_path != nullptr) {
+        std::ifstream file(file_path, std::ios::binary);
+        if (!file) {
+            fprintf(stderr, "Cannot read %s\n", file_path);
+            return 2;
+        }
+        streams.emplace_back(file_path, std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {}));
+    } else {
+        auto packets = GeneratePackets(seconds);
+        streams.emplace_back("4 KB pages", WriteStream(packets, 4096, 255));
+        streams.emplace_back("6 segments", WriteStream(packets, SIZE_MAX, 6));
+    }
+
+    int failures = 0;
+    printf("%-12s %-6s %-6s %9s %9s %10s %8s %7s\n", "stream", "input", "mode", "MB/s", "ns/pkt", "copied B",
+        "allocs", "views");
+    for (auto& [name, data] : streams) {
+        for (size_t chunk : { data.size(), (size_t)4096 }) {
+            auto copies = Run(data, false, chunk, rounds);
+            auto views = Run(data, true, chunk, rounds);
+            const std::pair<const char*, Result*> rows[] = { { "copy", &copies }, { "view", &views } };
+            for (auto& [mode, result] : rows) {
+                printf("%-12.12s %-6s %-6s %9.1f %9.1f %10.1f %8.3f %6.1f%%\n", name.c_str(),
+                    chunk == data.size() ? "whole" : "4 KB", mode, result->mb_per_second, result->ns_per_packet,
+                    result->copied_per_packet, result->allocs_per_packet, result->view_share * 100);
+            }
+            if (views.packets != copies.packets || views.checksum != copies.checksum || copies.packets == 0 ||
+                    views.allocs_per_packet != 0 || copies.allocs_per_packet != 0) {
+                fprintf(stderr, "%s: views read %llu packets, copies %llu, or a read allocated\n", name.c_str(),
+                    (unsigned long long)views.packets, (unsigned long long)copies.packets);
+                failures++;
+            }
+        }
+    }
+    return check && failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * The pcm_kernels sample loops against the loops they replaced (tests/pcm_reference.h), in ns per
+ * sample on 60ms frames. On the host only the C paths run, the PIE paths are ESP32-S3 / P4 only.
+ */
+#include "pcm_kernels.h"
+#include "tests/pcm_reference.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double NsPerSample(size_t samples, int rounds, const std::function<void()>& loop) {
+    loop();
+    auto start = Clock::now();
+    for (int i = 0; i < rounds; i++) {
+        loop();
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ((double)samples * rounds);
+}
+
+int main(int argc, char** argv) {
+    int rounds = 20000;
+    if (argc == 3 && strcmp(argv[1], "--rounds") == 0) {
+        rounds = atoi(argv[2]);
+    } else if (argc != 1) {
+        printf("Usage: pcm_kernels_bench [--rounds N]\n");
+        return 2;
+    }
+
+    constexpr size_t kSamples = 960;    // 60ms at 16kHz
+    std::vector<int16_t> pcm(kSamples * 2);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = (int16_t)(i * 7919);
+    }
+    std::vector<int32_t> wide(kSamples);
+    std::vector<int16_t> narrow(kSamples * 2);
+    std::vector<uint16_t> words(kSamples);
+    volatile int volume = 70;
+    // Unknown to the compiler, as the frame sizes are in the firmware
+    volatile size_t frame_samples = kSamples;
+    size_t n = frame_samples;
+
+    printf("%-14s %14s %12s\n", "ns/sample", "old loop", "kernel");
+    auto row = [&](const char* name, const std::function<void()>& old_loop, const std::function<void()>& kernel) {
+        double before = NsPerSample(kSamples, rounds, old_loop);
+        double after = NsPerSample(kSamples, rounds, kernel);
+        printf("%-14s %14.3f %12.3f\n", name, before, after);
+    };
+    row("volume", [&] { pcm_reference::Volume(pcm.data(), wide.data(), n, volume); },
+        [&] { pcm::Int16ToInt32(pcm.data(), wide.data(), n, pcm::VolumeFactor(volume)); });
+    row("int32->int16", [&] { pcm_reference::Int32ToInt16(wide.data(), narrow.data(), n); },
+        [&] { pcm::Int32ToInt16(wide.data(), narrow.data(), n, 12); });
+    row("gain", [&] { pcm_reference::Gain(narrow.data(), n, 3); },
+        [&] { pcm::Gain(narrow.data(), narrow.data(), n, 3); });
+    row("left channel", [&] { pcm_reference::LeftChannel(pcm.data(), narrow.data(), n); },
+        [&] { pcm::TakeChannel(pcm.data(), narrow.data(), n, 2); });
+    row("byte swap", [&] { pcm_reference::ByteSwap(words.data(), n); },
+        [&] { pcm::ByteSwap16(words.data(), words.data(), n); });
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * The MQTT+UDP audio datagrams: UdpAudioCipher writing the nonce and encrypting into a reused
+ * buffer, against the nonce and encrypted std::string SendAudio() built for every packet. The
+ * receive side reads the nonce, passes the reorder window and decrypts into a packet, pooled or,
+ * as before the pool, from the heap. It reports packets/s, ns and heap allocations per packet.
+ *
+ * AES is OpenSSL's block behind the mbedtls CTR loop of the host shim, so the numbers compare the
+ * paths with each other. The device runs mbedtls on the AES peripheral.
+ */
+#include "udp_audio_cipher.h"
+#include "udp_reorder_window.h"
+#include "protocol.h"
+#include "audio_pool.h"
+#include "host_tasks.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    double ns_per_packet;
+    double allocs_per_packet;
+    uint64_t checksum;
+};
+
+static std::string RandomBytes(std::mt19937& random, size_t size) {
+    std::string bytes(size, 0);
+    for (auto& byte : bytes) {
+        byte = random();
+    }
+    return bytes;
+}
+
+// What SendAudio() did before the cipher, one nonce and one datagram string per packet
+static std::string OldEncrypt(mbedtls_aes_context& aes_ctx, const std::string& aes_nonce, const uint8_t* data,
+    size_t size, uint32_t timestamp, uint32_t sequence) {
+    std::string nonce(aes_nonce);
+    *(uint16_t*)&nonce[2] = htons(size);
+    *(uint32_t*)&nonce[8] = htonl(timestamp);
+    *(uint32_t*)&nonce[12] = htonl(sequence);
+
+    std::string encrypted;
+    encrypted.resize(aes_nonce.size() + size);
+    memcpy(encrypted.data(), nonce.data(), nonce.size());
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    mbedtls_aes_crypt_ctr(&aes_ctx, size, &nc_off, (uint8_t*)nonce.data(), stream_block, data,
+        (uint8_t*)&encrypted[nonce.size()]);
+    return encrypted;
+}
+
+static uint64_t Checksum(const uint8_t* data, size_t size) {
+    return size + (size > 0 ? data[0] + data[size - 1] * 256 : 0);
+}
+
+static Result RunOldSend(const std::string& key, const std::string& nonce, const std::string& opus, int packets) {
+    mbedtls_aes_context aes_ctx;
+    mbedtls_aes_init(&aes_ctx);
+    mbedtls_aes_setkey_enc(&aes_ctx, (const unsigned char*)key.data(), 128);
+    uint64_t checksum = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int i = 0; i < packets; i++) {
+        auto datagram = OldEncrypt(aes_ctx, nonce, (const uint8_t*)opus.data(), opus.size(), i * 60, i + 1);
+        checksum += Checksum((const uint8_t*)datagram.data(), datagram.size());
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    allocs = HostGetAllocations() - allocs;
+    mbedtls_aes_free(&aes_ctx);
+    return {seconds * 1e9 / packets, (double)allocs / packets, checksum};
+}
+
+static Result RunSend(const std::string& key, const std::string& nonce, const std::string& opus, int packets) {
+    UdpAudioCipher cipher;
+    cipher.SetKey(key, nonce);
+    std::string datagram;
+    datagram.reserve(UDP_AUDIO_NONCE_SIZE + 1275);
+    uint64_t checksum = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int i = 0; i < packets; i++) {
+        cipher.Encrypt((const uint8_t*)opus.data(), opus.size(), i * 60, i + 1, datagram);
+        checksum += Checksum((const uint8_t*)datagram.data(), datagram.size());
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return {seconds * 1e9 / packets, (double)(HostGetAllocations() - allocs) / packets, checksum};
+}
+
+// As the UDP OnMessage() handler: nonce fields, reorder window, then the payload decrypted into the packet
+static Result RunReceive(const std::string& key, const std::string& nonce, const std::string& datagram, int packets) {
+    UdpAudioCipher cipher;
+    cipher.SetKey(key, nonce);
+    UdpReorderWindow reorder_window;
+    auto data = (const uint8_t*)datagram.data();
+    uint64_t checksum = 0;
+    uint64_t allocs = HostGetAllocations();
+    auto start = Clock::now();
+    for (int i = 0; i < packets; i++) {
+        if (data[0] != 0x01 || !reorder_window.Accept(i + 1)) {
+            continue;
+        }
+        auto packet = std::make_unique<AudioStreamPacket>();
+        packet->timestamp = UdpAudioCipher::Timestamp(data);
+        packet->sequence = UdpAudioCipher::Sequence(data);
+        packet->payload.resize(datagram.size() - UDP_AUDIO_NONCE_SIZE);
+        if (cipher.Decrypt(data, datagram.size(), packet->payload.data())) {
+            checksum += Checksum(packet->data(), packet->size());
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return {seconds * 1e9 / packets, (double)(HostGetAllocations() - allocs) / packets, checksum};
+}
+
+int main(int argc, char** argv) {
+    int packets = 200000;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--packets") == 0 && i + 1 < argc) {
+            packets = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            printf("Usage: udp_audio_bench [--packets N] [--check]\n"
+                "  --check fails when a datagram differs from the old one, the send path allocates or a\n"
+                "  received payload differs from the one sent\n");
+            return 2;
+        }
+    }
+    if (packets <= 0) {
+        return 2;
+    }
+
+    std::mt19937 random(22);
+    auto key = RandomBytes(random, 16);
+    auto nonce = RandomBytes(random, UDP_AUDIO_NONCE_SIZE);
+    nonce[0] = 0x01;
+
+    // A DTX frame, 60 ms at 16 and 32 kbps, and the largest Opus frame
+    const size_t sizes[] = { 3, 120, 240, 1275 };
+    struct Row {
+        std::string opus;
+        std::string datagram;
+        Result old_send, send, heap_receive, pooled_receive;
+    };
+    std::vector<Row> rows;
+    for (size_t size : sizes) {
+        Row row;
+        row.opus = RandomBytes(random, size);
+        UdpAudioCipher cipher;
+        cipher.SetKey(key, nonce);
+        cipher.Encrypt((const uint8_t*)row.opus.data(), size, 0x12345678, 1, row.datagram);
+        rows.push_back(std::move(row));
+    }
+    // Before Initialize() every packet and payload comes from the heap, as before the pool
+    for (auto& row : rows) {
+        row.heap_receive = RunReceive(key, nonce, row.datagram, packets);
+    }
+    AudioPacketPool::GetInstance().Initialize(4, AUDIO_PACKET_HEADROOM + 1275, MALLOC_CAP_8BIT);
+
+    int failures = 0;
+    printf("%-6s %-22s %9s %10s %9s\n", "opus", "path", "ns/pkt", "pkts/s", "allocs");
+    for (auto& row : rows) {
+        row.old_send = RunOldSend(key, nonce, row.opus, packets);
+        row.send = RunSend(key, nonce, row.opus, packets);
+        row.pooled_receive = RunReceive(key, nonce, row.datagram, packets);
+        const std::pair<const char*, Result*> results[] = { { "send, std::string", &row.old_send },
+            { "send, UdpAudioCipher", &row.send }, { "receive, heap packet", &row.heap_receive },
+            { "receive, pooled", &row.pooled_receive } };
+        for (auto& [name, result] : results) {
+            printf("%-6zu %-22s %9.1f %10.0f %9.3f\n", row.opus.size(), name, result->ns_per_packet,
+                1e9 / result->ns_per_packet, result->allocs_per_packet);
+        }
+
+        mbedtls_aes_context aes_ctx;
+        mbedtls_aes_init(&aes_ctx);
+        mbedtls_aes_setkey_enc(&aes_ctx, (const unsigned char*)key.data(), 128);
+        auto old_datagram = OldEncrypt(aes_ctx, nonce, (const uint8_t*)row.opus.data(), row.opus.size(), 0x12345678, 1);
+        mbedtls_aes_free(&aes_ctx);
+        std::vector<uint8_t> payload(row.opus.size());
+        UdpAudioCipher cipher;
+        cipher.SetKey(key, nonce);
+        bool round_trip = cipher.Decrypt((const uint8_t*)row.datagram.data(), row.datagram.size(), payload.data()) &&
+            memcmp(payload.data(), row.opus.data(), payload.size()) == 0;
+        if (old_datagram != row.datagram || !round_trip || row.send.checksum != row.old_send.checksum ||
+                row.send.allocs_per_packet != 0 || row.pooled_receive.checksum != row.heap_receive.checksum) {
+            fprintf(stderr, "%zu bytes: the datagram differs from the old one, does not decrypt or the send allocates\n",
+                row.opus.size());
+            failures++;
+        }
+    }
+    return check && failures > 0 ? 1 : 0;
+}
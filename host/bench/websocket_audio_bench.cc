@@ -0,0 +1,319 @@
+/*
+ * The uplink audio of the websocket protocol over a loopback TCP connection: one message per
+ * frame with v2 / v3 against the v4 batches of BatchWriter, with 20 ms and 60 ms frames. Each
+ * message goes out as a masked websocket client frame on a TCP_NODELAY socket. The next message
+ * waits until the receiver has read the last one, as frames 20-60 ms apart would, so the kernel
+ * does not merge them. The receiver unmasks and reads the frames back.
+ *
+ * Messages and TCP segments (TCP_INFO) are counted per second of audio. Wire bytes add the
+ * websocket frames, a 29 byte TLS 1.2 AES-GCM record per message and 40 bytes of IPv4 + TCP
+ * headers per segment.
+ */
+#include "audio_framing.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>     // tcp_info with tcpi_segs_out, glibc's has no segment counts
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define TLS_RECORD_OVERHEAD 29
+#define TCP_IP_HEADERS 40
+
+struct Result {
+    uint64_t messages;
+    uint64_t segments;
+    uint64_t websocket_bytes;
+    uint64_t frames_received;
+    uint64_t checksum_sent;
+    uint64_t checksum_received;
+};
+
+static uint64_t Checksum(const uint8_t* data, size_t size, uint32_t timestamp) {
+    uint64_t sum = timestamp;
+    for (size_t i = 0; i < size; i++) {
+        sum = sum * 31 + data[i];
+    }
+    return sum;
+}
+
+static bool SendAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = recv(fd, data, size, 0);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+// A binary client frame, masked as RFC 6455 requires from the client
+static void WebsocketFrame(const uint8_t* message, size_t size, std::vector<uint8_t>& frame) {
+    frame.clear();
+    frame.push_back(0x82);
+    if (size < 126) {
+        frame.push_back(0x80 | size);
+    } else if (size <= UINT16_MAX) {
+        frame.push_back(0x80 | 126);
+        frame.push_back(size >> 8);
+        frame.push_back(size & 0xFF);
+    } else {
+        frame.push_back(0x80 | 127);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame.push_back((uint64_t)size >> shift);
+        }
+    }
+    const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+    frame.insert(frame.end(), mask, mask + 4);
+    for (size_t i = 0; i < size; i++) {
+        frame.push_back(message[i] ^ mask[i % 4]);
+    }
+}
+
+struct Receiver {
+    int fd;
+    int version;
+    std::atomic<uint64_t> bytes_read = 0;
+    std::atomic<bool> done = false;
+    uint64_t frames = 0;
+    uint64_t checksum = 0;
+    bool valid = true;
+
+    void Run() {
+        std::vector<uint8_t> message;
+        uint8_t header[14];
+        while (ReadAll(fd, header, 2)) {
+            size_t header_size = 2;
+            uint64_t size = header[1] & 0x7F;
+            if (size >= 126) {
+                size_t length_bytes = size == 126 ? 2 : 8;
+                if (!ReadAll(fd, header + 2, length_bytes)) {
+                    break;
+                }
+                size = 0;
+                for (size_t i = 0; i < length_bytes; i++) {
+                    size = (size << 8) | header[2 + i];
+                }
+                header_size += length_bytes;
+            }
+            uint8_t mask[4];
+            message.resize(size);
+            if (!ReadAll(fd, mask, 4) || !ReadAll(fd, message.data(), size)) {
+                break;
+            }
+            for (size_t i = 0; i < size; i++) {
+                message[i] ^= mask[i % 4];
+            }
+            auto on_frame = [this](const audio_framing::Frame& frame) {
+                frames++;
+                checksum += Checksum(frame.payload, frame.size, frame.timestamp);
+            };
+            if (version == 4) {
+                valid = audio_framing::ReadBatch(message.data(), size, on_frame) && valid;
+            } else {
+                audio_framing::Frame frame;
+                if (audio_framing::ReadFrame(message.data(), size, version, frame)) {
+                    on_frame(frame);
+                } else {
+                    valid = false;
+                }
+            }
+            bytes_read.fetch_add(header_size + 4 + size, std::memory_order_release);
+        }
+        done = true;
+    }
+};
+
+static uint64_t SegmentsOut(int fd) {
+    struct tcp_info info = {};
+    socklen_t length = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+        return 0;
+    }
+    return info.tcpi_segs_out;
+}
+
+static bool Connect(int& client, int& server) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 1) != 0 ||
+            getsockname(listener, (sockaddr*)&address, &length) != 0) {
+        return false;
+    }
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    int nodelay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if (connect(client, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(listener);
+        return false;
+    }
+    server = accept(listener, nullptr, nullptr);
+    close(listener);
+    return server >= 0;
+}
+
+// Opus at about 16 kbps, frame sizes spread around the average as VBR leaves them
+static std::vector<std::vector<uint8_t>> GenerateFrames(int frame_ms, int count) {
+    std::mt19937 random(frame_ms);
+    size_t average = 16000 / 8 * frame_ms / 1000;
+    std::vector<std::vector<uint8_t>> frames(count);
+    for (auto& frame : frames) {
+        frame.resize(average * 3 / 4 + random() % (average / 2 + 1));
+        for (auto& byte : frame) {
+            byte = random();
+        }
+    }
+    return frames;
+}
+
+static bool Run(const std::vector<std::vector<uint8_t>>& frames, int frame_ms, int version, int budget_ms,
+    Result& result) {
+    int client, server;
+    if (!Connect(client, server)) {
+        return false;
+    }
+    Receiver receiver;
+    receiver.fd = server;
+    receiver.version = version;
+    std::thread thread([&receiver]() { receiver.Run(); });
+
+    result = {};
+    audio_framing::BatchWriter batch(budget_ms);
+    std::vector<uint8_t> frame;
+    uint64_t segments = SegmentsOut(client);
+    bool ok = true;
+    auto send_message = [&](const uint8_t* message, size_t size) {
+        WebsocketFrame(message, size, frame);
+        ok = ok && SendAll(client, frame.data(), frame.size());
+        result.messages++;
+        result.websocket_bytes += frame.size();
+        while (ok && !receiver.done && receiver.bytes_read.load(std::memory_order_acquire) < result.websocket_bytes) {
+            std::this_thread::yield();
+        }
+    };
+
+    AudioStreamPacket packet;
+    packet.frame_duration = frame_ms;
+    for (size_t i = 0; i < frames.size() && ok; i++) {
+        auto& opus = frames[i];
+        AssignBuffer(packet.payload, opus.data(), opus.size());
+        packet.headroom = 0;
+        packet.timestamp = i * frame_ms;
+        // v3 carries no timestamp
+        result.checksum_sent += Checksum(opus.data(), opus.size(), version == 3 ? 0 : packet.timestamp);
+        if (version == 4) {
+            // As BatchAudio() does, the timer only matters when the audio stops
+            if (!batch.Fits(packet)) {
+                size_t size;
+                auto message = batch.Finish(size);
+                send_message(message, size);
+            }
+            batch.Add(packet);
+            if (batch.Full()) {
+                size_t size;
+                auto message = batch.Finish(size);
+                send_message(message, size);
+            }
+        } else {
+            size_t size;
+            auto message = audio_framing::WriteHeader(packet, version, size);
+            send_message(message, size);
+        }
+    }
+    if (version == 4 && batch.frames() > 0) {
+        size_t size;
+        auto message = batch.Finish(size);
+        send_message(message, size);
+    }
+    result.segments = SegmentsOut(client) - segments;
+    close(client);
+    thread.join();
+    close(server);
+    result.frames_received = receiver.frames;
+    result.checksum_received = receiver.valid ? receiver.checksum : 0;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int seconds = 60;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            printf("Usage: websocket_audio_bench [--seconds N] [--check]\n"
+                "  --seconds of audio sent per row\n"
+                "  --check fails when the receiver does not read back every frame\n");
+            return 2;
+        }
+    }
+    if (seconds <= 0) {
+        return 2;
+    }
+
+    struct Mode {
+        const char* name;
+        int version;
+        int budget_ms;
+    };
+    const Mode modes[] = { { "v2", 2, 0 }, { "v3", 3, 0 }, { "v4 60 ms", 4, 60 }, { "v4 120 ms", 4, 120 },
+        { "v4 240 ms", 4, 240 } };
+    int failures = 0;
+    printf("%-6s %-10s %9s %9s %9s %10s %10s\n", "frame", "protocol", "msgs/s", "segs/s", "ws B/s", "wire B/s",
+        "vs v3");
+    for (int frame_ms : { 20, 60 }) {
+        auto frames = GenerateFrames(frame_ms, seconds * 1000 / frame_ms);
+        double v3_wire = 0;
+        for (auto& mode : modes) {
+            Result result;
+            if (!Run(frames, frame_ms, mode.version, mode.budget_ms, result)) {
+                fprintf(stderr, "Loopback connection failed\n");
+                return 2;
+            }
+            double wire = result.websocket_bytes + result.messages * TLS_RECORD_OVERHEAD +
+                result.segments * TCP_IP_HEADERS;
+            if (mode.version == 3) {
+                v3_wire = wire;
+            }
+            printf("%-6d %-10s %9.2f %9.2f %9.0f %10.0f", frame_ms, mode.name, (double)result.messages / seconds,
+                (double)result.segments / seconds, (double)result.websocket_bytes / seconds, wire / seconds);
+            if (v3_wire > 0) {
+                printf(" %9.1f%%", (wire - v3_wire) * 100 / v3_wire);
+            }
+            printf("\n");
+            if (result.frames_received != frames.size() || result.checksum_received != result.checksum_sent) {
+                fprintf(stderr, "%d ms %s: %llu of %zu frames read back\n", frame_ms, mode.name,
+                    (unsigned long long)result.frames_received, frames.size());
+                failures++;
+            }
+        }
+    }
+    return check && failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+// audio_codec.h includes board.h. Only the stream player reads the board: a host program linking it
+// declares its board with DECLARE_BOARD, like the firmware does
+#pragma once
+
+#include <network_interface.h>
+
+class AudioCodec;
+
+void* create_board();
+
+class Board {
+public:
+    static Board& GetInstance() {
+        static Board* instance = static_cast<Board*>(create_board());
+        return *instance;
+    }
+
+    virtual ~Board() = default;
+    virtual AudioCodec* GetAudioCodec() = 0;
+    virtual NetworkInterface* GetNetwork() = 0;
+};
+
+#define DECLARE_BOARD(BOARD_CLASS_NAME) \
+void* create_board() { \
+    return new BOARD_CLASS_NAME(); \
+}
@@ -0,0 +1,498 @@
+// The cJSON subset of cJSON.h, with cJSON's rules for escapes, surrogates and key lookups
+#include "cJSON.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+static cJSON_Hooks hooks = { malloc, free };
+
+void cJSON_InitHooks(cJSON_Hooks* new_hooks) {
+    hooks.malloc_fn = new_hooks != nullptr && new_hooks->malloc_fn != nullptr ? new_hooks->malloc_fn : malloc;
+    hooks.free_fn = new_hooks != nullptr && new_hooks->free_fn != nullptr ? new_hooks->free_fn : free;
+}
+
+const char* cJSON_Version() {
+    return "host shim";
+}
+
+static char* Strdup(const char* string) {
+    size_t size = strlen(string) + 1;
+    auto copy = (char*)hooks.malloc_fn(size);
+    memcpy(copy, string, size);
+    return copy;
+}
+
+static cJSON* NewItem(int type) {
+    auto item = (cJSON*)hooks.malloc_fn(sizeof(cJSON));
+    memset(item, 0, sizeof(cJSON));
+    item->type = type;
+    return item;
+}
+
+void cJSON_Delete(cJSON* item) {
+    while (item != nullptr) {
+        cJSON* next = item->next;
+        cJSON_Delete(item->child);
+        hooks.free_fn(item->valuestring);
+        hooks.free_fn(item->string);
+        hooks.free_fn(item);
+        item = next;
+    }
+}
+
+void cJSON_free(void* object) {
+    hooks.free_fn(object);
+}
+
+namespace {
+
+struct Parser {
+    const char* p;
+    const char* end;
+
+    void SkipSpace() {
+        while (p < end && (unsigned char)*p <= 32) {
+            p++;
+        }
+    }
+
+    bool Hex4(uint32_t& value) {
+        if (end - p < 4) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = p[i];
+            int digit = isdigit((unsigned char)c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (digit < 0) {
+                return false;
+            }
+            value = (value << 4) | digit;
+        }
+        p += 4;
+        return true;
+    }
+
+    bool String(char*& out) {
+        std::string value;
+        p++;
+        while (p < end && *p != '"') {
+            char c = *p++;
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (p >= end) {
+                return false;
+            }
+            c = *p++;
+            switch (c) {
+            case '"': case '\\': case '/': value += c; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (!Hex4(code) || (code >= 0xDC00 && code <= 0xDFFF)) {
+                    return false;
+                }
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - p < 2 || p[0] != '\\' || p[1] != 'u') {
+                        return false;
+                    }
+                    p += 2;
+                    if (!Hex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+                }
+                if (code < 0x80) {
+                    value += (char)code;
+                } else if (code < 0x800) {
+                    value += (char)(0xC0 | (code >> 6));
+                    value += (char)(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    value += (char)(0xE0 | (code >> 12));
+                    value += (char)(0x80 | ((code >> 6) & 0x3F));
+                    value += (char)(0x80 | (code & 0x3F));
+                } else {
+                    value += (char)(0xF0 | (code >> 18));
+                    value += (char)(0x80 | ((code >> 12) & 0x3F));
+                    value += (char)(0x80 | ((code >> 6) & 0x3F));
+                    value += (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (p >= end) {
+            return false;
+        }
+        p++;
+        out = Strdup(value.c_str());
+        return true;
+    }
+
+    cJSON* Value(int depth) {
+        SkipSpace();
+        if (p >= end || depth > 1000) {
+            return nullptr;
+        }
+        auto literal = [this](const char* word) {
+            size_t length = strlen(word);
+            if ((size_t)(end - p) >= length && strncmp(p, word, length) == 0) {
+                p += length;
+                return true;
+            }
+            return false;
+        };
+        if (literal("null")) {
+            return NewItem(cJSON_NULL);
+        }
+        if (literal("false")) {
+            return NewItem(cJSON_False);
+        }
+        if (literal("true")) {
+            auto item = NewItem(cJSON_True);
+            item->valueint = 1;
+            return item;
+        }
+        if (*p == '"') {
+            auto item = NewItem(cJSON_String);
+            if (!String(item->valuestring)) {
+                cJSON_Delete(item);
+                return nullptr;
+            }
+            return item;
+        }
+        if (*p == '-' || isdigit((unsigned char)*p)) {
+            char number[64];
+            size_t length = 0;
+            while (p + length < end && length < sizeof(number) - 1 &&
+                    strchr("0123456789+-eE.", p[length]) != nullptr) {
+                number[length] = p[length];
+                length++;
+            }
+            number[length] = '\0';
+            char* number_end;
+            double value = strtod(number, &number_end);
+            if (number_end == number) {
+                return nullptr;
+            }
+            p += number_end - number;
+            auto item = NewItem(cJSON_Number);
+            item->valuedouble = value;
+            item->valueint = value >= INT32_MAX ? INT32_MAX : value <= INT32_MIN ? INT32_MIN : (int)value;
+            return item;
+        }
+        if (*p == '[' || *p == '{') {
+            bool object = *p == '{';
+            char close = object ? '}' : ']';
+            auto container = NewItem(object ? cJSON_Object : cJSON_Array);
+            cJSON* last = nullptr;
+            p++;
+            SkipSpace();
+            if (p < end && *p == close) {
+                p++;
+                return container;
+            }
+            while (true) {
+                char* key = nullptr;
+                if (object) {
+                    SkipSpace();
+                    if (p >= end || *p != '"' || !String(key)) {
+                        break;
+                    }
+                    SkipSpace();
+                    if (p >= end || *p != ':') {
+                        hooks.free_fn(key);
+                        break;
+                    }
+                    p++;
+                }
+                cJSON* child = Value(depth + 1);
+                if (child == nullptr) {
+                    hooks.free_fn(key);
+                    break;
+                }
+                child->string = key;
+                if (last == nullptr) {
+                    container->child = child;
+                } else {
+                    last->next = child;
+                    child->prev = last;
+                }
+                last = child;
+                container->child->prev = last;
+                SkipSpace();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                if (p < end && *p == close) {
+                    p++;
+                    return container;
+                }
+                break;
+            }
+            cJSON_Delete(container);
+            return nullptr;
+        }
+        return nullptr;
+    }
+};
+
+}  // namespace
+
+cJSON* cJSON_ParseWithLength(const char* value, size_t buffer_length) {
+    if (value == nullptr) {
+        return nullptr;
+    }
+    Parser parser = {value, value + buffer_length};
+    return parser.Value(0);
+}
+
+cJSON* cJSON_Parse(const char* value) {
+    return value != nullptr ? cJSON_ParseWithLength(value, strlen(value)) : nullptr;
+}
+
+static void PrintString(std::string& out, const char* value) {
+    out += '"';
+    for (const char* c = value; *c != '\0'; c++) {
+        switch (*c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)*c < 32) {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", *c);
+                out += escape;
+            } else {
+                out += *c;
+            }
+        }
+    }
+    out += '"';
+}
+
+static void PrintValue(std::string& out, const cJSON* item, int depth, bool format) {
+    switch (item->type & 0xFF) {
+    case cJSON_NULL: out += "null"; break;
+    case cJSON_False: out += "false"; break;
+    case cJSON_True: out += "true"; break;
+    case cJSON_Raw: out += item->valuestring ? item->valuestring : ""; break;
+    case cJSON_String: PrintString(out, item->valuestring ? item->valuestring : ""); break;
+    case cJSON_Number: {
+        char number[32];
+        double d = item->valuedouble;
+        if (std::isnan(d) || std::isinf(d)) {
+            snprintf(number, sizeof(number), "null");
+        } else if (d == (double)item->valueint) {
+            snprintf(number, sizeof(number), "%d", item->valueint);
+        } else {
+            /* The shortest form that reads back the same, like cJSON */
+            snprintf(number, sizeof(number), "%1.15g", d);
+            if (strtod(number, nullptr) != d) {
+                snprintf(number, sizeof(number), "%1.17g", d);
+            }
+        }
+        out += number;
+        break;
+    }
+    case cJSON_Array:
+    case cJSON_Object: {
+        bool object = (item->type & 0xFF) == cJSON_Object;
+        out += object ? '{' : '[';
+        if (object && format && item->child != nullptr) {
+            out += '\n';
+        }
+        for (const cJSON* child = item->child; child != nullptr; child = child->next) {
+            if (object) {
+                if (format) {
+                    out.append(depth + 1, '\t');
+                }
+                PrintString(out, child->string ? child->string : "");
+                out += format ? ":\t" : ":";
+            }
+            PrintValue(out, child, depth + 1, format);
+            if (child->next != nullptr) {
+                out += (format && !object) ? ", " : ",";
+            }
+            if (object && format) {
+                out += '\n';
+            }
+        }
+        if (object && format && item->child != nullptr) {
+            out.append(depth, '\t');
+        }
+        out += object ? '}' : ']';
+        break;
+    }
+    }
+}
+
+static char* Print(const cJSON* item, bool format) {
+    if (item == nullptr) {
+        return nullptr;
+    }
+    std::string out;
+    PrintValue(out, item, 0, format);
+    return Strdup(out.c_str());
+}
+
+char* cJSON_Print(const cJSON* item) {
+    return Print(item, true);
+}
+
+char* cJSON_PrintUnformatted(const cJSON* item) {
+    return Print(item, false);
+}
+
+int cJSON_GetArraySize(const cJSON* array) {
+    int size = 0;
+    for (const cJSON* child = array ? array->child : nullptr; child != nullptr; child = child->next) {
+        size++;
+    }
+    return size;
+}
+
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index) {
+    cJSON* child = array ? array->child : nullptr;
+    while (child != nullptr && index-- > 0) {
+        child = child->next;
+    }
+    return index < 0 ? nullptr : child;
+}
+
+static cJSON* GetObjectItem(const cJSON* object, const char* string, bool case_sensitive) {
+    if (object == nullptr || string == nullptr) {
+        return nullptr;
+    }
+    for (cJSON* child = object->child; child != nullptr; child = child->next) {
+        if (child->string != nullptr &&
+                (case_sensitive ? strcmp(child->string, string) : strcasecmp(child->string, string)) == 0) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* string) {
+    return GetObjectItem(object, string, false);
+}
+
+cJSON* cJSON_GetObjectItemCaseSensitive(const cJSON* object, const char* string) {
+    return GetObjectItem(object, string, true);
+}
+
+cJSON_bool cJSON_HasObjectItem(const cJSON* object, const char* string) {
+    return cJSON_GetObjectItem(object, string) != nullptr;
+}
+
+char* cJSON_GetStringValue(const cJSON* item) {
+    return cJSON_IsString(item) ? item->valuestring : nullptr;
+}
+
+cJSON_bool cJSON_IsFalse(const cJSON* item) { return item && (item->type & 0xFF) == cJSON_False; }
+cJSON_bool cJSON_IsTrue(const cJSON* item) { return item && (item->type & 0xFF) == cJSON_True; }
+cJSON_bool cJSON_IsBool(const cJSON* item) { return item && (item->type & (cJSON_True | cJSON_False)) != 0; }
+cJSON_bool cJSON_IsNull(const cJSON* item) { return item && (item->type & 0xFF) == cJSON_NULL; }
+cJSON_bool cJSON_IsNumber(const cJSON* item) { return item && (item->type & 0xFF) == cJSON_Number; }
+cJSON_bool cJSON_IsString(const cJSON* item) { return item && (item->type & 0xFF) == cJSON_String; }
+cJSON_bool cJSON_IsArray(const cJSON* item) { return item && (item->type & 0xFF) == cJSON_Array; }
+cJSON_bool cJSON_IsObject(const cJSON* item) { return item && (item->type & 0xFF) == cJSON_Object; }
+
+cJSON* cJSON_CreateNull() {
+    return NewItem(cJSON_NULL);
+}
+
+cJSON* cJSON_CreateBool(cJSON_bool boolean) {
+    auto item = NewItem(boolean ? cJSON_True : cJSON_False);
+    item->valueint = boolean ? 1 : 0;
+    return item;
+}
+
+cJSON* cJSON_CreateNumber(double num) {
+    auto item = NewItem(cJSON_Number);
+    item->valuedouble = num;
+    item->valueint = num >= INT32_MAX ? INT32_MAX : num <= INT32_MIN ? INT32_MIN : (int)num;
+    return item;
+}
+
+cJSON* cJSON_CreateString(const char* string) {
+    auto item = NewItem(cJSON_String);
+    item->valuestring = Strdup(string ? string : "");
+    return item;
+}
+
+cJSON* cJSON_CreateArray() {
+    return NewItem(cJSON_Array);
+}
+
+cJSON* cJSON_CreateObject() {
+    return NewItem(cJSON_Object);
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON* array, cJSON* item) {
+    if (array == nullptr || item == nullptr) {
+        return 0;
+    }
+    if (array->child == nullptr) {
+        array->child = item;
+        item->prev = item;
+    } else {
+        cJSON* last = array->child->prev;
+        last->next = item;
+        item->prev = last;
+        array->child->prev = item;
+    }
+    item->next = nullptr;
+    return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON* object, const char* string, cJSON* item) {
+    if (object == nullptr || string == nullptr || item == nullptr) {
+        return 0;
+    }
+    hooks.free_fn(item->string);
+    item->string = Strdup(string);
+    return cJSON_AddItemToArray(object, item);
+}
+
+static cJSON* AddToObject(cJSON* object, const char* name, cJSON* item) {
+    if (cJSON_AddItemToObject(object, name, item)) {
+        return item;
+    }
+    cJSON_Delete(item);
+    return nullptr;
+}
+
+cJSON* cJSON_AddNullToObject(cJSON* object, const char* name) { return AddToObject(object, name, cJSON_CreateNull()); }
+cJSON* cJSON_AddBoolToObject(cJSON* object, const char* name, cJSON_bool boolean) {
+    return AddToObject(object, name, cJSON_CreateBool(boolean));
+}
+cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number) {
+    return AddToObject(object, name, cJSON_CreateNumber(number));
+}
+cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* string) {
+    return AddToObject(object, name, cJSON_CreateString(string));
+}
+cJSON* cJSON_AddObjectToObject(cJSON* object, const char* name) { return AddToObject(object, name, cJSON_CreateObject()); }
+cJSON* cJSON_AddArrayToObject(cJSON* object, const char* name) { return AddToObject(object, name, cJSON_CreateArray()); }
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "driver/i2s_types.h"
+
+// Only the codecs that own an I2S channel call these, the host codecs have none
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
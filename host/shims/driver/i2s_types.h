@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
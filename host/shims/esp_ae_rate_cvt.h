@@ -0,0 +1,37 @@
+// Sample rate conversion by linear interpolation, the host stand-in of esp_ae_rate_cvt
+#pragma once
+
+#include <cstdint>
+
+typedef void* esp_ae_rate_cvt_handle_t;
+typedef void* esp_ae_sample_t;
+
+typedef enum {
+    ESP_AE_ERR_OK = 0,
+    ESP_AE_ERR_FAIL = -1,
+    ESP_AE_ERR_MEM_LACK = -2,
+    ESP_AE_ERR_INVALID_PARAMETER = -4,
+} esp_ae_err_t;
+
+typedef enum {
+    ESP_AE_RATE_CVT_PERF_TYPE_SPEED = 0,
+    ESP_AE_RATE_CVT_PERF_TYPE_MEMORY = 1,
+} esp_ae_rate_cvt_perf_type_t;
+
+typedef struct {
+    uint32_t src_rate;
+    uint32_t dest_rate;
+    uint8_t channel;
+    uint8_t bits_per_sample;
+    uint8_t complexity;
+    esp_ae_rate_cvt_perf_type_t perf_type;
+} esp_ae_rate_cvt_cfg_t;
+
+esp_ae_err_t esp_ae_rate_cvt_open(esp_ae_rate_cvt_cfg_t* cfg, esp_ae_rate_cvt_handle_t* handle);
+esp_ae_err_t esp_ae_rate_cvt_get_max_out_sample_num(esp_ae_rate_cvt_handle_t handle, uint32_t in_sample_num,
+    uint32_t* out_sample_num);
+// Sample counts are per channel, out_sample_num is the room on input and the samples written on output
+esp_ae_err_t esp_ae_rate_cvt_process(esp_ae_rate_cvt_handle_t handle, esp_ae_sample_t in_samples,
+    uint32_t in_sample_num, esp_ae_sample_t out_samples, uint32_t* out_sample_num);
+esp_ae_err_t esp_ae_rate_cvt_reset(esp_ae_rate_cvt_handle_t handle);
+void esp_ae_rate_cvt_close(esp_ae_rate_cvt_handle_t handle);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+typedef enum {
+    ESP_AUDIO_ERR_OK = 0,
+    ESP_AUDIO_ERR_FAIL = -1,
+    ESP_AUDIO_ERR_MEM_LACK = -2,
+    ESP_AUDIO_ERR_DATA_LACK = -3,
+    ESP_AUDIO_ERR_BUFF_NOT_ENOUGH = -4,
+    ESP_AUDIO_ERR_INVALID_PARAMETER = -5,
+    ESP_AUDIO_ERR_NOT_SUPPORT = -6,
+} esp_audio_err_t;
+
+#define ESP_AUDIO_SAMPLE_RATE_8K 8000
+#define ESP_AUDIO_SAMPLE_RATE_16K 16000
+#define ESP_AUDIO_SAMPLE_RATE_24K 24000
+#define ESP_AUDIO_SAMPLE_RATE_48K 48000
+#define ESP_AUDIO_MONO 1
+#define ESP_AUDIO_DUAL 2
+#define ESP_AUDIO_BIT16 16
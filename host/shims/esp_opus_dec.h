@@ -0,0 +1,39 @@
+// The decoder of the stand-in codec, see esp_opus_enc.h
+#pragma once
+
+#include "esp_audio_dec.h"
+
+typedef enum {
+    ESP_OPUS_DEC_FRAME_DURATION_INVALID = -1,
+    ESP_OPUS_DEC_FRAME_DURATION_2_5_MS = 0,
+    ESP_OPUS_DEC_FRAME_DURATION_5_MS,
+    ESP_OPUS_DEC_FRAME_DURATION_10_MS,
+    ESP_OPUS_DEC_FRAME_DURATION_20_MS,
+    ESP_OPUS_DEC_FRAME_DURATION_40_MS,
+    ESP_OPUS_DEC_FRAME_DURATION_60_MS,
+    ESP_OPUS_DEC_FRAME_DURATION_80_MS,
+    ESP_OPUS_DEC_FRAME_DURATION_100_MS,
+    ESP_OPUS_DEC_FRAME_DURATION_120_MS,
+} esp_opus_dec_frame_duration_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t channel;
+    esp_opus_dec_frame_duration_t frame_duration;
+    bool self_delimited;
+} esp_opus_dec_cfg_t;
+
+esp_audio_err_t esp_opus_dec_open(void* cfg, uint32_t cfg_sz, void** dec_handle);
+esp_audio_err_t esp_opus_dec_close(void* dec_handle);
+esp_audio_err_t esp_opus_dec_reset(void* dec_handle);
+// A PLC frame (or an empty packet) decodes to silence, an FEC frame decodes the packet it is given
+esp_audio_err_t esp_opus_dec_decode(void* dec_handle, esp_audio_dec_in_raw_t* raw, esp_audio_dec_out_frame_t* frame,
+    esp_audio_dec_info_t* dec_info);
+
+// Host only: decoders open now, and esp_opus_dec_reset() calls so far, for the tests
+int HostOpusOpenDecoders();
+uint32_t HostOpusDecoderResets();
+
+// Host only: lost frames recovered with PLC and with FEC from the following packet so far
+uint32_t HostOpusPlcFrames();
+uint32_t HostOpusFecFrames();
@@ -0,0 +1,52 @@
+/*
+ * A stand-in for the Opus encoder: it is not Opus, but it has the same interface and packet sizes.
+ * A frame becomes bitrate * duration bytes of 8-bit mu-law block averages, which the stand-in
+ * decoder interpolates back, so a pipeline keeps its timing, sizes and an audible signal.
+ */
+#pragma once
+
+#include "esp_audio_enc.h"
+
+typedef enum {
+    ESP_OPUS_ENC_FRAME_DURATION_ARG = -1,
+    ESP_OPUS_ENC_FRAME_DURATION_2_5_MS = 0,
+    ESP_OPUS_ENC_FRAME_DURATION_5_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_10_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_20_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_40_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_60_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_80_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_100_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_120_MS,
+} esp_opus_enc_frame_duration_t;
+
+typedef enum {
+    ESP_OPUS_ENC_APPLICATION_VOIP,
+    ESP_OPUS_ENC_APPLICATION_AUDIO,
+    ESP_OPUS_ENC_APPLICATION_LOWDELAY,
+} esp_opus_enc_application_t;
+
+#define ESP_OPUS_BITRATE_AUTO -1000
+#define ESP_OPUS_HOST_AUTO_BITRATE 24000    // What the stand-in encodes at for ESP_OPUS_BITRATE_AUTO
+#define ESP_OPUS_HOST_MAX_BITRATE 32000     // AUTO may go up to it, the output buffer is sized for it
+
+typedef struct {
+    int sample_rate;
+    int channel;
+    int bits_per_sample;
+    int bitrate;
+    esp_opus_enc_frame_duration_t frame_duration;
+    esp_opus_enc_application_t application_mode;
+    int complexity;
+    bool enable_fec;
+    bool enable_dtx;
+    bool enable_vbr;
+} esp_opus_enc_config_t;
+
+esp_audio_err_t esp_opus_enc_open(void* cfg, uint32_t cfg_sz, void** enc_hd);
+esp_audio_err_t esp_opus_enc_close(void* enc_hd);
+// in_size is the PCM frame in bytes, out_size the largest packet at the bitrate
+esp_audio_err_t esp_opus_enc_get_frame_size(void* enc_hd, int* in_size, int* out_size);
+esp_audio_err_t esp_opus_enc_process(void* enc_hd, esp_audio_enc_in_frame_t* in_frame, esp_audio_enc_out_frame_t* out_frame);
+esp_audio_err_t esp_opus_enc_set_bitrate(void* enc_hd, int bitrate);
+esp_audio_err_t esp_opus_enc_reset(void* enc_hd);
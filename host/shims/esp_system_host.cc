@@ -0,0 +1,143 @@
+// esp_log, esp_err, the heap and the driver / model functions that have nothing to do on the host
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "driver/i2s_common.h"
+#include "model_path.h"
+#include "esp_wn_models.h"
+#include "host_tasks.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static std::atomic<esp_log_level_t> log_level = ESP_LOG_INFO;
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    if (strcmp(tag, "*") == 0) {
+        log_level = level;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    if (level > log_level) {
+        return;
+    }
+    static const char letters[] = "-EWIDV";
+    char line[512];
+    int length = snprintf(line, sizeof(line), "%c (%lld) %s: ", letters[level],
+        (long long)(esp_timer_get_time() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line + length, sizeof(line) - length, format, args);
+    va_end(args);
+    fprintf(stderr, "%s\n", line);
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+/* Like CONFIG_HEAP_USE_HOOKS, every allocation through heap_caps_* and operator new reaches the
+ * hook when the program defines it (CONFIG_AUDIO_INPUT_ALLOC_COUNTER) */
+extern "C" void esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps) __attribute__((weak));
+
+static void* Allocated(void* ptr, size_t size, uint32_t caps) {
+    if (ptr != nullptr) {
+        HostTaskCountAllocation();
+        if (esp_heap_trace_alloc_hook != nullptr) {
+            esp_heap_trace_alloc_hook(ptr, size, caps);
+        }
+    }
+    return ptr;
+}
+
+void* operator new(size_t size) {
+    void* ptr = Allocated(malloc(size > 0 ? size : 1), size, MALLOC_CAP_DEFAULT);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t size) noexcept {
+    free(ptr);
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    return Allocated(malloc(size), size, caps);
+}
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return Allocated(calloc(n, size), n * size, caps);
+}
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    return Allocated(realloc(ptr, size), size, caps);
+}
+
+void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    /* aligned_alloc() wants a size that is a multiple of the alignment */
+    return Allocated(aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment), size, caps);
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return SIZE_MAX;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) {
+    return ESP_OK;
+}
+
+srmodel_list_t* esp_srmodel_init(const char* partition_label) {
+    return nullptr;
+}
+
+void esp_srmodel_deinit(srmodel_list_t* models) {
+}
+
+char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2) {
+    return nullptr;
+}
+
+const esp_wn_iface_t* esp_wn_handle_from_name(const char* model_name) {
+    return nullptr;
+}
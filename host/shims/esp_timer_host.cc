@@ -0,0 +1,119 @@
+#include "esp_timer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HostTimer {
+    esp_timer_cb_t callback;
+    void* arg;
+    std::string name;
+    bool active = false;
+    int64_t period_us = 0;
+    int64_t next_us = 0;
+};
+
+/* Never destroyed, the dispatch thread may still run while the program exits */
+static std::mutex& timers_mutex = *new std::mutex();
+static std::condition_variable& timers_cv = *new std::condition_variable();
+static std::vector<HostTimer*>& timers = *new std::vector<HostTimer*>();
+
+int64_t esp_timer_get_time() {
+    static const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+/* One thread runs every callback in deadline order, like the esp_timer task */
+static void TimerThread() {
+    std::unique_lock<std::mutex> lock(timers_mutex);
+    while (true) {
+        HostTimer* due = nullptr;
+        for (auto timer : timers) {
+            if (timer->active && (due == nullptr || timer->next_us < due->next_us)) {
+                due = timer;
+            }
+        }
+        int64_t now = esp_timer_get_time();
+        if (due == nullptr) {
+            timers_cv.wait(lock);
+            continue;
+        }
+        if (due->next_us > now) {
+            timers_cv.wait_for(lock, std::chrono::microseconds(due->next_us - now));
+            continue;
+        }
+        if (due->period_us > 0) {
+            /* Missed periods are skipped */
+            while (due->next_us <= now) {
+                due->next_us += due->period_us;
+            }
+        } else {
+            due->active = false;
+        }
+        auto callback = due->callback;
+        auto arg = due->arg;
+        lock.unlock();
+        callback(arg);
+        lock.lock();
+    }
+}
+
+static esp_err_t Start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    static std::once_flag thread_started;
+    std::call_once(thread_started, [] {
+        std::thread(TimerThread).detach();
+    });
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->period_us = period_us;
+    timer->next_us = esp_timer_get_time() + timeout_us;
+    timers_cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    auto timer = new HostTimer{create_args->callback, create_args->arg, create_args->name ? create_args->name : ""};
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    timers.push_back(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return Start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return Start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    std::erase(timers, timer);
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    return timer->active;
+}
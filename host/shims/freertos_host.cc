@@ -0,0 +1,197 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "host_tasks.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HostTask {
+    std::string name;
+    TaskFunction_t function;
+    void* arg;
+    UBaseType_t priority;
+    bool running = true;
+    pthread_t thread;
+    uint64_t cpu_time_us = 0;
+    std::atomic<uint64_t> allocs = 0;
+};
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+/* Never destroyed, detached tasks may still run while the program exits */
+static std::mutex& tasks_mutex = *new std::mutex();
+static std::condition_variable& tasks_cv = *new std::condition_variable();
+static std::vector<HostTask*>& tasks = *new std::vector<HostTask*>();   // Kept after they end for HostGetTasks()
+static thread_local HostTask* current_task = nullptr;
+static std::atomic<uint64_t> total_allocs = 0;
+
+static uint64_t ThreadCpuTimeUs(clockid_t clock) {
+    timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void* TaskEntry(void* arg) {
+    auto task = (HostTask*)arg;
+    current_task = task;
+    task->function(task->arg);
+
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    task->cpu_time_us = ThreadCpuTimeUs(CLOCK_THREAD_CPUTIME_ID);
+    task->running = false;
+    tasks_cv.notify_all();
+    return nullptr;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core_id) {
+    auto task = new HostTask();
+    task->name = name;
+    task->function = function;
+    task->arg = arg;
+    task->priority = priority;
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    /* Stack sizes are tuned for the device, the host ones are larger */
+    int ret = pthread_create(&task->thread, &attr, TaskEntry, task);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        delete task;
+        return pdFAIL;
+    }
+    tasks.push_back(task);
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    /* A thread cannot be killed, the tasks of the compiled sources only delete themselves before returning */
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds((uint64_t)ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount() {
+    static const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / portTICK_PERIOD_MS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+    return 0;
+}
+
+std::vector<HostTaskInfo> HostGetTasks() {
+    std::vector<HostTaskInfo> result;
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    for (auto task : tasks) {
+        uint64_t cpu_time_us = task->cpu_time_us;
+        if (task->running) {
+            /* Still running, so the thread cannot go away while the lock is held */
+            clockid_t clock;
+            if (pthread_getcpuclockid(task->thread, &clock) == 0) {
+                cpu_time_us = ThreadCpuTimeUs(clock);
+            }
+        }
+        result.push_back({task->name, task->running, cpu_time_us, task->allocs.load()});
+    }
+    return result;
+}
+
+bool HostJoinTasks(uint32_t timeout_ms) {
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    return tasks_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [] {
+        for (auto task : tasks) {
+            if (task->running) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+void HostTaskCountAllocation() {
+    total_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (current_task != nullptr) {
+        current_task->allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t HostGetAllocations() {
+    return total_allocs.load(std::memory_order_relaxed);
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto satisfied = [&] {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    if (ticks == portMAX_DELAY) {
+        group->cv.wait(lock, satisfied);
+    } else {
+        group->cv.wait_for(lock, std::chrono::milliseconds((uint64_t)ticks * portTICK_PERIOD_MS), satisfied);
+    }
+    /* Like FreeRTOS, the bits as they were before clearing, whether or not the wait timed out */
+    EventBits_t value = group->bits;
+    if (clear_on_exit && satisfied()) {
+        group->bits &= ~bits;
+    }
+    return value;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
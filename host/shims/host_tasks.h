@@ -0,0 +1,24 @@
+// Host-only view of the shimmed FreeRTOS tasks and heap, for the benchmarks
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "freertos/task.h"
+
+struct HostTaskInfo {
+    std::string name;
+    bool running;
+    uint64_t cpu_time_us;   // Thread CPU time, sampled when the task ended for the finished ones
+    uint64_t allocs;        // operator new and heap_caps_* calls made by the task
+};
+
+std::vector<HostTaskInfo> HostGetTasks();
+// Waits until every task created so far has returned, false on timeout
+bool HostJoinTasks(uint32_t timeout_ms);
+
+// Counts an allocation for the calling task, called by the heap shim
+void HostTaskCountAllocation();
+// Allocations made by every thread since the program started
+uint64_t HostGetAllocations();
@@ -0,0 +1,16 @@
+// The part of the esp-ml307 Http interface read by the compiled sources
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class Http {
+public:
+    virtual ~Http() = default;
+    virtual void SetHeader(const std::string& key, const std::string& value) = 0;
+    virtual bool Open(const std::string& method, const std::string& url) = 0;
+    virtual void Close() = 0;
+    virtual int Read(char* buffer, size_t buffer_size) = 0;
+    virtual int GetStatusCode() = 0;
+    virtual size_t GetBodyLength() = 0;
+};
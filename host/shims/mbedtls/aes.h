@@ -0,0 +1,18 @@
+// The mbedtls AES calls of the protocols on top of OpenSSL's AES block. mbedtls_aes_crypt_ctr() keeps
+// the mbedtls semantics: the counter, nc_off and stream_block are advanced in place
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH -0x0020
+
+typedef struct {
+    void* cipher;   // EVP_CIPHER_CTX in ECB mode
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output);
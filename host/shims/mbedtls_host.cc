@@ -0,0 +1,51 @@
+#include "mbedtls/aes.h"
+
+#include <openssl/evp.h>
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    ctx->cipher = nullptr;
+}
+
+void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    EVP_CIPHER_CTX_free((EVP_CIPHER_CTX*)ctx->cipher);
+    ctx->cipher = nullptr;
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    const EVP_CIPHER* type = keybits == 128 ? EVP_aes_128_ecb() : keybits == 192 ? EVP_aes_192_ecb()
+        : keybits == 256 ? EVP_aes_256_ecb() : nullptr;
+    if (type == nullptr) {
+        return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    }
+    if (ctx->cipher == nullptr) {
+        ctx->cipher = EVP_CIPHER_CTX_new();
+    }
+    auto cipher = (EVP_CIPHER_CTX*)ctx->cipher;
+    if (EVP_EncryptInit_ex(cipher, type, nullptr, key, nullptr) != 1) {
+        return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    }
+    EVP_CIPHER_CTX_set_padding(cipher, 0);
+    return 0;
+}
+
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+    auto cipher = (EVP_CIPHER_CTX*)ctx->cipher;
+    size_t n = *nc_off;
+    if (cipher == nullptr || n > 15) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (n == 0) {
+            int size = 0;
+            EVP_EncryptUpdate(cipher, stream_block, &size, nonce_counter, 16);
+            /* The whole block is one big-endian counter */
+            for (int j = 15; j >= 0 && ++nonce_counter[j] == 0; j--) {
+            }
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) & 0x0f;
+    }
+    *nc_off = n;
+    return 0;
+}
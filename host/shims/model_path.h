@@ -0,0 +1,18 @@
+// No speech models on the host: esp_srmodel_init() finds none, so the wake word stays off
+#pragma once
+
+typedef struct {
+    char** partition_label;
+    char** model_name;
+    char** model_info;
+    int num;
+} srmodel_list_t;
+
+#define ESP_MN_PREFIX "mn"
+#define ESP_WN_PREFIX "wn"
+#define ESP_NSNET_PREFIX "nsnet"
+#define ESP_VADN_PREFIX "vadnet"
+
+srmodel_list_t* esp_srmodel_init(const char* partition_label);
+void esp_srmodel_deinit(srmodel_list_t* models);
+char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2);
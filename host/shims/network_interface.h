@@ -0,0 +1,12 @@
+// The part of the esp-ml307 NetworkInterface read by the compiled sources
+#pragma once
+
+#include <memory>
+
+#include "http.h"
+
+class NetworkInterface {
+public:
+    virtual ~NetworkInterface() = default;
+    virtual std::unique_ptr<Http> CreateHttp(int connect_id = -1) = 0;
+};
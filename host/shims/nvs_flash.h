@@ -0,0 +1,6 @@
+// NVS kept in memory for the lifetime of the program
+#pragma once
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init();
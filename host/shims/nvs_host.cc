@@ -0,0 +1,104 @@
+#include "nvs_flash.h"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <variant>
+
+typedef std::variant<std::string, int32_t, uint8_t> NvsValue;
+
+static std::mutex nvs_mutex;
+static std::map<std::string, std::map<std::string, NvsValue>> namespaces;
+static std::map<nvs_handle_t, std::string> handles;
+static nvs_handle_t next_handle = 1;
+
+esp_err_t nvs_flash_init() {
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    if (open_mode == NVS_READONLY && namespaces.find(name) == namespaces.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    namespaces[name];
+    *out_handle = next_handle++;
+    handles[*out_handle] = name;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+template <typename T>
+static esp_err_t Get(nvs_handle_t handle, const char* key, T* out_value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto& values = namespaces[handles[handle]];
+    auto it = values.find(key);
+    if (it == values.end() || !std::holds_alternative<T>(it->second)) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_value = std::get<T>(it->second);
+    return ESP_OK;
+}
+
+template <typename T>
+static esp_err_t Set(nvs_handle_t handle, const char* key, T value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    namespaces[handles[handle]][key] = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    std::string value;
+    esp_err_t ret = Get(handle, key, &value);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (out_value != nullptr) {
+        if (*length < value.size() + 1) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(out_value, value.c_str(), value.size() + 1);
+    }
+    *length = value.size() + 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    return Set(handle, key, std::string(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char* key, int32_t* out_value) {
+    return Get(handle, key, out_value);
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char* key, int32_t value) {
+    return Set(handle, key, value);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value) {
+    return Get(handle, key, out_value);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value) {
+    return Set(handle, key, value);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    return namespaces[handles[handle]].erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    namespaces[handles[handle]].clear();
+    return ESP_OK;
+}
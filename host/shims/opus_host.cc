@@ -0,0 +1,198 @@
+// The stand-in codec of esp_opus_enc.h / esp_opus_dec.h
+#include "esp_opus_enc.h"
+#include "esp_opus_dec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+static const int kFrameDurationsX10[] = {25, 50, 100, 200, 400, 600, 800, 1000, 1200};
+
+struct HostOpusEncoder {
+    int sample_rate;
+    int frame_samples;
+    int duration_x10;   // Tenths of a millisecond, for 2.5 ms frames
+    int bitrate;
+};
+
+struct HostOpusDecoder {
+    int frame_samples;
+};
+
+static std::atomic<int> open_decoders = 0;
+static std::atomic<uint32_t> decoder_resets = 0;
+static std::atomic<uint32_t> plc_frames = 0;
+static std::atomic<uint32_t> fec_frames = 0;
+
+static uint8_t LinearToMulaw(int sample) {
+    const int bias = 0x84;
+    int sign = sample < 0 ? 0x80 : 0;
+    int magnitude = std::min(sign ? -sample : sample, 32635) + bias;
+    int exponent = 7;
+    for (int mask = 0x4000; (magnitude & mask) == 0 && exponent > 0; mask >>= 1) {
+        exponent--;
+    }
+    int mantissa = (magnitude >> (exponent + 3)) & 0x0F;
+    return ~(sign | (exponent << 4) | mantissa);
+}
+
+static int MulawToLinear(uint8_t value) {
+    value = ~value;
+    int magnitude = ((((value & 0x0F) << 3) + 0x84) << ((value & 0x70) >> 4)) - 0x84;
+    return (value & 0x80) ? -magnitude : magnitude;
+}
+
+static int PacketBytes(const HostOpusEncoder* encoder, int bitrate) {
+    if (bitrate == ESP_OPUS_BITRATE_AUTO) {
+        bitrate = ESP_OPUS_HOST_AUTO_BITRATE;
+    }
+    return std::max(2, bitrate * encoder->duration_x10 / 80000);
+}
+
+esp_audio_err_t esp_opus_enc_open(void* cfg, uint32_t cfg_sz, void** enc_hd) {
+    auto config = (esp_opus_enc_config_t*)cfg;
+    *enc_hd = nullptr;
+    if (cfg_sz != sizeof(esp_opus_enc_config_t) || config->channel != 1 ||
+            config->frame_duration < ESP_OPUS_ENC_FRAME_DURATION_2_5_MS ||
+            config->frame_duration > ESP_OPUS_ENC_FRAME_DURATION_120_MS) {
+        return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    }
+    auto encoder = new HostOpusEncoder();
+    encoder->sample_rate = config->sample_rate;
+    encoder->duration_x10 = kFrameDurationsX10[config->frame_duration];
+    encoder->frame_samples = config->sample_rate / 100 * encoder->duration_x10 / 100;
+    encoder->bitrate = config->bitrate;
+    *enc_hd = encoder;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_close(void* enc_hd) {
+    delete (HostOpusEncoder*)enc_hd;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_get_frame_size(void* enc_hd, int* in_size, int* out_size) {
+    auto encoder = (HostOpusEncoder*)enc_hd;
+    *in_size = encoder->frame_samples * sizeof(int16_t);
+    int bound = encoder->bitrate == ESP_OPUS_BITRATE_AUTO ? ESP_OPUS_HOST_MAX_BITRATE : encoder->bitrate;
+    *out_size = PacketBytes(encoder, bound);
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_process(void* enc_hd, esp_audio_enc_in_frame_t* in_frame, esp_audio_enc_out_frame_t* out_frame) {
+    auto encoder = (HostOpusEncoder*)enc_hd;
+    if (in_frame->len != encoder->frame_samples * sizeof(int16_t)) {
+        return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    }
+    uint32_t bytes = PacketBytes(encoder, encoder->bitrate);
+    if (out_frame->len < bytes) {
+        return ESP_AUDIO_ERR_BUFF_NOT_ENOUGH;
+    }
+    /* Each byte is the average of one block of samples */
+    auto pcm = (const int16_t*)in_frame->buffer;
+    for (uint32_t i = 0; i < bytes; i++) {
+        int begin = i * encoder->frame_samples / bytes;
+        int end = std::max<int>(begin + 1, (i + 1) * encoder->frame_samples / bytes);
+        int sum = 0;
+        for (int j = begin; j < end; j++) {
+            sum += pcm[j];
+        }
+        out_frame->buffer[i] = LinearToMulaw(sum / (end - begin));
+    }
+    out_frame->encoded_bytes = bytes;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_set_bitrate(void* enc_hd, int bitrate) {
+    ((HostOpusEncoder*)enc_hd)->bitrate = bitrate;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_reset(void* enc_hd) {
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_open(void* cfg, uint32_t cfg_sz, void** dec_handle) {
+    auto config = (esp_opus_dec_cfg_t*)cfg;
+    *dec_handle = nullptr;
+    if (cfg_sz != sizeof(esp_opus_dec_cfg_t) || config->channel != 1 ||
+            config->frame_duration < ESP_OPUS_DEC_FRAME_DURATION_2_5_MS ||
+            config->frame_duration > ESP_OPUS_DEC_FRAME_DURATION_120_MS) {
+        return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    }
+    auto decoder = new HostOpusDecoder();
+    decoder->frame_samples = config->sample_rate / 100 * kFrameDurationsX10[config->frame_duration] / 100;
+    *dec_handle = decoder;
+    open_decoders++;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_close(void* dec_handle) {
+    if (dec_handle != nullptr) {
+        open_decoders--;
+    }
+    delete (HostOpusDecoder*)dec_handle;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_reset(void* dec_handle) {
+    decoder_resets++;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_decode(void* dec_handle, esp_audio_dec_in_raw_t* raw, esp_audio_dec_out_frame_t* frame,
+    esp_audio_dec_info_t* dec_info) {
+    auto decoder = (HostOpusDecoder*)dec_handle;
+    uint32_t needed = decoder->frame_samples * sizeof(int16_t);
+    if (frame->len < needed) {
+        frame->needed_size = needed;
+        return ESP_AUDIO_ERR_BUFF_NOT_ENOUGH;
+    }
+    auto pcm = (int16_t*)frame->buffer;
+    uint32_t bytes = raw->len;
+    if (raw->frame_recover == ESP_AUDIO_DEC_RECOVERY_FEC && bytes == 0) {
+        return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    }
+    if (raw->frame_recover == ESP_AUDIO_DEC_RECOVERY_PLC) {
+        plc_frames++;
+    } else if (raw->frame_recover == ESP_AUDIO_DEC_RECOVERY_FEC) {
+        fec_frames++;
+    }
+    if (raw->frame_recover == ESP_AUDIO_DEC_RECOVERY_PLC || bytes == 0) {
+        memset(pcm, 0, needed);
+    } else {
+        /* Interpolate between the centers of the blocks, in units of 1 / (2 * frame_samples) block */
+        int scale = 2 * decoder->frame_samples;
+        for (int i = 0; i < decoder->frame_samples; i++) {
+            int position = std::max<int>(0, (2 * i + 1) * bytes - decoder->frame_samples);
+            int index = position / scale;
+            int a = MulawToLinear(raw->buffer[index]);
+            int b = index + 1 < (int)bytes ? MulawToLinear(raw->buffer[index + 1]) : a;
+            pcm[i] = a + (b - a) * (position % scale) / scale;
+        }
+    }
+    raw->consumed = bytes;
+    frame->decoded_size = needed;
+    if (dec_info != nullptr) {
+        dec_info->channel = 1;
+        dec_info->bits_per_sample = 16;
+        dec_info->frame_size = needed;
+    }
+    return ESP_AUDIO_ERR_OK;
+}
+
+int HostOpusOpenDecoders() {
+    return open_decoders;
+}
+
+uint32_t HostOpusDecoderResets() {
+    return decoder_resets;
+}
+
+uint32_t HostOpusPlcFrames() {
+    return plc_frames;
+}
+
+uint32_t HostOpusFecFrames() {
+    return fec_frames;
+}
@@ -0,0 +1,76 @@
+#include "esp_ae_rate_cvt.h"
+
+#include <vector>
+
+struct HostRateConverter {
+    uint32_t src_rate;
+    uint32_t dest_rate;
+    int channels;
+    uint64_t phase;             // Next output position in 1 / dest_rate source samples, from the previous sample
+    std::vector<int16_t> last;  // Last input sample of each channel
+};
+
+esp_ae_err_t esp_ae_rate_cvt_open(esp_ae_rate_cvt_cfg_t* cfg, esp_ae_rate_cvt_handle_t* handle) {
+    *handle = nullptr;
+    if (cfg->src_rate == 0 || cfg->dest_rate == 0 || cfg->channel == 0 || cfg->bits_per_sample != 16) {
+        return ESP_AE_ERR_INVALID_PARAMETER;
+    }
+    auto converter = new HostRateConverter();
+    converter->src_rate = cfg->src_rate;
+    converter->dest_rate = cfg->dest_rate;
+    converter->channels = cfg->channel;
+    converter->phase = cfg->dest_rate;
+    converter->last.assign(cfg->channel, 0);
+    *handle = converter;
+    return ESP_AE_ERR_OK;
+}
+
+esp_ae_err_t esp_ae_rate_cvt_get_max_out_sample_num(esp_ae_rate_cvt_handle_t handle, uint32_t in_sample_num,
+    uint32_t* out_sample_num) {
+    auto converter = (HostRateConverter*)handle;
+    *out_sample_num = (uint64_t)in_sample_num * converter->dest_rate / converter->src_rate + 1;
+    return ESP_AE_ERR_OK;
+}
+
+esp_ae_err_t esp_ae_rate_cvt_process(esp_ae_rate_cvt_handle_t handle, esp_ae_sample_t in_samples,
+    uint32_t in_sample_num, esp_ae_sample_t out_samples, uint32_t* out_sample_num) {
+    auto converter = (HostRateConverter*)handle;
+    auto in = (const int16_t*)in_samples;
+    auto out = (int16_t*)out_samples;
+    int channels = converter->channels;
+    uint64_t dest_rate = converter->dest_rate;
+    /* Source position p (in 1 / dest_rate units) lies between sample p / dest_rate - 1 and the next one,
+     * sample -1 being the last one of the previous call */
+    uint64_t end = (uint64_t)in_sample_num * dest_rate;
+    uint32_t written = 0;
+    while (converter->phase <= end && written < *out_sample_num) {
+        uint64_t index = converter->phase / dest_rate;
+        uint64_t fraction = converter->phase % dest_rate;
+        for (int c = 0; c < channels; c++) {
+            int a = index == 0 ? converter->last[c] : in[(index - 1) * channels + c];
+            int b = index < in_sample_num ? in[index * channels + c] : a;
+            out[written * channels + c] = a + (int64_t)(b - a) * (int64_t)fraction / (int64_t)dest_rate;
+        }
+        written++;
+        converter->phase += converter->src_rate;
+    }
+    if (in_sample_num > 0) {
+        for (int c = 0; c < channels; c++) {
+            converter->last[c] = in[(in_sample_num - 1) * channels + c];
+        }
+        converter->phase = converter->phase > end ? converter->phase - end : 0;
+    }
+    *out_sample_num = written;
+    return ESP_AE_ERR_OK;
+}
+
+esp_ae_err_t esp_ae_rate_cvt_reset(esp_ae_rate_cvt_handle_t handle) {
+    auto converter = (HostRateConverter*)handle;
+    converter->phase = converter->dest_rate;
+    converter->last.assign(converter->channels, 0);
+    return ESP_AE_ERR_OK;
+}
+
+void esp_ae_rate_cvt_close(esp_ae_rate_cvt_handle_t handle) {
+    delete (HostRateConverter*)handle;
+}
@@ -0,0 +1,20 @@
+// Configuration of the host build: the Kconfig defaults (no SPIRAM, no audio processor) of the
+// options read by the compiled sources
+#pragma once
+
+#define CONFIG_FREERTOS_HZ 1000
+
+#define CONFIG_AUDIO_ENCODE_TASK_CORE -1
+#define CONFIG_AUDIO_ENCODE_TASK_PRIORITY 2
+#define CONFIG_AUDIO_ENCODE_TASK_STACK_SIZE 24576
+#define CONFIG_AUDIO_DECODE_TASK_CORE -1
+#define CONFIG_AUDIO_DECODE_TASK_PRIORITY 3
+#define CONFIG_AUDIO_DECODE_TASK_STACK_SIZE 24576
+#define CONFIG_AUDIO_SOUND_CACHE_CLIPS 5
+#define CONFIG_AUDIO_DECODER_CACHE_ENTRIES 3
+#define CONFIG_AUDIO_ADAPTIVE_ENCODER 1
+#define CONFIG_AUDIO_ADAPTIVE_ENCODER_MAX_LEVEL 2
+#define CONFIG_AUDIO_UPLINK_GATE_SEND_ALL 1
+#define CONFIG_AUDIO_INPUT_ALLOC_COUNTER 1     // The heap shim calls the hooks, see esp_system_host.cc
+#define CONFIG_STREAM_PLAYER_PREFETCH_MS 1000
+#define CONFIG_WEBSOCKET_AUDIO_BATCH_MS 120
@@ -0,0 +1,141 @@
+#include "audio_chunker.h"
+#include "host_test.h"
+
+#include <random>
+#include <vector>
+
+// The insert + erase buffer the processors and wake words used before
+static std::vector<std::vector<int16_t>> ReferenceChunks(const std::vector<std::vector<int16_t>>& inputs,
+    size_t chunk_samples, size_t step) {
+    std::vector<std::vector<int16_t>> chunks;
+    std::vector<int16_t> buffer;
+    for (auto& input : inputs) {
+        for (size_t i = 0; i + step <= input.size(); i += step) {
+            buffer.push_back(input[i]);
+        }
+        while (buffer.size() >= chunk_samples) {
+            chunks.emplace_back(buffer.begin(), buffer.begin() + chunk_samples);
+            buffer.erase(buffer.begin(), buffer.begin() + chunk_samples);
+        }
+    }
+    return chunks;
+}
+
+static std::vector<std::vector<int16_t>> RandomInputs(std::mt19937& random, size_t count, size_t max_size,
+    size_t step) {
+    std::vector<std::vector<int16_t>> inputs(count);
+    int16_t next = 0;
+    for (auto& input : inputs) {
+        input.resize(random() % (max_size / step + 1) * step);
+        for (auto& sample : input) {
+            sample = next++;
+        }
+    }
+    return inputs;
+}
+
+static void CheckAgainstReference(size_t chunk_samples, size_t step, size_t max_input, uint32_t seed) {
+    std::mt19937 random(seed);
+    auto inputs = RandomInputs(random, 200, max_input, step);
+    auto expected = ReferenceChunks(inputs, chunk_samples, step);
+
+    AudioChunker chunker;
+    chunker.Configure(chunk_samples, step);
+    std::vector<std::vector<int16_t>> chunks;
+    for (auto& input : inputs) {
+        chunker.Feed(std::span<const int16_t>(input), [&](std::span<const int16_t> chunk) {
+            chunks.emplace_back(chunk.begin(), chunk.end());
+            return true;
+        });
+    }
+    CHECK_EQ(chunks.size(), expected.size());
+    CHECK(chunks == expected);
+}
+
+TEST(MatchesInsertEraseBuffer) {
+    // Inputs shorter, equal and longer than the chunk, AFE and multinet like sizes
+    CheckAgainstReference(512, 1, 960, 1);
+    CheckAgainstReference(480, 1, 960, 2);
+    CheckAgainstReference(160, 1, 100, 3);
+    CheckAgainstReference(256, 1, 4096, 4);
+    CheckAgainstReference(1, 1, 16, 5);
+}
+
+TEST(MatchesInsertEraseBufferStrided) {
+    CheckAgainstReference(512, 2, 1920, 6);
+    CheckAgainstReference(160, 2, 100, 7);
+    CheckAgainstReference(256, 4, 4096, 8);
+}
+
+TEST(AlignedChunksAreViewsOfTheInput) {
+    AudioChunker chunker;
+    chunker.Configure(480);
+    std::vector<int16_t> input(960);
+    int views = 0;
+    int copies = 0;
+    auto count = [&](std::span<const int16_t> chunk) {
+        bool inside = chunk.data() >= input.data() && chunk.data() + chunk.size() <= input.data() + input.size();
+        inside ? views++ : copies++;
+        return true;
+    };
+    for (int i = 0; i < 10; i++) {
+        chunker.Feed(std::span<const int16_t>(input), count);
+    }
+    CHECK_EQ(views, 20);
+    CHECK_EQ(copies, 0);
+    CHECK_EQ(chunker.pending(), 0);
+
+    // Misaligned by 100 samples: only the chunk straddling two inputs is assembled
+    views = copies = 0;
+    std::vector<int16_t> odd(100);
+    chunker.Feed(std::span<const int16_t>(odd), count);
+    for (int i = 0; i < 10; i++) {
+        chunker.Feed(std::span<const int16_t>(input), count);
+    }
+    CHECK_EQ(copies, 10);
+    CHECK_EQ(views, 10);
+    CHECK_EQ(chunker.pending(), 100);
+}
+
+TEST(StopDropsTheRest) {
+    AudioChunker chunker;
+    chunker.Configure(4);
+    std::vector<int16_t> input = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    int calls = 0;
+    chunker.Feed(std::span<const int16_t>(input), [&](std::span<const int16_t>) {
+        calls++;
+        return false;
+    });
+    CHECK_EQ(calls, 1);
+    CHECK_EQ(chunker.pending(), 0);
+}
+
+TEST(ClearDropsPendingSamples) {
+    AudioChunker chunker;
+    chunker.Configure(4);
+    std::vector<int16_t> first = {1, 2, 3};
+    std::vector<int16_t> second = {10, 11, 12, 13};
+    std::vector<int16_t> seen;
+    auto collect = [&](std::span<const int16_t> chunk) {
+        seen.assign(chunk.begin(), chunk.end());
+        return true;
+    };
+    chunker.Feed(std::span<const int16_t>(first), collect);
+    CHECK_EQ(chunker.pending(), 3);
+    chunker.Clear();
+    chunker.Feed(std::span<const int16_t>(second), collect);
+    CHECK(seen == second);
+}
+
+TEST(UnconfiguredIgnoresInput) {
+    AudioChunker chunker;
+    std::vector<int16_t> input(100);
+    int calls = 0;
+    chunker.Feed(std::span<const int16_t>(input), [&](std::span<const int16_t>) {
+        calls++;
+        return true;
+    });
+    CHECK_EQ(calls, 0);
+}
+
+HOST_TEST_MAIN()
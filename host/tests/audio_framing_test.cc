@@ -0,0 +1,324 @@
+#include "audio_framing.h"
+#include "host_test.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// The per-frame std::string that SendAudio() built before the headers went into the headroom
+static std::string ReferenceMessage(const std::vector<uint8_t>& opus, uint32_t timestamp, int version) {
+    std::string serialized;
+    if (version == 2) {
+        serialized.resize(sizeof(BinaryProtocol2) + opus.size());
+        auto bp2 = (BinaryProtocol2*)serialized.data();
+        bp2->version = htons(version);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(timestamp);
+        bp2->payload_size = htonl(opus.size());
+        std::copy(opus.begin(), opus.end(), bp2->payload);
+    } else if (version == 3) {
+        serialized.resize(sizeof(BinaryProtocol3) + opus.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(opus.size());
+        std::copy(opus.begin(), opus.end(), bp3->payload);
+    } else {
+        serialized.assign(opus.begin(), opus.end());
+    }
+    return serialized;
+}
+
+static std::vector<uint8_t> Opus(size_t size) {
+    std::vector<uint8_t> opus(size);
+    for (size_t i = 0; i < size; i++) {
+        opus[i] = i * 13 + 5;
+    }
+    return opus;
+}
+
+static std::unique_ptr<AudioStreamPacket> MakePacket(const std::vector<uint8_t>& opus, uint16_t headroom,
+    uint32_t timestamp) {
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->payload.assign(headroom, 0xee);
+    packet->payload.insert(packet->payload.end(), opus.begin(), opus.end());
+    packet->headroom = headroom;
+    packet->timestamp = timestamp;
+    return packet;
+}
+
+TEST(header_matches_the_old_message) {
+    for (int version : { 1, 2, 3 }) {
+        // Encoder packets with the full headroom, wake word packets with none, and a short one
+        for (uint16_t headroom : { AUDIO_PACKET_HEADROOM, 0, 4 }) {
+            for (size_t size : { 0, 1, 120, 1275 }) {
+                auto opus = Opus(size);
+                auto packet = MakePacket(opus, headroom, 0x12345678 + size);
+                size_t message_size = 0;
+                auto message = audio_framing::WriteHeader(*packet, version, message_size);
+                auto expected = ReferenceMessage(opus, 0x12345678 + size, version);
+                REQUIRE(message_size == expected.size());
+                CHECK(std::string((const char*)message, message_size) == expected);
+                // The message ends with the packet data, which is unchanged
+                CHECK(message + message_size == packet->data() + packet->size());
+                CHECK(std::vector<uint8_t>(packet->data(), packet->data() + packet->size()) == opus);
+            }
+        }
+    }
+}
+
+TEST(header_goes_into_the_headroom) {
+    auto opus = Opus(100);
+    auto packet = MakePacket(opus, AUDIO_PACKET_HEADROOM, 1000);
+    auto payload = packet->payload.data();
+    auto data = packet->data();
+    size_t size = 0;
+    auto message = audio_framing::WriteHeader(*packet, 2, size);
+    CHECK(packet->payload.data() == payload);
+    CHECK(packet->data() == data);
+    CHECK(message == data - sizeof(BinaryProtocol2));
+    CHECK_EQ(size, sizeof(BinaryProtocol2) + 100);
+
+    // Written twice, as when a send is retried: the same message at the same place
+    auto again = audio_framing::WriteHeader(*packet, 2, size);
+    CHECK(again == message);
+    CHECK(std::vector<uint8_t>(packet->data(), packet->data() + packet->size()) == opus);
+}
+
+TEST(fields_are_big_endian) {
+    auto packet = MakePacket(Opus(0x0102), AUDIO_PACKET_HEADROOM, 0xa1b2c3d4);
+    size_t size = 0;
+    auto bp2 = audio_framing::WriteHeader(*packet, 2, size);
+    const uint8_t expected2[] = { 0, 2, 0, 0, 0, 0, 0, 0, 0xa1, 0xb2, 0xc3, 0xd4, 0, 0, 0x01, 0x02 };
+    CHECK(memcmp(bp2, expected2, sizeof(expected2)) == 0);
+
+    packet = MakePacket(Opus(0x0102), AUDIO_PACKET_HEADROOM, 0xa1b2c3d4);
+    auto bp3 = audio_framing::WriteHeader(*packet, 3, size);
+    const uint8_t expected3[] = { 0, 0, 0x01, 0x02 };
+    CHECK(memcmp(bp3, expected3, sizeof(expected3)) == 0);
+}
+
+TEST(read_round_trip_in_place) {
+    for (int version : { 1, 2, 3 }) {
+        auto opus = Opus(321);
+        auto message = ReferenceMessage(opus, 777, version);
+        audio_framing::Frame frame;
+        REQUIRE(audio_framing::ReadFrame((const uint8_t*)message.data(), message.size(), version, frame));
+        CHECK_EQ(frame.size, opus.size());
+        CHECK(memcmp(frame.payload, opus.data(), opus.size()) == 0);
+        CHECK(frame.payload + frame.size == (const uint8_t*)message.data() + message.size());
+        CHECK_EQ(frame.timestamp, version == 2 ? 777 : 0);
+    }
+}
+
+TEST(read_rejects_cut_messages) {
+    for (int version : { 2, 3 }) {
+        auto message = ReferenceMessage(Opus(60), 5, version);
+        size_t header = version == 2 ? sizeof(BinaryProtocol2) : sizeof(BinaryProtocol3);
+        // Each cut is read from its own buffer, nothing past the cut may be touched
+        for (size_t size = 0; size < message.size(); size++) {
+            std::vector<uint8_t> cut(message.begin(), message.begin() + size);
+            audio_framing::Frame frame;
+            CHECK(!audio_framing::ReadFrame(cut.data(), cut.size(), version, frame));
+        }
+        // Bytes after payload_size are ignored
+        std::vector<uint8_t> longer(message.begin(), message.end());
+        longer.resize(longer.size() + 9, 0);
+        audio_framing::Frame frame;
+        REQUIRE(audio_framing::ReadFrame(longer.data(), longer.size(), version, frame));
+        CHECK_EQ(frame.size, 60);
+        CHECK(frame.payload == longer.data() + header);
+    }
+}
+
+TEST(read_rejects_oversized_payload_size) {
+    // payload_size near the type limits must not wrap the bounds check
+    std::vector<uint8_t> bp2(sizeof(BinaryProtocol2) + 8, 0);
+    ((BinaryProtocol2*)bp2.data())->payload_size = htonl(0xffffffff);
+    audio_framing::Frame frame;
+    CHECK(!audio_framing::ReadFrame(bp2.data(), bp2.size(), 2, frame));
+    std::vector<uint8_t> bp3(sizeof(BinaryProtocol3) + 8, 0);
+    ((BinaryProtocol3*)bp3.data())->payload_size = htons(0xffff);
+    CHECK(!audio_framing::ReadFrame(bp3.data(), bp3.size(), 3, frame));
+}
+
+struct SentFrame {
+    std::vector<uint8_t> opus;
+    uint32_t timestamp;
+};
+
+static std::vector<SentFrame> ReadMessages(const std::vector<std::vector<uint8_t>>& messages) {
+    std::vector<SentFrame> frames;
+    for (auto& message : messages) {
+        bool complete = audio_framing::ReadBatch(message.data(), message.size(), [&](const audio_framing::Frame& frame) {
+            frames.push_back({ std::vector<uint8_t>(frame.payload, frame.payload + frame.size), frame.timestamp });
+        });
+        CHECK(complete);
+    }
+    return frames;
+}
+
+TEST(batch_round_trip) {
+    // Mixed 20 / 60 ms frames with random early flushes, as the timer and the text messages cause
+    std::mt19937 random(4);
+    audio_framing::BatchWriter writer(120);
+    std::vector<SentFrame> sent;
+    std::vector<std::vector<uint8_t>> messages;
+    auto flush = [&]() {
+        if (writer.frames() > 0) {
+            CHECK(writer.duration_ms() <= 120);
+            size_t size = 0;
+            auto message = writer.Finish(size);
+            messages.emplace_back(message, message + size);
+        }
+    };
+    uint32_t timestamp = 1000;
+    for (int i = 0; i < 500; i++) {
+        auto packet = MakePacket(Opus(random() % 200), AUDIO_PACKET_HEADROOM, timestamp);
+        packet->frame_duration = random() % 2 ? 20 : 60;
+        timestamp += packet->frame_duration;
+        sent.push_back({ std::vector<uint8_t>(packet->data(), packet->data() + packet->size()), packet->timestamp });
+        if (!writer.Fits(*packet)) {
+            flush();
+        }
+        writer.Add(*packet);
+        if (writer.Full() || random() % 10 == 0) {
+            flush();
+        }
+    }
+    flush();
+
+    auto received = ReadMessages(messages);
+    REQUIRE(received.size() == sent.size());
+    for (size_t i = 0; i < sent.size(); i++) {
+        CHECK(received[i].opus == sent[i].opus);
+        CHECK_EQ(received[i].timestamp, sent[i].timestamp);
+    }
+    CHECK(messages.size() < sent.size());
+}
+
+TEST(batch_header_fields) {
+    audio_framing::BatchWriter writer(120);
+    auto a = MakePacket(Opus(3), AUDIO_PACKET_HEADROOM, 0x01020304);
+    auto b = MakePacket(Opus(2), 0, 0x01020304 + 60);
+    a->frame_duration = b->frame_duration = 60;
+    writer.Add(*a);
+    REQUIRE(writer.Fits(*b));
+    writer.Add(*b);
+    CHECK(writer.Full());
+    size_t size = 0;
+    auto message = writer.Finish(size);
+    const uint8_t expected[] = { 0, 2, 0, 13, 0x01, 0x02, 0x03, 0x04,
+        0, 0, 0, 3, 5, 18, 31,
+        0, 60, 0, 2, 5, 18 };
+    REQUIRE(size == sizeof(expected));
+    CHECK(memcmp(message, expected, size) == 0);
+    CHECK_EQ(writer.frames(), 0);
+    CHECK_EQ(writer.duration_ms(), 0);
+}
+
+TEST(batch_limits) {
+    // The budget
+    audio_framing::BatchWriter writer(120);
+    auto packet = MakePacket(Opus(10), 0, 0);
+    packet->frame_duration = 60;
+    CHECK(writer.Fits(*packet));
+    writer.Add(*packet);
+    CHECK(!writer.Full());
+    packet->frame_duration = 80;
+    CHECK(!writer.Fits(*packet));
+    writer.Clear();
+    // A first frame always fits, even over the budget
+    CHECK(writer.Fits(*packet));
+
+    // 255 frames, the 8-bit frame_count
+    packet->frame_duration = 0;
+    for (int i = 0; i < 255; i++) {
+        REQUIRE(writer.Fits(*packet));
+        writer.Add(*packet);
+    }
+    CHECK(!writer.Fits(*packet));
+    writer.Clear();
+
+    // The 16-bit payload_size
+    auto large = MakePacket(Opus(16000), 0, 0);
+    large->frame_duration = 1;
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(writer.Fits(*large));
+        writer.Add(*large);
+    }
+    CHECK(!writer.Fits(*large));
+    size_t size = 0;
+    writer.Finish(size);
+    CHECK(size - sizeof(BinaryProtocol4) <= UINT16_MAX);
+
+    // The 16-bit timestamp_offset, after a gap in the uplink
+    packet->frame_duration = 20;
+    packet->timestamp = 100;
+    writer.Add(*packet);
+    packet->timestamp = 100 + 65535;
+    CHECK(writer.Fits(*packet));
+    packet->timestamp = 100 + 65536;
+    CHECK(!writer.Fits(*packet));
+}
+
+TEST(batch_buffer_is_reused) {
+    audio_framing::BatchWriter writer(120);
+    auto packet = MakePacket(Opus(100), 0, 0);
+    packet->frame_duration = 60;
+    size_t size = 0;
+    writer.Add(*packet);
+    writer.Add(*packet);
+    auto first = writer.Finish(size);
+    writer.Add(*packet);
+    auto second = writer.Finish(size);
+    CHECK(first == second);
+    CHECK_EQ(size, sizeof(BinaryProtocol4) + sizeof(BinaryProtocol4Frame) + 100);
+}
+
+static std::vector<uint8_t> ThreeFrameBatch() {
+    audio_framing::BatchWriter writer(120);
+    for (size_t opus_size : { 30, 0, 45 }) {
+        auto packet = MakePacket(Opus(opus_size), 0, 500);
+        packet->frame_duration = 20;
+        writer.Add(*packet);
+    }
+    size_t size = 0;
+    auto message = writer.Finish(size);
+    return std::vector<uint8_t>(message, message + size);
+}
+
+TEST(batch_read_rejects_cut_messages) {
+    auto message = ThreeFrameBatch();
+    for (size_t size = 0; size < message.size(); size++) {
+        std::vector<uint8_t> cut(message.begin(), message.begin() + size);
+        int frames = 0;
+        CHECK(!audio_framing::ReadBatch(cut.data(), cut.size(), [&](const audio_framing::Frame&) { frames++; }));
+        CHECK_EQ(frames, 0);
+    }
+}
+
+TEST(batch_read_stops_at_a_bad_frame) {
+    // frame_count beyond the frames in payload_size: the complete frames are delivered
+    auto message = ThreeFrameBatch();
+    ((BinaryProtocol4*)message.data())->frame_count = 4;
+    message.resize(message.size() + 16, 0xff);
+    int frames = 0;
+    CHECK(!audio_framing::ReadBatch(message.data(), message.size(), [&](const audio_framing::Frame&) { frames++; }));
+    CHECK_EQ(frames, 3);
+
+    // A frame size past payload_size, although the message is longer
+    message = ThreeFrameBatch();
+    auto second = (BinaryProtocol4Frame*)(message.data() + sizeof(BinaryProtocol4) + sizeof(BinaryProtocol4Frame) + 30);
+    second->size = htons(0xffff);
+    message.resize(message.size() + 0x10000, 0);
+    frames = 0;
+    CHECK(!audio_framing::ReadBatch(message.data(), message.size(), [&](const audio_framing::Frame&) { frames++; }));
+    CHECK_EQ(frames, 1);
+}
+
+HOST_TEST_MAIN()
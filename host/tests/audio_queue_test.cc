@@ -0,0 +1,180 @@
+#include "audio_queue.h"
+#include "host_test.h"
+
+#include <freertos/event_groups.h>
+
+#include <memory>
+#include <thread>
+
+TEST(CapacityRoundsUpToPowerOfTwo) {
+    CHECK_EQ(AudioQueue<int>(1).capacity(), 1);
+    CHECK_EQ(AudioQueue<int>(3).capacity(), 4);
+    CHECK_EQ(AudioQueue<int>(16).capacity(), 16);
+    CHECK_EQ(AudioQueue<int>(17).capacity(), 32);
+}
+
+TEST(FifoAcrossWraps) {
+    AudioQueue<int> queue(4);
+    int next_push = 0;
+    int next_pop = 0;
+    // Three in, three out, so the indices wrap the ring at every offset
+    for (int round = 0; round < 1000; round++) {
+        for (int i = 0; i < 3; i++) {
+            REQUIRE(queue.Push(int(next_push++)));
+        }
+        CHECK_EQ(queue.Size(), 3);
+        int value;
+        for (int i = 0; i < 3; i++) {
+            REQUIRE(queue.Pop(value));
+            CHECK_EQ(value, next_pop++);
+        }
+        CHECK(queue.Empty());
+    }
+    int value;
+    CHECK(!queue.Pop(value));
+}
+
+TEST(FullQueueRejectsPushAndKeepsItem) {
+    AudioQueue<std::unique_ptr<int>> queue(4);
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(queue.Push(std::make_unique<int>(i)));
+    }
+    auto item = std::make_unique<int>(4);
+    CHECK(!queue.Push(std::move(item)));
+    CHECK(item != nullptr);
+
+    std::unique_ptr<int> popped;
+    REQUIRE(queue.Pop(popped));
+    CHECK_EQ(*popped, 0);
+    CHECK(queue.Push(std::move(item)));
+    CHECK(item == nullptr);
+    CHECK_EQ(queue.Size(), 4);
+}
+
+TEST(ClearDropsStaleItemsOnNextPop) {
+    AudioQueue<std::shared_ptr<int>> queue(8);
+    auto stale = std::make_shared<int>(1);
+    REQUIRE(queue.Push(std::shared_ptr<int>(stale)));
+    REQUIRE(queue.Push(std::shared_ptr<int>(stale)));
+    CHECK_EQ(stale.use_count(), 3);
+
+    queue.Clear();
+    CHECK_EQ(queue.Size(), 0);
+    CHECK(queue.Empty());
+    // Only the consumer touches the slots, so the stale items live until its next Pop
+    CHECK_EQ(stale.use_count(), 3);
+
+    REQUIRE(queue.Push(std::make_shared<int>(2)));
+    CHECK_EQ(queue.Size(), 1);
+    std::shared_ptr<int> item;
+    REQUIRE(queue.Pop(item));
+    CHECK_EQ(*item, 2);
+    CHECK_EQ(stale.use_count(), 1);
+    CHECK(!queue.Pop(item));
+}
+
+TEST(ClearOnEmptyQueueIsHarmless) {
+    AudioQueue<int> queue(4);
+    queue.Clear();
+    int value;
+    CHECK(!queue.Pop(value));
+    REQUIRE(queue.Push(7));
+    queue.Clear();
+    queue.Clear();
+    CHECK(!queue.Pop(value));
+    REQUIRE(queue.Push(8));
+    REQUIRE(queue.Pop(value));
+    CHECK_EQ(value, 8);
+}
+
+TEST(PeakTracksDeepestPoint) {
+    AudioQueue<int> queue(8);
+    for (int i = 0; i < 5; i++) {
+        queue.Push(int(i));
+    }
+    int value;
+    for (int i = 0; i < 5; i++) {
+        queue.Pop(value);
+    }
+    CHECK_EQ(queue.peak(), 5);
+    queue.ResetPeak();
+    CHECK_EQ(queue.peak(), 0);
+    queue.Push(1);
+    CHECK_EQ(queue.peak(), 1);
+}
+
+TEST(EventBitsPerBoundary) {
+    constexpr EventBits_t kNotEmpty = 1 << 0;
+    constexpr EventBits_t kNotFull = 1 << 1;
+    EventGroupHandle_t group = xEventGroupCreate();
+    AudioQueue<int> queue(2);
+    queue.SetEventBits(group, kNotEmpty, kNotFull);
+
+    queue.Push(1);
+    CHECK_EQ(xEventGroupGetBits(group), kNotEmpty);
+    xEventGroupClearBits(group, kNotEmpty | kNotFull);
+    int value;
+    queue.Pop(value);
+    CHECK_EQ(xEventGroupGetBits(group), kNotFull);
+    xEventGroupClearBits(group, kNotEmpty | kNotFull);
+    // A clear wakes the consumer so it drains the stale items, which frees the producer
+    queue.Push(2);
+    xEventGroupClearBits(group, kNotEmpty | kNotFull);
+    queue.Clear();
+    CHECK_EQ(xEventGroupGetBits(group), kNotEmpty);
+    CHECK(!queue.Pop(value));
+    CHECK((xEventGroupGetBits(group) & kNotFull) != 0);
+    vEventGroupDelete(group);
+}
+
+TEST(ProducerConsumerWithConcurrentClear) {
+    constexpr EventBits_t kNotEmpty = 1 << 0;
+    constexpr EventBits_t kNotFull = 1 << 1;
+    constexpr int kItems = 200000;
+    EventGroupHandle_t group = xEventGroupCreate();
+    AudioQueue<int> queue(16);
+    queue.SetEventBits(group, kNotEmpty, kNotFull);
+
+    std::atomic<bool> done = false;
+    std::thread producer([&]() {
+        for (int i = 0; i < kItems; i++) {
+            while (!queue.Push(int(i))) {
+                xEventGroupWaitBits(group, kNotFull, pdTRUE, pdFALSE, pdMS_TO_TICKS(10));
+            }
+        }
+        done = true;
+        xEventGroupSetBits(group, kNotEmpty);
+    });
+    std::thread clearer([&]() {
+        while (!done) {
+            queue.Clear();
+            std::this_thread::yield();
+        }
+    });
+
+    // Values only go up and none is seen twice, whatever the clears dropped
+    int last = -1;
+    int received = 0;
+    bool ordered = true;
+    int value;
+    while (true) {
+        if (queue.Pop(value)) {
+            ordered = ordered && value > last;
+            last = value;
+            received++;
+            continue;
+        }
+        if (done && queue.Empty()) {
+            break;
+        }
+        xEventGroupWaitBits(group, kNotEmpty, pdTRUE, pdFALSE, pdMS_TO_TICKS(10));
+    }
+    producer.join();
+    clearer.join();
+    CHECK(ordered);
+    CHECK(received > 0);
+    CHECK(received <= kItems);
+    vEventGroupDelete(group);
+}
+
+HOST_TEST_MAIN()
@@ -0,0 +1,290 @@
+#include "control_message.h"
+#include "host_test.h"
+
+#include <cJSON.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Reference {
+    bool parsed = false;
+    bool fallback = false;  // Parsed, but not something the parser has to read
+    bool present[4] = {};
+    std::string fields[4];
+};
+
+// What the application read with cJSON before the parser
+static Reference ReadWithCjson(const std::string& json) {
+    Reference reference;
+    cJSON* root = cJSON_ParseWithLength(json.data(), json.size());
+    if (root == nullptr) {
+        return reference;
+    }
+    reference.parsed = true;
+    const char* names[] = { "type", "state", "text", "emotion" };
+    for (int i = 0; i < 4; i++) {
+        cJSON* item = cJSON_GetObjectItem(root, names[i]);
+        if (item == nullptr) {
+            continue;
+        }
+        if (!cJSON_IsString(item)) {
+            reference.fallback = true;
+            continue;
+        }
+        reference.present[i] = true;
+        reference.fields[i] = item->valuestring;
+    }
+    auto& type = reference.fields[0];
+    if (type != "tts" && type != "stt" && type != "llm") {
+        reference.fallback = true;
+    }
+    cJSON_Delete(root);
+    return reference;
+}
+
+// Parses a copy of exactly length bytes, ASan catches a read past the end
+static bool Parse(ControlMessageParser& parser, const std::string& json, size_t length, ControlMessage& message,
+    std::vector<char>& buffer) {
+    buffer.assign(json.begin(), json.begin() + length);
+    return parser.Parse(buffer.data(), buffer.size(), message);
+}
+
+// The parser either falls back or reads what cJSON reads
+static bool MatchesCjson(const std::string& json, bool expect_parsed) {
+    static ControlMessageParser parser;
+    std::vector<char> buffer;
+    ControlMessage message;
+    bool parsed = Parse(parser, json, json.size(), message, buffer);
+    auto reference = ReadWithCjson(json);
+    if (!parsed) {
+        return !expect_parsed;
+    }
+    if (!reference.parsed || reference.fallback) {
+        return false;
+    }
+    std::string_view fields[] = { message.type, message.state, message.text, message.emotion };
+    for (int i = 0; i < 4; i++) {
+        if ((fields[i].data() != nullptr) != reference.present[i] || fields[i] != reference.fields[i]) {
+            return false;
+        }
+    }
+    return expect_parsed;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += (char)code;
+    } else if (code < 0x800) {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    } else {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+static void AppendEscape(std::string& out, uint32_t code) {
+    char hex[16];
+    snprintf(hex, sizeof(hex), "\\u%04x", code);
+    out += hex;
+}
+
+// A JSON string of random code points, each written raw or escaped
+static std::string RandomString(std::mt19937& random, size_t max_length, std::string* decoded = nullptr) {
+    static const uint32_t samples[] = { 'a', 'Z', ' ', '"', '\\', '/', '\b', '\f', '\n', '\r', '\t', 0x1f,
+        '{', '}', ',', ':', 0xe9, 0x4f60, 0x597d, 0xff01, 0x1f60a, 0x1f914, 0x10ffff };
+    std::string json = "\"";
+    size_t length = random() % (max_length + 1);
+    for (size_t i = 0; i < length; i++) {
+        uint32_t code = samples[random() % (sizeof(samples) / sizeof(samples[0]))];
+        if (decoded != nullptr) {
+            AppendUtf8(*decoded, code);
+        }
+        bool escape = code < 0x20 || code == '"' || code == '\\' || random() % 3 == 0;
+        if (!escape) {
+            AppendUtf8(json, code);
+            continue;
+        }
+        const char* shorthand = code == '"' ? "\\\"" : code == '\\' ? "\\\\" : code == '/' ? "\\/" :
+            code == '\b' ? "\\b" : code == '\f' ? "\\f" : code == '\n' ? "\\n" : code == '\r' ? "\\r" :
+            code == '\t' ? "\\t" : nullptr;
+        if (shorthand != nullptr && random() % 2 == 0) {
+            json += shorthand;
+        } else if (code >= 0x10000) {
+            AppendEscape(json, 0xD800 + ((code - 0x10000) >> 10));
+            AppendEscape(json, 0xDC00 + ((code - 0x10000) & 0x3FF));
+        } else {
+            AppendEscape(json, code);
+        }
+    }
+    return json + "\"";
+}
+
+static std::string RandomSpace(std::mt19937& random) {
+    static const char* spaces[] = { "", "", " ", "\n  ", "\t", "\r\n" };
+    return spaces[random() % 6];
+}
+
+static std::string RandomCase(std::mt19937& random, std::string key) {
+    if (random() % 4 == 0) {
+        for (auto& c : key) {
+            if (random() % 2 == 0) {
+                c = toupper(c);
+            }
+        }
+    }
+    return key;
+}
+
+// A control message as the server sends it, with its other members, shuffled, some keys repeated
+static std::string RandomMessage(std::mt19937& random) {
+    static const char* types[] = { "\"tts\"", "\"stt\"", "\"llm\"", "\"t\\u0074s\"" };
+    std::vector<std::string> members;
+    members.push_back("\"type\":" + std::string(types[random() % 4]));
+    for (const char* key : { "state", "text", "emotion" }) {
+        for (int count = random() % 3; count > 0; count--) {
+            members.push_back("\"" + RandomCase(random, key) + "\":" + RandomSpace(random) + RandomString(random, 40));
+        }
+    }
+    members.push_back("\"session_id\":" + RandomString(random, 10));
+    if (random() % 2 == 0) {
+        members.push_back("\"index\":" + std::to_string((int)random() % 1000 - 500));
+    }
+    if (random() % 2 == 0) {
+        members.push_back("\"extra\":{\"list\":[1,-2.5e3,true,null," + RandomString(random, 8) +
+            ",{\"type\":\"mcp\"}],\"flag\":false}");
+    }
+    std::shuffle(members.begin(), members.end(), random);
+    std::string json = "{" + RandomSpace(random);
+    for (size_t i = 0; i < members.size(); i++) {
+        json += (i > 0 ? "," + RandomSpace(random) : "") + members[i];
+    }
+    return json + RandomSpace(random) + "}";
+}
+
+TEST(escapes_and_surrogates_decode_like_cjson) {
+    CHECK(MatchesCjson("{\"type\":\"tts\",\"state\":\"sentence_start\",\"text\":\"\\u4f60\\u597d\\uff01\"}", true));
+    CHECK(MatchesCjson("{\"type\":\"llm\",\"text\":\"\\ud83d\\ude0a\",\"emotion\":\"happy\"}", true));
+    CHECK(MatchesCjson("{\"type\":\"stt\",\"text\":\"\\\"a\\\\b\\/c\\b\\f\\n\\r\\t\\u00e9\\uDBFF\\uDFFF\"}", true));
+    CHECK(MatchesCjson("{\"type\":\"tts\",\"text\":\"\xf0\x9f\x98\x8a \xe4\xbd\xa0\"}", true));
+    CHECK(MatchesCjson("{\"type\":\"tts\",\"state\":\"\"}", true));
+
+    ControlMessageParser parser;
+    ControlMessage message;
+    std::string json = "{\"type\":\"llm\",\"emotion\":\"\\ud83e\\udd14\",\"text\":\"\\ud83e\\udd14\"}";
+    REQUIRE(parser.Parse(json.data(), json.size(), message));
+    CHECK(message.emotion == "\xf0\x9f\xa4\x94");
+    CHECK(message.text == message.emotion);
+    CHECK(message.text.data() != message.emotion.data());
+}
+
+TEST(bad_escapes_fall_back) {
+    // Lone or reversed surrogates, short and bad hex, unknown escapes: cJSON fails as well
+    for (const char* text : { "\\ud83d", "\\ud83dx", "\\ud83d\\u0041", "\\ude0a", "\\ude0a\\ud83d", "\\u12",
+            "\\u12g4", "\\x41", "\\" }) {
+        std::string json = std::string("{\"type\":\"tts\",\"text\":\"") + text + "\"}";
+        CHECK(MatchesCjson(json, false));
+        CHECK(cJSON_ParseWithLength(json.data(), json.size()) == nullptr);
+    }
+}
+
+TEST(keys_ignore_case_and_first_wins) {
+    CHECK(MatchesCjson("{\"Type\":\"tts\",\"STATE\":\"start\",\"state\":\"stop\",\"tExT\":\"a\",\"text\":\"b\"}",
+        true));
+    CHECK(MatchesCjson("{\"typ\\u0065\":\"tts\",\"stat\\u0045\":\"stop\",\"states\":\"x\",\"stat\":\"y\"}", true));
+
+    ControlMessageParser parser;
+    ControlMessage message;
+    std::string json = "{\"type\":\"tts\",\"State\":\"start\",\"state\":\"stop\"}";
+    REQUIRE(parser.Parse(json.data(), json.size(), message));
+    CHECK(message.state == "start");
+    CHECK(message.text.data() == nullptr);
+}
+
+TEST(other_messages_fall_back) {
+    for (const char* json : {
+            "{\"type\":\"mcp\",\"payload\":{\"type\":\"tts\"}}",
+            "{\"type\":\"hello\",\"transport\":\"websocket\"}",
+            "{\"type\":\"TTS\",\"state\":\"start\"}",
+            "{\"state\":\"start\"}",
+            "{\"type\":1}",
+            "{}",
+            "[\"type\",\"tts\"]",
+            // cJSON sees the first state, which is not a string
+            "{\"type\":\"tts\",\"state\":1,\"state\":\"start\"}",
+            "{\"type\":\"tts\",\"text\":null}",
+            "{\"type\":\"tts\" \"state\":\"start\"}",
+        }) {
+        CHECK(MatchesCjson(json, false));
+    }
+}
+
+TEST(long_text_is_a_view_or_falls_back) {
+    std::string text(4 * CONTROL_MESSAGE_SCRATCH_SIZE, 'a');
+    std::string json = "{\"type\":\"tts\",\"state\":\"sentence_start\",\"text\":\"" + text + "\"}";
+    ControlMessageParser parser;
+    ControlMessage message;
+    REQUIRE(parser.Parse(json.data(), json.size(), message));
+    CHECK(message.text == text);
+    CHECK(message.text.data() >= json.data() && message.text.data() < json.data() + json.size());
+
+    // Escaped text longer than the scratch buffer is left to cJSON
+    json = "{\"type\":\"tts\",\"text\":\"" + text + "\\n\"}";
+    CHECK(MatchesCjson(json, false));
+    json = "{\"type\":\"tts\",\"text\":\"" + text.substr(0, CONTROL_MESSAGE_SCRATCH_SIZE - 8) + "\\n\"}";
+    CHECK(MatchesCjson(json, true));
+}
+
+TEST(random_messages_match_cjson) {
+    std::mt19937 random(24);
+    int parsed = 0;
+    for (int i = 0; i < 3000; i++) {
+        auto json = RandomMessage(random);
+        bool ok = MatchesCjson(json, true);
+        if (!ok) {
+            printf("mismatch: %s\n", json.c_str());
+        }
+        CHECK(ok);
+        parsed += ok;
+    }
+    CHECK_EQ(parsed, 3000);
+}
+
+TEST(decoded_strings_are_exact) {
+    std::mt19937 random(7);
+    ControlMessageParser parser;
+    for (int i = 0; i < 1000; i++) {
+        std::string decoded;
+        auto text = RandomString(random, 100, &decoded);
+        auto json = "{\"type\":\"tts\",\"text\":" + text + "}";
+        ControlMessage message;
+        REQUIRE(parser.Parse(json.data(), json.size(), message));
+        CHECK(message.text == decoded);
+    }
+}
+
+TEST(truncated_messages_are_rejected) {
+    std::mt19937 random(11);
+    ControlMessageParser parser;
+    std::vector<char> buffer;
+    for (int i = 0; i < 300; i++) {
+        auto json = RandomMessage(random);
+        // The closing brace is the last byte, any prefix is incomplete
+        for (size_t length = 0; length < json.size(); length++) {
+            ControlMessage message;
+            CHECK(!Parse(parser, json, length, message, buffer));
+        }
+    }
+}
+
+HOST_TEST_MAIN()
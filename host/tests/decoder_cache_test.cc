@@ -0,0 +1,147 @@
+#include "decoder_cache.h"
+#include "host_test.h"
+
+TEST(repeated_format_reuses_the_decoder) {
+    DecoderCache cache("test");
+    cache.Configure(3, 24000);
+    auto entry = cache.Get(24000, 60);
+    REQUIRE(entry != nullptr);
+    void* decoder = entry->decoder;
+    CHECK(entry->resampler == nullptr);
+    CHECK_EQ(entry->frame_size, 1440);
+    for (int i = 0; i < 10; i++) {
+        CHECK(cache.Get(24000, 60) == entry);
+    }
+    CHECK(entry->decoder == decoder);
+    // The current decoder is not a format switch
+    auto stats = cache.GetStats();
+    CHECK_EQ(stats.entries, 1);
+    CHECK_EQ(stats.hits, 0);
+    CHECK_EQ(stats.misses, 1);
+    CHECK_EQ(HostOpusOpenDecoders(), 1);
+}
+
+TEST(switching_back_hits_the_open_decoder) {
+    DecoderCache cache("test");
+    cache.Configure(3, 24000);
+    auto speech = cache.Get(24000, 60);
+    REQUIRE(speech != nullptr);
+    void* speech_decoder = speech->decoder;
+    auto stream = cache.Get(48000, 20);
+    REQUIRE(stream != nullptr);
+    CHECK(stream->resampler != nullptr);
+    CHECK_EQ(stream->frame_size, 960);
+
+    // Speech, stream, speech...: every switch after the first two keeps both decoders and their state
+    for (int i = 0; i < 5; i++) {
+        CHECK(cache.Get(24000, 60) == speech);
+        CHECK(cache.Get(48000, 20) == stream);
+    }
+    CHECK(speech->decoder == speech_decoder);
+    auto stats = cache.GetStats();
+    CHECK_EQ(stats.entries, 2);
+    CHECK_EQ(stats.misses, 2);
+    CHECK_EQ(stats.hits, 10);
+    CHECK_EQ(stats.evictions, 0);
+    CHECK_EQ(HostOpusOpenDecoders(), 2);
+}
+
+TEST(least_recently_used_is_evicted) {
+    DecoderCache cache("test");
+    cache.Configure(2, 16000);
+    auto a = cache.Get(16000, 60);
+    auto b = cache.Get(24000, 60);
+    REQUIRE(a != nullptr && b != nullptr);
+    CHECK(cache.Get(16000, 60) == a);
+
+    // b is older than a, the third format takes its slot
+    auto c = cache.Get(48000, 20);
+    REQUIRE(c == b);
+    CHECK_EQ(c->sample_rate, 48000);
+    CHECK(c->resampler != nullptr);
+    auto stats = cache.GetStats();
+    CHECK_EQ(stats.entries, 2);
+    CHECK_EQ(stats.evictions, 1);
+    CHECK_EQ(HostOpusOpenDecoders(), 2);
+
+    // a was used before c, it goes next; the 24 kHz format opens again
+    CHECK(cache.Get(24000, 60) == a);
+    CHECK(cache.Get(48000, 20) == c);
+    stats = cache.GetStats();
+    CHECK_EQ(stats.misses, 4);
+    CHECK_EQ(stats.hits, 2);
+    CHECK_EQ(stats.evictions, 2);
+    CHECK_EQ(HostOpusOpenDecoders(), 2);
+}
+
+TEST(single_entry_switches_like_one_decoder) {
+    DecoderCache cache("test");
+    cache.Configure(1, 16000);
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(cache.Get(16000, 60) != nullptr);
+        REQUIRE(cache.Get(24000, 20) != nullptr);
+    }
+    auto stats = cache.GetStats();
+    CHECK_EQ(stats.entries, 1);
+    CHECK_EQ(stats.hits, 0);
+    CHECK_EQ(stats.misses, 8);
+    CHECK_EQ(stats.evictions, 7);
+    CHECK_EQ(HostOpusOpenDecoders(), 1);
+}
+
+TEST(entries_are_clamped) {
+    DecoderCache cache("test");
+    cache.Configure(100, 16000);
+    for (int rate : { 8000, 12000, 16000, 24000, 48000 }) {
+        REQUIRE(cache.Get(rate, 20) != nullptr);
+    }
+    CHECK_EQ(cache.GetStats().entries, DECODER_CACHE_MAX_ENTRIES);
+    CHECK_EQ(cache.GetStats().evictions, 1);
+    CHECK_EQ(HostOpusOpenDecoders(), DECODER_CACHE_MAX_ENTRIES);
+
+    cache.Configure(0, 16000);
+    CHECK_EQ(HostOpusOpenDecoders(), 0);
+    CHECK(cache.Get(16000, 20) != nullptr);
+    CHECK(cache.Get(24000, 20) != nullptr);
+    CHECK_EQ(cache.GetStats().entries, 1);
+}
+
+TEST(reset_keeps_the_decoders_open) {
+    DecoderCache cache("test");
+    cache.Configure(3, 16000);
+    auto a = cache.Get(16000, 60);
+    auto b = cache.Get(24000, 60);
+    REQUIRE(a != nullptr && b != nullptr);
+    uint32_t resets = HostOpusDecoderResets();
+    cache.Reset();
+    CHECK_EQ(HostOpusDecoderResets() - resets, 2);
+    CHECK(cache.Get(16000, 60) == a);
+    CHECK(cache.Get(24000, 60) == b);
+    CHECK_EQ(cache.GetStats().misses, 2);
+}
+
+TEST(open_failure_returns_null) {
+    DecoderCache cache("test");
+    cache.Configure(2, 16000);
+    REQUIRE(cache.Get(16000, 60) != nullptr);
+    // 30 ms is not an Opus frame duration
+    CHECK(cache.Get(16000, 30) == nullptr);
+    CHECK_EQ(cache.GetStats().entries, 1);
+    CHECK_EQ(HostOpusOpenDecoders(), 1);
+    CHECK(cache.Get(16000, 60) != nullptr);
+    CHECK_EQ(cache.GetStats().hits, 1);
+}
+
+TEST(destructor_closes_everything) {
+    {
+        DecoderCache cache("test");
+        cache.Configure(4, 16000);
+        cache.Get(16000, 60);
+        cache.Get(24000, 60);
+        cache.Get(48000, 60);
+        CHECK_EQ(HostOpusOpenDecoders(), 3);
+    }
+    CHECK_EQ(HostOpusOpenDecoders(), 0);
+}
+
+HOST_TEST_MAIN()
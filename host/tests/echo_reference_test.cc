@@ -0,0 +1,158 @@
+#include "echo_reference.h"
+#include "host_test.h"
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/*
+ * A simulated simplex board: the speaker plays white noise in 10 ms buffers written at their play
+ * time, and the microphone hears it delay_ms later at half level. Both sides run on one clock.
+ */
+struct EchoSimulation {
+    EchoReference reference;
+    std::mt19937 random{7};
+    std::vector<int16_t> played;    // 16 kHz timeline of what the speaker played
+    int64_t time_us = 1000000;
+    int output_rate = 16000;
+    int delay_ms = 100;
+    int channels = 1;
+    bool speaker_on = true;
+    std::vector<int16_t> last_mic;
+    std::vector<int16_t> last_feed;
+
+    void Run(int ms) {
+        for (int t = 0; t < ms; t += 10) {
+            Step();
+        }
+    }
+
+    void Step() {
+        size_t out_samples = output_rate / 100;
+        std::vector<int16_t> out(out_samples);
+        for (auto& sample : out) {
+            sample = speaker_on ? (int16_t)((int)(random() % 16001) - 8000) : 0;
+        }
+        if (speaker_on) {
+            reference.Write(out.data(), out.size(), output_rate, time_us);
+        }
+        // The 16 kHz view of the speaker, decimated the same way for 16 kHz (exact) and 32 kHz
+        for (size_t i = 0; i < 160; i++) {
+            played.push_back(out[i * out_samples / 160]);
+        }
+
+        // The read returns the 10 ms that just ended
+        time_us += 10000;
+        last_mic.assign(160 * channels, 0);
+        for (size_t i = 0; i < 160; i++) {
+            int64_t pos = (int64_t)played.size() - 160 + i - delay_ms * 16;
+            int16_t echo = pos >= 0 ? played[pos] / 2 : 0;
+            for (int c = 0; c < channels; c++) {
+                last_mic[i * channels + c] = c == 0 ? echo : (int16_t)(1000 + c);
+            }
+        }
+        last_feed.assign(160 * (channels + 1), 0);
+        reference.Interleave(last_mic.data(), 160, channels, last_feed.data(), time_us);
+    }
+};
+
+TEST(EstimatesTheEchoDelay) {
+    EchoSimulation simulation;
+    simulation.delay_ms = 100;
+    simulation.Run(4000);
+    auto stats = simulation.reference.GetStats();
+    CHECK(stats.locked);
+    CHECK(stats.estimates > 0);
+    // The reference leads the echo by ECHO_REFERENCE_LEAD_SAMPLES (2 ms)
+    CHECK(std::abs(stats.delay_ms - (100 - ECHO_REFERENCE_LEAD_SAMPLES / 16)) <= 1);
+}
+
+TEST(ReferenceChannelIsAlignedWithTheEcho) {
+    EchoSimulation simulation;
+    simulation.delay_ms = 80;
+    simulation.Run(4000);
+    REQUIRE(simulation.reference.GetStats().locked);
+
+    // After the lock the reference sample ECHO_REFERENCE_LEAD_SAMPLES ahead of the echo is the one
+    // that produced it, give or take the decimation step of the estimate
+    simulation.Step();
+    auto& feed = simulation.last_feed;
+    auto& mic = simulation.last_mic;
+    int best_offset = -1000;
+    int best_matches = 0;
+    for (int offset = 0; offset <= 2 * ECHO_REFERENCE_LEAD_SAMPLES; offset++) {
+        int matches = 0;
+        for (int i = 0; i + offset < 160; i++) {
+            matches += std::abs(feed[i * 2 + 1] / 2 - mic[i + offset]) <= 1;
+        }
+        if (matches > best_matches) {
+            best_matches = matches;
+            best_offset = offset;
+        }
+    }
+    CHECK(std::abs(best_offset - ECHO_REFERENCE_LEAD_SAMPLES) <= ECHO_REFERENCE_DECIMATION);
+    CHECK(best_matches >= 160 - 2 * ECHO_REFERENCE_LEAD_SAMPLES - ECHO_REFERENCE_DECIMATION);
+}
+
+TEST(ResampledOutputStillLocks) {
+    EchoSimulation simulation;
+    simulation.output_rate = 32000;
+    simulation.delay_ms = 150;
+    simulation.Run(4000);
+    auto stats = simulation.reference.GetStats();
+    CHECK(stats.locked);
+    CHECK(std::abs(stats.delay_ms - (150 - ECHO_REFERENCE_LEAD_SAMPLES / 16)) <= 1);
+}
+
+TEST(MicrophoneChannelsComeFirst) {
+    EchoSimulation simulation;
+    simulation.channels = 2;
+    simulation.Run(200);
+    auto& feed = simulation.last_feed;
+    auto& mic = simulation.last_mic;
+    bool layout = true;
+    for (size_t i = 0; i < 160; i++) {
+        layout = layout && feed[i * 3] == mic[i * 2] && feed[i * 3 + 1] == mic[i * 2 + 1];
+    }
+    CHECK(layout);
+}
+
+TEST(SilenceKeepsTheInitialDelay) {
+    EchoSimulation simulation;
+    simulation.speaker_on = false;
+    simulation.Run(3000);
+    auto stats = simulation.reference.GetStats();
+    CHECK(!stats.locked);
+    CHECK_EQ(stats.estimates, 0);
+    CHECK_EQ(stats.delay_ms, ECHO_REFERENCE_INITIAL_DELAY_MS);
+    // Nothing was played, the reference channel is silent
+    bool silent = true;
+    for (size_t i = 0; i < 160; i++) {
+        silent = silent && simulation.last_feed[i * 2 + 1] == 0;
+    }
+    CHECK(silent);
+}
+
+TEST(NewDelayNeedsTwoAgreeingEstimates) {
+    EchoSimulation simulation;
+    simulation.delay_ms = 60;
+    simulation.Run(3000);
+    REQUIRE(simulation.reference.GetStats().locked);
+    int first = simulation.reference.GetStats().delay_ms;
+
+    auto step_to_next_estimate = [&]() {
+        uint32_t estimates = simulation.reference.GetStats().estimates;
+        for (int i = 0; i < 200 && simulation.reference.GetStats().estimates == estimates; i++) {
+            simulation.Step();
+        }
+    };
+    // Change the path right at a window boundary, so the next window only sees the new delay
+    step_to_next_estimate();
+    simulation.delay_ms = 200;
+    step_to_next_estimate();
+    CHECK_EQ(simulation.reference.GetStats().delay_ms, first);
+    step_to_next_estimate();
+    CHECK(std::abs(simulation.reference.GetStats().delay_ms - (200 - ECHO_REFERENCE_LEAD_SAMPLES / 16)) <= 1);
+}
+
+HOST_TEST_MAIN()
@@ -0,0 +1,97 @@
+#include "encoder_controller.h"
+#include "host_test.h"
+
+// Feeds one 2 s interval of 60 ms frames, encoded at cpu_percent of the audio time
+static bool Interval(EncoderController& controller, int cpu_percent, uint32_t queue_ms = 0) {
+    bool changed = false;
+    int frames = (ENCODER_INTERVAL_MS + 59) / 60;
+    for (int i = 0; i < frames; i++) {
+        changed = controller.OnFrameEncoded(60, 60 * 10 * cpu_percent, queue_ms) || changed;
+    }
+    return changed;
+}
+
+static void Intervals(EncoderController& controller, int count, int cpu_percent, uint32_t queue_ms = 0) {
+    for (int i = 0; i < count; i++) {
+        Interval(controller, cpu_percent, queue_ms);
+    }
+}
+
+TEST(StartsAtTheBaseLevelAndClimbsWhenIdle) {
+    EncoderController controller;
+    controller.Configure(4);
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL);
+    Intervals(controller, ENCODER_GOOD_INTERVALS - 1, 10);
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL);
+    CHECK(Interval(controller, 10));
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL + 1);
+    Intervals(controller, 10 * ENCODER_GOOD_INTERVALS, 10);
+    CHECK_EQ(controller.GetStats().level, 4);
+}
+
+TEST(MaxLevelBoundsTheLadder) {
+    EncoderController controller;
+    controller.Configure(1);
+    CHECK_EQ(controller.GetStats().level, 1);
+    Intervals(controller, 10 * ENCODER_GOOD_INTERVALS, 10);
+    CHECK_EQ(controller.GetStats().level, 1);
+}
+
+TEST(CongestionStepsDown) {
+    EncoderController controller;
+    controller.Configure(4);
+    CHECK(Interval(controller, 10, ENCODER_CONGESTED_QUEUE_MS));
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL - 1);
+    controller.Configure(4);
+    CHECK(Interval(controller, 10, ENCODER_BACKLOG_QUEUE_MS));
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL - 2);
+    controller.Configure(4);
+    controller.OnSendFailed();
+    CHECK(Interval(controller, 10));
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL - 1);
+}
+
+TEST(SlowEncoderCapsTheLevelUntilRetried) {
+    EncoderController controller;
+    controller.Configure(4);
+    Intervals(controller, 2 * ENCODER_GOOD_INTERVALS, 10);
+    REQUIRE(controller.GetStats().level == 4);
+
+    CHECK(Interval(controller, ENCODER_BUSY_CPU_PERCENT));
+    CHECK_EQ(controller.GetStats().level, 3);
+    CHECK_EQ(controller.GetStats().ceiling, 3);
+    CHECK_EQ(controller.GetStats().max_level, 4);
+
+    // Good intervals do not climb past the cap until the retry
+    Intervals(controller, ENCODER_CEILING_RETRY_INTERVALS - 1, 10);
+    CHECK_EQ(controller.GetStats().level, 3);
+    CHECK_EQ(controller.GetStats().ceiling, 3);
+    Interval(controller, 10);
+    CHECK_EQ(controller.GetStats().ceiling, 4);
+    Intervals(controller, ENCODER_GOOD_INTERVALS, 10);
+    CHECK_EQ(controller.GetStats().level, 4);
+}
+
+TEST(ResetCeilingLiftsTheCapAtOnce) {
+    EncoderController controller;
+    controller.Configure(4);
+    Intervals(controller, 2 * ENCODER_GOOD_INTERVALS, 10);
+    Interval(controller, ENCODER_BUSY_CPU_PERCENT);
+    Interval(controller, ENCODER_BUSY_CPU_PERCENT);
+    CHECK_EQ(controller.GetStats().ceiling, ENCODER_BASE_LEVEL);
+
+    controller.ResetCeiling();
+    CHECK_EQ(controller.GetStats().ceiling, 4);
+    Intervals(controller, ENCODER_GOOD_INTERVALS, 10);
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL + 1);
+}
+
+TEST(SlowAtTheBaseLevelKeepsIt) {
+    EncoderController controller;
+    controller.Configure(4);
+    CHECK(!Interval(controller, 90));
+    CHECK_EQ(controller.GetStats().level, ENCODER_BASE_LEVEL);
+    CHECK_EQ(controller.GetStats().ceiling, 4);
+}
+
+HOST_TEST_MAIN()
@@ -0,0 +1,80 @@
+// A minimal test runner for the host tests: TEST(name) { CHECK(...); }, one binary per file
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+struct HostTestCase {
+    const char* name;
+    std::function<void()> function;
+};
+
+inline std::vector<HostTestCase>& HostTestCases() {
+    static std::vector<HostTestCase> cases;
+    return cases;
+}
+
+inline int& HostTestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct HostTestRegistrar {
+    HostTestRegistrar(const char* name, std::function<void()> function) {
+        HostTestCases().push_back({name, function});
+    }
+};
+
+// Integers of any signedness compare by value, a negative int is never equal to an unsigned one
+template <typename A, typename B>
+inline bool HostTestEqual(const A& a, const B& b) {
+    if constexpr (std::is_integral_v<A> && std::is_integral_v<B>) {
+        return (__int128)a == (__int128)b;
+    } else {
+        return a == b;
+    }
+}
+
+#define TEST(name)                                                          \
+    static void name();                                                     \
+    static HostTestRegistrar name##_registrar(#name, name);                 \
+    static void name()
+
+// Reports the failure and carries on with the test
+#define CHECK(condition) do {                                               \
+        if (!(condition)) {                                                 \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            HostTestFailures()++;                                           \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ(a, b) do {                                                 \
+        auto a_ = (a);                                                      \
+        auto b_ = (b);                                                      \
+        if (!HostTestEqual(a_, b_)) {                                       \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, \
+                (long long)a_, (long long)b_);                              \
+            HostTestFailures()++;                                           \
+        }                                                                   \
+    } while (0)
+
+// Ends the test on failure
+#define REQUIRE(condition) do {                                             \
+        if (!(condition)) {                                                 \
+            fprintf(stderr, "%s:%d: REQUIRE(%s) failed\n", __FILE__, __LINE__, #condition); \
+            HostTestFailures()++;                                           \
+            return;                                                         \
+        }                                                                   \
+    } while (0)
+
+#define HOST_TEST_MAIN()                                                    \
+    int main() {                                                            \
+        for (auto& test : HostTestCases()) {                                \
+            int failures = HostTestFailures();                              \
+            test.function();                                                \
+            printf("%s %s\n", HostTestFailures() == failures ? "PASS" : "FAIL", test.name); \
+        }                                                                   \
+        return HostTestFailures() == 0 ? 0 : 1;                             \
+    }
@@ -0,0 +1,74 @@
+#include "audio_service.h"
+#include "jitter_buffer.h"
+#include "wav_audio_codec.h"
+#include "host_test.h"
+
+#include <esp_log.h>
+#include <esp_opus_dec.h>
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+static std::unique_ptr<AudioStreamPacket> MakePacket(uint32_t sequence) {
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->sample_rate = 16000;
+    packet->frame_duration = 60;
+    packet->sequence = sequence;
+    packet->payload.assign(40, (uint8_t)(0x80 + sequence));
+    return packet;
+}
+
+TEST(conceal_passes_the_following_packet) {
+    JitterBuffer buffer;
+    for (uint32_t sequence : { 1, 2, 5 }) {
+        buffer.Put(MakePacket(sequence), 0);
+    }
+    JitterBuffer::Frame frame;
+    for (int i = 0; i < 2; i++) {
+        REQUIRE(buffer.Get(0, frame) == JitterBuffer::kPacket);
+    }
+    // 3 has nothing after it, 4 has 5
+    CHECK(buffer.Get(0, frame) == JitterBuffer::kConceal);
+    CHECK(frame.fec_source == nullptr);
+    CHECK(buffer.Get(0, frame) == JitterBuffer::kConceal);
+    REQUIRE(frame.fec_source != nullptr);
+    CHECK_EQ(frame.fec_source->sequence, 5);
+    CHECK(buffer.Get(0, frame) == JitterBuffer::kPacket);
+    CHECK_EQ(frame.packet->sequence, 5);
+    CHECK_EQ(buffer.GetStats().concealed, 2);
+}
+
+TEST(lost_frames_go_to_fec_or_plc) {
+    esp_log_level_set("*", ESP_LOG_WARN);
+    auto input = (std::filesystem::temp_directory_path() / "jitter_recovery_test_input.wav").string();
+    REQUIRE(WavAudioCodec::WriteTestSignal(input, 16000, 1));
+    // The service tasks are not joined on Stop(), the codec and service stay allocated until the process exits
+    auto codec = new WavAudioCodec(input, "", false);
+    REQUIRE(codec->ok());
+    auto service = new AudioService();
+    service->Initialize(codec);
+
+    // Queued before the decode task starts, so every packet is in the jitter buffer before the first
+    // Get(). 3 and 4 are lost, 3 is concealed with PLC and 4 with FEC from 5. 8 is lost, FEC from 9.
+    for (uint32_t sequence : { 1, 2, 5, 6, 7, 9, 10 }) {
+        REQUIRE(service->PushPacketToDecodeQueue(MakePacket(sequence)));
+    }
+    uint32_t plc_frames = HostOpusPlcFrames();
+    uint32_t fec_frames = HostOpusFecFrames();
+    service->Start();
+
+    int concealed = 0;
+    for (int i = 0; i < 300 && concealed < 3; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        cJSON* stats = service->GetStatsJson();
+        concealed = cJSON_GetObjectItem(cJSON_GetObjectItem(stats, "jitter_buffer"), "concealed")->valueint;
+        cJSON_Delete(stats);
+    }
+    service->Stop();
+    CHECK_EQ(concealed, 3);
+    CHECK_EQ(HostOpusPlcFrames() - plc_frames, 1);
+    CHECK_EQ(HostOpusFecFrames() - fec_frames, 2);
+}
+
+HOST_TEST_MAIN()
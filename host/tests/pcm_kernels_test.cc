@@ -0,0 +1,134 @@
+#include "pcm_kernels.h"
+#include "pcm_reference.h"
+#include "host_test.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Lengths around the unrolled blocks and the 16-sample vector blocks, at every alignment
+static const size_t kLengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 960, 1023};
+
+static std::vector<int16_t> RandomSamples(size_t count, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<int16_t> samples(count);
+    const int16_t extremes[] = {INT16_MIN, INT16_MIN + 1, -1, 0, 1, INT16_MAX - 1, INT16_MAX};
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = i % 5 == 0 ? extremes[random() % 7] : (int16_t)random();
+    }
+    return samples;
+}
+
+TEST(VolumeFactorMatchesPow) {
+    for (int volume = 0; volume <= 100; volume++) {
+        CHECK_EQ(pcm::VolumeFactor(volume), (int32_t)(pow(double(volume) / 100.0, 2) * 65536));
+    }
+    CHECK_EQ(pcm::VolumeFactor(-5), 0);
+    CHECK_EQ(pcm::VolumeFactor(150), 65536);
+}
+
+TEST(Int16ToInt32MatchesVolumeLoop) {
+    auto samples = RandomSamples(1100, 1);
+    for (int volume : {0, 1, 37, 70, 99, 100}) {
+        for (size_t length : kLengths) {
+            for (size_t offset = 0; offset < 4; offset++) {
+                std::vector<int32_t> expected(length), actual(length);
+                pcm_reference::Volume(samples.data() + offset, expected.data(), length, volume);
+                pcm::Int16ToInt32(samples.data() + offset, actual.data(), length, pcm::VolumeFactor(volume));
+                CHECK(actual == expected);
+            }
+        }
+    }
+}
+
+TEST(Int32ToInt16MatchesReadLoop) {
+    std::mt19937 random(2);
+    std::vector<int32_t> samples(1100);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = i % 7 == 0 ? (i % 2 ? INT32_MAX : INT32_MIN) : (int32_t)random();
+    }
+    for (size_t length : kLengths) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            std::vector<int16_t> expected(length), actual(length);
+            pcm_reference::Int32ToInt16(samples.data() + offset, expected.data(), length);
+            pcm::Int32ToInt16(samples.data() + offset, actual.data(), length, 12);
+            CHECK(actual == expected);
+        }
+    }
+}
+
+TEST(GainMatchesGainLoopInPlace) {
+    auto samples = RandomSamples(1100, 3);
+    for (int gain : {1, 2, 3, 10, 36, 100}) {
+        for (size_t length : kLengths) {
+            for (size_t offset = 0; offset < 4; offset++) {
+                std::vector<int16_t> expected(samples.begin() + offset, samples.begin() + offset + length);
+                std::vector<int16_t> actual = expected;
+                pcm_reference::Gain(expected.data(), length, gain);
+                pcm::Gain(actual.data(), actual.data(), length, gain);
+                CHECK(actual == expected);
+            }
+        }
+    }
+}
+
+TEST(TakeChannelMatchesStereoLoop) {
+    auto samples = RandomSamples(2200, 4);
+    for (size_t length : kLengths) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            const int16_t* stereo = samples.data() + offset;
+            std::vector<int16_t> expected(length), actual(length);
+            pcm_reference::LeftChannel(stereo, expected.data(), length);
+            pcm::TakeChannel(stereo, actual.data(), length, 2);
+            CHECK(actual == expected);
+
+            // Right channel: the reference loop shifted by one sample
+            pcm_reference::LeftChannel(stereo + 1, expected.data(), length);
+            pcm::TakeChannel(stereo, actual.data(), length, 2, 1);
+            CHECK(actual == expected);
+
+            // In place, as the input task and the AFSK demodulator call it
+            std::vector<int16_t> buffer(samples.begin() + offset, samples.begin() + offset + length * 2);
+            pcm_reference::LeftChannel(buffer.data(), expected.data(), length);
+            pcm::TakeChannel(buffer.data(), buffer.data(), length, 2);
+            CHECK(std::equal(expected.begin(), expected.end(), buffer.begin()));
+        }
+    }
+}
+
+TEST(TakeChannelOtherLayouts) {
+    auto samples = RandomSamples(4 * 100, 5);
+    for (size_t channels : {1, 3, 4}) {
+        for (size_t channel = 0; channel < channels; channel++) {
+            size_t frames = samples.size() / channels;
+            std::vector<int16_t> actual(frames);
+            pcm::TakeChannel(samples.data(), actual.data(), frames, channels, channel);
+            bool equal = true;
+            for (size_t i = 0; i < frames; i++) {
+                equal = equal && actual[i] == samples[i * channels + channel];
+            }
+            CHECK(equal);
+        }
+    }
+}
+
+TEST(ByteSwap16MatchesSwapLoop) {
+    auto samples = RandomSamples(1100, 6);
+    for (size_t length : kLengths) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            std::vector<uint16_t> expected(length), actual(length);
+            memcpy(expected.data(), samples.data() + offset, length * sizeof(uint16_t));
+            actual = expected;
+            pcm_reference::ByteSwap(expected.data(), length);
+            pcm::ByteSwap16(actual.data(), actual.data(), length);
+            CHECK(actual == expected);
+
+            // Out of place, from an address that is not 4-byte aligned for the odd offsets
+            std::vector<uint16_t> swapped(length);
+            pcm::ByteSwap16((const uint16_t*)samples.data() + offset, swapped.data(), length);
+            CHECK(swapped == expected);
+        }
+    }
+}
+
+HOST_TEST_MAIN()
@@ -0,0 +1,55 @@
+// The sample loops pcm_kernels replaced, as they were, for the equivalence test and the benchmark
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace pcm_reference {
+
+// NoAudioCodec::Write()
+inline void Volume(const int16_t* data, int32_t* buffer, size_t samples, int output_volume) {
+    int32_t volume_factor = pow(double(output_volume) / 100.0, 2) * 65536;
+    for (size_t i = 0; i < samples; i++) {
+        int64_t temp = int64_t(data[i]) * volume_factor;
+        if (temp > INT32_MAX) {
+            buffer[i] = INT32_MAX;
+        } else if (temp < INT32_MIN) {
+            buffer[i] = INT32_MIN;
+        } else {
+            buffer[i] = static_cast<int32_t>(temp);
+        }
+    }
+}
+
+// NoAudioCodec::Read()
+inline void Int32ToInt16(const int32_t* bit32_buffer, int16_t* dest, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t value = bit32_buffer[i] >> 12;
+        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+    }
+}
+
+// NoAudioCodec input gain
+inline void Gain(int16_t* dest, size_t samples, int gain_factor) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t amplified = dest[i] * gain_factor;
+        dest[i] = (amplified > INT16_MAX) ? INT16_MAX : (amplified < -INT16_MAX) ? -INT16_MAX : (int16_t)amplified;
+    }
+}
+
+// AudioService / AfskDemod stereo to left channel
+inline void LeftChannel(const int16_t* data, int16_t* mono, size_t frames) {
+    for (size_t i = 0, j = 0; i < frames; ++i, j += 2) {
+        mono[i] = data[j];
+    }
+}
+
+// LvglDisplay::SnapshotToJpeg()
+inline void ByteSwap(uint16_t* data, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        data[i] = __builtin_bswap16(data[i]);
+    }
+}
+
+} // namespace pcm_reference
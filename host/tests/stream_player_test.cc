@@ -0,0 +1,366 @@
+#include "stream_player.h"
+#include "audio_service.h"
+#include "wav_audio_codec.h"
+#include "host_test.h"
+
+#include <board.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define PACKET_MS 20
+#define PACKET_BYTES 200
+#define PAGE_PACKETS 5
+#define PAGE_MS (PACKET_MS * PAGE_PACKETS)
+
+// An Ogg/Opus file of 20 ms packets, 5 to a page, every packet within its page
+struct OggFile {
+    std::vector<uint8_t> data;
+    std::vector<size_t> page_offsets;   // Audio pages, the headers excluded
+    int duration_ms = 0;
+};
+
+static void WritePage(std::vector<uint8_t>& data, uint32_t sequence, uint8_t flags,
+    const std::vector<std::vector<uint8_t>>& packets) {
+    uint8_t header[27] = { 'O', 'g', 'g', 'S', 0, flags };
+    memcpy(header + 18, &sequence, 4);
+    header[26] = (uint8_t)packets.size();
+    data.insert(data.end(), header, header + 27);
+    for (auto& packet : packets) {
+        data.push_back((uint8_t)packet.size());
+    }
+    for (auto& packet : packets) {
+        data.insert(data.end(), packet.begin(), packet.end());
+    }
+}
+
+static OggFile WriteOggFile(int seconds) {
+    OggFile file;
+    std::vector<uint8_t> head(19, 0);
+    memcpy(head.data(), "OpusHead", 8);
+    head[8] = 1;
+    head[9] = 1;
+    uint32_t sample_rate = 16000;
+    memcpy(head.data() + 12, &sample_rate, 4);
+    WritePage(file.data, 0, 0x02, { head });
+    std::vector<uint8_t> tags(16, 0);
+    memcpy(tags.data(), "OpusTags", 8);
+    WritePage(file.data, 1, 0, { tags });
+
+    int pages = seconds * 1000 / PAGE_MS;
+    for (int page = 0; page < pages; page++) {
+        std::vector<std::vector<uint8_t>> packets;
+        for (int i = 0; i < PAGE_PACKETS; i++) {
+            // TOC 0x08: SILK, one 20 ms frame. The bytes above 0x7f never contain "OggS"
+            std::vector<uint8_t> packet(PACKET_BYTES, (uint8_t)(0x80 | ((page * PAGE_PACKETS + i) & 0x7f)));
+            packet[0] = 0x08;
+            packets.push_back(packet);
+        }
+        file.page_offsets.push_back(file.data.size());
+        WritePage(file.data, 2 + page, page + 1 == pages ? 0x04 : 0, packets);
+    }
+    file.duration_ms = pages * PAGE_MS;
+    return file;
+}
+
+// In-process HTTP server for one file, with Range support that can be turned off, a stall and a dropped connection
+struct HttpServer {
+    std::vector<uint8_t> file;
+    bool ranges = true;
+    int64_t stall_at = -1;          // Byte where the next read blocks for stall_ms, once
+    int stall_ms = 0;
+    int64_t drop_at = -1;           // Byte where the connection is lost, once
+
+    std::mutex mutex;
+    std::vector<int64_t> range_starts;  // Of every request, -1 without a Range header
+    std::vector<int> status_codes;
+    int64_t first_read_us = 0;
+    size_t served = 0;              // Highest byte delivered
+
+    void Reset(const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        file = data;
+        ranges = true;
+        stall_at = -1;
+        drop_at = -1;
+        range_starts.clear();
+        status_codes.clear();
+        first_read_us = 0;
+        served = 0;
+    }
+};
+
+static HttpServer server;
+
+class TestHttp : public Http {
+public:
+    void SetHeader(const std::string& key, const std::string& value) override {
+        if (key == "Range") {
+            range_start_ = std::stoll(value.substr(strlen("bytes=")));
+        }
+    }
+
+    bool Open(const std::string& method, const std::string& url) override {
+        std::lock_guard<std::mutex> lock(server.mutex);
+        server.range_starts.push_back(range_start_);
+        if (range_start_ >= 0 && server.ranges) {
+            status_code_ = 206;
+            position_ = range_start_;
+        } else {
+            status_code_ = 200;
+            position_ = 0;
+        }
+        server.status_codes.push_back(status_code_);
+        return true;
+    }
+
+    void Close() override {
+    }
+
+    int Read(char* buffer, size_t buffer_size) override {
+        std::unique_lock<std::mutex> lock(server.mutex);
+        if (server.first_read_us == 0) {
+            server.first_read_us = esp_timer_get_time();
+        }
+        size_t end = server.file.size();
+        if (server.drop_at >= 0 && (size_t)server.drop_at >= position_) {
+            if ((size_t)server.drop_at == position_) {
+                server.drop_at = -1;
+                return -1;
+            }
+            end = server.drop_at;
+        }
+        if (server.stall_at >= 0 && (size_t)server.stall_at <= position_) {
+            int stall_ms = server.stall_ms;
+            server.stall_at = -1;
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms));
+            lock.lock();
+        } else if (server.stall_at >= 0) {
+            end = std::min<size_t>(end, server.stall_at);
+        }
+        size_t size = std::min(buffer_size, end - position_);
+        memcpy(buffer, server.file.data() + position_, size);
+        position_ += size;
+        server.served = std::max(server.served, position_);
+        return size;
+    }
+
+    int GetStatusCode() override {
+        return status_code_;
+    }
+
+    size_t GetBodyLength() override {
+        std::lock_guard<std::mutex> lock(server.mutex);
+        return server.file.size() - position_;
+    }
+
+private:
+    int64_t range_start_ = -1;
+    int status_code_ = 0;
+    size_t position_ = 0;
+};
+
+class TestNetwork : public NetworkInterface {
+public:
+    std::unique_ptr<Http> CreateHttp(int connect_id) override {
+        return std::make_unique<TestHttp>();
+    }
+};
+
+static WavAudioCodec* codec = nullptr;
+
+class TestBoard : public Board {
+public:
+    AudioCodec* GetAudioCodec() override { return codec; }
+    NetworkInterface* GetNetwork() override { return &network_; }
+
+private:
+    TestNetwork network_;
+};
+
+DECLARE_BOARD(TestBoard)
+
+// One service and player for every test. The service tasks are not joined on Stop() and the player
+// task cannot be deleted on the host, so they stay allocated until the process exits.
+static StreamPlayer& GetPlayer() {
+    static StreamPlayer* player = nullptr;
+    if (player == nullptr) {
+        esp_log_level_set("*", ESP_LOG_WARN);
+        auto input = (std::filesystem::temp_directory_path() / "stream_player_test_input.wav").string();
+        WavAudioCodec::WriteTestSignal(input, 16000, 1);
+        codec = new WavAudioCodec(input, "", false);
+        auto service = new AudioService();
+        service->Initialize(codec);
+        service->Start();
+        player = new StreamPlayer(*service);
+        player->Hold(false);
+    }
+    return *player;
+}
+
+struct Status {
+    std::string state;
+    int64_t played_ms = 0;
+    int64_t underruns = 0;
+    int64_t underrun_ms = 0;
+    int64_t reconnects = 0;
+    int64_t skipped_packets = 0;
+};
+
+static Status GetStatus(StreamPlayer& player) {
+    cJSON* json = player.GetStatusJson();
+    Status status;
+    status.state = cJSON_GetObjectItem(json, "state")->valuestring;
+    status.played_ms = cJSON_GetObjectItem(json, "played_ms")->valuedouble;
+    status.underruns = cJSON_GetObjectItem(json, "underruns")->valuedouble;
+    status.underrun_ms = cJSON_GetObjectItem(json, "underrun_ms")->valuedouble;
+    status.reconnects = cJSON_GetObjectItem(json, "reconnects")->valuedouble;
+    status.skipped_packets = cJSON_GetObjectItem(json, "skipped_packets")->valuedouble;
+    cJSON_Delete(json);
+    return status;
+}
+
+static Status WaitStopped(StreamPlayer& player, int timeout_ms) {
+    for (int elapsed = 0; elapsed < timeout_ms; elapsed += 20) {
+        auto status = GetStatus(player);
+        if (status.state == "stopped") {
+            return status;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return GetStatus(player);
+}
+
+static int PageIndex(const OggFile& file, int64_t offset) {
+    for (size_t i = 0; i < file.page_offsets.size(); i++) {
+        if ((int64_t)file.page_offsets[i] == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Audio in the first bytes of the file, whole pages only
+static int AudioMs(const OggFile& file, size_t bytes) {
+    int pages = 0;
+    for (size_t i = 0; i < file.page_offsets.size(); i++) {
+        size_t end = i + 1 < file.page_offsets.size() ? file.page_offsets[i + 1] : file.data.size();
+        if (end <= bytes) {
+            pages++;
+        }
+    }
+    return pages * PAGE_MS;
+}
+
+TEST(prefetch_is_bounded) {
+    auto& player = GetPlayer();
+    auto file = WriteOggFile(3);
+    server.Reset(file.data);
+    REQUIRE(player.Play("http://host/prefetch.ogg"));
+
+    // The bytes read never hold more than the prefetch ahead of the player clock, plus the chunk being
+    // demuxed. The clock starts at the first read, give it 20 ms for the first packet.
+    int chunk_ms = STREAM_PLAYER_CHUNK_BYTES / (PACKET_BYTES + 1) * PACKET_MS + PAGE_MS;
+    int max_ahead_ms = -1000000;
+    while (GetStatus(player).state != "stopped") {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::lock_guard<std::mutex> lock(server.mutex);
+        if (server.first_read_us == 0) {
+            continue;
+        }
+        int elapsed_ms = (esp_timer_get_time() - server.first_read_us) / 1000;
+        int ahead_ms = AudioMs(file, server.served) - elapsed_ms;
+        max_ahead_ms = std::max(max_ahead_ms, ahead_ms);
+        CHECK(ahead_ms <= CONFIG_STREAM_PLAYER_PREFETCH_MS + chunk_ms + 20);
+    }
+    // And the prefetch is filled
+    CHECK(max_ahead_ms >= CONFIG_STREAM_PLAYER_PREFETCH_MS - PAGE_MS);
+
+    auto status = GetStatus(player);
+    CHECK_EQ(status.played_ms, file.duration_ms);
+    CHECK_EQ(status.underruns, 0);
+    CHECK_EQ(status.skipped_packets, 0);
+    CHECK_EQ(server.range_starts.size(), 1);
+}
+
+TEST(pause_resumes_from_the_page_being_heard) {
+    auto& player = GetPlayer();
+    auto file = WriteOggFile(3);
+    for (bool ranges : { true, false }) {
+        server.Reset(file.data);
+        server.ranges = ranges;
+        REQUIRE(player.Play("http://host/pause.ogg"));
+        while (GetStatus(player).played_ms < 1230) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        player.Pause();
+        // The session ends and adds the audio it played
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        int64_t paused_ms = GetStatus(player).played_ms;
+        player.Resume();
+        auto status = WaitStopped(player, 10000);
+        REQUIRE(status.state == "stopped");
+
+        std::lock_guard<std::mutex> lock(server.mutex);
+        REQUIRE(server.range_starts.size() == 2);
+        CHECK_EQ(server.range_starts[0], -1);
+        // The newest page whose first packet had started playing
+        int page = PageIndex(file, server.range_starts[1]);
+        CHECK_EQ(page, paused_ms / PAGE_MS);
+        CHECK_EQ(server.status_codes[1], ranges ? 206 : 200);
+        // What was heard of that page is heard again, nothing else
+        CHECK_EQ(status.played_ms, paused_ms + file.duration_ms - page * PAGE_MS);
+        CHECK(status.played_ms - file.duration_ms < PAGE_MS);
+        CHECK_EQ(status.underruns, 0);
+        CHECK_EQ(status.skipped_packets, 0);
+    }
+}
+
+TEST(dropped_connection_continues_at_the_same_byte) {
+    auto& player = GetPlayer();
+    auto file = WriteOggFile(3);
+    server.Reset(file.data);
+    // Inside a packet of the 11th page
+    server.drop_at = file.page_offsets[10] + 100;
+    REQUIRE(player.Play("http://host/drop.ogg"));
+    auto status = WaitStopped(player, 10000);
+    REQUIRE(status.state == "stopped");
+
+    std::lock_guard<std::mutex> lock(server.mutex);
+    REQUIRE(server.range_starts.size() == 2);
+    CHECK_EQ(server.range_starts[1], (int64_t)file.page_offsets[10] + 100);
+    CHECK_EQ(status.reconnects, 1);
+    CHECK_EQ(status.played_ms, file.duration_ms);
+    CHECK_EQ(status.underruns, 0);
+    CHECK_EQ(status.skipped_packets, 0);
+}
+
+TEST(stall_longer_than_the_prefetch_is_one_underrun) {
+    auto& player = GetPlayer();
+    auto file = WriteOggFile(3);
+    server.Reset(file.data);
+    // Past the prefetch, so the queue is full when the read blocks
+    const int stall_ms = 2000;
+    server.stall_at = file.page_offsets[20];
+    server.stall_ms = stall_ms;
+    REQUIRE(player.Play("http://host/stall.ogg"));
+    auto status = WaitStopped(player, 15000);
+    REQUIRE(status.state == "stopped");
+
+    CHECK_EQ(status.underruns, 1);
+    // The stall less the audio that was queued, the queue is refilled up to one packet over the prefetch
+    int expected_ms = stall_ms - CONFIG_STREAM_PLAYER_PREFETCH_MS;
+    CHECK(status.underrun_ms >= expected_ms - PACKET_MS - 20);
+    CHECK(status.underrun_ms <= expected_ms + 150);
+    CHECK_EQ(status.played_ms, file.duration_ms);
+    CHECK_EQ(status.reconnects, 0);
+}
+
+HOST_TEST_MAIN()
@@ -0,0 +1,134 @@
+#include "udp_audio_cipher.h"
+#include "host_test.h"
+
+#include <openssl/evp.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string RandomBytes(std::mt19937& random, size_t size) {
+    std::string bytes(size, 0);
+    for (auto& byte : bytes) {
+        byte = random();
+    }
+    return bytes;
+}
+
+// The datagram by the protocol description, encrypted with OpenSSL's own AES-128-CTR
+static std::string ReferenceDatagram(const std::string& key, std::string nonce, const std::string& data,
+    uint32_t timestamp, uint32_t sequence) {
+    nonce[2] = data.size() >> 8;
+    nonce[3] = data.size();
+    for (int i = 0; i < 4; i++) {
+        nonce[8 + i] = timestamp >> (24 - 8 * i);
+        nonce[12 + i] = sequence >> (24 - 8 * i);
+    }
+    std::string encrypted(data.size(), 0);
+    auto ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), nullptr, (const uint8_t*)key.data(), (const uint8_t*)nonce.data());
+    int size = 0;
+    EVP_EncryptUpdate(ctx, (uint8_t*)encrypted.data(), &size, (const uint8_t*)data.data(), data.size());
+    EVP_CIPHER_CTX_free(ctx);
+    return nonce + encrypted;
+}
+
+static std::string HelloNonce(std::mt19937& random) {
+    auto nonce = RandomBytes(random, UDP_AUDIO_NONCE_SIZE);
+    nonce[0] = 0x01;
+    return nonce;
+}
+
+TEST(datagrams_match_openssl_ctr) {
+    std::mt19937 random(22);
+    auto key = RandomBytes(random, 16);
+    auto nonce = HelloNonce(random);
+    UdpAudioCipher cipher;
+    REQUIRE(cipher.SetKey(key, nonce));
+    std::string datagram;
+    for (int i = 0; i < 1000; i++) {
+        // Empty (DTX) and sub-block packets, block edges and full Opus frames
+        size_t size = i < 40 ? i : random() % 1500;
+        auto data = RandomBytes(random, size);
+        uint32_t timestamp = random();
+        uint32_t sequence = i + 1;
+        REQUIRE(cipher.Encrypt((const uint8_t*)data.data(), size, timestamp, sequence, datagram));
+        CHECK(datagram == ReferenceDatagram(key, nonce, data, timestamp, sequence));
+    }
+}
+
+TEST(counter_carries_over_the_whole_block) {
+    // The counter is the whole nonce, a payload of several blocks after sequence 0xffffffff carries
+    // into the timestamp bytes, as in any AES-CTR implementation of the server
+    std::mt19937 random(5);
+    auto key = RandomBytes(random, 16);
+    auto nonce = HelloNonce(random);
+    UdpAudioCipher cipher;
+    REQUIRE(cipher.SetKey(key, nonce));
+    auto data = RandomBytes(random, 100);
+    std::string datagram;
+    for (uint32_t timestamp : { 0u, 0xffffffffu }) {
+        REQUIRE(cipher.Encrypt((const uint8_t*)data.data(), data.size(), timestamp, 0xffffffff, datagram));
+        CHECK(datagram == ReferenceDatagram(key, nonce, data, timestamp, 0xffffffff));
+    }
+}
+
+TEST(round_trip_keeps_the_datagram) {
+    std::mt19937 random(7);
+    auto key = RandomBytes(random, 16);
+    auto nonce = HelloNonce(random);
+    UdpAudioCipher send;
+    UdpAudioCipher recv;
+    REQUIRE(send.SetKey(key, nonce));
+    REQUIRE(recv.SetKey(key, nonce));
+    std::string datagram;
+    for (int i = 0; i < 200; i++) {
+        auto data = RandomBytes(random, random() % 400);
+        uint32_t timestamp = i * 60;
+        REQUIRE(send.Encrypt((const uint8_t*)data.data(), data.size(), timestamp, i + 1, datagram));
+        CHECK_EQ(UdpAudioCipher::Timestamp((const uint8_t*)datagram.data()), timestamp);
+        CHECK_EQ(UdpAudioCipher::Sequence((const uint8_t*)datagram.data()), i + 1);
+
+        // Decrypted twice: the counter is taken from the datagram and not advanced in it
+        std::string received = datagram;
+        for (int pass = 0; pass < 2; pass++) {
+            std::vector<uint8_t> payload(received.size() - UDP_AUDIO_NONCE_SIZE);
+            REQUIRE(recv.Decrypt((const uint8_t*)received.data(), received.size(), payload.data()));
+            CHECK(std::string(payload.begin(), payload.end()) == data);
+            CHECK(received == datagram);
+        }
+    }
+}
+
+TEST(packets_do_not_share_keystream_state) {
+    // A packet ending inside a block must not offset the next one
+    std::mt19937 random(9);
+    auto key = RandomBytes(random, 16);
+    auto nonce = HelloNonce(random);
+    UdpAudioCipher cipher;
+    REQUIRE(cipher.SetKey(key, nonce));
+    auto data = RandomBytes(random, 37);
+    std::string first;
+    std::string second;
+    REQUIRE(cipher.Encrypt((const uint8_t*)data.data(), data.size(), 1, 1, first));
+    REQUIRE(cipher.Encrypt((const uint8_t*)data.data(), 5, 1, 2, second));
+    REQUIRE(cipher.Encrypt((const uint8_t*)data.data(), data.size(), 1, 1, second));
+    CHECK(first == second);
+}
+
+TEST(rejects_bad_keys_and_short_datagrams) {
+    UdpAudioCipher cipher;
+    CHECK(!cipher.SetKey(std::string(15, 'k'), std::string(16, 'n')));
+    CHECK(!cipher.SetKey(std::string(16, 'k'), std::string(8, 'n')));
+    CHECK(!cipher.SetKey("", ""));
+    REQUIRE(cipher.SetKey(std::string(16, 'k'), std::string(16, 'n')));
+
+    uint8_t datagram[UDP_AUDIO_NONCE_SIZE] = { 0x01 };
+    uint8_t payload[1];
+    CHECK(!cipher.Decrypt(datagram, UDP_AUDIO_NONCE_SIZE - 1, payload));
+    // A nonce alone is an empty payload
+    CHECK(cipher.Decrypt(datagram, UDP_AUDIO_NONCE_SIZE, payload));
+}
+
+HOST_TEST_MAIN()
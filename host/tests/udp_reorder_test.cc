@@ -0,0 +1,174 @@
+#include "udp_reorder_window.h"
+#include "jitter_buffer.h"
+#include "host_test.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+static_assert(UDP_REORDER_WINDOW == JITTER_BUFFER_CAPACITY, "The window must match the jitter buffer");
+
+TEST(window_accepts_reordered_and_duplicates) {
+    UdpReorderWindow window;
+    CHECK(window.Accept(100));
+    CHECK_EQ(window.newest(), 100);
+    CHECK(window.Accept(102));
+    CHECK(window.Accept(101));
+    CHECK(window.Accept(101));
+    CHECK_EQ(window.newest(), 102);
+    CHECK(window.Accept(102 - (UDP_REORDER_WINDOW - 1)));
+    CHECK(!window.Accept(102 - UDP_REORDER_WINDOW));
+    CHECK(!window.Accept(1));
+    CHECK_EQ(window.newest(), 102);
+    // A jump ahead is accepted, the jitter buffer counts the gap
+    CHECK(window.Accept(500));
+    CHECK(!window.Accept(102));
+    window.Reset();
+    CHECK(window.Accept(3));
+    CHECK_EQ(window.newest(), 3);
+}
+
+TEST(window_wraps_around) {
+    UdpReorderWindow window;
+    CHECK(window.Accept(0xfffffffe));
+    CHECK(window.Accept(2));
+    CHECK_EQ(window.newest(), 2);
+    CHECK(window.Accept(0xffffffff));
+    CHECK_EQ(window.newest(), 2);
+    CHECK(!window.Accept(2 - UDP_REORDER_WINDOW));
+}
+
+struct Link {
+    double reorder;     // Held back 70-200 ms, overtaken by the following packets
+    double loss;
+    double duplicate;
+};
+
+struct Playout {
+    uint32_t played = 0;
+    uint32_t concealed = 0;
+    uint32_t dropped = 0;   // By the receive filter
+    JitterBufferStats stats;
+};
+
+// 3000 frames of 60 ms over the link, through the receive filter into the jitter buffer, played at the
+// frame rate as the decode task does
+static Playout Simulate(const Link& link, uint32_t seed, const std::function<bool(uint32_t)>& accept) {
+    const int frames = 3000;
+    const int64_t frame_us = 60000;
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::exponential_distribution<double> jitter(1 / 15000.0);
+
+    struct Arrival { int64_t time_us; uint32_t sequence; };
+    std::vector<Arrival> arrivals;
+    for (int i = 0; i < frames; i++) {
+        if (uniform(random) < link.loss) {
+            continue;
+        }
+        int64_t time_us = i * frame_us + 40000 + (int64_t)jitter(random);
+        if (uniform(random) < link.reorder) {
+            time_us += 70000 + random() % 130000;
+        }
+        arrivals.push_back({ time_us, (uint32_t)i + 1 });
+        if (uniform(random) < link.duplicate) {
+            arrivals.push_back({ time_us + (int64_t)(random() % 100000), (uint32_t)i + 1 });
+        }
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(), [](auto& a, auto& b) { return a.time_us < b.time_us; });
+
+    Playout playout;
+    JitterBuffer jitter_buffer;
+    size_t next = 0;
+    int64_t next_get_us = 0;
+    int64_t end_us = frames * frame_us + 2000000;
+    for (int64_t now = 0; now < end_us; now += 2000) {
+        for (; next < arrivals.size() && arrivals[next].time_us <= now; next++) {
+            if (!accept(arrivals[next].sequence)) {
+                playout.dropped++;
+                continue;
+            }
+            auto packet = std::make_unique<AudioStreamPacket>();
+            packet->sample_rate = 16000;
+            packet->frame_duration = 60;
+            packet->sequence = arrivals[next].sequence;
+            jitter_buffer.Put(std::move(packet), now);
+        }
+        if (now < next_get_us) {
+            continue;
+        }
+        JitterBuffer::Frame frame;
+        switch (jitter_buffer.Get(now, frame)) {
+          case JitterBuffer::kPacket:
+            playout.played++;
+            next_get_us = now + frame_us;
+            break;
+          case JitterBuffer::kConceal:
+            playout.concealed++;
+            next_get_us = now + frame_us;
+            break;
+          case JitterBuffer::kWait:
+            next_get_us = frame.release_time_us;
+            break;
+          case JitterBuffer::kEmpty:
+            break;
+        }
+    }
+    playout.stats = jitter_buffer.GetStats();
+    return playout;
+}
+
+static void Compare(const char* name, const Link& link, Playout& old_playout, Playout& new_playout) {
+    old_playout = Simulate(link, 23, [last = 0u](uint32_t sequence) mutable {
+        // Before: anything below the last sequence seen was dropped
+        if (sequence < last) {
+            return false;
+        }
+        last = sequence;
+        return true;
+    });
+    UdpReorderWindow window;
+    new_playout = Simulate(link, 23, [&window](uint32_t sequence) { return window.Accept(sequence); });
+    printf("%-40s played %u -> %u, concealed %u -> %u, reordered %u, late %u\n", name, old_playout.played,
+        new_playout.played, old_playout.concealed, new_playout.concealed, new_playout.stats.reordered,
+        new_playout.stats.late);
+}
+
+TEST(reordered_packets_are_played) {
+    Playout before, after;
+    Compare("5% reordering", { 0.05, 0, 0 }, before, after);
+    CHECK(after.played > before.played);
+    CHECK(after.concealed < before.concealed);
+    CHECK_EQ(after.dropped, 0);
+    CHECK(after.stats.reordered > 100);
+    // Without loss every frame plays, or arrived later than the adaptive depth and is counted late
+    CHECK_EQ(after.played + after.stats.late, 3000);
+}
+
+TEST(impaired_links_play_more) {
+    const Link links[] = { { 0.05, 0.03, 0.01 }, { 0.15, 0.08, 0.02 } };
+    const char* names[] = { "3% loss, 5% reordering, 1% duplicates", "8% loss, 15% reordering, 2% duplicates" };
+    for (int i = 0; i < 2; i++) {
+        Playout before, after;
+        Compare(names[i], links[i], before, after);
+        CHECK(after.played > before.played);
+        CHECK(after.concealed < before.concealed);
+        CHECK(after.stats.duplicates > 0);
+        // A duplicate never plays twice
+        CHECK(after.played <= 3000);
+    }
+}
+
+TEST(jitter_alone_reorders) {
+    // Arrival jitter alone lets a packet overtake the one before, the old filter dropped those
+    Playout before, after;
+    Compare("jitter only", { 0, 0, 0 }, before, after);
+    CHECK(before.played < 3000);
+    CHECK_EQ(after.played, 3000);
+    CHECK_EQ(after.concealed, 0);
+    CHECK_EQ(after.stats.late, 0);
+}
+
+HOST_TEST_MAIN()
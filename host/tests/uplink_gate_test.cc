@@ -0,0 +1,141 @@
+#include "uplink_gate.h"
+#include "host_test.h"
+
+#include <vector>
+
+/*
+ * The send callback stands in for the encode queue: it holds `room` frames, a frame is encoded
+ * (leaves the queue) on every Tick(), and a waiting push encodes one frame first.
+ */
+struct GateHarness {
+    UplinkGate gate;
+    size_t room = 100;
+    size_t queued = 0;
+    std::vector<int64_t> sent;      // Capture times in send order
+    int waits_this_frame = 0;
+    int max_waits_per_frame = 0;
+
+    explicit GateHarness(UplinkGatePolicy policy, int padding_ms = 200, int keepalive_ms = 0) {
+        gate.Configure(policy, padding_ms, keepalive_ms);
+        gate.OnSend([this](std::span<const int16_t> pcm, int64_t capture_time_us, bool wait) {
+            // Would deadlock if the gate still held its lock
+            gate.GetStats();
+            if (queued >= room) {
+                if (!wait) {
+                    return false;
+                }
+                waits_this_frame++;
+                queued--;
+            }
+            queued++;
+            sent.push_back(capture_time_us);
+            return true;
+        });
+        gate.Start();
+    }
+
+    // One 20 ms frame, its capture time is its index
+    void Frame(int64_t index, bool speaking, int encoded = 1) {
+        std::vector<int16_t> pcm(320, (int16_t)index);
+        waits_this_frame = 0;
+        gate.Process(pcm, index, speaking);
+        max_waits_per_frame = std::max(max_waits_per_frame, waits_this_frame);
+        queued -= std::min<size_t>(queued, encoded);
+    }
+};
+
+static bool InOrderWithoutGaps(const std::vector<int64_t>& sent, int64_t first, int64_t last) {
+    if (sent.size() != (size_t)(last - first + 1)) {
+        return false;
+    }
+    for (size_t i = 0; i < sent.size(); i++) {
+        if (sent[i] != first + (int64_t)i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(SendAllSendsEveryFrame) {
+    GateHarness harness(kUplinkGateSendAll);
+    for (int i = 0; i < 50; i++) {
+        harness.Frame(i, false);
+    }
+    CHECK(InOrderWithoutGaps(harness.sent, 0, 49));
+    CHECK_EQ(harness.gate.GetStats().sent_ms, 50 * 20);
+}
+
+TEST(PrerollGoesFirstOnSpeech) {
+    GateHarness harness(kUplinkGateSpeech, 200);
+    for (int i = 0; i < 30; i++) {
+        harness.Frame(i, false);
+    }
+    CHECK(harness.sent.empty());
+    harness.Frame(30, true);
+    // The 200 ms before the speech, then the speech frame
+    CHECK(InOrderWithoutGaps(harness.sent, 20, 30));
+    auto stats = harness.gate.GetStats();
+    CHECK_EQ(stats.sent_ms, 11 * 20);
+    CHECK_EQ(stats.dropped_ms, 20 * 20);
+}
+
+TEST(HoldsOpenForThePadding) {
+    GateHarness harness(kUplinkGateSpeech, 200);
+    harness.Frame(0, true);
+    for (int i = 1; i < 30; i++) {
+        harness.Frame(i, false);
+    }
+    // The speech frame and 200 ms after it
+    CHECK(InOrderWithoutGaps(harness.sent, 0, 10));
+    auto stats = harness.gate.Finish();
+    CHECK_EQ(stats.sent_ms, 11 * 20);
+    CHECK_EQ(stats.dropped_ms, 19 * 20);
+}
+
+TEST(BusyEncoderNeverHoldsTheCaptureForThePreroll) {
+    // Room for two frames: the 10 frame pre-roll cannot be pushed at once
+    GateHarness harness(kUplinkGateSpeech, 200);
+    harness.room = 2;
+    for (int i = 0; i < 30; i++) {
+        harness.Frame(i, false);
+    }
+    for (int i = 30; i < 60; i++) {
+        harness.Frame(i, true, 2);
+    }
+    // Each captured frame waited for at most one encode
+    CHECK(harness.max_waits_per_frame <= 1);
+    // The backlog drained in order and the live frames followed without a gap
+    CHECK(InOrderWithoutGaps(harness.sent, 20, 59));
+}
+
+TEST(BacklogOfAFinishedSessionIsDropped) {
+    GateHarness harness(kUplinkGateSpeech, 200);
+    harness.room = 1;
+    for (int i = 0; i < 30; i++) {
+        harness.Frame(i, false);
+    }
+    harness.Frame(30, true, 0);
+    size_t sent_in_session = harness.sent.size();
+    CHECK(sent_in_session < 11);
+    harness.gate.Finish();
+    harness.gate.Start();
+    harness.room = 100;
+    harness.Frame(100, true);
+    // Only the new session's frame, nothing left from the old pre-roll
+    CHECK_EQ(harness.sent.size(), sent_in_session + 1);
+    CHECK_EQ(harness.sent.back(), 100);
+}
+
+TEST(KeepaliveSendsOneFramePerInterval) {
+    GateHarness harness(kUplinkGateKeepalive, 100, 200);
+    for (int i = 0; i < 50; i++) {
+        harness.Frame(i, false);
+    }
+    CHECK_EQ(harness.gate.GetStats().keepalive_frames, 5);
+    CHECK_EQ(harness.sent.size(), 5);
+    for (size_t i = 1; i < harness.sent.size(); i++) {
+        CHECK_EQ(harness.sent[i] - harness.sent[i - 1], 10);
+    }
+}
+
+HOST_TEST_MAIN()
@@ -0,0 +1,186 @@
+#include "wav_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#define TAG "WavAudioCodec"
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmt_size;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    char data[4];
+    uint32_t data_size;
+};
+
+static WavHeader MakeHeader(int sample_rate, int channels, uint32_t data_size) {
+    WavHeader header;
+    memcpy(header.riff, "RIFF", 4);
+    header.riff_size = 36 + data_size;
+    memcpy(header.wave, "WAVE", 4);
+    memcpy(header.fmt, "fmt ", 4);
+    header.fmt_size = 16;
+    header.format = 1;
+    header.channels = channels;
+    header.sample_rate = sample_rate;
+    header.byte_rate = sample_rate * channels * 2;
+    header.block_align = channels * 2;
+    header.bits_per_sample = 16;
+    memcpy(header.data, "data", 4);
+    header.data_size = data_size;
+    return header;
+}
+
+WavAudioCodec::WavAudioCodec(const std::string& input_path, const std::string& output_path, bool realtime,
+    int output_sample_rate) : realtime_(realtime) {
+    duplex_ = true;
+    input_reference_ = false;
+
+    FILE* file = fopen(input_path.c_str(), "rb");
+    if (file == nullptr) {
+        ESP_LOGE(TAG, "Cannot open %s", input_path.c_str());
+        return;
+    }
+    /* Walk the chunks for "fmt " and "data" */
+    char riff[12];
+    uint16_t format = 0, channels = 0, bits_per_sample = 0;
+    uint32_t sample_rate = 0;
+    if (fread(riff, 1, 12, file) == 12 && memcmp(riff, "RIFF", 4) == 0 && memcmp(riff + 8, "WAVE", 4) == 0) {
+        char id[4];
+        uint32_t size;
+        while (fread(id, 1, 4, file) == 4 && fread(&size, 4, 1, file) == 1) {
+            if (memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+                uint8_t fmt[16];
+                fread(fmt, 1, 16, file);
+                memcpy(&format, fmt, 2);
+                memcpy(&channels, fmt + 2, 2);
+                memcpy(&sample_rate, fmt + 4, 4);
+                memcpy(&bits_per_sample, fmt + 14, 2);
+                fseek(file, size - 16 + (size & 1), SEEK_CUR);
+            } else if (memcmp(id, "data", 4) == 0) {
+                input_.resize(size / 2);
+                input_.resize(fread(input_.data(), 2, input_.size(), file));
+                break;
+            } else {
+                fseek(file, size + (size & 1), SEEK_CUR);
+            }
+        }
+    }
+    fclose(file);
+    if (format != 1 || bits_per_sample != 16 || (channels != 1 && channels != 2) || sample_rate == 0) {
+        ESP_LOGE(TAG, "%s is not a 16-bit mono or stereo PCM WAV file", input_path.c_str());
+        input_.clear();
+        return;
+    }
+    input_.resize(input_.size() / channels * channels);
+    input_channels_ = channels;
+    input_sample_rate_ = sample_rate;
+    output_sample_rate_ = output_sample_rate > 0 ? output_sample_rate : sample_rate;
+    output_channels_ = 1;
+
+    if (!output_path.empty()) {
+        output_file_ = fopen(output_path.c_str(), "wb");
+        if (output_file_ == nullptr) {
+            ESP_LOGE(TAG, "Cannot create %s", output_path.c_str());
+        } else {
+            WavHeader header = MakeHeader(output_sample_rate_, 1, 0);
+            fwrite(&header, sizeof(header), 1, output_file_);
+        }
+    }
+    ESP_LOGI(TAG, "%s: %d Hz, %d channels, %.1f s, output %d Hz%s", input_path.c_str(), input_sample_rate_,
+        input_channels_, (double)input_.size() / channels / sample_rate, output_sample_rate_,
+        realtime_ ? ", real time" : "");
+}
+
+WavAudioCodec::~WavAudioCodec() {
+    if (output_file_ != nullptr) {
+        WavHeader header = MakeHeader(output_sample_rate_, 1, output_frames_ * 2);
+        fseek(output_file_, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, output_file_);
+        fclose(output_file_);
+    }
+}
+
+void WavAudioCodec::Pace(int64_t& start_us, uint64_t frames, int sample_rate) {
+    /* Block until the frames handed over so far would have been played / captured */
+    int64_t now = esp_timer_get_time();
+    if (start_us == 0) {
+        start_us = now;
+    }
+    int64_t due = start_us + (int64_t)(frames * 1000000 / sample_rate);
+    if (due > now) {
+        std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+    }
+}
+
+int WavAudioCodec::Read(int16_t* dest, int samples) {
+    if (input_.empty()) {
+        return 0;
+    }
+    for (int i = 0; i < samples; i++) {
+        dest[i] = input_[input_position_];
+        input_position_ = (input_position_ + 1) % input_.size();
+    }
+    input_frames_ += samples / input_channels_;
+    if (realtime_) {
+        Pace(input_start_us_, input_frames_, input_sample_rate_);
+    }
+    return samples;
+}
+
+int WavAudioCodec::Write(const int16_t* data, int samples) {
+    if (output_file_ != nullptr) {
+        fwrite(data, 2, samples, output_file_);
+    }
+    output_frames_ += samples;
+    if (realtime_) {
+        Pace(output_start_us_, output_frames_, output_sample_rate_);
+    }
+    return samples;
+}
+
+bool WavAudioCodec::WriteWav(const std::string& path, int sample_rate, int channels, const std::vector<int16_t>& samples) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    WavHeader header = MakeHeader(sample_rate, channels, samples.size() * 2);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(samples.data(), 2, samples.size(), file);
+    fclose(file);
+    return true;
+}
+
+bool WavAudioCodec::WriteTestSignal(const std::string& path, int sample_rate, int seconds) {
+    /* 1.5 s of a tone gliding between 200 and 800 Hz with a syllable envelope, then 1 s of faint noise */
+    std::vector<int16_t> samples(sample_rate * seconds);
+    double phase = 0;
+    uint32_t noise = 1;
+    for (size_t i = 0; i < samples.size(); i++) {
+        double t = (double)i / sample_rate;
+        double cycle = fmod(t, 2.5);
+        noise = noise * 1664525 + 1013904223;
+        double value = ((int32_t)noise >> 20) / 16.0;
+        if (cycle < 1.5) {
+            double frequency = 500 + 300 * sin(2 * M_PI * 0.7 * t);
+            phase += 2 * M_PI * frequency / sample_rate;
+            double envelope = 0.5 - 0.5 * cos(2 * M_PI * cycle / 0.3);
+            value += 12000 * envelope * sin(phase);
+        }
+        samples[i] = (int16_t)value;
+    }
+    return WriteWav(path, sample_rate, 1, samples);
+}
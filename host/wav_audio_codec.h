@@ -0,0 +1,47 @@
+#ifndef _WAV_AUDIO_CODEC_H
+#define _WAV_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+/*
+ * An AudioCodec for the host build: the microphone reads a 16-bit PCM WAV file (looped) and the
+ * speaker writes one. In real time mode the reads and writes block like the I2S DMA does, otherwise
+ * they return at once so the pipeline runs as fast as its tasks can.
+ */
+class WavAudioCodec : public AudioCodec {
+public:
+    // output_path may be empty to discard the output, output_sample_rate 0 to use the input rate
+    WavAudioCodec(const std::string& input_path, const std::string& output_path, bool realtime,
+        int output_sample_rate = 0);
+    virtual ~WavAudioCodec();
+
+    bool ok() const { return !input_.empty(); }
+    uint64_t input_frames() const { return input_frames_; }
+    uint64_t output_frames() const { return output_frames_; }
+
+    // Writes a mono test signal: speech-like bursts of a swept tone with pauses, for the VAD and gate
+    static bool WriteTestSignal(const std::string& path, int sample_rate, int seconds);
+    static bool WriteWav(const std::string& path, int sample_rate, int channels, const std::vector<int16_t>& samples);
+
+private:
+    std::vector<int16_t> input_;
+    size_t input_position_ = 0;
+    FILE* output_file_ = nullptr;
+    bool realtime_;
+    int64_t input_start_us_ = 0;
+    int64_t output_start_us_ = 0;
+    std::atomic<uint64_t> input_frames_ = 0;
+    std::atomic<uint64_t> output_frames_ = 0;
+
+    void Pace(int64_t& start_us, uint64_t frames, int sample_rate);
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+};
+
+#endif // _WAV_AUDIO_CODEC_H
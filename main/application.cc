@@ -83,6 +83,13 @@ void Application::Initialize() {
     callbacks.on_vad_change = [this](bool speaking) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
+#if CONFIG_AUDIO_CHANNEL_PREWARM_ON_SPEECH
+    callbacks.on_speech_start = [this]() {
+        Schedule([this]() {
+            PrewarmAudioChannel();
+        });
+    };
+#endif
     audio_service_.SetCallbacks(callbacks);
 
     // Add state change listeners
@@ -219,9 +226,13 @@ void Application::Run() {
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+                int64_t origin_time = packet->origin_time_us;
+                int64_t pop_time = packet->stage_time_us;
                 if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
+                    audio_service_.RecordPacketSendFailed();
                     break;
                 }
+                audio_service_.RecordPacketSent(origin_time, pop_time);
             }
         }
 
@@ -254,6 +265,10 @@ void Application::Run() {
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
             }
+            // Audio latency per stage every minute, only printed when audio flowed
+            if (clock_ticks_ % 60 == 0) {
+                audio_service_.LogLatency();
+            }
         }
     }
 }
@@ -513,53 +528,34 @@ void Application::InitializeProtocol() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
+#if CONFIG_AUDIO_CHANNEL_PREWARM
+            // A follow-up question is likely, keep a connection ready for it
+            Schedule([this]() {
+                PrewarmAudioChannel();
+            });
+#endif
         });
     });
     
+    protocol_->OnIncomingControl([this](const ControlMessage& message) {
+        HandleControlMessage(message);
+    });
     protocol_->OnIncomingJson([this, display](const cJSON* root) {
         // Parse JSON data
         auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    SetDeviceState(kDeviceStateSpeaking);
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (GetDeviceState() == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
-                }
-            }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
-            }
+        if (strcmp(type->valuestring, "tts") == 0 || strcmp(type->valuestring, "stt") == 0 ||
+                strcmp(type->valuestring, "llm") == 0) {
+            // Left by the fast path, e.g. a text too long to decode in its scratch buffer
+            auto string_field = [root](const char* name) {
+                auto item = cJSON_GetObjectItem(root, name);
+                return cJSON_IsString(item) ? std::string_view(item->valuestring) : std::string_view();
+            };
+            ControlMessage message;
+            message.type = type->valuestring;
+            message.state = string_field("state");
+            message.text = string_field("text");
+            message.emotion = string_field("emotion");
+            HandleControlMessage(message);
         } else if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
             if (cJSON_IsObject(payload)) {
@@ -607,6 +603,46 @@ void Application::InitializeProtocol() {
     protocol_->Start();
 }
 
+void Application::HandleControlMessage(const ControlMessage& message) {
+    auto display = Board::GetInstance().GetDisplay();
+    if (message.type == "tts") {
+        if (message.state == "start") {
+            Schedule([this]() {
+                aborted_ = false;
+                SetDeviceState(kDeviceStateSpeaking);
+            });
+        } else if (message.state == "stop") {
+            Schedule([this]() {
+                if (GetDeviceState() == kDeviceStateSpeaking) {
+                    if (listening_mode_ == kListeningModeManualStop) {
+                        SetDeviceState(kDeviceStateIdle);
+                    } else {
+                        SetDeviceState(kDeviceStateListening);
+                    }
+                }
+            });
+        } else if (message.state == "sentence_start" && message.text.data() != nullptr) {
+            ESP_LOGI(TAG, "<< %.*s", (int)message.text.size(), message.text.data());
+            Schedule([display, text = std::string(message.text)]() {
+                display->SetChatMessage("assistant", text.c_str());
+            });
+        }
+    } else if (message.type == "stt") {
+        if (message.text.data() != nullptr) {
+            ESP_LOGI(TAG, ">> %.*s", (int)message.text.size(), message.text.data());
+            Schedule([display, text = std::string(message.text)]() {
+                display->SetChatMessage("user", text.c_str());
+            });
+        }
+    } else if (message.type == "llm") {
+        if (message.emotion.data() != nullptr) {
+            Schedule([display, emotion = std::string(message.emotion)]() {
+                display->SetEmotion(emotion.c_str());
+            });
+        }
+    }
+}
+
 void Application::ShowActivationCode(const std::string& code, const std::string& message) {
     struct digit_sound {
         char digit;
@@ -781,6 +817,7 @@ void Application::HandleWakeWordDetectedEvent() {
     ESP_LOGI(TAG, "Wake word detected: %s (state: %d)", wake_word.c_str(), (int)state);
 
     if (state == kDeviceStateIdle) {
+        wake_word_time_ = esp_timer_get_time();
         audio_service_.EncodeWakeWord();
         auto wake_word = audio_service_.GetLastWakeWord();
 
@@ -830,7 +867,8 @@ void Application::ContinueWakeWordInvoke(const std::string& wake_word) {
         }
     }
 
-    ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
+    ESP_LOGI(TAG, "Wake word detected: %s, audio channel open after %ld ms", wake_word.c_str(),
+        (long)((esp_timer_get_time() - wake_word_time_) / 1000));
 #if CONFIG_SEND_WAKE_WORD_DATA
     // Encode and send the wake word data to the server
     while (auto packet = audio_service_.PopWakeWordPacket()) {
@@ -850,6 +888,22 @@ void Application::ContinueWakeWordInvoke(const std::string& wake_word) {
 #endif
 }
 
+#if CONFIG_AUDIO_CHANNEL_PREWARM
+void Application::PrewarmAudioChannel() {
+    if (!protocol_ || GetDeviceState() != kDeviceStateIdle || protocol_->IsAudioChannelOpened()) {
+        return;
+    }
+    // The connect runs in the background, a failed one is reported by the next call. Wait before trying again.
+    int64_t now = esp_timer_get_time();
+    if (now < prewarm_retry_time_) {
+        return;
+    }
+    if (!protocol_->Prewarm()) {
+        prewarm_retry_time_ = now + CONFIG_AUDIO_CHANNEL_WARM_SECONDS * 1000000LL;
+    }
+}
+#endif
+
 void Application::HandleStateChangedEvent() {
     DeviceState new_state = state_machine_.GetState();
     clock_ticks_ = 0;
@@ -858,6 +912,11 @@ void Application::HandleStateChangedEvent() {
     auto display = board.GetDisplay();
     auto led = board.GetLed();
     led->OnStateChanged();
+
+#if CONFIG_USE_STREAM_PLAYER
+    // Streamed audio plays between conversations, it resumes where it was when the device is idle again
+    stream_player_.Hold(new_state != kDeviceStateIdle);
+#endif
     
     switch (new_state) {
         case kDeviceStateUnknown:
@@ -1022,6 +1081,7 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
+        wake_word_time_ = esp_timer_get_time();
         audio_service_.EncodeWakeWord();
 
         if (!protocol_->IsAudioChannelOpened()) {
@@ -1060,6 +1120,12 @@ bool Application::CanEnterSleepMode() {
         return false;
     }
 
+#if CONFIG_USE_STREAM_PLAYER
+    if (stream_player_.IsActive()) {
+        return false;
+    }
+#endif
+
     // Now it is safe to enter sleep mode
     return true;
 }
@@ -17,6 +17,10 @@
 #include "device_state.h"
 #include "device_state_machine.h"
 
+#if CONFIG_USE_STREAM_PLAYER
+#include "stream_player.h"
+#endif
+
 // Main event bits
 #define MAIN_EVENT_SCHEDULE             (1 << 0)
 #define MAIN_EVENT_SEND_AUDIO           (1 << 1)
@@ -112,6 +116,9 @@ public:
     AecMode GetAecMode() const { return aec_mode_; }
     void PlaySound(const std::string_view& sound);
     AudioService& GetAudioService() { return audio_service_; }
+#if CONFIG_USE_STREAM_PLAYER
+    StreamPlayer& GetStreamPlayer() { return stream_player_; }
+#endif
     
     /**
      * Reset protocol resources (thread-safe)
@@ -134,12 +141,19 @@ private:
     AecMode aec_mode_ = kAecOff;
     std::string last_error_message_;
     AudioService audio_service_;
+#if CONFIG_USE_STREAM_PLAYER
+    StreamPlayer stream_player_{audio_service_};
+#endif
     std::unique_ptr<Ota> ota_;
 
     bool has_server_time_ = false;
     bool aborted_ = false;
     bool assets_version_checked_ = false;
     bool play_popup_on_listening_ = false;  // Flag to play popup sound after state changes to listening
+    int64_t wake_word_time_ = 0;   // Wake word heard while idle, for the wake to channel open latency
+#if CONFIG_AUDIO_CHANNEL_PREWARM
+    int64_t prewarm_retry_time_ = 0;
+#endif
     int clock_ticks_ = 0;
     TaskHandle_t activation_task_handle_ = nullptr;
 
@@ -153,8 +167,12 @@ private:
     void HandleNetworkDisconnectedEvent();
     void HandleActivationDoneEvent();
     void HandleWakeWordDetectedEvent();
+    void HandleControlMessage(const ControlMessage& message);
     void ContinueOpenAudioChannel(ListeningMode mode);
     void ContinueWakeWordInvoke(const std::string& wake_word);
+#if CONFIG_AUDIO_CHANNEL_PREWARM
+    void PrewarmAudioChannel();
+#endif
 
     // Activation task (runs in background)
     void ActivationTask();
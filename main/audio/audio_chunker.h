@@ -0,0 +1,99 @@
+#ifndef AUDIO_CHUNKER_H
+#define AUDIO_CHUNKER_H
+
+#include <span>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "audio_scratch.h"
+#include "pcm_kernels.h"
+
+/*
+ * Cuts a stream of input frames into the fixed chunks an engine wants (AFE feed chunk, multinet
+ * sample chunk) without shifting the remaining samples after every chunk.
+ *
+ * Chunks that lie entirely inside the input are passed as a view of the input itself. Only the
+ * chunk that straddles two inputs is assembled in a carry buffer reserved once in Configure().
+ * With step > 1 every step-th sample is kept (left channel of interleaved stereo), which always
+ * goes through the carry buffer.
+ *
+ * Not thread safe, the owner serializes Feed() and Clear().
+ */
+class AudioChunker {
+public:
+    void Configure(size_t chunk_samples, size_t step = 1) {
+        chunk_samples_ = chunk_samples;
+        step_ = step > 0 ? step : 1;
+        carry_.Reserve(chunk_samples);
+        fill_ = 0;
+    }
+
+    void Clear() { fill_ = 0; }
+
+    size_t chunk_samples() const { return chunk_samples_; }
+    size_t pending() const { return fill_; }
+
+    // Calls on_chunk(std::span<const int16_t>) for each complete chunk, the view is only valid during the call.
+    // on_chunk returns false to stop, the rest of the input and the pending samples are dropped.
+    template <typename F>
+    void Feed(std::span<const int16_t> data, F&& on_chunk) {
+        if (chunk_samples_ == 0 || carry_.data() == nullptr) {
+            return;
+        }
+        if (step_ > 1) {
+            FeedStrided(data, on_chunk);
+            return;
+        }
+
+        size_t offset = 0;
+        if (fill_ > 0) {
+            size_t n = std::min(chunk_samples_ - fill_, data.size());
+            memcpy(carry_.data() + fill_, data.data(), n * sizeof(int16_t));
+            fill_ += n;
+            offset = n;
+            if (fill_ < chunk_samples_) {
+                return;
+            }
+            fill_ = 0;
+            if (!on_chunk(std::span<const int16_t>(carry_.data(), chunk_samples_))) {
+                return;
+            }
+        }
+        while (data.size() - offset >= chunk_samples_) {
+            if (!on_chunk(data.subspan(offset, chunk_samples_))) {
+                return;
+            }
+            offset += chunk_samples_;
+        }
+        fill_ = data.size() - offset;
+        memcpy(carry_.data(), data.data() + offset, fill_ * sizeof(int16_t));
+    }
+
+private:
+    AudioScratch<int16_t> carry_;
+    size_t chunk_samples_ = 0;
+    size_t step_ = 1;
+    size_t fill_ = 0;
+
+    template <typename F>
+    void FeedStrided(std::span<const int16_t> data, F& on_chunk) {
+        int16_t* carry = carry_.data();
+        size_t frames = data.size() / step_;
+        size_t offset = 0;
+        while (offset < frames) {
+            size_t n = std::min(chunk_samples_ - fill_, frames - offset);
+            pcm::TakeChannel(data.data() + offset * step_, carry + fill_, n, step_);
+            fill_ += n;
+            offset += n;
+            if (fill_ == chunk_samples_) {
+                fill_ = 0;
+                if (!on_chunk(std::span<const int16_t>(carry, chunk_samples_))) {
+                    return;
+                }
+            }
+        }
+    }
+};
+
+#endif // AUDIO_CHUNKER_H
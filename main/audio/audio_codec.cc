@@ -14,16 +14,16 @@ AudioCodec::AudioCodec() {
 AudioCodec::~AudioCodec() {
 }
 
-void AudioCodec::OutputData(std::vector<int16_t>& data) {
+void AudioCodec::OutputData(std::span<const int16_t> data) {
     Write(data.data(), data.size());
 }
 
 bool AudioCodec::InputData(std::vector<int16_t>& data) {
-    int samples = Read(data.data(), data.size());
-    if (samples > 0) {
-        return true;
-    }
-    return false;
+    return InputData(data.data(), data.size());
+}
+
+bool AudioCodec::InputData(int16_t* data, int samples) {
+    return Read(data, samples) > 0;
 }
 
 void AudioCodec::Start() {
@@ -6,6 +6,7 @@
 #include <driver/i2s_std.h>
 
 #include <vector>
+#include <span>
 #include <string>
 #include <functional>
 
@@ -24,8 +25,9 @@ public:
     virtual void EnableInput(bool enable);
     virtual void EnableOutput(bool enable);
 
-    virtual void OutputData(std::vector<int16_t>& data);
+    virtual void OutputData(std::span<const int16_t> data);
     virtual bool InputData(std::vector<int16_t>& data);
+    virtual bool InputData(int16_t* data, int samples);
     virtual void Start();
 
     inline bool duplex() const { return duplex_; }
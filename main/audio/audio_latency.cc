@@ -0,0 +1,182 @@
+#include "audio_latency.h"
+
+#include <esp_log.h>
+#include <cinttypes>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+
+#define TAG "AudioLatency"
+
+namespace {
+
+struct BucketBounds {
+    uint32_t upper_us[LATENCY_HISTOGRAM_BUCKETS];
+
+    BucketBounds() {
+        double bound = LATENCY_HISTOGRAM_MIN_US;
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+            upper_us[i] = (uint32_t)bound;
+            bound *= 1.189207115;   // 2^(1/4)
+        }
+        upper_us[LATENCY_HISTOGRAM_BUCKETS - 1] = UINT32_MAX;
+    }
+};
+
+const BucketBounds bucket_bounds;
+
+const char* const stage_names[kLatencyStageCount] = {
+    "process", "encode", "send_queue", "send", "total",
+    "decode", "playback_queue", "output", "total",
+};
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() {
+    Clear(banks_[0]);
+    Clear(banks_[1]);
+}
+
+void LatencyHistogram::Clear(Bank& bank) {
+    for (auto& bucket : bank.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    bank.count.store(0, std::memory_order_relaxed);
+    bank.sum_16us.store(0, std::memory_order_relaxed);
+    bank.min_us.store(UINT32_MAX, std::memory_order_relaxed);
+    bank.max_us.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Record(uint32_t us) {
+    auto& bank = banks_[active_.load(std::memory_order_relaxed) & 1];
+    auto bucket = std::upper_bound(bucket_bounds.upper_us, bucket_bounds.upper_us + LATENCY_HISTOGRAM_BUCKETS - 1, us) -
+        bucket_bounds.upper_us;
+    bank.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    bank.count.fetch_add(1, std::memory_order_relaxed);
+    bank.sum_16us.fetch_add(us >> 4, std::memory_order_relaxed);
+
+    uint32_t current = bank.min_us.load(std::memory_order_relaxed);
+    while (us < current && !bank.min_us.compare_exchange_weak(current, us, std::memory_order_relaxed)) {
+    }
+    current = bank.max_us.load(std::memory_order_relaxed);
+    while (us > current && !bank.max_us.compare_exchange_weak(current, us, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::Rotate() {
+    uint32_t next = (active_.load(std::memory_order_relaxed) + 1) & 1;
+    Clear(banks_[next]);
+    active_.store(next, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Summary LatencyHistogram::GetSummary() const {
+    Summary summary = {};
+    summary.min_us = UINT32_MAX;
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS] = {};
+    uint64_t sum_16us = 0;
+    for (auto& bank : banks_) {
+        for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] += bank.buckets[i].load(std::memory_order_relaxed);
+        }
+        summary.count += bank.count.load(std::memory_order_relaxed);
+        sum_16us += bank.sum_16us.load(std::memory_order_relaxed);
+        summary.min_us = std::min(summary.min_us, bank.min_us.load(std::memory_order_relaxed));
+        summary.max_us = std::max(summary.max_us, bank.max_us.load(std::memory_order_relaxed));
+    }
+    if (summary.count == 0) {
+        summary.min_us = 0;
+        return summary;
+    }
+    summary.avg_us = sum_16us * 16 / summary.count;
+
+    uint32_t rank = (summary.count * 95 + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            summary.p95_us = std::min(bucket_bounds.upper_us[i], summary.max_us);
+            break;
+        }
+    }
+    return summary;
+}
+
+void CaptureClock::Mark(size_t frames, int64_t time_us) {
+    uint32_t end = frames_.load(std::memory_order_relaxed) + frames;
+    uint32_t count = count_.load(std::memory_order_relaxed);
+    auto& mark = marks_[count % CAPTURE_CLOCK_MARKS];
+    mark.time_us.store((uint32_t)time_us, std::memory_order_relaxed);
+    mark.end.store(end, std::memory_order_release);
+    frames_.store(end, std::memory_order_relaxed);
+    count_.store(count + 1, std::memory_order_release);
+}
+
+int64_t CaptureClock::Lookup(uint32_t frame, int64_t now_us) const {
+    uint32_t count = count_.load(std::memory_order_acquire);
+    uint32_t marks = std::min<uint32_t>(count, CAPTURE_CLOCK_MARKS);
+    int64_t found = 0;
+    // Newest to oldest, the read holding the frame is the oldest one that ends after it
+    for (uint32_t k = 0; k < marks; k++) {
+        auto& mark = marks_[(count - 1 - k) % CAPTURE_CLOCK_MARKS];
+        uint32_t end = mark.end.load(std::memory_order_acquire);
+        if ((int32_t)(end - frame) <= 0) {
+            return found;
+        }
+        uint32_t age_us = (uint32_t)now_us - mark.time_us.load(std::memory_order_relaxed);
+        found = now_us - age_us;
+    }
+    // In the first read since boot, or older than every mark still held
+    return count <= CAPTURE_CLOCK_MARKS ? found : 0;
+}
+
+void AudioLatency::Record(AudioLatencyStage stage, int64_t from_us, int64_t to_us) {
+    if (from_us <= 0 || to_us < from_us) {
+        return;
+    }
+    stages_[stage].Record((uint32_t)std::min<int64_t>(to_us - from_us, UINT32_MAX));
+}
+
+void AudioLatency::Rotate() {
+    for (auto& stage : stages_) {
+        stage.Rotate();
+    }
+}
+
+cJSON* AudioLatency::GetJson() const {
+    cJSON* json = cJSON_CreateObject();
+    cJSON* uplink = cJSON_CreateObject();
+    cJSON* downlink = cJSON_CreateObject();
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto summary = stages_[i].GetSummary();
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "count", summary.count);
+        cJSON_AddNumberToObject(stage, "min_ms", summary.min_us / 1000.0);
+        cJSON_AddNumberToObject(stage, "avg_ms", summary.avg_us / 1000.0);
+        cJSON_AddNumberToObject(stage, "p95_ms", summary.p95_us / 1000.0);
+        cJSON_AddNumberToObject(stage, "max_ms", summary.max_us / 1000.0);
+        cJSON_AddItemToObject(i <= kLatencyStageUplink ? uplink : downlink, stage_names[i], stage);
+    }
+    cJSON_AddItemToObject(json, "uplink", uplink);
+    cJSON_AddItemToObject(json, "downlink", downlink);
+    return json;
+}
+
+void AudioLatency::Log() const {
+    const AudioLatencyStage directions[][2] = {
+        {kLatencyStageProcess, kLatencyStageUplink},
+        {kLatencyStageDecode, kLatencyStageDownlink},
+    };
+    for (auto& direction : directions) {
+        if (stages_[direction[1]].GetSummary().count == 0) {
+            continue;
+        }
+        char line[256];
+        int length = 0;
+        for (int i = direction[0]; i <= direction[1] && length < (int)sizeof(line); i++) {
+            auto summary = stages_[i].GetSummary();
+            length += snprintf(line + length, sizeof(line) - length, " %s %" PRIu32 "/%" PRIu32 "/%" PRIu32, stage_names[i],
+                summary.avg_us / 1000, summary.p95_us / 1000, summary.max_us / 1000);
+        }
+        ESP_LOGI(TAG, "%s avg/p95/max ms:%s", direction[0] == kLatencyStageProcess ? "Uplink" : "Downlink", line);
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef AUDIO_LATENCY_H
+#define AUDIO_LATENCY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <cJSON.h>
+
+#define LATENCY_HISTOGRAM_BUCKETS 56    // 2^(1/4) steps from 250 us, the last one holds everything above 3.4 s
+#define LATENCY_HISTOGRAM_MIN_US 250
+#define CAPTURE_CLOCK_MARKS 64          // Input reads remembered to date the processor output, 640 ms of 10 ms reads
+
+/*
+ * The stages a frame goes through, each measured from the end of the previous one.
+ *
+ * Uplink: capture (I2S read returned) -> processed (audio processor output) -> encoded -> popped
+ * from the send queue by the application -> SendAudio() returned.
+ * Downlink: packet arrival -> decoded (decode queue, jitter buffer and Opus) -> dequeued by the
+ * output task -> OutputData() returned.
+ */
+enum AudioLatencyStage {
+    kLatencyStageProcess,
+    kLatencyStageEncode,
+    kLatencyStageSendQueue,
+    kLatencyStageSend,
+    kLatencyStageUplink,
+    kLatencyStageDecode,
+    kLatencyStagePlaybackQueue,
+    kLatencyStageOutput,
+    kLatencyStageDownlink,
+    kLatencyStageCount,
+};
+
+/*
+ * Rolling latency histogram, safe to record from any task without a lock.
+ *
+ * Samples go to one of two banks. Rotate() starts a new bank and clears the older one, so a read
+ * covers between one and two rotation periods. Percentiles are bucket upper bounds (about 19% wide).
+ */
+class LatencyHistogram {
+public:
+    struct Summary {
+        uint32_t count;
+        uint32_t min_us;
+        uint32_t avg_us;
+        uint32_t p95_us;
+        uint32_t max_us;
+    };
+
+    LatencyHistogram();
+
+    void Record(uint32_t us);
+    void Rotate();
+    Summary GetSummary() const;
+
+private:
+    struct Bank {
+        std::atomic<uint32_t> buckets[LATENCY_HISTOGRAM_BUCKETS];
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> sum_16us;     // 32-bit atomics stay lock-free on every target
+        std::atomic<uint32_t> min_us;
+        std::atomic<uint32_t> max_us;
+    };
+
+    Bank banks_[2] = {};
+    std::atomic<uint32_t> active_ = 0;
+
+    static void Clear(Bank& bank);
+};
+
+/*
+ * Dates the audio processor output. The input task marks every read with the number of frames
+ * fed so far, the processor output (another task with the AFE) looks up the read that contained
+ * its first sample. Frame counts and times are kept in 32 bits, differences stay valid across
+ * the wrap.
+ */
+class CaptureClock {
+public:
+    // Only the input task marks, and only while it feeds the processor
+    void Mark(size_t frames, int64_t time_us);
+    uint32_t frames() const { return frames_.load(std::memory_order_relaxed); }
+    // Capture time of the read holding this frame of the stream, 0 if it is not remembered
+    int64_t Lookup(uint32_t frame, int64_t now_us) const;
+
+private:
+    struct Entry {
+        std::atomic<uint32_t> end;      // Frames fed after this read
+        std::atomic<uint32_t> time_us;
+    };
+    Entry marks_[CAPTURE_CLOCK_MARKS] = {};
+    std::atomic<uint32_t> count_ = 0;
+    std::atomic<uint32_t> frames_ = 0;
+};
+
+class AudioLatency {
+public:
+    void Record(AudioLatencyStage stage, int64_t from_us, int64_t to_us);
+    void Rotate();
+    cJSON* GetJson() const;
+    // One line per direction: avg/p95/max of every stage in ms
+    void Log() const;
+
+private:
+    LatencyHistogram stages_[kLatencyStageCount];
+};
+
+#endif // AUDIO_LATENCY_H
@@ -0,0 +1,34 @@
+#include "audio_pool.h"
+#include "audio_service.h"
+
+AudioStreamPacket::AudioStreamPacket() {
+    AudioPacketPool::GetInstance().AttachBuffer(this, payload);
+}
+
+AudioStreamPacket::~AudioStreamPacket() {
+    AudioPacketPool::GetInstance().DetachBuffer(this, payload);
+}
+
+void* AudioStreamPacket::operator new(size_t size) {
+    return AudioPacketPool::GetInstance().Allocate(size);
+}
+
+void AudioStreamPacket::operator delete(void* ptr) {
+    AudioPacketPool::GetInstance().Free(ptr);
+}
+
+AudioTask::AudioTask() {
+    AudioTaskPool::GetInstance().AttachBuffer(this, pcm);
+}
+
+AudioTask::~AudioTask() {
+    AudioTaskPool::GetInstance().DetachBuffer(this, pcm);
+}
+
+void* AudioTask::operator new(size_t size) {
+    return AudioTaskPool::GetInstance().Allocate(size);
+}
+
+void AudioTask::operator delete(void* ptr) {
+    AudioTaskPool::GetInstance().Free(ptr);
+}
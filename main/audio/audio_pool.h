@@ -0,0 +1,158 @@
+#ifndef AUDIO_POOL_H
+#define AUDIO_POOL_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_heap_caps.h>
+
+#include "heap_caps_allocator.h"
+
+struct AudioStreamPacket;
+struct AudioTask;
+
+struct AudioPoolStats {
+    uint32_t capacity = 0;
+    uint32_t in_use = 0;
+    uint32_t peak = 0;
+    uint32_t fallback_allocs = 0;   // Objects taken from the heap because the pool was empty
+    uint32_t buffer_allocs = 0;     // Slot buffers that had to be replaced by a new heap buffer
+};
+
+/*
+ * Fixed-size object pool for the per-frame audio objects.
+ *
+ * The objects live in one slab allocated with heap_caps at startup, and every slot owns a spare
+ * buffer reserved once. Buffer is an AudioPayload or AudioPcm, so that reserve and any later growth
+ * come from AUDIO_BUFFER_CAPS as well. An object moves the spare buffer in when it is constructed
+ * and back when it is destroyed, so the reserved capacity is reused frame after frame.
+ *
+ * The pooled types route their class operator new / delete here, so a plain std::make_unique()
+ * takes a slot and releasing the unique_ptr returns it. When the pool is empty the object comes
+ * from the heap and fallback_allocs is increased.
+ */
+template <typename T, typename Buffer>
+class AudioPool {
+public:
+    static AudioPool& GetInstance() {
+        static AudioPool instance;
+        return instance;
+    }
+
+    AudioPool(const AudioPool&) = delete;
+    AudioPool& operator=(const AudioPool&) = delete;
+
+    void Initialize(size_t count, size_t buffer_reserve, uint32_t caps) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (slab_ != nullptr || count == 0) {
+            return;
+        }
+        stride_ = (sizeof(T) + alignof(T) - 1) & ~(alignof(T) - 1);
+        slab_ = (uint8_t*)heap_caps_aligned_alloc(alignof(T), stride_ * count, caps);
+        if (slab_ == nullptr) {
+            slab_ = (uint8_t*)heap_caps_aligned_alloc(alignof(T), stride_ * count, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (slab_ == nullptr) {
+            return;
+        }
+        buffers_.resize(count);
+        buffer_data_.resize(count);
+        free_list_.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            buffers_[i].reserve(buffer_reserve);
+            buffer_data_[i] = buffers_[i].data();
+            free_list_.push_back(count - 1 - i);
+        }
+        count_ = count;
+        stats_.capacity = count;
+    }
+
+    void* Allocate(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (size <= stride_ && !free_list_.empty()) {
+                size_t index = free_list_.back();
+                free_list_.pop_back();
+                stats_.in_use++;
+                if (stats_.in_use > stats_.peak) {
+                    stats_.peak = stats_.in_use;
+                }
+                return slab_ + index * stride_;
+            }
+            stats_.fallback_allocs++;
+        }
+        return ::operator new(size);
+    }
+
+    void Free(void* ptr) {
+        int index = IndexOf(ptr);
+        if (index < 0) {
+            ::operator delete(ptr);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_list_.push_back(index);
+        stats_.in_use--;
+    }
+
+    // Called from the constructor, hands the slot buffer to the new object
+    void AttachBuffer(const void* object, Buffer& buffer) {
+        int index = IndexOf(object);
+        if (index >= 0) {
+            buffer.swap(buffers_[index]);
+            buffer.clear();
+        }
+    }
+
+    // Called from the destructor, keeps whatever buffer the object ended up with
+    void DetachBuffer(const void* object, Buffer& buffer) {
+        int index = IndexOf(object);
+        if (index < 0) {
+            return;
+        }
+        if (buffer.data() != buffer_data_[index]) {
+            if (buffer.capacity() > 0) {
+                buffer_allocs_.fetch_add(1, std::memory_order_relaxed);
+            }
+            buffer_data_[index] = buffer.data();
+        }
+        buffers_[index].swap(buffer);
+    }
+
+    AudioPoolStats GetStats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AudioPoolStats stats = stats_;
+        stats.buffer_allocs = buffer_allocs_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    uint8_t* slab_ = nullptr;
+    size_t stride_ = 0;
+    size_t count_ = 0;
+    std::vector<Buffer> buffers_;
+    std::vector<const void*> buffer_data_;
+    std::vector<uint16_t> free_list_;
+    std::mutex mutex_;
+    AudioPoolStats stats_;
+    std::atomic<uint32_t> buffer_allocs_ = 0;
+
+    AudioPool() = default;
+
+    int IndexOf(const void* ptr) const {
+        auto p = (const uint8_t*)ptr;
+        if (slab_ == nullptr || p < slab_ || p >= slab_ + stride_ * count_) {
+            return -1;
+        }
+        return (p - slab_) / stride_;
+    }
+};
+
+using AudioPacketPool = AudioPool<AudioStreamPacket, AudioPayload>;
+using AudioTaskPool = AudioPool<AudioTask, AudioPcm>;
+
+#endif // AUDIO_POOL_H
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <span>
 
 #include <model_path.h>
 #include "audio_codec.h"
@@ -13,14 +14,18 @@ public:
     virtual ~AudioProcessor() = default;
     
     virtual void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) = 0;
-    virtual void Feed(std::vector<int16_t>&& data) = 0;
+    // Interleaved input at 16kHz, only valid during the call
+    virtual void Feed(std::span<const int16_t> data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual bool IsRunning() = 0;
-    virtual void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) = 0;
+    // 16kHz mono frames, the span is only valid during the call
+    virtual void OnOutput(std::function<void(std::span<const int16_t> data)> callback) = 0;
     virtual void OnVadStateChange(std::function<void(bool speaking)> callback) = 0;
     virtual size_t GetFeedSize() = 0;
     virtual void EnableDeviceAec(bool enable) = 0;
+    // Size of the frames passed to OnOutput(), may change while running
+    virtual void SetFrameDuration(int frame_duration_ms) = 0;
 };
 
 #endif
@@ -0,0 +1,134 @@
+#ifndef AUDIO_QUEUE_H
+#define AUDIO_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+/*
+ * Fixed-capacity single-producer / single-consumer ring used between two audio pipeline stages.
+ *
+ * - Push() must only be called by the producer task and Pop() only by the consumer task.
+ * - Size() / Empty() may be called from any task.
+ * - Clear() may be called from any task. It marks everything pushed so far as stale, and the
+ *   consumer drops those items on its next Pop(), so a slot is never touched by two tasks.
+ *
+ * Each boundary signals its own event bits: the "not empty" bit is set after a push (and after a
+ * clear, so the consumer can drain), the "not full" bit is set after a pop. Only the task waiting
+ * for that bit is woken.
+ */
+template <typename T>
+class AudioQueue {
+public:
+    explicit AudioQueue(size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        slots_ = std::make_unique<T[]>(capacity_);
+    }
+
+    AudioQueue(const AudioQueue&) = delete;
+    AudioQueue& operator=(const AudioQueue&) = delete;
+
+    void SetEventBits(EventGroupHandle_t event_group, EventBits_t not_empty_bit, EventBits_t not_full_bit) {
+        event_group_ = event_group;
+        not_empty_bit_ = not_empty_bit;
+        not_full_bit_ = not_full_bit;
+    }
+
+    bool Push(T&& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (tail - head >= capacity_) {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        if (tail + 1 - head > peak_.load(std::memory_order_relaxed)) {
+            peak_.store(tail + 1 - head, std::memory_order_relaxed);
+        }
+        if (event_group_ != nullptr && not_empty_bit_ != 0) {
+            xEventGroupSetBits(event_group_, not_empty_bit_);
+        }
+        return true;
+    }
+
+    bool Pop(T& item) {
+        DropStale();
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        item = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        if (event_group_ != nullptr && not_full_bit_ != 0) {
+            xEventGroupSetBits(event_group_, not_full_bit_);
+        }
+        return true;
+    }
+
+    void Clear() {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t upto = clear_upto_.load(std::memory_order_relaxed);
+        // Keep the newest mark if two tasks clear at the same time
+        while ((int32_t)(tail - upto) > 0 &&
+               !clear_upto_.compare_exchange_weak(upto, tail, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        if (event_group_ != nullptr && not_empty_bit_ != 0) {
+            xEventGroupSetBits(event_group_, not_empty_bit_);
+        }
+    }
+
+    size_t Size() const {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t upto = clear_upto_.load(std::memory_order_acquire);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        if ((int32_t)(upto - head) > 0) {
+            head = upto;
+        }
+        return tail - head;
+    }
+
+    bool Empty() const { return Size() == 0; }
+    size_t capacity() const { return capacity_; }
+    // Deepest the queue has been since the last ResetPeak(), a rough figure for benchmarks
+    size_t peak() const { return peak_.load(std::memory_order_relaxed); }
+    void ResetPeak() { peak_.store(0, std::memory_order_relaxed); }
+
+private:
+    std::unique_ptr<T[]> slots_;
+    uint32_t capacity_ = 0;
+    uint32_t mask_ = 0;
+    std::atomic<uint32_t> head_ = 0;        // Written by the consumer
+    std::atomic<uint32_t> tail_ = 0;        // Written by the producer
+    std::atomic<uint32_t> clear_upto_ = 0;  // Items before this index are stale
+    std::atomic<uint32_t> peak_ = 0;
+    EventGroupHandle_t event_group_ = nullptr;
+    EventBits_t not_empty_bit_ = 0;
+    EventBits_t not_full_bit_ = 0;
+
+    void DropStale() {
+        uint32_t upto = clear_upto_.load(std::memory_order_acquire);
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if ((int32_t)(upto - head) <= 0) {
+            return;
+        }
+        while (head != upto) {
+            slots_[head & mask_] = T();
+            head++;
+        }
+        head_.store(head, std::memory_order_release);
+        if (event_group_ != nullptr && not_full_bit_ != 0) {
+            xEventGroupSetBits(event_group_, not_full_bit_);
+        }
+    }
+};
+
+#endif // AUDIO_QUEUE_H
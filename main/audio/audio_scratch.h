@@ -0,0 +1,57 @@
+#ifndef AUDIO_SCRATCH_H
+#define AUDIO_SCRATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_heap_caps.h>
+
+#define AUDIO_SCRATCH_ALIGNMENT 16  // I2S DMA copies and the S3 / P4 SIMD loads want 16-byte alignment
+
+/*
+ * Persistent, aligned sample buffer for the real-time audio paths.
+ *
+ * Reserve() only touches the heap when a larger buffer than ever before is requested, so after
+ * the first frames a capture or playback loop runs without allocating. allocs() counts the
+ * reallocations for the statistics.
+ */
+template <typename T>
+class AudioScratch {
+public:
+    explicit AudioScratch(uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) : caps_(caps) {}
+    ~AudioScratch() {
+        if (data_ != nullptr) {
+            heap_caps_free(data_);
+        }
+    }
+
+    AudioScratch(const AudioScratch&) = delete;
+    AudioScratch& operator=(const AudioScratch&) = delete;
+
+    // Returns a buffer for at least count elements, the content is not preserved when it grows
+    T* Reserve(size_t count) {
+        if (count <= capacity_) {
+            return data_;
+        }
+        if (data_ != nullptr) {
+            heap_caps_free(data_);
+        }
+        size_t bytes = (count * sizeof(T) + AUDIO_SCRATCH_ALIGNMENT - 1) & ~(size_t)(AUDIO_SCRATCH_ALIGNMENT - 1);
+        data_ = (T*)heap_caps_aligned_alloc(AUDIO_SCRATCH_ALIGNMENT, bytes, caps_);
+        capacity_ = data_ != nullptr ? bytes / sizeof(T) : 0;
+        allocs_++;
+        return data_;
+    }
+
+    T* data() const { return data_; }
+    size_t capacity() const { return capacity_; }
+    uint32_t allocs() const { return allocs_; }
+
+private:
+    T* data_ = nullptr;
+    size_t capacity_ = 0;
+    uint32_t caps_;
+    uint32_t allocs_ = 0;
+};
+
+#endif // AUDIO_SCRATCH_H
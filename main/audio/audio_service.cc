@@ -1,6 +1,10 @@
 #include "audio_service.h"
+#include "settings.h"
+#include "pcm_kernels.h"
 #include <esp_log.h>
+#include <cinttypes>
 #include <cstring>
+#include <algorithm>
 
 #define RATE_CVT_CFG(_src_rate, _dest_rate, _channel)        \
     (esp_ae_rate_cvt_cfg_t)                                  \
@@ -13,15 +17,6 @@
         .perf_type       = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,  \
     }
 
-#define OPUS_DEC_CFG(_sample_rate, _frame_duration_ms)                                                    \
-    (esp_opus_dec_cfg_t)                                                                                  \
-    {                                                                                                     \
-        .sample_rate    = (uint32_t)(_sample_rate),                                                       \
-        .channel        = ESP_AUDIO_MONO,                                                                 \
-        .frame_duration = (esp_opus_dec_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(_frame_duration_ms),  \
-        .self_delimited = false,                                                                          \
-    }
-
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
 #else
@@ -37,60 +32,107 @@
 
 #define TAG "AudioService"
 
-AudioService::AudioService() {
-    event_group_ = xEventGroupCreate();
+#if CONFIG_AUDIO_INPUT_ALLOC_COUNTER
+/* Heap hooks (CONFIG_HEAP_USE_HOOKS) count every allocation made by the audio input task */
+static TaskHandle_t input_task_handle_for_hooks = nullptr;
+static std::atomic<uint32_t> input_task_allocs = 0;
 
-    demuxer_.OnDemuxerFinished([this](const uint8_t* data, int sample_rate, size_t size){
-        auto packet = std::make_unique<AudioStreamPacket>();
-        packet->sample_rate = sample_rate;
-        packet->frame_duration = 60;
-        packet->payload.resize(size);
-        std::memcpy(packet->payload.data(), data, size);
-        PushPacketToDecodeQueue(std::move(packet), true);
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps) {
+    if (input_task_handle_for_hooks != nullptr && xTaskGetCurrentTaskHandle() == input_task_handle_for_hooks) {
+        input_task_allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void* ptr) {
+}
+#endif
+
+AudioService::AudioService()
+    /* Room for the shortest frames, the limits in milliseconds are checked when pushing */
+    : audio_decode_queue_(std::max(AS_QUEUE_FRAMES(MAX_DECODE_QUEUE_MS, OPUS_MIN_FRAME_DURATION_MS),
+          AS_QUEUE_FRAMES(AUDIO_TESTING_MAX_DURATION_MS, OPUS_MIN_FRAME_DURATION_MS))),
+      audio_send_queue_(AS_QUEUE_FRAMES(MAX_SEND_QUEUE_MS, OPUS_MIN_FRAME_DURATION_MS)),
+      audio_testing_queue_(AS_QUEUE_FRAMES(AUDIO_TESTING_MAX_DURATION_MS, OPUS_MIN_FRAME_DURATION_MS)),
+      audio_encode_queue_(AS_QUEUE_FRAMES(MAX_ENCODE_QUEUE_MS, OPUS_MIN_FRAME_DURATION_MS)),
+      audio_playback_queue_(AS_QUEUE_FRAMES(MAX_PLAYBACK_QUEUE_MS, OPUS_MIN_FRAME_DURATION_MS)),
+      audio_cue_queue_(AUDIO_CUE_QUEUE_PACKETS),
+      audio_cue_playback_queue_(AS_QUEUE_FRAMES(MAX_CUE_PLAYBACK_QUEUE_MS, OPUS_MIN_FRAME_DURATION_MS)),
+      timestamp_queue_(MAX_TIMESTAMPS_IN_QUEUE * 2) {
+    event_group_ = xEventGroupCreate();
+    audio_encode_queue_.SetEventBits(event_group_, AS_EVENT_ENCODE_NOT_EMPTY, AS_EVENT_ENCODE_NOT_FULL);
+    audio_decode_queue_.SetEventBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY, AS_EVENT_DECODE_NOT_FULL);
+    audio_send_queue_.SetEventBits(event_group_, 0, AS_EVENT_SEND_NOT_FULL);
+    audio_playback_queue_.SetEventBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY, AS_EVENT_PLAYBACK_NOT_FULL);
+    audio_cue_queue_.SetEventBits(event_group_, AS_EVENT_CUE_NOT_EMPTY, AS_EVENT_CUE_NOT_FULL);
+    audio_cue_playback_queue_.SetEventBits(event_group_, AS_EVENT_CUE_PLAYBACK_NOT_EMPTY, AS_EVENT_CUE_PLAYBACK_NOT_FULL);
+
+    /* Sounds go to the cue queue, so they never wait behind queued speech */
+    demuxer_.EnableViews(true);
+    demuxer_.OnDemuxerFinished([this](const uint8_t* data, int sample_rate, size_t size, bool view) {
+        SoundCue cue;
+        if (view) {
+            /* Inside one Ogg page of the sound data, the decode task reads it there */
+            cue.view = std::span<const uint8_t>(data, size);
+            cue.sample_rate = sample_rate;
+        } else {
+            auto packet = std::make_unique<AudioStreamPacket>();
+            packet->sample_rate = sample_rate;
+            packet->frame_duration = 60;
+            AssignBuffer(packet->payload, data, size);
+            cue.packet = std::move(packet);
+        }
+        cue.record = cue_record_key_;
+        cue_record_key_ = nullptr;
+        PushCue(std::move(cue));
     });
 }
 
 AudioService::~AudioService() {
+    if (audio_power_timer_ != nullptr) {
+        esp_timer_stop(audio_power_timer_);
+        esp_timer_delete(audio_power_timer_);
+    }
     if (event_group_ != nullptr) {
         vEventGroupDelete(event_group_);
     }
     if (opus_encoder_ != nullptr) {
         esp_opus_enc_close(opus_encoder_);
     }
-    if (opus_decoder_ != nullptr) {
-        esp_opus_dec_close(opus_decoder_);
-    }
     if (input_resampler_ != nullptr) {
         esp_ae_rate_cvt_close(input_resampler_);
     }
-    if (output_resampler_ != nullptr) {
-        esp_ae_rate_cvt_close(output_resampler_);
-    }
 }
 
 void AudioService::Initialize(AudioCodec* codec) {
     codec_ = codec;
     codec_->Start();
-
-    esp_opus_dec_cfg_t opus_dec_cfg = OPUS_DEC_CFG(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
-    auto ret = esp_opus_dec_open(&opus_dec_cfg, sizeof(esp_opus_dec_cfg_t), &opus_decoder_);
-    if (opus_decoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", ret);
-    } else {
-        decoder_sample_rate_ = codec->output_sample_rate();
-        decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
-        decoder_frame_size_ = decoder_sample_rate_ / 1000 * OPUS_FRAME_DURATION_MS;
+    sound_cache_.Configure(CONFIG_AUDIO_SOUND_CACHE_CLIPS, codec->output_sample_rate());
+
+    decoders_.Configure(CONFIG_AUDIO_DECODER_CACHE_ENTRIES, codec->output_sample_rate());
+    cue_decoders_.Configure(CONFIG_AUDIO_DECODER_CACHE_ENTRIES, codec->output_sample_rate());
+    /* Open the decoder for the server's usual format ahead of the first packet */
+    {
+        std::lock_guard<std::mutex> decoder_lock(decoder_mutex_);
+        decoders_.Get(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
     }
-    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG();
-    ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
-    if (opus_encoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
-    } else {
-        encoder_sample_rate_ = 16000;
-        encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
-        esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
-        encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
+    Settings settings("audio", false);
+    int frame_duration = settings.GetInt("frame_duration", OPUS_FRAME_DURATION_MS);
+    if (frame_duration != 20 && frame_duration != 40 && frame_duration != 60) {
+        frame_duration = OPUS_FRAME_DURATION_MS;
     }
+    frame_duration_ms_ = frame_duration;
+#if CONFIG_AUDIO_ADAPTIVE_ENCODER
+    encoder_controller_.Configure(CONFIG_AUDIO_ADAPTIVE_ENCODER_MAX_LEVEL);
+#endif
+    SetEncodeFrameDuration(frame_duration);
+
+    /* Reserve the per-frame packets and tasks once, they are recycled afterwards */
+    uint32_t pool_caps = AUDIO_BUFFER_CAPS;
+    int pcm_reserve = std::max(codec->output_sample_rate(), 16000) / 1000 * OPUS_FRAME_DURATION_MS + 32;
+    packet_payload_reserve_ = std::max<size_t>(AUDIO_PACKET_PAYLOAD_RESERVE, AUDIO_PACKET_HEADROOM + encoder_outbuf_size_);
+    AudioPacketPool::GetInstance().Initialize(AUDIO_PACKET_POOL_SIZE, packet_payload_reserve_, pool_caps);
+    AudioTaskPool::GetInstance().Initialize(AUDIO_TASK_POOL_SIZE, pcm_reserve, pool_caps);
+    sound_mixer_.Configure(codec->output_sample_rate());
 
     if (codec->input_sample_rate() != 16000) {
         esp_ae_rate_cvt_cfg_t input_resampler_cfg = RATE_CVT_CFG(
@@ -103,12 +145,27 @@ void AudioService::Initialize(AudioCodec* codec) {
 
 #if CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
+    echo_reference_enabled_ = AfeAudioProcessor::UsesSoftwareReference(codec);
 #else
     audio_processor_ = std::make_unique<NoAudioProcessor>();
 #endif
 
-    audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+    audio_processor_->OnOutput([this](std::span<const int16_t> data) {
+        /* Date the frame by the read that captured its first sample */
+        int64_t now = esp_timer_get_time();
+        int64_t capture_time = capture_clock_.Lookup(processed_frames_, now);
+        processed_frames_ += data.size();
+        latency_.Record(kLatencyStageProcess, capture_time, now);
+        uplink_gate_.Process(data, capture_time, voice_detected_);
+    });
+
+#if CONFIG_AUDIO_UPLINK_GATE_SPEECH
+    uplink_gate_.Configure(kUplinkGateSpeech, CONFIG_AUDIO_UPLINK_GATE_PADDING_MS, 0);
+#elif CONFIG_AUDIO_UPLINK_GATE_KEEPALIVE
+    uplink_gate_.Configure(kUplinkGateKeepalive, CONFIG_AUDIO_UPLINK_GATE_PADDING_MS, CONFIG_AUDIO_UPLINK_GATE_KEEPALIVE_MS);
+#endif
+    uplink_gate_.OnSend([this](std::span<const int16_t> pcm, int64_t capture_time_us, bool wait) {
+        return PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, pcm, capture_time_us, wait);
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
@@ -133,7 +190,8 @@ void AudioService::Initialize(AudioCodec* codec) {
 
 void AudioService::Start() {
     service_stopped_ = false;
-    xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+    xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING |
+        AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_CODEC_STRESS_RUNNING);
 
     esp_timer_start_periodic(audio_power_timer_, 1000000);
 
@@ -166,13 +224,24 @@ void AudioService::Start() {
         vTaskDelete(NULL);
     }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
 #endif
+#if CONFIG_AUDIO_INPUT_ALLOC_COUNTER
+    input_task_handle_for_hooks = audio_input_task_handle_;
+#endif
 
-    /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    /* Start the opus encode / decode tasks, each direction runs and backs off on its own */
+    xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusEncodeTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 12, this, 2, &opus_codec_task_handle_);
+    }, "opus_encode", CONFIG_AUDIO_ENCODE_TASK_STACK_SIZE, this, CONFIG_AUDIO_ENCODE_TASK_PRIORITY,
+        &opus_encode_task_handle_, CONFIG_AUDIO_ENCODE_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_AUDIO_ENCODE_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusDecodeTask();
+        vTaskDelete(NULL);
+    }, "opus_decode", CONFIG_AUDIO_DECODE_TASK_STACK_SIZE, this, CONFIG_AUDIO_DECODE_TASK_PRIORITY,
+        &opus_decode_task_handle_, CONFIG_AUDIO_DECODE_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_AUDIO_DECODE_TASK_CORE);
 }
 
 void AudioService::Stop() {
@@ -182,43 +251,61 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    audio_cue_queue_.Clear();
+    audio_cue_playback_queue_.Clear();
+    /* Wake up every task that may be blocked on a queue */
+    xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY | AS_EVENT_PLAYBACK_NOT_FULL |
+        AS_EVENT_ENCODE_NOT_EMPTY | AS_EVENT_ENCODE_NOT_FULL | AS_EVENT_DECODE_NOT_EMPTY |
+        AS_EVENT_DECODE_NOT_FULL | AS_EVENT_SEND_NOT_FULL | AS_EVENT_PLAYBACK_DRAINED |
+        AS_EVENT_CUE_NOT_EMPTY | AS_EVENT_CUE_NOT_FULL | AS_EVENT_CUE_PLAYBACK_NOT_EMPTY |
+        AS_EVENT_CUE_PLAYBACK_NOT_FULL);
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+    /* The vector keeps its capacity, so a caller that reuses it does not allocate after the first read */
+    size_t dest_frames = samples + AUDIO_INPUT_RESAMPLE_SLACK;
+    data.resize(dest_frames * codec_->input_channels());
+    int frames = ReadAudioFrames(data.data(), dest_frames, sample_rate, samples);
+    data.resize(frames * codec_->input_channels());
+    return frames > 0;
+}
+
+int AudioService::ReadAudioFrames(int16_t* dest, size_t dest_frames, int sample_rate, int samples) {
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
         codec_->EnableInput(true);
     }
 
+    int channels = codec_->input_channels();
+    int frames = samples;
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
-        if (!codec_->InputData(data)) {
-            return false;
+        std::lock_guard<std::mutex> lock(input_resampler_mutex_);
+        if (input_resampler_ == nullptr) {
+            return 0;
         }
-        if (input_resampler_ != nullptr) {
-            std::lock_guard<std::mutex> lock(input_resampler_mutex_);
-            uint32_t in_sample_num = data.size() / codec_->input_channels();
-            uint32_t output_samples = 0;
-            esp_ae_rate_cvt_get_max_out_sample_num(input_resampler_, in_sample_num, &output_samples);
-            auto resampled = std::vector<int16_t>(output_samples * codec_->input_channels());
-            uint32_t actual_output = output_samples;
-            esp_ae_rate_cvt_process(input_resampler_, (esp_ae_sample_t)data.data(), in_sample_num,
-                                   (esp_ae_sample_t)resampled.data(), &actual_output);
-            resampled.resize(actual_output * codec_->input_channels());
-            data = std::move(resampled);
+        /* Read at the codec rate into the persistent capture buffer, then resample into dest */
+        uint32_t in_sample_num = samples * codec_->input_sample_rate() / sample_rate;
+        int16_t* capture = capture_buffer_.Reserve(in_sample_num * channels);
+        if (capture == nullptr || !codec_->InputData(capture, in_sample_num * channels)) {
+            return 0;
         }
-    } else {
-        data.resize(samples * codec_->input_channels());
-        if (!codec_->InputData(data)) {
-            return false;
+        uint32_t output_samples = 0;
+        esp_ae_rate_cvt_get_max_out_sample_num(input_resampler_, in_sample_num, &output_samples);
+        if (output_samples > dest_frames) {
+            ESP_LOGE(TAG, "Input resampler needs %" PRIu32 " frames, only %zu available", output_samples, dest_frames);
+            return 0;
         }
+        uint32_t actual_output = output_samples;
+        esp_ae_rate_cvt_process(input_resampler_, (esp_ae_sample_t)capture, in_sample_num,
+                               (esp_ae_sample_t)dest, &actual_output);
+        frames = actual_output;
+    } else if (!codec_->InputData(dest, samples * channels)) {
+        return 0;
     }
 
     /* Update the last input time */
@@ -230,16 +317,36 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     if (audio_debugger_ == nullptr) {
         audio_debugger_ = std::make_unique<AudioDebugger>();
     }
-    audio_debugger_->Feed(data);
+    audio_debugger_->Feed(std::span<const int16_t>(dest, frames * channels));
 #endif
 
-    return true;
+    return frames;
+}
+
+uint32_t AudioService::GetInputTaskAllocs() {
+#if CONFIG_AUDIO_INPUT_ALLOC_COUNTER
+    return input_task_allocs.load(std::memory_order_relaxed);
+#else
+    /* Without the heap hooks only the capture buffers are counted */
+    return capture_buffer_.allocs() + input_frame_.allocs() + reference_frame_.allocs();
+#endif
+}
+
+void AudioService::UpdateInputAllocRate() {
+    int64_t now = esp_timer_get_time();
+    if (now - input_allocs_window_start_ < 1000000) {
+        return;
+    }
+    uint32_t allocs = GetInputTaskAllocs();
+    input_allocs_per_sec_ = (uint64_t)(allocs - input_allocs_base_) * 1000000 / (now - input_allocs_window_start_);
+    input_allocs_base_ = allocs;
+    input_allocs_window_start_ = now;
 }
 
 void AudioService::AudioInputTask() {
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
-            AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
+            AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING | AS_EVENT_CODEC_STRESS_RUNNING,
             pdFALSE, pdFALSE, portMAX_DELAY);
 
         if (service_stopped_) {
@@ -251,25 +358,30 @@ void AudioService::AudioInputTask() {
             continue;
         }
 
+        /* Full-duplex codec stress test: microphone -> encoder -> decoder -> (muted) speaker */
+        if ((bits & AS_EVENT_CODEC_STRESS_RUNNING) && esp_timer_get_time() >= codec_stress_end_time_) {
+            FinishCodecStressTest();
+            continue;
+        }
+
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
-        if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+        if (bits & (AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_CODEC_STRESS_RUNNING)) {
+            bool stress = bits & AS_EVENT_CODEC_STRESS_RUNNING;
+            if (!stress && audio_testing_queue_.Size() >= AS_QUEUE_FRAMES(AUDIO_TESTING_MAX_DURATION_MS, frame_duration_ms_)) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
-            if (ReadAudioData(data, 16000, samples)) {
-                // If input channels is 2, we need to fetch the left channel data
-                if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
-                }
-                PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
+            int samples = frame_duration_ms_ * 16000 / 1000;
+            size_t dest_frames = samples + AUDIO_INPUT_RESAMPLE_SLACK;
+            int16_t* data = input_frame_.Reserve(dest_frames * codec_->input_channels());
+            int frames = data != nullptr ? ReadAudioFrames(data, dest_frames, 16000, samples) : 0;
+            if (frames > 0) {
+                // If input channels is 2, keep the left channel (in place)
+                pcm::TakeChannel(data, data, frames, codec_->input_channels());
+                PushTaskToEncodeQueue(stress ? kAudioTaskTypeEncodeToLoopback : kAudioTaskTypeEncodeToTestingQueue,
+                    std::span<const int16_t>(data, frames));
+                UpdateInputAllocRate();
                 continue;
             }
         }
@@ -277,19 +389,36 @@ void AudioService::AudioInputTask() {
         /* Feed the wake word and/or audio processor */
         if (bits & (AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING)) {
             int samples = 160; // 10ms
-            std::vector<int16_t> data;
-            if (ReadAudioData(data, 16000, samples)) {
+            size_t dest_frames = samples + AUDIO_INPUT_RESAMPLE_SLACK;
+            int16_t* data = input_frame_.Reserve(dest_frames * codec_->input_channels());
+            int frames = data != nullptr ? ReadAudioFrames(data, dest_frames, 16000, samples) : 0;
+            if (frames > 0) {
+                /* The consumers copy what they keep, the buffer is reused for the next read */
+                std::span<const int16_t> input(data, frames * codec_->input_channels());
                 if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-                    wake_word_->Feed(data);
+                    wake_word_->Feed(input);
                 }
                 if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-                    audio_processor_->Feed(std::move(data));
+                    int64_t now = esp_timer_get_time();
+                    capture_clock_.Mark(frames, now);
+                    if (echo_reference_enabled_) {
+                        /* The AFE takes the played audio as one more channel */
+                        size_t channels = codec_->input_channels();
+                        int16_t* feed = reference_frame_.Reserve(frames * (channels + 1));
+                        if (feed == nullptr) {
+                            continue;
+                        }
+                        echo_reference_.Interleave(data, frames, channels, feed, now);
+                        input = std::span<const int16_t>(feed, frames * (channels + 1));
+                    }
+                    audio_processor_->Feed(input);
                 }
+                UpdateInputAllocRate();
                 continue;
             }
         }
 
-        ESP_LOGE(TAG, "Should not be here, bits: %lx", bits);
+        ESP_LOGE(TAG, "Should not be here, bits: %" PRIx32, (uint32_t)bits);
         break;
     }
 
@@ -297,24 +426,63 @@ void AudioService::AudioInputTask() {
 }
 
 void AudioService::AudioOutputTask() {
+    uint32_t cues_started = 0;
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        std::unique_ptr<AudioTask> task;
+        while (!service_stopped_ && !audio_playback_queue_.Pop(task) && !sound_mixer_.Pending(audio_cue_playback_queue_)) {
+            xEventGroupWaitBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY | AS_EVENT_CUE_PLAYBACK_NOT_EMPTY,
+                pdTRUE, pdFALSE, portMAX_DELAY);
+        }
         if (service_stopped_) {
             break;
         }
-
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        int64_t dequeue_time = 0;
+        if (task != nullptr) {
+            dequeue_time = esp_timer_get_time();
+            latency_.Record(kLatencyStagePlaybackQueue, task->stage_time_us, dequeue_time);
+            if (audio_playback_queue_.Empty()) {
+                xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_DRAINED);
+            }
+            sound_mixer_.Mix(task->pcm.data(), task->pcm.size(), audio_cue_playback_queue_);
+        } else {
+            /* Only a cue plays, in short chunks so that speech joins it without waiting */
+            task = std::make_unique<AudioTask>();
+            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+            task->pcm.resize(codec_->output_sample_rate() / 1000 * AUDIO_CUE_RENDER_MS);
+            size_t samples = sound_mixer_.Render(task->pcm.data(), task->pcm.size(), audio_cue_playback_queue_);
+            if (samples == 0) {
+                /* The cue has ended, or its next frame is not decoded yet */
+                xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_DRAINED);
+                continue;
+            }
+            task->pcm.resize(samples);
+        }
+        if (sound_mixer_.cues_started() != cues_started) {
+            cues_started = sound_mixer_.cues_started();
+            int64_t request_time = cue_request_time_us_.exchange(0);
+            if (request_time > 0) {
+                int cached = cue_request_cached_ ? 1 : 0;
+                cue_last_start_latency_us_ = esp_timer_get_time() - request_time;
+                cue_max_start_latency_us_ = std::max(cue_max_start_latency_us_, cue_last_start_latency_us_);
+                cue_start_latency_sum_us_[cached] += cue_last_start_latency_us_;
+                cue_start_count_[cached]++;
+            }
+        }
 
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
+        if (echo_reference_enabled_) {
+            echo_reference_.Write(task->pcm.data(), task->pcm.size(), codec_->output_sample_rate(), esp_timer_get_time());
+        }
         codec_->OutputData(task->pcm);
+        if (task->origin_time_us > 0) {
+            int64_t now = esp_timer_get_time();
+            latency_.Record(kLatencyStageOutput, dequeue_time, now);
+            latency_.Record(kLatencyStageDownlink, task->origin_time_us, now);
+        }
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
@@ -322,9 +490,8 @@ void AudioService::AudioOutputTask() {
 
 #if CONFIG_USE_SERVER_AEC
         /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+        if (task->timestamp > 0 && !timestamp_queue_.Push(std::move(task->timestamp))) {
+            ESP_LOGW(TAG, "Timestamp queue is full, dropping timestamp");
         }
 #endif
     }
@@ -332,213 +499,467 @@ void AudioService::AudioOutputTask() {
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
+void AudioService::OpusDecodeTask() {
+    std::unique_ptr<AudioStreamPacket> local_packet;    // Sounds and testing, decoded in arrival order
+    cue_clip_.reset();
+    cue_clip_active_ = false;
+    while (!service_stopped_) {
+        if (jitter_reset_requested_.exchange(false)) {
+            jitter_buffer_.Reset();
+            local_packet.reset();
         }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
+        /* Move network packets into the jitter buffer as soon as they arrive, so their arrival time is measured */
+        int64_t now = esp_timer_get_time();
+        while (local_packet == nullptr && !jitter_buffer_.Full()) {
+            std::unique_ptr<AudioStreamPacket> packet;
+            if (!audio_decode_queue_.Pop(packet)) {
+                break;
+            }
+            if (packet->sequence == 0) {
+                local_packet = std::move(packet);
+            } else {
+                jitter_buffer_.Put(std::move(packet), now);
+            }
+        }
+        if (local_packet == nullptr && jitter_buffer_.Depth() == 0 && audio_decode_queue_.Empty()) {
+            xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_DRAINED);
+        }
 
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_ != nullptr) {
-                task->pcm.resize(decoder_frame_size_);
-                esp_audio_dec_in_raw_t raw = {
-                    .buffer = (uint8_t *)(packet->payload.data()),
-                    .len = (uint32_t)(packet->payload.size()),
-                    .consumed = 0,
-                    .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
-                };
-                esp_audio_dec_out_frame_t out_frame = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(task->pcm.size() * sizeof(int16_t)),
-                    .decoded_size = 0,
-                };
-                esp_audio_dec_info_t dec_info = {};
-                std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-                auto ret = esp_opus_dec_decode(opus_decoder_, &raw, &out_frame, &dec_info);
-                decoder_lock.unlock();
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    task->pcm.resize(out_frame.decoded_size / sizeof(int16_t));
-                    if (decoder_sample_rate_ != codec_->output_sample_rate() && output_resampler_ != nullptr) {
-                        uint32_t target_size = 0;
-                        esp_ae_rate_cvt_get_max_out_sample_num(output_resampler_, task->pcm.size(), &target_size);
-                        std::vector<int16_t> resampled(target_size);
-                        uint32_t actual_output = target_size;
-                        esp_ae_rate_cvt_process(output_resampler_, (esp_ae_sample_t)task->pcm.data(), task->pcm.size(),
-                                                (esp_ae_sample_t)resampled.data(), &actual_output);
-                        resampled.resize(actual_output);
-                        task->pcm = std::move(resampled);
-                    }
-                    lock.lock();
-                    audio_playback_queue_.push_back(std::move(task));
-                    audio_queue_cv_.notify_all();
-                    debug_statistics_.decode_count++;
-                } else {
-                    ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
-                    lock.lock();
+        /* Sound cues play on their own voice, keep a few frames of them decoded ahead of the speech */
+        if (cue_clip_ != nullptr) {
+            if (audio_cue_playback_queue_.Size() < AS_QUEUE_FRAMES(MAX_CUE_PLAYBACK_QUEUE_MS, AUDIO_CUE_CLIP_FRAME_MS)) {
+                QueueCueClip();
+                continue;
+            }
+        } else if (audio_cue_playback_queue_.Size() < AS_QUEUE_FRAMES(MAX_CUE_PLAYBACK_QUEUE_MS, cue_duration_ms_)) {
+            SoundCue cue;
+            if (audio_cue_queue_.Pop(cue)) {
+                if (cue.record != nullptr) {
+                    sound_cache_.BeginRecording(cue.record);
                 }
-            } else {
-                ESP_LOGE(TAG, "Audio decoder is not configured");
-                lock.lock();
+                if (cue.packet != nullptr) {
+                    DecodeCue({cue.packet->data(), cue.packet->size()}, cue.packet->sample_rate, cue.packet->frame_duration);
+                } else if (!cue.view.empty()) {
+                    DecodeCue(cue.view, cue.sample_rate, 60);
+                }
+                if (cue.clip != nullptr) {
+                    cue_clip_ = std::move(cue.clip);
+                    cue_clip_offset_ = 0;
+                    cue_clip_active_ = true;
+                    QueueCueClip();
+                }
+                if (cue.end) {
+                    sound_cache_.EndRecording();
+                }
+                continue;
+            }
+        }
+
+        /* Only decode when the playback queue has room, the uplink never waits for the speaker */
+        TickType_t wait_ticks = portMAX_DELAY;
+        if (audio_playback_queue_.Size() < AS_QUEUE_FRAMES(MAX_PLAYBACK_QUEUE_MS, decoder_duration_ms_)) {
+            JitterBuffer::Frame frame;
+            auto action = jitter_buffer_.Get(now, frame);
+            if (action == JitterBuffer::kPacket) {
+                auto& packet = frame.packet;
+                DecodeFrame(packet->sample_rate, packet->frame_duration, packet->timestamp,
+                    packet->data(), packet->size(), false, packet->origin_time_us);
+                continue;
+            } else if (action == JitterBuffer::kConceal) {
+                auto fec = frame.fec_source;
+                DecodeFrame(frame.sample_rate, frame.frame_duration, 0,
+                    fec ? fec->data() : nullptr, fec ? fec->size() : 0, true, 0);
+                continue;
+            } else if (action == JitterBuffer::kWait) {
+                wait_ticks = std::max<TickType_t>(1, pdMS_TO_TICKS((frame.release_time_us - now + 999) / 1000));
             }
+            if (local_packet != nullptr) {
+                DecodeFrame(local_packet->sample_rate, local_packet->frame_duration, local_packet->timestamp,
+                    local_packet->data(), local_packet->size(), false, 0);
+                local_packet.reset();
+                continue;
+            }
+        }
+        xEventGroupWaitBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY | AS_EVENT_PLAYBACK_NOT_FULL |
+            AS_EVENT_CUE_NOT_EMPTY | AS_EVENT_CUE_PLAYBACK_NOT_FULL, pdTRUE, pdFALSE, wait_ticks);
+    }
+
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+void AudioService::DecodeFrame(int sample_rate, int frame_duration, uint32_t timestamp,
+    const uint8_t* data, size_t size, bool conceal, int64_t origin_time_us) {
+    int64_t start_time = esp_timer_get_time();
+
+    auto task = std::make_unique<AudioTask>();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    task->timestamp = timestamp;
+
+    std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
+    auto decoder = decoders_.Get(sample_rate, frame_duration);
+    decoder_lock.unlock();
+    if (decoder != nullptr) {
+        decoder_duration_ms_ = frame_duration;
+        /* Decode straight into the task, or into decode_buffer_ if it has to be resampled */
+        bool resample = decoder->resampler != nullptr;
+        auto& pcm = resample ? decode_buffer_ : task->pcm;
+        pcm.resize(decoder->frame_size);
+        /* To conceal a lost frame, the decoder takes the following packet (FEC) or nothing (PLC) */
+        esp_audio_dec_recovery_t recover = ESP_AUDIO_DEC_RECOVERY_NONE;
+        if (conceal) {
+            recover = data != nullptr ? ESP_AUDIO_DEC_RECOVERY_FEC : ESP_AUDIO_DEC_RECOVERY_PLC;
+        }
+        esp_audio_dec_in_raw_t raw = {
+            .buffer = (uint8_t *)data,
+            .len = (uint32_t)size,
+            .consumed = 0,
+            .frame_recover = recover,
+        };
+        esp_audio_dec_out_frame_t out_frame = {
+            .buffer = (uint8_t *)(pcm.data()),
+            .len = (uint32_t)(pcm.size() * sizeof(int16_t)),
+            .needed_size = 0,
+            .decoded_size = 0,
+        };
+        esp_audio_dec_info_t dec_info = {};
+        decoder_lock.lock();
+        auto ret = esp_opus_dec_decode(decoder->decoder, &raw, &out_frame, &dec_info);
+        if (ret != ESP_AUDIO_ERR_OK && recover == ESP_AUDIO_DEC_RECOVERY_FEC) {
+            /* The following packet could not be used, fall back to PLC */
+            raw = { .buffer = nullptr, .len = 0, .consumed = 0, .frame_recover = ESP_AUDIO_DEC_RECOVERY_PLC };
+            out_frame.decoded_size = 0;
+            ret = esp_opus_dec_decode(decoder->decoder, &raw, &out_frame, &dec_info);
+        }
+        decoder_lock.unlock();
+        if (ret == ESP_AUDIO_ERR_OK) {
+            pcm.resize(out_frame.decoded_size / sizeof(int16_t));
+        } else if (conceal) {
+            /* Keep the timing with a silent frame */
+            std::fill(pcm.begin(), pcm.end(), 0);
+        }
+        if (ret == ESP_AUDIO_ERR_OK || conceal) {
+            if (resample) {
+                uint32_t target_size = 0;
+                esp_ae_rate_cvt_get_max_out_sample_num(decoder->resampler, pcm.size(), &target_size);
+                task->pcm.resize(target_size);
+                uint32_t actual_output = target_size;
+                esp_ae_rate_cvt_process(decoder->resampler, (esp_ae_sample_t)pcm.data(), pcm.size(),
+                                        (esp_ae_sample_t)task->pcm.data(), &actual_output);
+                task->pcm.resize(actual_output);
+            }
+            /* The stress test loops the microphone back, keep the speaker silent */
+            if (xEventGroupGetBits(event_group_) & AS_EVENT_CODEC_STRESS_RUNNING) {
+                std::fill(task->pcm.begin(), task->pcm.end(), 0);
+            }
+            if (origin_time_us > 0) {
+                task->origin_time_us = origin_time_us;
+                task->stage_time_us = esp_timer_get_time();
+                latency_.Record(kLatencyStageDecode, origin_time_us, task->stage_time_us);
+            }
+            audio_playback_queue_.Push(std::move(task));
             debug_statistics_.decode_count++;
+        } else {
+            ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
         }
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
+    } else {
+        ESP_LOGE(TAG, "Audio decoder is not configured");
+    }
+    debug_statistics_.decode_count++;
+    UpdateCodecTaskStats(decode_stats_, decode_max_reset_, start_time, frame_duration);
+}
 
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-
-            if (opus_encoder_ != nullptr && task->pcm.size() == encoder_frame_size_) {
-                std::vector<uint8_t> buf(encoder_outbuf_size_);
-                esp_audio_enc_in_frame_t in = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
-                };
-                esp_audio_enc_out_frame_t out = {
-                    .buffer = buf.data(),
-                    .len = (uint32_t)encoder_outbuf_size_,
-                    .encoded_bytes = 0,
-                };
-                auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    packet->payload.assign(buf.data(), buf.data() + out.encoded_bytes);
-
-                    if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                        {
-                            std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                            audio_send_queue_.push_back(std::move(packet));
-                        }
-                        if (callbacks_.on_send_queue_available) {
-                            callbacks_.on_send_queue_available();
-                        }
-                    } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                        std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                        audio_testing_queue_.push_back(std::move(packet));
-                    }
-                    debug_statistics_.encode_count++;
+void AudioService::DecodeCue(std::span<const uint8_t> payload, int sample_rate, int frame_duration) {
+    auto decoder = cue_decoders_.Get(sample_rate, frame_duration);
+    if (decoder == nullptr) {
+        return;
+    }
+    cue_duration_ms_ = frame_duration;
+
+    auto task = std::make_unique<AudioTask>();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    auto& pcm = decoder->resampler != nullptr ? cue_decode_buffer_ : task->pcm;
+    pcm.resize(decoder->frame_size);
+    esp_audio_dec_in_raw_t raw = {
+        .buffer = (uint8_t *)payload.data(),
+        .len = (uint32_t)payload.size(),
+        .consumed = 0,
+        .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
+    };
+    esp_audio_dec_out_frame_t out_frame = {
+        .buffer = (uint8_t *)(pcm.data()),
+        .len = (uint32_t)(pcm.size() * sizeof(int16_t)),
+        .needed_size = 0,
+        .decoded_size = 0,
+    };
+    esp_audio_dec_info_t dec_info = {};
+    auto ret = esp_opus_dec_decode(decoder->decoder, &raw, &out_frame, &dec_info);
+    if (ret != ESP_AUDIO_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to decode sound, error code: %d", ret);
+        return;
+    }
+    pcm.resize(out_frame.decoded_size / sizeof(int16_t));
+
+    if (decoder->resampler != nullptr) {
+        uint32_t target_size = 0;
+        esp_ae_rate_cvt_get_max_out_sample_num(decoder->resampler, pcm.size(), &target_size);
+        task->pcm.resize(target_size);
+        uint32_t actual_output = target_size;
+        esp_ae_rate_cvt_process(decoder->resampler, (esp_ae_sample_t)pcm.data(), pcm.size(),
+                                (esp_ae_sample_t)task->pcm.data(), &actual_output);
+        task->pcm.resize(actual_output);
+    }
+    sound_cache_.Record(task->pcm);
+    audio_cue_playback_queue_.Push(std::move(task));
+}
+
+void AudioService::QueueCueClip() {
+    /* A cached sound needs no decoding, its PCM is copied to the cue voice a frame at a time */
+    size_t frame_samples = codec_->output_sample_rate() / 1000 * AUDIO_CUE_CLIP_FRAME_MS;
+    size_t samples = std::min(frame_samples, cue_clip_->samples - cue_clip_offset_);
+    auto task = std::make_unique<AudioTask>();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    AssignBuffer(task->pcm, cue_clip_->pcm + cue_clip_offset_, samples);
+    cue_clip_offset_ += samples;
+    if (cue_clip_offset_ >= cue_clip_->samples) {
+        cue_clip_.reset();
+    }
+    audio_cue_playback_queue_.Push(std::move(task));
+    if (cue_clip_ == nullptr) {
+        cue_clip_active_ = false;
+    }
+}
+
+void AudioService::PushCue(SoundCue&& cue) {
+    while (!audio_cue_queue_.Push(std::move(cue)) && !service_stopped_) {
+        xEventGroupWaitBits(event_group_, AS_EVENT_CUE_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+}
+
+void AudioService::OpusEncodeTask() {
+    while (true) {
+        /* Only encode when the send queue has room, the downlink never waits for the network */
+        std::unique_ptr<AudioTask> task;
+        while (!service_stopped_ &&
+               (audio_send_queue_.Size() >= AS_QUEUE_FRAMES(MAX_SEND_QUEUE_MS, encoder_duration_ms_) ||
+                !audio_encode_queue_.Pop(task))) {
+            xEventGroupWaitBits(event_group_, AS_EVENT_ENCODE_NOT_EMPTY | AS_EVENT_SEND_NOT_FULL,
+                pdTRUE, pdFALSE, portMAX_DELAY);
+        }
+        if (service_stopped_) {
+            break;
+        }
+        int64_t start_time = esp_timer_get_time();
+
+        /* The frame duration changed, tasks already queued are encoded at their own duration */
+        int task_duration_ms = task->pcm.size() * 1000 / 16000;
+        if (task_duration_ms != encoder_duration_ms_) {
+            SetEncodeFrameDuration(task_duration_ms);
+        }
+
+        auto packet = std::make_unique<AudioStreamPacket>();
+        packet->frame_duration = encoder_duration_ms_;
+        packet->sample_rate = 16000;
+        packet->timestamp = task->timestamp;
+
+        if (opus_encoder_ != nullptr && task->pcm.size() == (size_t)encoder_frame_size_) {
+            /* Encoded behind the headroom so the protocol frames the packet in place, straight into
+             * the pooled buffer when it can take the encoder's largest output */
+            bool in_place = packet->payload.capacity() >= (size_t)(AUDIO_PACKET_HEADROOM + encoder_outbuf_size_);
+            if (in_place) {
+                packet->payload.resize(AUDIO_PACKET_HEADROOM + encoder_outbuf_size_);
+            }
+            esp_audio_enc_in_frame_t in = {
+                .buffer = (uint8_t *)(task->pcm.data()),
+                .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
+            };
+            esp_audio_enc_out_frame_t out = {
+                .buffer = in_place ? packet->payload.data() + AUDIO_PACKET_HEADROOM : encode_buffer_.data(),
+                .len = (uint32_t)encoder_outbuf_size_,
+                .encoded_bytes = 0,
+                .pts = 0,
+            };
+            auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
+            if (ret == ESP_AUDIO_ERR_OK) {
+                if (in_place) {
+                    packet->payload.resize(AUDIO_PACKET_HEADROOM + out.encoded_bytes);
                 } else {
-                    ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+                    packet->payload.resize(AUDIO_PACKET_HEADROOM);
+                    AppendBuffer(packet->payload, encode_buffer_.data(), out.encoded_bytes);
                 }
+                packet->headroom = AUDIO_PACKET_HEADROOM;
+
+                if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+                    uplink_session_bytes_ += out.encoded_bytes;
+                    packet->origin_time_us = task->origin_time_us;
+                    packet->stage_time_us = esp_timer_get_time();
+                    latency_.Record(kLatencyStageEncode, task->stage_time_us, packet->stage_time_us);
+                    audio_send_queue_.Push(std::move(packet));
+                    if (callbacks_.on_send_queue_available) {
+                        callbacks_.on_send_queue_available();
+                    }
+#if CONFIG_AUDIO_ADAPTIVE_ENCODER
+                    if (encoder_controller_.OnFrameEncoded(encoder_duration_ms_, esp_timer_get_time() - start_time,
+                            audio_send_queue_.Size() * encoder_duration_ms_)) {
+                        ApplyEncoderSettings();
+                    }
+#endif
+                } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
+                    audio_testing_queue_.Push(std::move(packet));
+                } else if (task->type == kAudioTaskTypeEncodeToLoopback) {
+                    PushPacketToDecodeQueue(std::move(packet));
+                }
+                debug_statistics_.encode_count++;
             } else {
-                ESP_LOGE(TAG, "Failed to encode audio: encoder not configured or invalid frame size (got %u, expected %u)",
-                         task->pcm.size(), encoder_frame_size_);
+                ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
             }
-            lock.lock();
+        } else {
+            ESP_LOGE(TAG, "Failed to encode audio: encoder not configured or invalid frame size (got %zu, expected %d)",
+                     task->pcm.size(), encoder_frame_size_);
         }
+        UpdateCodecTaskStats(encode_stats_, encode_max_reset_, start_time, encoder_duration_ms_);
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    ESP_LOGW(TAG, "Opus encode task stopped");
 }
 
-void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (decoder_sample_rate_ == sample_rate && decoder_duration_ms_ == frame_duration) {
-        return;
+void AudioService::UpdateCodecTaskStats(CodecTaskStats& stats, std::atomic<bool>& reset_max, int64_t start_time,
+    int frame_duration_ms) {
+    uint32_t elapsed_us = esp_timer_get_time() - start_time;
+    if (reset_max.exchange(false, std::memory_order_relaxed)) {
+        stats.max_time_us = 0;
     }
-    std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-    if (opus_decoder_ != nullptr) {
-        esp_opus_dec_close(opus_decoder_);
-        opus_decoder_ = nullptr;
+    stats.frames++;
+    stats.total_time_us += elapsed_us;
+    if (elapsed_us > stats.max_time_us) {
+        stats.max_time_us = elapsed_us;
     }
-    decoder_lock.unlock();
-    esp_opus_dec_cfg_t opus_dec_cfg = OPUS_DEC_CFG(sample_rate, frame_duration);
-    auto ret = esp_opus_dec_open(&opus_dec_cfg, sizeof(esp_opus_dec_cfg_t), &opus_decoder_);
-    if (opus_decoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", ret);
-        return;
+    if (elapsed_us > (uint32_t)frame_duration_ms * 1000) {
+        stats.deadline_misses++;
     }
-    decoder_sample_rate_ = sample_rate;
-    decoder_duration_ms_ = frame_duration;
-    decoder_frame_size_ = decoder_sample_rate_ / 1000 * frame_duration;
+}
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (decoder_sample_rate_ != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", decoder_sample_rate_, codec->output_sample_rate());
-        if (output_resampler_ != nullptr) {
-            esp_ae_rate_cvt_close(output_resampler_);
-            output_resampler_ = nullptr;
-        }
-        esp_ae_rate_cvt_cfg_t output_resampler_cfg = RATE_CVT_CFG(
-            decoder_sample_rate_, codec->output_sample_rate(), ESP_AUDIO_MONO);
-        auto resampler_ret = esp_ae_rate_cvt_open(&output_resampler_cfg, &output_resampler_);
-        if (output_resampler_ == nullptr) {
-            ESP_LOGE(TAG, "Failed to create output resampler, error code: %d", resampler_ret);
-        }
+bool AudioService::SetEncodeFrameDuration(int frame_duration_ms) {
+    if (AS_OPUS_GET_FRAME_DRU_ENUM(frame_duration_ms) < 0) {
+        ESP_LOGE(TAG, "Invalid encode frame duration: %d ms", frame_duration_ms);
+        return false;
+    }
+    if (opus_encoder_ != nullptr) {
+        esp_opus_enc_close(opus_encoder_);
+        opus_encoder_ = nullptr;
     }
+
+    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG(frame_duration_ms);
+    encoder_settings_ = encoder_controller_.settings();
+    opus_enc_cfg.bitrate = encoder_settings_.bitrate;
+    opus_enc_cfg.complexity = encoder_settings_.complexity;
+    opus_enc_cfg.enable_fec = encoder_settings_.fec;
+    auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
+    if (opus_encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
+        return false;
+    }
+    encoder_sample_rate_ = 16000;
+    encoder_duration_ms_ = frame_duration_ms;
+    esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
+    encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
+    encode_buffer_.resize(encoder_outbuf_size_);
+    if (packet_payload_reserve_ != 0 && (size_t)(AUDIO_PACKET_HEADROOM + encoder_outbuf_size_) > packet_payload_reserve_) {
+        ESP_LOGW(TAG, "Encoder output buffer of %d bytes exceeds the %u byte packet buffers, packets are copied",
+            encoder_outbuf_size_, (unsigned)packet_payload_reserve_);
+    }
+    return true;
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
+void AudioService::ApplyEncoderSettings() {
+    auto settings = encoder_controller_.settings();
+    bool bitrate_only = settings.complexity == encoder_settings_.complexity && settings.fec == encoder_settings_.fec &&
+        settings.bitrate != ESP_OPUS_BITRATE_AUTO && encoder_settings_.bitrate != ESP_OPUS_BITRATE_AUTO;
+    if (bitrate_only && esp_opus_enc_set_bitrate(opus_encoder_, settings.bitrate) == ESP_AUDIO_ERR_OK) {
+        encoder_settings_ = settings;
+        return;
+    }
+    /* Complexity and FEC are only set when the encoder opens */
+    SetEncodeFrameDuration(encoder_duration_ms_);
+}
+
+bool AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::span<const int16_t> pcm, int64_t origin_time_us,
+    bool wait) {
+    size_t max_tasks = AS_QUEUE_FRAMES(MAX_ENCODE_QUEUE_MS, (int)(pcm.size() * 1000 / 16000));
+    if (!wait && audio_encode_queue_.Size() >= max_tasks) {
+        return false;
+    }
+
     auto task = std::make_unique<AudioTask>();
     task->type = type;
-    task->pcm = std::move(pcm);
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    task->origin_time_us = origin_time_us;
+    task->stage_time_us = esp_timer_get_time();
+    /* Copy into the pooled buffer instead of adopting the caller's allocation */
+    AssignBuffer(task->pcm, pcm.data(), pcm.size());
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        size_t timestamps = timestamp_queue_.Size();
+        uint32_t timestamp = 0;
+        if (timestamp_queue_.Pop(timestamp)) {
+            if (timestamps <= MAX_TIMESTAMPS_IN_QUEUE) {
+                task->timestamp = timestamp;
+            } else {
+                ESP_LOGW(TAG, "Timestamp queue (%zu) is full, dropping timestamp", timestamps);
+            }
         }
-        timestamp_queue_.pop_front();
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    /* Push the task to the encode queue, only the input task pushes so the room checked above stays */
+    while (audio_encode_queue_.Size() >= max_tasks && !service_stopped_) {
+        xEventGroupWaitBits(event_group_, AS_EVENT_ENCODE_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    return audio_encode_queue_.Push(std::move(task));
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+    if (packet->sequence != 0 && packet->origin_time_us == 0) {
+        packet->origin_time_us = esp_timer_get_time();
+    }
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+            if (audio_decode_queue_.Size() < AS_QUEUE_FRAMES(MAX_DECODE_QUEUE_MS, packet->frame_duration)) {
+                return audio_decode_queue_.Push(std::move(packet));
+            }
+        }
+        if (!wait || service_stopped_) {
             return false;
         }
+        /* Wait outside the producer lock so the network task never blocks behind us */
+        xEventGroupWaitBits(event_group_, AS_EVENT_DECODE_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
-    return true;
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+    std::unique_ptr<AudioStreamPacket> packet;
+    if (audio_send_queue_.Pop(packet)) {
+        int64_t now = esp_timer_get_time();
+        latency_.Record(kLatencyStageSendQueue, packet->stage_time_us, now);
+        packet->stage_time_us = now;
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
+void AudioService::RecordPacketSent(int64_t origin_time_us, int64_t stage_time_us) {
+    int64_t now = esp_timer_get_time();
+    latency_.Record(kLatencyStageSend, stage_time_us, now);
+    latency_.Record(kLatencyStageUplink, origin_time_us, now);
+}
+
+void AudioService::LogLatency() {
+    latency_.Log();
+    latency_.Rotate();
+}
+
 void AudioService::EncodeWakeWord() {
     if (wake_word_) {
-        wake_word_->EncodeWakeWordData();
+        wake_word_->EncodeWakeWordData(frame_duration_ms_);
     }
 }
 
@@ -547,11 +968,13 @@ const std::string& AudioService::GetLastWakeWord() const {
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
-    if (wake_word_->GetWakeWordOpus(packet->payload)) {
-        return packet;
+    std::vector<uint8_t> opus;
+    if (!wake_word_->GetWakeWordOpus(opus)) {
+        return nullptr;
     }
-    return nullptr;
+    auto packet = std::make_unique<AudioStreamPacket>();
+    AssignBuffer(packet->payload, opus.data(), opus.size());
+    return packet;
 }
 
 void AudioService::EnableWakeWordDetection(bool enable) {
@@ -567,6 +990,7 @@ void AudioService::EnableWakeWordDetection(bool enable) {
                 return;
             }
             wake_word_initialized_ = true;
+            wake_word_->SetFrameDuration(frame_duration_ms_);
         }
         // Reset input resampler to clear cached data from previous mode (e.g. AudioProcessor)
         // This prevents buffer overflow when switching between different feed sizes
@@ -588,7 +1012,7 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, frame_duration_ms_, models_list_);
             audio_processor_initialized_ = true;
         }
 
@@ -603,12 +1027,35 @@ void AudioService::EnableVoiceProcessing(bool enable) {
                 esp_ae_rate_cvt_reset(input_resampler_);
             }
         }
+        /* The processor output counts frames from here, the input task only marks reads while it feeds it */
+        processed_frames_ = capture_clock_.frames();
+        uplink_gate_.Start();
+        uplink_session_bytes_ = 0;
+#if CONFIG_AUDIO_ADAPTIVE_ENCODER
+        /* A level the encoder was too slow for gets another try each session */
+        encoder_controller_.ResetCeiling();
+#endif
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+        if (uplink_gate_.policy() != kUplinkGateSendAll) {
+            auto stats = uplink_gate_.Finish();
+            uint32_t saved = GetUplinkSavedBytes(stats);
+            uplink_saved_bytes_ += saved;
+            ESP_LOGI(TAG, "Uplink gate: sent %" PRIu32 " ms, dropped %" PRIu32 " ms, about %" PRIu32 " bytes saved",
+                stats.sent_ms, stats.dropped_ms, saved);
+        }
+    }
+}
+
+uint32_t AudioService::GetUplinkSavedBytes(const UplinkGate::Stats& stats) {
+    /* The dropped audio would have been encoded at the session's average rate */
+    if (stats.sent_ms == 0) {
+        return 0;
     }
+    return (uint64_t)stats.dropped_ms * uplink_session_bytes_ / stats.sent_ms;
 }
 
 void AudioService::EnableAudioTesting(bool enable) {
@@ -617,17 +1064,20 @@ void AudioService::EnableAudioTesting(bool enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Move audio_testing_queue_ to audio_decode_queue_ */
+        std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+        audio_decode_queue_.Clear();
+        std::unique_ptr<AudioStreamPacket> packet;
+        while (audio_testing_queue_.Pop(packet)) {
+            audio_decode_queue_.Push(std::move(packet));
+        }
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, frame_duration_ms_, models_list_);
         audio_processor_initialized_ = true;
     }
 
@@ -647,34 +1097,81 @@ void AudioService::PlaySound(const std::string_view& ogg) {
 
     const auto* buf = reinterpret_cast<const uint8_t*>(ogg.data());
     size_t size = ogg.size();
+    std::lock_guard<std::mutex> lock(sound_producer_mutex_);
+    auto clip = sound_cache_.Find(ogg.data());
+    if (!sound_mixer_.Pending(audio_cue_playback_queue_) && audio_cue_queue_.Empty() && !cue_clip_active_) {
+        cue_request_cached_ = clip != nullptr;
+        cue_request_time_us_ = esp_timer_get_time();
+    }
+    if (clip != nullptr) {
+        SoundCue cue;
+        cue.clip = std::move(clip);
+        PushCue(std::move(cue));
+        return;
+    }
+
+    /* Decoded from Opus, the decode task records the PCM for the next play */
+    cue_record_key_ = sound_cache_.enabled() ? ogg.data() : nullptr;
     demuxer_.Reset();
     demuxer_.Process(buf, size);
+    cue_record_key_ = nullptr;
+    if (sound_cache_.enabled()) {
+        SoundCue cue;
+        cue.end = true;
+        PushCue(std::move(cue));
+    }
+}
+
+bool AudioService::SetFrameDuration(int frame_duration_ms) {
+    static_assert(OPUS_FRAME_DURATION_MS <= OPUS_MAX_FRAME_DURATION_MS);
+    if (frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != OPUS_MAX_FRAME_DURATION_MS) {
+        ESP_LOGE(TAG, "Unsupported frame duration: %d ms", frame_duration_ms);
+        return false;
+    }
+    if (frame_duration_ms == frame_duration_ms_) {
+        return true;
+    }
+    ESP_LOGI(TAG, "Uplink frame duration: %d ms -> %d ms", frame_duration_ms_.load(), frame_duration_ms);
+    frame_duration_ms_ = frame_duration_ms;
+    /* The encoder follows the size of the frames it receives, the processor starts cutting new ones now */
+    if (audio_processor_initialized_) {
+        audio_processor_->SetFrameDuration(frame_duration_ms);
+    }
+    if (wake_word_initialized_) {
+        wake_word_->SetFrameDuration(frame_duration_ms);
+    }
+
+    Settings settings("audio", true);
+    settings.SetInt("frame_duration", frame_duration_ms);
+    return true;
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.Empty() && audio_decode_queue_.Empty() && jitter_buffer_.Depth() == 0 &&
+        audio_playback_queue_.Empty() && audio_testing_queue_.Empty() && audio_cue_queue_.Empty() &&
+        !cue_clip_active_ && !sound_mixer_.Pending(audio_cue_playback_queue_);
 }
 
 void AudioService::WaitForPlaybackQueueEmpty() {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    audio_queue_cv_.wait(lock, [this]() { 
-        return service_stopped_ || (audio_decode_queue_.empty() && audio_playback_queue_.empty()); 
-    });
+    /* AS_EVENT_PLAYBACK_DRAINED is set whenever the decode, playback or cue queues may have become empty */
+    while (!service_stopped_ &&
+           !(audio_decode_queue_.Empty() && jitter_buffer_.Depth() == 0 && audio_playback_queue_.Empty() &&
+             audio_cue_queue_.Empty() && !cue_clip_active_ && !sound_mixer_.Pending(audio_cue_playback_queue_))) {
+        xEventGroupWaitBits(event_group_, AS_EVENT_PLAYBACK_DRAINED, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-    if (opus_decoder_ != nullptr) {
-        esp_opus_dec_reset(opus_decoder_);
-    }
+    decoders_.Reset();
     decoder_lock.unlock();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    timestamp_queue_.Clear();
+    /* The jitter buffer belongs to the decode task, it is reset there (Clear() wakes the task up) */
+    jitter_reset_requested_ = true;
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_DRAINED);
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
@@ -717,7 +1214,239 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
         });
+        wake_word_->OnSpeechStart([this]() {
+            if (callbacks_.on_speech_start) {
+                callbacks_.on_speech_start();
+            }
+        });
+    }
+}
+
+bool AudioService::StartCodecStressTest(int duration_ms) {
+    EventBits_t bits = xEventGroupGetBits(event_group_);
+    if (service_stopped_ || (bits & (AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING |
+        AS_EVENT_CODEC_STRESS_RUNNING))) {
+        ESP_LOGW(TAG, "Codec stress test needs an idle audio service");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Starting codec stress test for %d ms", duration_ms);
+    codec_stress_encode_base_ = encode_stats_;
+    codec_stress_decode_base_ = decode_stats_;
+    encode_max_reset_ = true;
+    decode_max_reset_ = true;
+    codec_stress_allocs_base_ = GetPipelineAllocs();
+    audio_encode_queue_.ResetPeak();
+    audio_decode_queue_.ResetPeak();
+    audio_playback_queue_.ResetPeak();
+    codec_stress_start_time_ = esp_timer_get_time();
+    codec_stress_end_time_ = codec_stress_start_time_ + (int64_t)duration_ms * 1000;
+    xEventGroupSetBits(event_group_, AS_EVENT_CODEC_STRESS_RUNNING);
+    return true;
+}
+
+static CodecTaskStats CodecTaskStatsSince(const CodecTaskStats& now, const CodecTaskStats& base) {
+    CodecTaskStats stats;
+    stats.frames = now.frames - base.frames;
+    stats.deadline_misses = now.deadline_misses - base.deadline_misses;
+    stats.total_time_us = now.total_time_us - base.total_time_us;
+    // Reset by the codec tasks when the run started
+    stats.max_time_us = now.max_time_us;
+    return stats;
+}
+
+void AudioService::FinishCodecStressTest() {
+    xEventGroupClearBits(event_group_, AS_EVENT_CODEC_STRESS_RUNNING);
+    /* Drop the looped back frames that are still queued */
+    ResetDecoder();
+
+    codec_stress_encode_result_ = CodecTaskStatsSince(encode_stats_, codec_stress_encode_base_);
+    codec_stress_decode_result_ = CodecTaskStatsSince(decode_stats_, codec_stress_decode_base_);
+    auto& result = codec_stress_result_;
+    result.elapsed_ms = (esp_timer_get_time() - codec_stress_start_time_) / 1000;
+    result.encode_queue_peak = audio_encode_queue_.peak();
+    result.decode_queue_peak = audio_decode_queue_.peak();
+    result.playback_queue_peak = audio_playback_queue_.peak();
+    result.allocs = GetPipelineAllocs() - codec_stress_allocs_base_;
+    for (auto [name, stats] : { std::pair{"encode", &codec_stress_encode_result_},
+                                std::pair{"decode", &codec_stress_decode_result_} }) {
+        ESP_LOGI(TAG, "Codec stress %s: %" PRIu32 " frames (%.1f/s), %" PRIu32 " deadline misses, avg %" PRIu32 " us, max %" PRIu32 " us", name,
+            stats->frames, result.elapsed_ms > 0 ? stats->frames * 1000.0f / result.elapsed_ms : 0.0f,
+            stats->deadline_misses,
+            stats->frames > 0 ? (uint32_t)(stats->total_time_us / stats->frames) : 0, stats->max_time_us);
+    }
+    ESP_LOGI(TAG, "Codec stress queue peaks: encode %" PRIu32 ", decode %" PRIu32 ", playback %" PRIu32 ", %" PRIu32 " allocations in %" PRIu32 " ms",
+        result.encode_queue_peak, result.decode_queue_peak, result.playback_queue_peak, result.allocs, result.elapsed_ms);
+    ESP_LOGI(TAG, "Stack high water mark: encode %u of %u, decode %u of %u bytes",
+        (unsigned)uxTaskGetStackHighWaterMark(opus_encode_task_handle_), (unsigned)CONFIG_AUDIO_ENCODE_TASK_STACK_SIZE,
+        (unsigned)uxTaskGetStackHighWaterMark(opus_decode_task_handle_), (unsigned)CONFIG_AUDIO_DECODE_TASK_STACK_SIZE);
+}
+
+static cJSON* CodecTaskStatsToJson(const CodecTaskStats& stats) {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "frames", stats.frames);
+    cJSON_AddNumberToObject(json, "deadline_misses", stats.deadline_misses);
+    cJSON_AddNumberToObject(json, "avg_time_us", stats.frames > 0 ? stats.total_time_us / stats.frames : 0);
+    cJSON_AddNumberToObject(json, "max_time_us", stats.max_time_us);
+    return json;
+}
+
+static cJSON* PoolStatsToJson(const AudioPoolStats& stats) {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "capacity", stats.capacity);
+    cJSON_AddNumberToObject(json, "in_use", stats.in_use);
+    cJSON_AddNumberToObject(json, "peak", stats.peak);
+    cJSON_AddNumberToObject(json, "fallback_allocs", stats.fallback_allocs);
+    cJSON_AddNumberToObject(json, "buffer_allocs", stats.buffer_allocs);
+    return json;
+}
+
+static cJSON* DecoderCacheStatsToJson(const DecoderCache::Stats& stats) {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "open", stats.entries);
+    cJSON_AddNumberToObject(json, "hits", stats.hits);
+    cJSON_AddNumberToObject(json, "misses", stats.misses);
+    cJSON_AddNumberToObject(json, "evictions", stats.evictions);
+    return json;
+}
+
+uint32_t AudioService::GetPipelineAllocs() {
+    auto packets = AudioPacketPool::GetInstance().GetStats();
+    auto tasks = AudioTaskPool::GetInstance().GetStats();
+    return packets.fallback_allocs + packets.buffer_allocs + tasks.fallback_allocs + tasks.buffer_allocs +
+        GetInputTaskAllocs();
+}
+
+cJSON* AudioService::GetStatsJson() {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "frame_duration_ms", frame_duration_ms_);
+    cJSON_AddItemToObject(json, "packet_pool", PoolStatsToJson(AudioPacketPool::GetInstance().GetStats()));
+    cJSON_AddItemToObject(json, "task_pool", PoolStatsToJson(AudioTaskPool::GetInstance().GetStats()));
+    cJSON* input = cJSON_CreateObject();
+#if CONFIG_AUDIO_INPUT_ALLOC_COUNTER
+    cJSON_AddNumberToObject(input, "allocs", GetInputTaskAllocs());
+    cJSON_AddNumberToObject(input, "allocs_per_sec", input_allocs_per_sec_);
+#else
+    /* Without the heap hooks only the capture buffers growing is seen, not every allocation */
+    cJSON_AddNumberToObject(input, "scratch_growth", GetInputTaskAllocs());
+    cJSON_AddNumberToObject(input, "scratch_growth_per_sec", input_allocs_per_sec_);
+#endif
+    cJSON_AddItemToObject(json, "input", input);
+    cJSON_AddItemToObject(json, "encode", CodecTaskStatsToJson(encode_stats_));
+    cJSON_AddItemToObject(json, "decode", CodecTaskStatsToJson(decode_stats_));
+    auto jitter = jitter_buffer_.GetStats();
+    cJSON* jitter_json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jitter_json, "depth", jitter.depth);
+    cJSON_AddNumberToObject(jitter_json, "target_depth", jitter.target_depth);
+    cJSON_AddNumberToObject(jitter_json, "jitter_ms", jitter.jitter_ms);
+    cJSON_AddNumberToObject(jitter_json, "received", jitter.received);
+    cJSON_AddNumberToObject(jitter_json, "reordered", jitter.reordered);
+    cJSON_AddNumberToObject(jitter_json, "late", jitter.late);
+    cJSON_AddNumberToObject(jitter_json, "duplicates", jitter.duplicates);
+    cJSON_AddNumberToObject(jitter_json, "lost", jitter.lost);
+    cJSON_AddNumberToObject(jitter_json, "concealed", jitter.concealed);
+    cJSON_AddNumberToObject(jitter_json, "underruns", jitter.underruns);
+    cJSON_AddItemToObject(json, "jitter_buffer", jitter_json);
+    cJSON* cue_json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(cue_json, "played", sound_mixer_.cues_started());
+    cJSON_AddNumberToObject(cue_json, "last_start_latency_ms", cue_last_start_latency_us_ / 1000);
+    cJSON_AddNumberToObject(cue_json, "max_start_latency_ms", cue_max_start_latency_us_ / 1000);
+    /* Average start latency of the sounds decoded from Opus and of the ones played from the cache */
+    cJSON_AddNumberToObject(cue_json, "avg_decoded_start_latency_ms", cue_start_count_[0] > 0 ?
+        cue_start_latency_sum_us_[0] / cue_start_count_[0] / 1000.0 : 0);
+    cJSON_AddNumberToObject(cue_json, "avg_cached_start_latency_ms", cue_start_count_[1] > 0 ?
+        cue_start_latency_sum_us_[1] / cue_start_count_[1] / 1000.0 : 0);
+    auto cache = sound_cache_.GetStats();
+    cJSON* cache_json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(cache_json, "clips", cache.clips);
+    cJSON_AddNumberToObject(cache_json, "bytes", cache.bytes);
+    cJSON_AddNumberToObject(cache_json, "hits", cache.hits);
+    cJSON_AddNumberToObject(cache_json, "misses", cache.misses);
+    cJSON_AddNumberToObject(cache_json, "evictions", cache.evictions);
+    cJSON_AddItemToObject(cue_json, "cache", cache_json);
+    {
+        /* Sound packets read in place from flash, and the ones copied because they span two Ogg pages */
+        std::lock_guard<std::mutex> lock(sound_producer_mutex_);
+        cJSON_AddNumberToObject(cue_json, "packets_in_place", demuxer_.view_packets());
+        cJSON_AddNumberToObject(cue_json, "packets_copied", demuxer_.copied_packets());
+    }
+    cJSON_AddItemToObject(json, "sound_cues", cue_json);
+    cJSON* decoders_json = cJSON_CreateObject();
+    cJSON_AddItemToObject(decoders_json, "speech", DecoderCacheStatsToJson(decoders_.GetStats()));
+    cJSON_AddItemToObject(decoders_json, "sounds", DecoderCacheStatsToJson(cue_decoders_.GetStats()));
+    cJSON_AddItemToObject(json, "decoders", decoders_json);
+    auto encoder = encoder_controller_.GetStats();
+    auto encoder_settings = EncoderController::GetLevelSettings(encoder.level);
+    cJSON* encoder_json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(encoder_json, "level", encoder.level);
+    cJSON_AddNumberToObject(encoder_json, "max_level", encoder.max_level);
+    cJSON_AddNumberToObject(encoder_json, "ceiling", encoder.ceiling);
+    if (encoder_settings.bitrate == ESP_OPUS_BITRATE_AUTO) {
+        cJSON_AddStringToObject(encoder_json, "bitrate", "auto");
+    } else {
+        cJSON_AddNumberToObject(encoder_json, "bitrate", encoder_settings.bitrate);
+    }
+    cJSON_AddNumberToObject(encoder_json, "complexity", encoder_settings.complexity);
+    cJSON_AddBoolToObject(encoder_json, "fec", encoder_settings.fec);
+    cJSON_AddNumberToObject(encoder_json, "changes", encoder.changes);
+    cJSON_AddNumberToObject(encoder_json, "send_failures", encoder.send_failures);
+    cJSON_AddNumberToObject(encoder_json, "cpu_percent", encoder.cpu_percent);
+    cJSON_AddNumberToObject(encoder_json, "max_queue_ms", encoder.max_queue_ms);
+    cJSON_AddItemToObject(json, "encoder", encoder_json);
+    if (uplink_gate_.policy() != kUplinkGateSendAll) {
+        auto gate = uplink_gate_.GetStats();
+        cJSON* gate_json = cJSON_CreateObject();
+        cJSON_AddStringToObject(gate_json, "policy", uplink_gate_.policy() == kUplinkGateSpeech ? "speech" : "keepalive");
+        cJSON_AddNumberToObject(gate_json, "padding_ms", uplink_gate_.padding_ms());
+        /* The current session, or the last one when voice processing is off */
+        cJSON_AddNumberToObject(gate_json, "session_sent_ms", gate.sent_ms);
+        cJSON_AddNumberToObject(gate_json, "session_dropped_ms", gate.dropped_ms);
+        cJSON_AddNumberToObject(gate_json, "session_keepalive_frames", gate.keepalive_frames);
+        cJSON_AddNumberToObject(gate_json, "session_saved_bytes", GetUplinkSavedBytes(gate));
+        cJSON_AddNumberToObject(gate_json, "total_saved_bytes", uplink_saved_bytes_);
+        cJSON_AddItemToObject(json, "uplink_gate", gate_json);
+    }
+    if (echo_reference_enabled_) {
+        auto echo = echo_reference_.GetStats();
+        cJSON* echo_json = cJSON_CreateObject();
+        cJSON_AddNumberToObject(echo_json, "delay_ms", echo.delay_ms);
+        cJSON_AddBoolToObject(echo_json, "locked", echo.locked);
+        cJSON_AddNumberToObject(echo_json, "estimates", echo.estimates);
+        cJSON_AddNumberToObject(echo_json, "rejected", echo.rejected);
+        cJSON_AddNumberToObject(echo_json, "peak_ratio", echo.peak_ratio);
+        cJSON_AddItemToObject(json, "echo_reference", echo_json);
+    }
+    /* Frames queued now, and the deepest since the service started or the last stress test */
+    cJSON* queues = cJSON_CreateObject();
+    for (auto [name, size, peak] : { std::tuple{"encode", audio_encode_queue_.Size(), audio_encode_queue_.peak()},
+                                     std::tuple{"send", audio_send_queue_.Size(), audio_send_queue_.peak()},
+                                     std::tuple{"decode", audio_decode_queue_.Size(), audio_decode_queue_.peak()},
+                                     std::tuple{"playback", audio_playback_queue_.Size(), audio_playback_queue_.peak()} }) {
+        cJSON* queue = cJSON_CreateObject();
+        cJSON_AddNumberToObject(queue, "size", size);
+        cJSON_AddNumberToObject(queue, "peak", peak);
+        cJSON_AddItemToObject(queues, name, queue);
+    }
+    cJSON_AddItemToObject(json, "queues", queues);
+    cJSON* stress = cJSON_CreateObject();
+    cJSON_AddBoolToObject(stress, "running", xEventGroupGetBits(event_group_) & AS_EVENT_CODEC_STRESS_RUNNING);
+    auto& result = codec_stress_result_;
+    cJSON_AddNumberToObject(stress, "elapsed_ms", result.elapsed_ms);
+    for (auto [name, stats] : { std::pair{"encode", &codec_stress_encode_result_},
+                                std::pair{"decode", &codec_stress_decode_result_} }) {
+        cJSON* direction = CodecTaskStatsToJson(*stats);
+        cJSON_AddNumberToObject(direction, "frames_per_sec",
+            result.elapsed_ms > 0 ? stats->frames * 1000.0 / result.elapsed_ms : 0);
+        cJSON_AddItemToObject(stress, name, direction);
     }
+    cJSON* peaks = cJSON_CreateObject();
+    cJSON_AddNumberToObject(peaks, "encode", result.encode_queue_peak);
+    cJSON_AddNumberToObject(peaks, "decode", result.decode_queue_peak);
+    cJSON_AddNumberToObject(peaks, "playback", result.playback_queue_peak);
+    cJSON_AddItemToObject(stress, "queue_peaks", peaks);
+    cJSON_AddNumberToObject(stress, "allocs", result.allocs);
+    cJSON_AddItemToObject(json, "stress", stress);
+    return json;
 }
 
 bool AudioService::IsAfeWakeWord() {
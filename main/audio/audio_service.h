@@ -2,10 +2,11 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <span>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -24,25 +25,63 @@
 #include "wake_word.h"
 #include "protocol.h"
 #include "ogg_demuxer.h"
+#include "audio_queue.h"
+#include "audio_pool.h"
+#include "jitter_buffer.h"
+#include "audio_scratch.h"
+#include "sound_mixer.h"
+#include "sound_cache.h"
+#include "audio_latency.h"
+#include "echo_reference.h"
+#include "uplink_gate.h"
+#include "encoder_controller.h"
+#include "decoder_cache.h"
 
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Speaker / Processors, and one task each for the Opus Encoder and the
+ * Opus Decoder, so a slow frame in one direction never delays the other.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
- * 
+ *
+ * Every queue is a fixed-capacity single-producer / single-consumer ring (AudioQueue) with its own
+ * event bits, so a push or pop only wakes the task on the other side of that queue.
  */
 
-#define OPUS_FRAME_DURATION_MS 60
-#define MAX_ENCODE_TASKS_IN_QUEUE 2
-#define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define OPUS_FRAME_DURATION_MS 60       // Default uplink frame duration, see SetFrameDuration()
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#define OPUS_MAX_FRAME_DURATION_MS 60
+
+// Queue limits are durations, so the buffering depth does not depend on the frame duration
+#define MAX_ENCODE_QUEUE_MS 120
+#define MAX_PLAYBACK_QUEUE_MS 120
+#define MAX_DECODE_QUEUE_MS 2400
+#define MAX_SEND_QUEUE_MS 2400
+#define MAX_CUE_PLAYBACK_QUEUE_MS 120   // Sound cue PCM decoded ahead of the output task
+#define AUDIO_CUE_QUEUE_PACKETS 32      // Sound cue Opus packets, PlaySound() waits beyond that
+#define AUDIO_CUE_RENDER_MS 20          // Cue chunk played when nothing else plays
+#define AUDIO_CUE_CLIP_FRAME_MS 60      // Cached sounds are queued to the cue voice in frames of this length
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
+#define AS_QUEUE_FRAMES(duration_ms, frame_duration_ms) \
+    std::max<size_t>(1, (duration_ms) / std::max<int>((frame_duration_ms), OPUS_MIN_FRAME_DURATION_MS))
+
+// Packets / tasks that can be alive outside the queues (being encoded, decoded, sent or played).
+// Sized for the default frame duration, shorter frames only use more when the queues back up.
+#define AUDIO_PACKET_POOL_SIZE (AS_QUEUE_FRAMES(MAX_DECODE_QUEUE_MS, OPUS_FRAME_DURATION_MS) + \
+    AS_QUEUE_FRAMES(MAX_SEND_QUEUE_MS, OPUS_FRAME_DURATION_MS) + JITTER_BUFFER_CAPACITY + AUDIO_CUE_QUEUE_PACKETS + 8)
+// The headroom and the largest packet of the encoder ladder, so the encoder writes into the pooled
+// buffer. Initialize() raises it when the encoder asks for a larger output buffer.
+#define AUDIO_PACKET_PAYLOAD_RESERVE (AUDIO_PACKET_HEADROOM + \
+    ENCODER_MAX_BITRATE / 8 * OPUS_MAX_FRAME_DURATION_MS / 1000 + 64)
+#define AUDIO_TASK_POOL_SIZE (AS_QUEUE_FRAMES(MAX_ENCODE_QUEUE_MS, OPUS_MIN_FRAME_DURATION_MS) + \
+    AS_QUEUE_FRAMES(MAX_PLAYBACK_QUEUE_MS, OPUS_FRAME_DURATION_MS) + \
+    AS_QUEUE_FRAMES(MAX_CUE_PLAYBACK_QUEUE_MS, OPUS_FRAME_DURATION_MS) + 5)
+
+#define AUDIO_INPUT_RESAMPLE_SLACK 32  // Extra frames for the input resampler rounding up
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
@@ -51,6 +90,18 @@
 #define AS_EVENT_WAKE_WORD_RUNNING          (1 << 1)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
+#define AS_EVENT_PLAYBACK_NOT_FULL          (1 << 4)
+#define AS_EVENT_ENCODE_NOT_EMPTY           (1 << 5)
+#define AS_EVENT_ENCODE_NOT_FULL            (1 << 6)
+#define AS_EVENT_DECODE_NOT_EMPTY           (1 << 7)
+#define AS_EVENT_DECODE_NOT_FULL            (1 << 8)
+#define AS_EVENT_SEND_NOT_FULL              (1 << 9)
+#define AS_EVENT_PLAYBACK_DRAINED           (1 << 10)
+#define AS_EVENT_CODEC_STRESS_RUNNING       (1 << 11)
+#define AS_EVENT_CUE_NOT_EMPTY              (1 << 12)
+#define AS_EVENT_CUE_NOT_FULL               (1 << 13)
+#define AS_EVENT_CUE_PLAYBACK_NOT_EMPTY     (1 << 14)
+#define AS_EVENT_CUE_PLAYBACK_NOT_FULL      (1 << 15)
 
 #define AS_OPUS_GET_FRAME_DRU_ENUM(duration_ms)                   \
     ((duration_ms) == 5 ? ESP_OPUS_ENC_FRAME_DURATION_5_MS :      \
@@ -62,12 +113,12 @@
      (duration_ms) == 100 ? ESP_OPUS_ENC_FRAME_DURATION_100_MS :  \
      (duration_ms) == 120 ? ESP_OPUS_ENC_FRAME_DURATION_120_MS : -1)
 
-#define AS_OPUS_ENC_CONFIG() {                                                                                    \
+#define AS_OPUS_ENC_CONFIG(duration_ms) {                                                                         \
         .sample_rate        = ESP_AUDIO_SAMPLE_RATE_16K,                                                          \
         .channel            = ESP_AUDIO_MONO,                                                                     \
         .bits_per_sample    = ESP_AUDIO_BIT16,                                                                    \
         .bitrate            = ESP_OPUS_BITRATE_AUTO,                                                              \
-        .frame_duration     = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(OPUS_FRAME_DURATION_MS),  \
+        .frame_duration     = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(duration_ms),             \
         .application_mode   = ESP_OPUS_ENC_APPLICATION_AUDIO,                                                     \
         .complexity         = 0,                                                                                  \
         .enable_fec         = false,                                                                              \
@@ -75,9 +126,20 @@
         .enable_vbr         = true,                                                                               \
     }
 
+// An entry of the sound cue queue
+struct SoundCue {
+    std::unique_ptr<AudioStreamPacket> packet;  // Opus packet to decode
+    std::span<const uint8_t> view;              // Or one read in place from the Ogg data of PlaySound()
+    int sample_rate = 0;                        // Of the view
+    std::shared_ptr<const SoundClip> clip;      // Or a cached sound, already at the output rate
+    const void* record = nullptr;               // First packet of a sound to cache
+    bool end = false;                           // Follows the last packet of a sound
+};
+
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
+    std::function<void(void)> on_speech_start;    // Heard by the wake word engine, see WakeWord::OnSpeechStart
     std::function<void(bool)> on_vad_change;
     std::function<void(void)> on_audio_testing_queue_full;
 };
@@ -87,12 +149,38 @@ enum AudioTaskType {
     kAudioTaskTypeEncodeToSendQueue,
     kAudioTaskTypeEncodeToTestingQueue,
     kAudioTaskTypeDecodeToPlaybackQueue,
+    kAudioTaskTypeEncodeToLoopback,
 };
 
 struct AudioTask {
-    AudioTaskType type;
-    std::vector<int16_t> pcm;
-    uint32_t timestamp;
+    AudioTaskType type = kAudioTaskTypeEncodeToSendQueue;
+    AudioPcm pcm;
+    uint32_t timestamp = 0;
+    int64_t origin_time_us = 0;     // Capture (uplink) or packet arrival (downlink), see AudioLatency
+    int64_t stage_time_us = 0;      // End of the previous stage
+
+    // Tasks are recycled through AudioTaskPool (audio_pool.h)
+    AudioTask();
+    ~AudioTask();
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+};
+
+// Per-direction codec timing, a frame misses its deadline when it takes longer than its duration
+struct CodecTaskStats {
+    uint32_t frames = 0;
+    uint32_t deadline_misses = 0;
+    uint32_t max_time_us = 0;
+    uint64_t total_time_us = 0;
+};
+
+// What the codec stress test measures besides the per-task codec stats
+struct CodecStressResult {
+    uint32_t elapsed_ms = 0;
+    uint32_t encode_queue_peak = 0;
+    uint32_t decode_queue_peak = 0;
+    uint32_t playback_queue_peak = 0;
+    uint32_t allocs = 0;    // Pool fallbacks, pool buffer replacements and capture buffer allocations
 };
 
 struct DebugStatistics {
@@ -129,10 +217,22 @@ public:
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    // Called after SendAudio() with the packet's origin and stage times
+    void RecordPacketSent(int64_t origin_time_us, int64_t stage_time_us);
+    // Called when SendAudio() fails, the encoder controller lowers the bitrate
+    void RecordPacketSendFailed() { encoder_controller_.OnSendFailed(); }
+    // The Ogg data is read in place until the sound has played, it must stay valid (the built-in sounds are in flash)
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
     void SetModelsList(srmodel_list_t* models_list);
+    cJSON* GetStatsJson();
+    cJSON* GetLatencyJson() const { return latency_.GetJson(); }
+    // Logs the per-stage latencies and starts a new histogram period
+    void LogLatency();
+    int GetFrameDuration() const { return frame_duration_ms_; }
+    bool SetFrameDuration(int frame_duration_ms);
+    bool StartCodecStressTest(int duration_ms);
 
 private:
     AudioCodec* codec_ = nullptr;
@@ -141,23 +241,58 @@ private:
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
     void* opus_encoder_ = nullptr;
-    void* opus_decoder_ = nullptr;
+    DecoderCache decoders_{"speech"};      // Under decoder_mutex_
     std::mutex decoder_mutex_;
     std::mutex input_resampler_mutex_;
     esp_ae_rate_cvt_handle_t input_resampler_ = nullptr;
-    esp_ae_rate_cvt_handle_t output_resampler_ = nullptr;
+    AudioScratch<int16_t> capture_buffer_;  // Codec rate samples before resampling, under input_resampler_mutex_
+    AudioScratch<int16_t> input_frame_;     // 16kHz frames handed to the consumers, input task only
+    AudioScratch<int16_t> reference_frame_; // input_frame_ with the software echo reference appended
+    EchoReference echo_reference_;
+    bool echo_reference_enabled_ = false;
+    UplinkGate uplink_gate_;
+    std::atomic<uint32_t> uplink_session_bytes_ = 0;   // Opus bytes queued for sending since voice processing started
+    uint64_t uplink_saved_bytes_ = 0;
+    uint32_t input_allocs_per_sec_ = 0;
+    uint32_t input_allocs_base_ = 0;
+    int64_t input_allocs_window_start_ = 0;
 
     OggDemuxer      demuxer_;
+    std::mutex sound_producer_mutex_;   // PlaySound() callers, demuxer_ and the cue queue producer side
+    const void* cue_record_key_ = nullptr;  // Set while demuxing a sound to cache, under sound_producer_mutex_
     
     // Encoder/Decoder state
     int encoder_sample_rate_ = 16000;
+    std::atomic<int> frame_duration_ms_ = OPUS_FRAME_DURATION_MS;  // Uplink, the encoder follows the frames it gets
     int encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
     int encoder_frame_size_ = 0;
+    EncoderController encoder_controller_;
+    EncoderSettings encoder_settings_ = {};     // Applied to opus_encoder_, encode task only
     int encoder_outbuf_size_ = 0;
-    int decoder_sample_rate_ = 0;
+    size_t packet_payload_reserve_ = 0;    // Set when the packet pool is created
     int decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
-    int decoder_frame_size_ = 0;
+    std::vector<uint8_t> encode_buffer_;
+    AudioPcm decode_buffer_;     // Same type as AudioTask::pcm, the decoder writes to either
+
+    // Sound cue voice, decoded by the decode task with its own decoder and mixed by the output task
+    DecoderCache cue_decoders_{"sounds"};
+    int cue_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    AudioPcm cue_decode_buffer_;
+    SoundMixer sound_mixer_;
+    SoundCache sound_cache_;
+    std::shared_ptr<const SoundClip> cue_clip_;     // Cached sound being queued, decode task only
+    size_t cue_clip_offset_ = 0;
+    std::atomic<bool> cue_clip_active_ = false;
+    std::atomic<int64_t> cue_request_time_us_ = 0;
+    std::atomic<bool> cue_request_cached_ = false;
+    uint32_t cue_last_start_latency_us_ = 0;
+    uint32_t cue_max_start_latency_us_ = 0;
+    uint64_t cue_start_latency_sum_us_[2] = {};     // Decoded, cached
+    uint32_t cue_start_count_[2] = {};
     DebugStatistics debug_statistics_;
+    AudioLatency latency_;
+    CaptureClock capture_clock_;
+    uint32_t processed_frames_ = 0;     // Processor output frames since it started, in capture_clock_ frames
     srmodel_list_t* models_list_ = nullptr;
 
     EventGroupHandle_t event_group_;
@@ -165,16 +300,34 @@ private:
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    CodecTaskStats encode_stats_;
+    CodecTaskStats decode_stats_;
+    // Set when a stress run starts, the owning task clears max_time_us before its next frame
+    std::atomic<bool> encode_max_reset_ = false;
+    std::atomic<bool> decode_max_reset_ = false;
+    int64_t codec_stress_start_time_ = 0;
+    int64_t codec_stress_end_time_ = 0;
+    uint32_t codec_stress_allocs_base_ = 0;
+    CodecStressResult codec_stress_result_;
+    CodecTaskStats codec_stress_encode_base_;
+    CodecTaskStats codec_stress_decode_base_;
+    CodecTaskStats codec_stress_encode_result_;
+    CodecTaskStats codec_stress_decode_result_;
+    // The decode queue has several producers (network, sounds, testing), they take this mutex
+    std::mutex decode_producer_mutex_;
+    AudioQueue<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
+    JitterBuffer jitter_buffer_;
+    std::atomic<bool> jitter_reset_requested_ = false;
+    AudioQueue<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
+    AudioQueue<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
+    AudioQueue<std::unique_ptr<AudioTask>> audio_encode_queue_;
+    AudioQueue<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    AudioQueue<SoundCue> audio_cue_queue_;
+    AudioQueue<std::unique_ptr<AudioTask>> audio_cue_playback_queue_;
     // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    AudioQueue<uint32_t> timestamp_queue_;
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
@@ -188,9 +341,25 @@ private:
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
-    void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void OpusEncodeTask();
+    void OpusDecodeTask();
+    void DecodeFrame(int sample_rate, int frame_duration, uint32_t timestamp, const uint8_t* data, size_t size, bool conceal,
+        int64_t origin_time_us);
+    void UpdateCodecTaskStats(CodecTaskStats& stats, std::atomic<bool>& reset_max, int64_t start_time, int frame_duration_ms);
+    void FinishCodecStressTest();
+    // With wait false, returns false instead of waiting when the encode queue is full
+    bool PushTaskToEncodeQueue(AudioTaskType type, std::span<const int16_t> pcm, int64_t origin_time_us = 0,
+        bool wait = true);
+    int ReadAudioFrames(int16_t* dest, size_t dest_frames, int sample_rate, int samples);
+    uint32_t GetInputTaskAllocs();
+    uint32_t GetPipelineAllocs();
+    void UpdateInputAllocRate();
+    uint32_t GetUplinkSavedBytes(const UplinkGate::Stats& stats);
+    void ApplyEncoderSettings();
+    void PushCue(SoundCue&& cue);
+    void DecodeCue(std::span<const uint8_t> payload, int sample_rate, int frame_duration);
+    void QueueCueClip();
+    bool SetEncodeFrameDuration(int frame_duration_ms);
     void CheckAndUpdateAudioPowerState();
 };
 
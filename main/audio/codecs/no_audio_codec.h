@@ -2,6 +2,7 @@
 #define _NO_AUDIO_CODEC_H
 
 #include "audio_codec.h"
+#include "audio_scratch.h"
 
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
@@ -10,6 +11,8 @@
 class NoAudioCodec : public AudioCodec {
 protected:
     std::mutex data_if_mutex_;
+    AudioScratch<int32_t> read_buffer_;     // 32-bit I2S samples, kept between calls
+    AudioScratch<int32_t> write_buffer_;
 
     virtual int Write(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
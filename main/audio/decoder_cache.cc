@@ -0,0 +1,117 @@
+#include "decoder_cache.h"
+#include "audio_service.h"
+
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "DecoderCache"
+
+DecoderCache::~DecoderCache() {
+    for (auto& entry : entries_) {
+        Close(entry);
+    }
+}
+
+void DecoderCache::Configure(size_t max_entries, int output_sample_rate) {
+    for (auto& entry : entries_) {
+        Close(entry);
+    }
+    max_entries_ = std::clamp<size_t>(max_entries, 1, DECODER_CACHE_MAX_ENTRIES);
+    output_sample_rate_ = output_sample_rate;
+    current_ = nullptr;
+    count_ = 0;
+}
+
+void DecoderCache::Close(DecoderCacheEntry& entry) {
+    if (entry.decoder != nullptr) {
+        esp_opus_dec_close(entry.decoder);
+    }
+    if (entry.resampler != nullptr) {
+        esp_ae_rate_cvt_close(entry.resampler);
+    }
+    entry = {};
+}
+
+DecoderCacheEntry* DecoderCache::Get(int sample_rate, int frame_duration) {
+    if (current_ != nullptr && current_->sample_rate == sample_rate && current_->frame_duration == frame_duration) {
+        current_->last_used = ++clock_;
+        return current_;
+    }
+
+    /* A format decoded before, or the free or least recently used slot */
+    DecoderCacheEntry* victim = nullptr;
+    for (size_t i = 0; i < max_entries_; i++) {
+        auto& entry = entries_[i];
+        if (entry.decoder != nullptr && entry.sample_rate == sample_rate && entry.frame_duration == frame_duration) {
+            entry.last_used = ++clock_;
+            current_ = &entry;
+            hits_++;
+            return current_;
+        }
+        if (victim == nullptr || (victim->decoder != nullptr &&
+                (entry.decoder == nullptr || entry.last_used < victim->last_used))) {
+            victim = &entry;
+        }
+    }
+    misses_++;
+    if (victim->decoder != nullptr) {
+        ESP_LOGI(TAG, "%s: closing %d Hz / %d ms for %d Hz / %d ms", name_, victim->sample_rate,
+            victim->frame_duration, sample_rate, frame_duration);
+        evictions_++;
+        count_--;
+    }
+    Close(*victim);
+    current_ = nullptr;
+
+    esp_opus_dec_cfg_t opus_dec_cfg = {
+        .sample_rate = (uint32_t)sample_rate,
+        .channel = ESP_AUDIO_MONO,
+        .frame_duration = (esp_opus_dec_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(frame_duration),
+        .self_delimited = false,
+    };
+    auto ret = esp_opus_dec_open(&opus_dec_cfg, sizeof(esp_opus_dec_cfg_t), &victim->decoder);
+    if (victim->decoder == nullptr) {
+        ESP_LOGE(TAG, "%s: failed to create the decoder, error code: %d", name_, ret);
+        return nullptr;
+    }
+    if (sample_rate != output_sample_rate_) {
+        esp_ae_rate_cvt_cfg_t resampler_cfg = {
+            .src_rate = (uint32_t)sample_rate,
+            .dest_rate = (uint32_t)output_sample_rate_,
+            .channel = ESP_AUDIO_MONO,
+            .bits_per_sample = ESP_AUDIO_BIT16,
+            .complexity = 2,
+            .perf_type = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,
+        };
+        auto resampler_ret = esp_ae_rate_cvt_open(&resampler_cfg, &victim->resampler);
+        if (victim->resampler == nullptr) {
+            ESP_LOGE(TAG, "%s: failed to create the resampler, error code: %d", name_, resampler_ret);
+            Close(*victim);
+            return nullptr;
+        }
+    }
+    victim->sample_rate = sample_rate;
+    victim->frame_duration = frame_duration;
+    victim->frame_size = sample_rate / 1000 * frame_duration;
+    victim->last_used = ++clock_;
+    count_++;
+    current_ = victim;
+    return current_;
+}
+
+void DecoderCache::Reset() {
+    for (size_t i = 0; i < max_entries_; i++) {
+        if (entries_[i].decoder != nullptr) {
+            esp_opus_dec_reset(entries_[i].decoder);
+        }
+    }
+}
+
+DecoderCache::Stats DecoderCache::GetStats() const {
+    Stats stats;
+    stats.entries = count_.load(std::memory_order_relaxed);
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,68 @@
+#ifndef DECODER_CACHE_H
+#define DECODER_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_opus_dec.h"
+#include "esp_ae_rate_cvt.h"
+
+#define DECODER_CACHE_MAX_ENTRIES 4
+
+// An open Opus decoder, with the resampler to the codec output rate when the rates differ
+struct DecoderCacheEntry {
+    int sample_rate = 0;
+    int frame_duration = 0;
+    int frame_size = 0;                             // Samples per frame at sample_rate
+    void* decoder = nullptr;
+    esp_ae_rate_cvt_handle_t resampler = nullptr;
+    uint32_t last_used = 0;
+};
+
+/*
+ * Opus decoders kept open per (sample rate, frame duration).
+ *
+ * Server speech, streamed audio and the audio test all decode on the same voice at different
+ * rates and frame durations. Switching back to a stream reuses its decoder and resampler with
+ * their state, instead of closing and opening both on the decode task. At most max_entries stay
+ * open (about 20KB each), the least recently used one is closed first.
+ *
+ * Get() is called by the decode task, Reset() by any task, both under the owner's decoder lock.
+ */
+class DecoderCache {
+public:
+    struct Stats {
+        uint32_t entries;
+        uint32_t hits;          // Format switches to an open decoder
+        uint32_t misses;        // Format switches that opened one
+        uint32_t evictions;
+    };
+
+    explicit DecoderCache(const char* name) : name_(name) {}
+    ~DecoderCache();
+
+    void Configure(size_t max_entries, int output_sample_rate);
+    // The decoder for this format, opened on a miss. nullptr if it cannot be opened
+    DecoderCacheEntry* Get(int sample_rate, int frame_duration);
+    // Clears the state of every open decoder, a new stream starts
+    void Reset();
+
+    Stats GetStats() const;
+
+private:
+    const char* name_;
+    DecoderCacheEntry entries_[DECODER_CACHE_MAX_ENTRIES];
+    size_t max_entries_ = 1;
+    int output_sample_rate_ = 0;
+    DecoderCacheEntry* current_ = nullptr;
+    uint32_t clock_ = 0;
+    std::atomic<uint32_t> count_ = 0;
+    std::atomic<uint32_t> hits_ = 0;
+    std::atomic<uint32_t> misses_ = 0;
+    std::atomic<uint32_t> evictions_ = 0;
+
+    void Close(DecoderCacheEntry& entry);
+};
+
+#endif // DECODER_CACHE_H
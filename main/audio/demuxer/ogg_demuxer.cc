@@ -23,10 +23,69 @@ void OggDemuxer::Reset()
     ctx_.body_offset = 0;
     ctx_.packet_continued = false;
     
-    // 清空缓冲区数据
+    // 清空页头数据，包缓冲区由packet_len界定，无需清零
     memset(ctx_.header, 0, sizeof(ctx_.header));
     memset(ctx_.seg_table, 0, sizeof(ctx_.seg_table));
-    memset(ctx_.packet_buf, 0, sizeof(ctx_.packet_buf));
+
+    position_ = 0;
+    page_position_ = 0;
+    resync_ = false;
+    skip_packet_ = false;
+}
+
+/// @brief 跳转后重新同步
+void OggDemuxer::Resync(uint64_t position)
+{
+    auto opus_info = opus_info_;
+    Reset();
+    opus_info_ = opus_info;
+    position_ = position;
+    page_position_ = position;
+    resync_ = true;
+}
+
+/// @brief 处理一个完整的包：识别OpusHead/OpusTags，其余交给回调
+void OggDemuxer::EmitPacket(const uint8_t* data, size_t len, bool view)
+{
+    if (skip_packet_) {
+        skip_packet_ = false;
+        return;
+    }
+    if (len == 0) {
+        return;
+    }
+    if (!opus_info_.head_seen) {
+        if (len >= 8 && memcmp(data, "OpusHead", 8) == 0) {
+            opus_info_.head_seen = true;
+            if (len >= 19) {
+                opus_info_.sample_rate = data[12] | 
+                                        (data[13] << 8) | 
+                                        (data[14] << 16) | 
+                                        (data[15] << 24);
+                ESP_LOGI(TAG, "OpusHead found, sample_rate=%d", opus_info_.sample_rate);
+            }
+            return;
+        }
+    }
+    if (!opus_info_.tags_seen) {
+        if (len >= 8 && memcmp(data, "OpusTags", 8) == 0) {
+            opus_info_.tags_seen = true;
+            ESP_LOGI(TAG, "OpusTags found.");
+            return;
+        }
+    }
+    if (opus_info_.head_seen && opus_info_.tags_seen) {
+        if (view) {
+            view_packets_++;
+        } else {
+            copied_packets_++;
+        }
+        if (on_demuxer_finished_) {
+            on_demuxer_finished_(data, opus_info_.sample_rate, len, view);
+        }
+    } else {
+        ESP_LOGW(TAG, "当前Ogg容器未解析到OpusHead/OpusTags，丢弃");
+    }
 }
 
 /// @brief 处理数据块
@@ -34,6 +93,14 @@ void OggDemuxer::Reset()
 /// @param size 输入数据大小
 /// @return 已处理的字节数
 size_t OggDemuxer::Process(const uint8_t* data, size_t size)
+{
+    size_t processed = Parse(data, size);
+    // 未处理的数据由调用者丢弃，流位置按输入计算
+    position_ += size;
+    return processed;
+}
+
+size_t OggDemuxer::Parse(const uint8_t* data, size_t size)
 {
     size_t processed = 0;  // 已处理的字节数
     
@@ -52,6 +119,7 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                 if (ctx_.bytes_needed == 0) {
                     // 检查是否匹配"OggS"
                     if (memcmp(ctx_.header, "OggS", 4) == 0) {
+                        page_position_ = position_ + processed - 4;
                         state_ = ParseState::PARSE_HEADER;
                         ctx_.data_offset = 4;
                         ctx_.bytes_needed = 27 - 4;  // 还需要23字节完成页头
@@ -84,6 +152,7 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                     
                     // 不记录找到的"OggS"，无必要
                     // memcpy(ctx_.header, data + processed, 4);
+                    page_position_ = position_ + processed;
                     processed += 4;
                     
                     state_ = ParseState::PARSE_HEADER;
@@ -139,6 +208,12 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                     ctx_.data_offset = 0;
                     break;
                 }
+
+                if (resync_) {
+                    // 跳转后的第一页：以上一页未结束的包开头时丢弃该包
+                    resync_ = false;
+                    skip_packet_ = (ctx_.header[5] & 0x01) != 0;
+                }
                 
                 ctx_.seg_count = ctx_.header[26];
                 if (ctx_.seg_count > 0 && ctx_.seg_count <= 255) {
@@ -151,7 +226,7 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                     ctx_.bytes_needed = 4;
                     ctx_.data_offset = 0;
                 } else {
-                    ESP_LOGE(TAG, "无效的段数: %u", ctx_.seg_count);
+                    ESP_LOGE(TAG, "无效的段数: %zu", ctx_.seg_count);
                     state_ = ParseState::FIND_PAGE;
                     ctx_.bytes_needed = 4;
                     ctx_.data_offset = 0;
@@ -197,6 +272,27 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
             
           case ParseState::PARSE_DATA: {
             while (ctx_.seg_index < ctx_.seg_count && processed < size) {
+                if (views_enabled_ && ctx_.packet_len == 0 && ctx_.seg_remaining == 0) {
+                    // 包在本页结束且完整位于本次输入中：直接输出输入数据的指针
+                    size_t packet_size = 0;
+                    size_t end = ctx_.seg_index;
+                    bool complete = false;
+                    while (end < ctx_.seg_count && !complete) {
+                        packet_size += ctx_.seg_table[end];
+                        complete = ctx_.seg_table[end++] < 255;
+                    }
+                    // 超过packet_buf的包与复制模式一样丢弃，走下面的溢出处理
+                    if (complete && packet_size <= size - processed && packet_size <= sizeof(ctx_.packet_buf)) {
+                        const uint8_t* packet = data + processed;
+                        processed += packet_size;
+                        ctx_.body_offset += packet_size;
+                        ctx_.seg_index = end;
+                        ctx_.packet_continued = false;
+                        EmitPacket(packet, packet_size, true);
+                        continue;
+                    }
+                }
+
                 uint8_t seg_len = ctx_.seg_table[ctx_.seg_index];
                 
                 // 检查段数据是否已经部分读取
@@ -237,43 +333,7 @@ size_t OggDemuxer::Process(const uint8_t* data, size_t size)
                 
                 if (!seg_continued) {
                     // 包结束
-                    if (ctx_.packet_len) {
-                        if (!opus_info_.head_seen) {
-                            if (ctx_.packet_len >=8 && memcmp(ctx_.packet_buf, "OpusHead", 8) == 0) {
-                                opus_info_.head_seen = true;
-                                if (ctx_.packet_len >= 19) {
-                                    opus_info_.sample_rate = ctx_.packet_buf[12] | 
-                                                            (ctx_.packet_buf[13] << 8) | 
-                                                            (ctx_.packet_buf[14] << 16) | 
-                                                            (ctx_.packet_buf[15] << 24);
-                                    ESP_LOGI(TAG, "OpusHead found, sample_rate=%d", opus_info_.sample_rate);
-                                }
-                                ctx_.packet_len = 0;
-                                ctx_.packet_continued = false;
-                                ctx_.seg_index++;
-                                ctx_.seg_remaining = 0;
-                                continue;
-                            }
-                        }
-                        if (!opus_info_.tags_seen) {
-                            if (ctx_.packet_len >= 8 && memcmp(ctx_.packet_buf, "OpusTags", 8) == 0) {
-                                opus_info_.tags_seen = true;
-                                ESP_LOGI(TAG, "OpusTags found.");
-                                ctx_.packet_len = 0;
-                                ctx_.packet_continued = false;
-                                ctx_.seg_index++;
-                                ctx_.seg_remaining = 0;
-                                continue;  
-                            }
-                        }
-                        if (opus_info_.head_seen && opus_info_.tags_seen) {
-                            if (on_demuxer_finished_) {
-                                on_demuxer_finished_(ctx_.packet_buf, opus_info_.sample_rate, ctx_.packet_len);
-                            }
-                        } else {
-                            ESP_LOGW(TAG, "当前Ogg容器未解析到OpusHead/OpusTags，丢弃");
-                        }
-                    }
+                    EmitPacket(ctx_.packet_buf, ctx_.packet_len, false);
                     ctx_.packet_len = 0;
                     ctx_.packet_continued = false;
                 } else {
@@ -44,20 +44,45 @@ public:
     }
     
     void Reset();
+
+    /// @brief 跳转后重新同步：清除解析状态但保留OpusHead信息，从下一个页头继续，
+    /// 丢弃跳转后第一页开头的续包
+    /// @param position 下一次Process()输入数据在整个流中的字节位置
+    void Resync(uint64_t position);
     
     size_t Process(const uint8_t* data, size_t size);
 
+    /// @brief 当前页（最后输出的包所在页）的"OggS"在整个流中的字节位置，可用于从该页恢复播放
+    uint64_t page_position() const { return page_position_; }
+
     /// @brief 设置解封装完毕后回调处理函数
-    /// @param on_demuxer_finished 
-    void OnDemuxerFinished(std::function<void(const uint8_t* data, int sample_rate, size_t len)> on_demuxer_finished) {
+    /// @param on_demuxer_finished view为true时data指向Process()的输入数据，否则指向内部缓冲区，仅在回调期间有效
+    void OnDemuxerFinished(std::function<void(const uint8_t* data, int sample_rate, size_t len, bool view)> on_demuxer_finished) {
         on_demuxer_finished_ = on_demuxer_finished;
     }
+
+    /// @brief 零拷贝模式：完整位于一次输入内且不跨页的包直接以输入数据的指针输出，
+    /// 跨页或跨输入块的包仍复制到内部缓冲区。适用于内存或flash映射中的完整Ogg数据
+    void EnableViews(bool enable) { views_enabled_ = enable; }
+
+    uint32_t view_packets() const { return view_packets_; }
+    uint32_t copied_packets() const { return copied_packets_; }
+
 private:
+    size_t Parse(const uint8_t* data, size_t size);
+    void EmitPacket(const uint8_t* data, size_t len, bool view);
 
     ParseState  state_ = ParseState::FIND_PAGE;
     context_t   ctx_;
     Opus_t      opus_info_;
-    std::function<void(const uint8_t*, int, size_t)> on_demuxer_finished_;
+    std::function<void(const uint8_t*, int, size_t, bool)> on_demuxer_finished_;
+    bool        views_enabled_ = false;
+    uint32_t    view_packets_ = 0;
+    uint32_t    copied_packets_ = 0;
+    uint64_t    position_ = 0;          // 本次输入数据起点在流中的位置
+    uint64_t    page_position_ = 0;
+    bool        resync_ = false;        // Resync()后尚未找到第一页
+    bool        skip_packet_ = false;   // 丢弃下一个输出的包（跳转后的续包）
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "echo_reference.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#define TAG "EchoReference"
+
+#define RING_SAMPLES (ECHO_REFERENCE_RING_MS * 16)
+#define MAX_LAG_GROUPS (ECHO_REFERENCE_MAX_DELAY_MS * 16 / ECHO_REFERENCE_DECIMATION)
+#define WINDOW_GROUPS (ECHO_REFERENCE_WINDOW_MS * 16 / ECHO_REFERENCE_DECIMATION)
+#define MIN_HISTORY_ENERGY ((int64_t)(MAX_LAG_GROUPS + 1) * \
+    (ECHO_REFERENCE_MIN_LEVEL * ECHO_REFERENCE_DECIMATION) * (ECHO_REFERENCE_MIN_LEVEL * ECHO_REFERENCE_DECIMATION))
+
+void EchoReference::Write(const int16_t* pcm, size_t samples, int sample_rate, int64_t time_us) {
+    if (samples == 0) {
+        return;
+    }
+    if (sample_rate != write_rate_) {
+        write_rate_ = sample_rate;
+        write_step_ = ((uint64_t)sample_rate << 16) / 16000;
+        write_phase_ = 1 << 16;
+        write_last_ = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ring_.empty()) {
+        ring_.assign(RING_SAMPLES, 0);
+    }
+    size_t size = ring_.size();
+    int64_t now = Position(time_us);
+    if (write_pos_ < now) {
+        // The speaker ran dry or was idle: what was not written reads as silence, this buffer plays from now
+        int64_t gap = std::min<int64_t>(now - write_pos_, size);
+        size_t index = (now - gap) % size;
+        for (int64_t i = 0; i < gap; i++) {
+            ring_[index] = 0;
+            index = index + 1 == size ? 0 : index + 1;
+        }
+        write_pos_ = now;
+    }
+
+    // Linear interpolation to 16 kHz, the microphone is band limited by the same rate so the aliases
+    // of a downsampled output only add noise to the reference
+    size_t index = write_pos_ % size;
+    uint64_t end = (uint64_t)samples << 16;
+    while (write_phase_ < end) {
+        size_t i = write_phase_ >> 16;
+        int64_t frac = write_phase_ & 0xffff;
+        int32_t a = i == 0 ? write_last_ : pcm[i - 1];
+        int32_t b = pcm[i];
+        ring_[index] = (int16_t)(a + (((b - a) * frac) >> 16));
+        index = index + 1 == size ? 0 : index + 1;
+        write_pos_++;
+        write_phase_ += write_step_;
+    }
+    write_phase_ -= end;
+    write_last_ = pcm[samples - 1];
+}
+
+void EchoReference::CopyLocked(int64_t pos, size_t count, int16_t* dest, size_t stride) const {
+    size_t size = ring_.size();
+    int64_t oldest = std::max<int64_t>(write_pos_ - (int64_t)size, 0);
+    size_t index = size > 0 && pos >= 0 ? pos % size : 0;
+    for (size_t k = 0; k < count; k++, pos++) {
+        dest[k * stride] = pos >= oldest && pos < write_pos_ ? ring_[index] : 0;
+        index = index + 1 >= size ? 0 : index + 1;
+    }
+}
+
+void EchoReference::Restart(int64_t pos) {
+    if (history_.empty()) {
+        history_.resize(MAX_LAG_GROUPS + 1);
+        correlation_.resize(MAX_LAG_GROUPS + 1);
+    }
+    std::fill(history_.begin(), history_.end(), 0);
+    std::fill(correlation_.begin(), correlation_.end(), 0.0f);
+    history_index_ = 0;
+    history_energy_ = 0;
+    group_ = (pos + ECHO_REFERENCE_DECIMATION - 1) / ECHO_REFERENCE_DECIMATION;
+    first_group_ = group_;
+    mic_acc_ = 0;
+    window_groups_ = 0;
+}
+
+void EchoReference::Interleave(const int16_t* mic, size_t frames, size_t channels, int16_t* dest, int64_t time_us) {
+    int64_t start = Position(time_us) - (int64_t)frames;
+    if (mic_pos_ < 0 || std::abs(mic_pos_ - start) > 16 * ECHO_REFERENCE_REANCHOR_MS) {
+        // First read, or the input paused: the timeline and the correlation start over
+        Restart(start);
+    } else {
+        start = mic_pos_;
+    }
+    mic_pos_ = start + frames;
+
+    int64_t first_pcm = group_ * ECHO_REFERENCE_DECIMATION;
+    int64_t groups = std::max<int64_t>(mic_pos_ / ECHO_REFERENCE_DECIMATION - group_, 0);
+    group_pcm_.resize(groups * ECHO_REFERENCE_DECIMATION);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        CopyLocked(start - delay_.load(std::memory_order_relaxed), frames, dest + channels, channels + 1);
+        CopyLocked(first_pcm, group_pcm_.size(), group_pcm_.data(), 1);
+    }
+    for (size_t i = 0; i < frames; i++) {
+        std::copy(mic + i * channels, mic + (i + 1) * channels, dest + i * (channels + 1));
+    }
+
+    // Decimate the first microphone by summing groups of samples, a group may span two reads
+    const int16_t* reference = group_pcm_.data();
+    for (size_t i = 0; i < frames; i++) {
+        int64_t pos = start + i;
+        if (pos < first_pcm) {
+            continue;
+        }
+        mic_acc_ += mic[i * channels];
+        if ((pos + 1) % ECHO_REFERENCE_DECIMATION == 0) {
+            int32_t reference_sum = 0;
+            for (int k = 0; k < ECHO_REFERENCE_DECIMATION; k++) {
+                reference_sum += reference[k];
+            }
+            reference += ECHO_REFERENCE_DECIMATION;
+            Correlate(mic_acc_, reference_sum);
+            mic_acc_ = 0;
+        }
+    }
+}
+
+void EchoReference::Correlate(int32_t mic, int32_t reference) {
+    size_t size = history_.size();
+    int32_t old = history_[history_index_];
+    history_energy_ += (int64_t)reference * reference - (int64_t)old * old;
+    history_[history_index_] = reference;
+
+    // Only while the speaker plays, a silent reference correlates with nothing
+    if (history_energy_ >= MIN_HISTORY_ENERGY) {
+        size_t lags = std::min<int64_t>(group_ - first_group_, MAX_LAG_GROUPS) + 1;
+        float m = mic;
+        const int32_t* h = history_.data();
+        float* c = correlation_.data();
+        size_t index = history_index_;
+        for (size_t lag = 0; lag < lags; lag++) {
+            c[lag] += m * h[index];
+            index = index == 0 ? size - 1 : index - 1;
+        }
+        if (++window_groups_ == WINDOW_GROUPS) {
+            Estimate();
+        }
+    }
+
+    history_index_ = history_index_ + 1 == size ? 0 : history_index_ + 1;
+    group_++;
+}
+
+void EchoReference::Estimate() {
+    size_t peak = 0;
+    float peak_value = 0;
+    float total = 0;
+    for (size_t lag = 0; lag < correlation_.size(); lag++) {
+        float value = std::fabs(correlation_[lag]);
+        total += value;
+        if (value > peak_value) {
+            peak_value = value;
+            peak = lag;
+        }
+    }
+    std::fill(correlation_.begin(), correlation_.end(), 0.0f);
+    window_groups_ = 0;
+
+    float mean = total / correlation_.size();
+    float ratio = mean > 0 ? peak_value / mean : 0;
+    peak_ratio_.store(ratio, std::memory_order_relaxed);
+    if (ratio < ECHO_REFERENCE_MIN_PEAK_RATIO) {
+        rejected_++;
+        return;
+    }
+    estimates_++;
+
+    int delay = std::max<int>(peak * ECHO_REFERENCE_DECIMATION - ECHO_REFERENCE_LEAD_SAMPLES, 0);
+    int current = delay_.load(std::memory_order_relaxed);
+    if (locked_ && std::abs(delay - current) <= ECHO_REFERENCE_DECIMATION) {
+        candidate_ = -1;
+        return;
+    }
+    if (locked_ && (candidate_ < 0 || std::abs(delay - candidate_) > ECHO_REFERENCE_DECIMATION)) {
+        // Wait for the next window to confirm
+        candidate_ = delay;
+        return;
+    }
+    candidate_ = -1;
+    locked_ = true;
+    delay_.store(delay, std::memory_order_relaxed);
+    ESP_LOGI(TAG, "Echo delay %d ms (peak ratio %.1f)", delay / 16, ratio);
+}
+
+EchoReference::Stats EchoReference::GetStats() const {
+    Stats stats;
+    stats.delay_ms = delay_.load(std::memory_order_relaxed) / 16;
+    stats.locked = locked_.load(std::memory_order_relaxed);
+    stats.estimates = estimates_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.peak_ratio = peak_ratio_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,88 @@
+#ifndef ECHO_REFERENCE_H
+#define ECHO_REFERENCE_H
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#define ECHO_REFERENCE_RING_MS 1000         // Played audio kept for the input side, must exceed the largest delay
+#define ECHO_REFERENCE_MAX_DELAY_MS 250     // Delays searched by the estimator
+#define ECHO_REFERENCE_INITIAL_DELAY_MS 60  // Until the first estimate, about the I2S DMA depths of a simplex board
+#define ECHO_REFERENCE_LEAD_SAMPLES 32      // The reference is handed to the AEC 2 ms before the echo it predicts
+#define ECHO_REFERENCE_DECIMATION 8         // The estimator works at 2 kHz
+#define ECHO_REFERENCE_WINDOW_MS 1000       // Reference signal correlated per estimate
+#define ECHO_REFERENCE_MIN_PEAK_RATIO 4.0f  // Correlation peak over its mean, below that the estimate is dropped
+#define ECHO_REFERENCE_MIN_LEVEL 32         // Mean reference amplitude needed to correlate, quieter windows are skipped
+#define ECHO_REFERENCE_REANCHOR_MS 20       // Input timeline drift that restarts the estimation
+
+/*
+ * Software echo reference for codecs without a hardware reference channel.
+ *
+ * The output task writes every buffer it hands to the codec, resampled to 16 kHz, on a timeline
+ * driven by esp_timer. The input task interleaves the reference as one more channel after the
+ * microphones, taken from the same timeline minus the echo delay, so the AFE can run its AEC
+ * as if the codec looped the speaker signal back.
+ *
+ * The delay (output DMA, acoustic path and input DMA) is estimated by correlating the microphone
+ * with the reference at 2 kHz while the speaker plays. A new delay replaces the current one only
+ * after two consecutive estimates agree, so the AEC filter is not reset by a single bad window.
+ *
+ * Write() is called by the output task only, Interleave() by the input task only.
+ */
+class EchoReference {
+public:
+    struct Stats {
+        int delay_ms;
+        bool locked;        // The delay comes from an estimate, not from the initial guess
+        uint32_t estimates;
+        uint32_t rejected;
+        float peak_ratio;   // Of the last window
+    };
+
+    void Write(const int16_t* pcm, size_t samples, int sample_rate, int64_t time_us);
+
+    // dest gets frames * (channels + 1) samples: the microphone channels of each frame, then the reference
+    void Interleave(const int16_t* mic, size_t frames, size_t channels, int16_t* dest, int64_t time_us);
+
+    Stats GetStats() const;
+
+private:
+    std::mutex mutex_;
+    std::vector<int16_t> ring_;
+    int64_t write_pos_ = 0;             // Timeline position after the last written sample
+
+    // Output task
+    int write_rate_ = 0;
+    uint64_t write_step_ = 0;           // Input samples per output sample in 16.16
+    uint64_t write_phase_ = 0;
+    int16_t write_last_ = 0;
+
+    // Input task
+    int64_t mic_pos_ = -1;
+    std::vector<int16_t> group_pcm_;    // Reference of the groups completed by a read
+    std::vector<int32_t> history_;      // Decimated reference, lag 0 aligned with the microphone
+    size_t history_index_ = 0;          // Slot of group_
+    int64_t group_ = 0;                 // Next decimated position
+    int64_t first_group_ = 0;
+    int32_t mic_acc_ = 0;
+    int64_t history_energy_ = 0;        // Of the groups within the largest delay
+    std::vector<float> correlation_;
+    uint32_t window_groups_ = 0;
+    int candidate_ = -1;
+
+    std::atomic<int> delay_ = ECHO_REFERENCE_INITIAL_DELAY_MS * 16;     // In 16 kHz samples
+    std::atomic<bool> locked_ = false;
+    std::atomic<uint32_t> estimates_ = 0;
+    std::atomic<uint32_t> rejected_ = 0;
+    std::atomic<float> peak_ratio_ = 0;
+
+    static int64_t Position(int64_t time_us) { return time_us * 16 / 1000; }
+    void CopyLocked(int64_t pos, size_t count, int16_t* dest, size_t stride) const;
+    void Restart(int64_t pos);
+    void Correlate(int32_t mic, int32_t reference);
+    void Estimate();
+};
+
+#endif // ECHO_REFERENCE_H
@@ -0,0 +1,132 @@
+#include "encoder_controller.h"
+
+#include <esp_log.h>
+#include <cinttypes>
+#include <esp_opus_enc.h>
+#include <algorithm>
+
+#define TAG "EncoderController"
+
+namespace {
+
+// 16kHz mono speech, the automatic bitrate is about 17 kbps at 60ms frames
+constexpr EncoderSettings levels[ENCODER_LEVELS] = {
+    { 10000, 0, false },
+    { 14000, 0, false },
+    { ESP_OPUS_BITRATE_AUTO, 0, false },
+    { 24000, 3, true },
+    { 32000, 5, true },
+};
+
+// The automatic bitrate stays below it for 16kHz mono
+constexpr bool LevelsWithinMaxBitrate() {
+    for (auto& level : levels) {
+        if (level.bitrate > ENCODER_MAX_BITRATE) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(LevelsWithinMaxBitrate(), "AUDIO_PACKET_PAYLOAD_RESERVE is sized for ENCODER_MAX_BITRATE");
+
+} // namespace
+
+void EncoderController::Configure(int max_level) {
+    max_level = std::clamp(max_level, 0, ENCODER_LEVELS - 1);
+    max_level_ = max_level;
+    ceiling_ = max_level;
+    level_ = std::min(ENCODER_BASE_LEVEL, max_level);
+}
+
+EncoderSettings EncoderController::GetLevelSettings(int level) {
+    return levels[std::clamp(level, 0, ENCODER_LEVELS - 1)];
+}
+
+EncoderSettings EncoderController::settings() const {
+    return GetLevelSettings(level_.load(std::memory_order_relaxed));
+}
+
+bool EncoderController::OnFrameEncoded(int frame_ms, uint32_t encode_us, uint32_t send_queue_ms) {
+    interval_ms_ += frame_ms;
+    interval_encode_us_ += encode_us;
+    interval_max_queue_ms_ = std::max(interval_max_queue_ms_, send_queue_ms);
+    if (interval_ms_ < ENCODER_INTERVAL_MS) {
+        return false;
+    }
+    bool changed = Evaluate();
+    interval_ms_ = 0;
+    interval_encode_us_ = 0;
+    interval_max_queue_ms_ = 0;
+    return changed;
+}
+
+bool EncoderController::Evaluate() {
+    uint32_t cpu_percent = interval_encode_us_ / 10 / interval_ms_;
+    uint32_t failures = send_failures_.load(std::memory_order_relaxed);
+    bool send_failed = failures != failures_base_;
+    failures_base_ = failures;
+    cpu_percent_.store(cpu_percent, std::memory_order_relaxed);
+    max_queue_ms_.store(interval_max_queue_ms_, std::memory_order_relaxed);
+
+    int level = level_.load(std::memory_order_relaxed);
+    int ceiling = ceiling_.load(std::memory_order_relaxed);
+    if (send_failed || interval_max_queue_ms_ >= ENCODER_CONGESTED_QUEUE_MS) {
+        good_intervals_ = 0;
+        ceiling_good_intervals_ = 0;
+        int steps = interval_max_queue_ms_ >= ENCODER_BACKLOG_QUEUE_MS ? 2 : 1;
+        if (level > 0) {
+            SetLevel(std::max(level - steps, 0), send_failed ? "send failed" : "send queue backed up");
+            return true;
+        }
+        return false;
+    }
+    if (cpu_percent >= ENCODER_BUSY_CPU_PERCENT) {
+        good_intervals_ = 0;
+        ceiling_good_intervals_ = 0;
+        // Only the levels above the base one add complexity, a lower bitrate does not save time
+        if (level > ENCODER_BASE_LEVEL) {
+            ceiling_ = level - 1;
+            SetLevel(level - 1, "encoder too slow");
+            return true;
+        }
+        return false;
+    }
+    if (interval_max_queue_ms_ > ENCODER_IDLE_QUEUE_MS || cpu_percent > ENCODER_IDLE_CPU_PERCENT) {
+        good_intervals_ = 0;
+        ceiling_good_intervals_ = 0;
+        return false;
+    }
+    if (ceiling < max_level_ && ++ceiling_good_intervals_ >= ENCODER_CEILING_RETRY_INTERVALS) {
+        ceiling_good_intervals_ = 0;
+        ceiling = ceiling + 1;
+        ceiling_ = ceiling;
+        ESP_LOGI(TAG, "Ceiling raised to level %d after %d good intervals", ceiling, ENCODER_CEILING_RETRY_INTERVALS);
+    }
+    if (++good_intervals_ >= ENCODER_GOOD_INTERVALS && level < ceiling) {
+        good_intervals_ = 0;
+        SetLevel(level + 1, "idle");
+        return true;
+    }
+    return false;
+}
+
+void EncoderController::SetLevel(int level, const char* reason) {
+    auto settings = GetLevelSettings(level);
+    ESP_LOGI(TAG, "Level %d -> %d (%s, queue %" PRIu32 " ms, cpu %" PRIu32 "%%): bitrate %d, complexity %d, fec %d",
+        level_.load(), level, reason, interval_max_queue_ms_, cpu_percent_.load(), settings.bitrate,
+        settings.complexity, settings.fec);
+    level_ = level;
+    changes_++;
+}
+
+EncoderController::Stats EncoderController::GetStats() const {
+    Stats stats;
+    stats.level = level_.load(std::memory_order_relaxed);
+    stats.max_level = max_level_.load(std::memory_order_relaxed);
+    stats.ceiling = ceiling_.load(std::memory_order_relaxed);
+    stats.changes = changes_.load(std::memory_order_relaxed);
+    stats.send_failures = send_failures_.load(std::memory_order_relaxed);
+    stats.cpu_percent = cpu_percent_.load(std::memory_order_relaxed);
+    stats.max_queue_ms = max_queue_ms_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,85 @@
+#ifndef ENCODER_CONTROLLER_H
+#define ENCODER_CONTROLLER_H
+
+#include <atomic>
+#include <cstdint>
+
+#define ENCODER_LEVELS 5
+#define ENCODER_BASE_LEVEL 2                // The fixed configuration used before the controller
+#define ENCODER_MAX_BITRATE 32000           // Highest bitrate of the ladder, sizes the packet buffers
+#define ENCODER_INTERVAL_MS 2000            // Audio encoded for the send queue between two decisions
+#define ENCODER_CONGESTED_QUEUE_MS 480      // Send queue depth that steps down
+#define ENCODER_BACKLOG_QUEUE_MS 1200       // Send queue depth that steps down twice
+#define ENCODER_IDLE_QUEUE_MS 120           // Send queue depth that counts as a good interval
+#define ENCODER_BUSY_CPU_PERCENT 50         // Encode time per audio time that steps down for good
+#define ENCODER_IDLE_CPU_PERCENT 25
+#define ENCODER_GOOD_INTERVALS 5            // Consecutive good intervals before stepping up
+#define ENCODER_CEILING_RETRY_INTERVALS 30  // Consecutive good intervals before a level found too slow is retried
+
+struct EncoderSettings {
+    int bitrate;        // ESP_OPUS_BITRATE_AUTO or bits per second
+    int complexity;
+    bool fec;
+};
+
+/*
+ * Adjusts the uplink Opus encoder to the network and the chip.
+ *
+ * The settings are a ladder of levels, from a low bitrate for a congested uplink to a higher
+ * bitrate with more complexity and in-band FEC for an idle Wi-Fi link. Every interval of sent
+ * audio, the controller steps down at once when the send queue backs up or SendAudio() fails,
+ * and steps up one level after several intervals with an empty queue and spare encode time.
+ * An interval where encoding takes more than half the audio time above the base level steps
+ * down and caps the level below it. The cap is lifted one level after a long run of good
+ * intervals, or at once by ResetCeiling() when a new session starts, since the load that made
+ * the encoder slow (display, other tasks) may be gone.
+ *
+ * OnFrameEncoded() is called by the encode task, the other functions by any task.
+ */
+class EncoderController {
+public:
+    struct Stats {
+        int level;
+        int max_level;
+        int ceiling;                // max_level, or lower after the encoder was too slow
+        uint32_t changes;
+        uint32_t send_failures;
+        uint32_t cpu_percent;       // Of the last interval
+        uint32_t max_queue_ms;      // Of the last interval
+    };
+
+    // max_level bounds the ladder, ENCODER_BASE_LEVEL keeps today's settings as the ceiling
+    void Configure(int max_level);
+    EncoderSettings settings() const;
+    static EncoderSettings GetLevelSettings(int level);
+
+    // One frame encoded for the send queue. Returns true when the settings changed
+    bool OnFrameEncoded(int frame_ms, uint32_t encode_us, uint32_t send_queue_ms);
+    void OnSendFailed() { send_failures_++; }
+    // Lifts the cap set by a slow encoder back to max_level
+    void ResetCeiling() { ceiling_ = max_level_.load(std::memory_order_relaxed); }
+
+    Stats GetStats() const;
+
+private:
+    std::atomic<int> level_ = ENCODER_BASE_LEVEL;
+    std::atomic<int> max_level_ = ENCODER_BASE_LEVEL;
+    std::atomic<int> ceiling_ = ENCODER_BASE_LEVEL;
+    std::atomic<uint32_t> changes_ = 0;
+    std::atomic<uint32_t> send_failures_ = 0;
+    std::atomic<uint32_t> cpu_percent_ = 0;
+    std::atomic<uint32_t> max_queue_ms_ = 0;
+
+    // Encode task
+    uint32_t interval_ms_ = 0;
+    uint64_t interval_encode_us_ = 0;
+    uint32_t interval_max_queue_ms_ = 0;
+    uint32_t failures_base_ = 0;
+    int good_intervals_ = 0;
+    int ceiling_good_intervals_ = 0;
+
+    bool Evaluate();
+    void SetLevel(int level, const char* reason);
+};
+
+#endif // ENCODER_CONTROLLER_H
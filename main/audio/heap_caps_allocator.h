@@ -0,0 +1,83 @@
+#ifndef HEAP_CAPS_ALLOCATOR_H
+#define HEAP_CAPS_ALLOCATOR_H
+
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <esp_heap_caps.h>
+
+// The per-frame audio buffers, in PSRAM when the board has it
+#if CONFIG_SPIRAM
+#define AUDIO_BUFFER_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define AUDIO_BUFFER_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#endif
+
+/*
+ * Standard allocator that takes its memory from heap_caps_malloc(Caps), and from internal RAM
+ * when that region is full. Stateless, so containers using it swap and move like the default ones.
+ */
+template <typename T, uint32_t Caps>
+struct HeapCapsAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = HeapCapsAllocator<U, Caps>;
+    };
+
+    HeapCapsAllocator() = default;
+    template <typename U>
+    HeapCapsAllocator(const HeapCapsAllocator<U, Caps>&) {}
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        void* ptr = heap_caps_malloc(n * sizeof(T), Caps);
+        if (ptr == nullptr) {
+            ptr = heap_caps_malloc(n * sizeof(T), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return (T*)ptr;
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        heap_caps_free(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const HeapCapsAllocator<U, Caps>&) const { return true; }
+};
+
+using AudioPayload = std::vector<uint8_t, HeapCapsAllocator<uint8_t, AUDIO_BUFFER_CAPS>>;
+using AudioPcm = std::vector<int16_t, HeapCapsAllocator<int16_t, AUDIO_BUFFER_CAPS>>;
+
+/*
+ * libstdc++ copies into a vector with a custom allocator one element at a time, assign() and
+ * insert() of 1275 bytes take about 45 times longer than with std::allocator. resize() still
+ * clears with memset, so the audio buffers are filled with resize() and memcpy() instead.
+ */
+template <typename T, uint32_t Caps>
+void AssignBuffer(std::vector<T, HeapCapsAllocator<T, Caps>>& buffer, const T* data, size_t count) {
+    buffer.resize(count);
+    if (count > 0) {
+        memcpy(buffer.data(), data, count * sizeof(T));
+    }
+}
+
+template <typename T, uint32_t Caps>
+void AppendBuffer(std::vector<T, HeapCapsAllocator<T, Caps>>& buffer, const T* data, size_t count) {
+    size_t size = buffer.size();
+    buffer.resize(size + count);
+    if (count > 0) {
+        memcpy(buffer.data() + size, data, count * sizeof(T));
+    }
+}
+
+#endif // HEAP_CAPS_ALLOCATOR_H
@@ -0,0 +1,185 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+
+JitterBuffer::JitterBuffer() {
+}
+
+void JitterBuffer::Reset() {
+    Flush();
+    started_ = false;
+    underrun_time_us_ = 0;
+    last_sample_rate_ = 0;
+    last_frame_duration_ = 0;
+}
+
+void JitterBuffer::Flush() {
+    for (auto& slot : slots_) {
+        slot.reset();
+    }
+    depth_.store(0, std::memory_order_relaxed);
+    playing_ = false;
+    consecutive_concealed_ = 0;
+    have_base_transit_ = false;
+}
+
+bool JitterBuffer::Has(uint32_t sequence) const {
+    auto& slot = slots_[sequence & (JITTER_BUFFER_CAPACITY - 1)];
+    return slot && slot->sequence == sequence;
+}
+
+bool JitterBuffer::FindLowest(uint32_t& sequence) const {
+    for (uint32_t i = 0; i < JITTER_BUFFER_CAPACITY; i++) {
+        if (Has(next_sequence_ + i)) {
+            sequence = next_sequence_ + i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JitterBuffer::Put(std::unique_ptr<AudioStreamPacket> packet, int64_t now_us) {
+    received_++;
+    uint32_t sequence = packet->sequence;
+    if (!started_) {
+        next_sequence_ = sequence;
+        highest_sequence_ = sequence;
+        started_ = true;
+    }
+
+    int32_t offset = (int32_t)(sequence - next_sequence_);
+    if (offset < 0 && !playing_ && offset > -(int32_t)JITTER_BUFFER_CAPACITY) {
+        /* Reordered before playback started, move the start back if everything still fits */
+        bool fits = true;
+        for (uint32_t i = 0; i < JITTER_BUFFER_CAPACITY && fits; i++) {
+            uint32_t stored = next_sequence_ + i;
+            fits = !Has(stored) || stored - sequence < JITTER_BUFFER_CAPACITY;
+        }
+        if (fits) {
+            next_sequence_ = sequence;
+            offset = 0;
+        }
+    }
+    if (offset < -(int32_t)JITTER_BUFFER_CAPACITY || offset >= (int32_t)JITTER_BUFFER_CAPACITY) {
+        /* The sender restarted its sequence or we lost a whole buffer, start over from this packet */
+        Flush();
+        next_sequence_ = sequence;
+        highest_sequence_ = sequence;
+        offset = 0;
+    } else if (offset < 0) {
+        late_++;
+        return;
+    }
+
+    auto& slot = Slot(sequence);
+    if (slot) {
+        duplicates_++;
+        return;
+    }
+    if ((int32_t)(sequence - highest_sequence_) < 0) {
+        reordered_++;
+    } else {
+        highest_sequence_ = sequence;
+    }
+    UpdateJitter(*packet, now_us);
+    slot = std::move(packet);
+    if (depth_.fetch_add(1, std::memory_order_relaxed) == 0 && !playing_) {
+        buffering_since_us_ = now_us;
+    }
+}
+
+void JitterBuffer::UpdateJitter(const AudioStreamPacket& packet, int64_t now_us) {
+    int frame_ms = packet.frame_duration > 0 ? packet.frame_duration : 60;
+    int64_t transit_ms = now_us / 1000 - (int64_t)packet.sequence * frame_ms;
+
+    /* After a long pause (e.g. between two replies) the sender's pacing starts over */
+    bool new_talkspurt = !have_base_transit_ ||
+        (Depth() == 0 && !playing_ && now_us - underrun_time_us_ > JITTER_BUFFER_UNDERRUN_WINDOW_MS * 1000LL);
+    if (new_talkspurt || transit_ms < base_transit_ms_) {
+        base_transit_ms_ = transit_ms;
+        have_base_transit_ = true;
+    }
+
+    int delay_ms = std::min<int64_t>(transit_ms - base_transit_ms_, JITTER_BUFFER_MAX_DELAY_MS);
+    int jitter_ms = jitter_ms_.load(std::memory_order_relaxed);
+    if (delay_ms > jitter_ms) {
+        jitter_ms = delay_ms;
+    } else {
+        // Release slowly, about 4 seconds of 60ms frames
+        jitter_ms = (jitter_ms * 63 + delay_ms) / 64;
+    }
+    jitter_ms_.store(jitter_ms, std::memory_order_relaxed);
+
+    int max_depth = std::min(JITTER_BUFFER_MAX_DELAY_MS / frame_ms, JITTER_BUFFER_CAPACITY - 2);
+    target_depth_.store(std::clamp((jitter_ms + frame_ms - 1) / frame_ms, 1, std::max(max_depth, 1)),
+        std::memory_order_relaxed);
+}
+
+JitterBuffer::Action JitterBuffer::Get(int64_t now_us, Frame& frame) {
+    if (Depth() == 0) {
+        if (playing_) {
+            playing_ = false;
+            underrun_time_us_ = now_us;
+            underruns_++;
+        }
+        return kEmpty;
+    }
+
+    uint32_t lowest = 0;
+    FindLowest(lowest);
+    if (!playing_) {
+        int frame_ms = Slot(lowest)->frame_duration > 0 ? Slot(lowest)->frame_duration : 60;
+        int target_depth = target_depth_.load(std::memory_order_relaxed);
+        int64_t release_time_us = buffering_since_us_ + (int64_t)target_depth * frame_ms * 1000;
+        if ((int)Depth() < target_depth && now_us < release_time_us) {
+            frame.release_time_us = release_time_us;
+            return kWait;
+        }
+        playing_ = true;
+        lost_ += lowest - next_sequence_;
+        next_sequence_ = lowest;
+    }
+
+    auto& slot = Slot(next_sequence_);
+    if (!slot) {
+        lost_++;
+        if (consecutive_concealed_ < JITTER_BUFFER_MAX_CONCEAL_FRAMES && last_sample_rate_ > 0) {
+            /* Conceal the missing frame, the following packet may carry FEC data for it */
+            consecutive_concealed_++;
+            concealed_++;
+            next_sequence_++;
+            frame.fec_source = Has(next_sequence_) ? Slot(next_sequence_).get() : nullptr;
+            frame.sample_rate = last_sample_rate_;
+            frame.frame_duration = last_frame_duration_;
+            return kConceal;
+        }
+        /* Too long a gap to conceal, jump to the next packet we have */
+        lost_ += lowest - next_sequence_ - 1;
+        next_sequence_ = lowest;
+    }
+
+    auto& next = Slot(next_sequence_);
+    frame.packet = std::move(next);
+    depth_.fetch_sub(1, std::memory_order_relaxed);
+    next_sequence_++;
+    consecutive_concealed_ = 0;
+    last_sample_rate_ = frame.packet->sample_rate;
+    last_frame_duration_ = frame.packet->frame_duration;
+    return kPacket;
+}
+
+JitterBufferStats JitterBuffer::GetStats() const {
+    // Each counter is read on its own, a snapshot taken while the decode task runs may be a frame apart
+    JitterBufferStats stats;
+    stats.depth = Depth();
+    stats.target_depth = target_depth_.load(std::memory_order_relaxed);
+    stats.jitter_ms = jitter_ms_.load(std::memory_order_relaxed);
+    stats.received = received_.load(std::memory_order_relaxed);
+    stats.reordered = reordered_.load(std::memory_order_relaxed);
+    stats.late = late_.load(std::memory_order_relaxed);
+    stats.duplicates = duplicates_.load(std::memory_order_relaxed);
+    stats.lost = lost_.load(std::memory_order_relaxed);
+    stats.concealed = concealed_.load(std::memory_order_relaxed);
+    stats.underruns = underruns_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,98 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+#include "protocol.h"
+
+#define JITTER_BUFFER_CAPACITY 16           // Slots, must be a power of 2
+#define JITTER_BUFFER_MAX_DELAY_MS 600      // Upper bound of the adaptive target depth
+#define JITTER_BUFFER_MAX_CONCEAL_FRAMES 3  // Longer gaps are skipped instead of concealed
+#define JITTER_BUFFER_UNDERRUN_WINDOW_MS 1000 // A packet later than this after an underrun starts a new talkspurt
+
+struct JitterBufferStats {
+    uint32_t depth = 0;
+    uint32_t target_depth = 0;
+    uint32_t jitter_ms = 0;
+    uint32_t received = 0;
+    uint32_t reordered = 0;     // Arrived after a later packet, still in time
+    uint32_t late = 0;          // Arrived after its slot was played or concealed
+    uint32_t duplicates = 0;
+    uint32_t lost = 0;          // Never arrived in time
+    uint32_t concealed = 0;     // Lost frames replaced by PLC / FEC
+    uint32_t underruns = 0;
+};
+
+/*
+ * Orders network packets by sequence and releases them at the decoder's pace.
+ *
+ * The target depth follows the measured arrival jitter: how late each packet arrives compared
+ * to the earliest packet of the talkspurt. The peak is taken at once and released slowly, so a
+ * bursty link (e.g. 4G) keeps a deeper buffer while a clean link starts playing immediately.
+ *
+ * Only used by the decode task, except Depth() and GetStats() which may be read from any task.
+ */
+class JitterBuffer {
+public:
+    enum Action {
+        kEmpty,     // Nothing to play
+        kWait,      // Buffering, call again at release_time_us
+        kPacket,    // Decode packet
+        kConceal,   // The next frame is missing, conceal it (fec_source is the following packet if any)
+    };
+
+    struct Frame {
+        std::unique_ptr<AudioStreamPacket> packet;
+        const AudioStreamPacket* fec_source = nullptr;
+        int sample_rate = 0;
+        int frame_duration = 0;
+        int64_t release_time_us = 0;
+    };
+
+    JitterBuffer();
+
+    void Put(std::unique_ptr<AudioStreamPacket> packet, int64_t now_us);
+    Action Get(int64_t now_us, Frame& frame);
+    void Reset();
+
+    size_t Depth() const { return depth_.load(std::memory_order_relaxed); }
+    bool Full() const { return Depth() >= JITTER_BUFFER_CAPACITY; }
+    JitterBufferStats GetStats() const;
+
+private:
+    std::unique_ptr<AudioStreamPacket> slots_[JITTER_BUFFER_CAPACITY];
+    std::atomic<size_t> depth_ = 0;
+    bool started_ = false;          // next_sequence_ is valid
+    bool playing_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t highest_sequence_ = 0; // Newest packet received
+    int64_t buffering_since_us_ = 0;
+    int64_t underrun_time_us_ = 0;
+    int consecutive_concealed_ = 0;
+    int last_sample_rate_ = 0;
+    int last_frame_duration_ = 0;
+
+    // Jitter estimation, in milliseconds. Written by the decode task only, atomic for GetStats()
+    bool have_base_transit_ = false;
+    int64_t base_transit_ms_ = 0;
+    std::atomic<int> jitter_ms_ = 0;
+    std::atomic<int> target_depth_ = 1;
+
+    std::atomic<uint32_t> received_ = 0;
+    std::atomic<uint32_t> reordered_ = 0;
+    std::atomic<uint32_t> late_ = 0;
+    std::atomic<uint32_t> duplicates_ = 0;
+    std::atomic<uint32_t> lost_ = 0;
+    std::atomic<uint32_t> concealed_ = 0;
+    std::atomic<uint32_t> underruns_ = 0;
+
+    std::unique_ptr<AudioStreamPacket>& Slot(uint32_t sequence) { return slots_[sequence & (JITTER_BUFFER_CAPACITY - 1)]; }
+    bool Has(uint32_t sequence) const;
+    bool FindLowest(uint32_t& sequence) const;
+    void UpdateJitter(const AudioStreamPacket& packet, int64_t now_us);
+    void Flush();
+};
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,212 @@
+#include "pcm_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if CONFIG_AUDIO_PCM_SIMD && CONFIG_IDF_TARGET_ESP32S3
+#define PIE_OP(op) "ee." op
+#elif CONFIG_AUDIO_PCM_SIMD && CONFIG_IDF_TARGET_ESP32P4
+#define PIE_OP(op) "esp." op
+#endif
+
+#ifdef PIE_OP
+#include <esp_log.h>
+#define TAG "PcmKernels"
+#endif
+
+namespace pcm {
+
+static inline int16_t Saturate(int32_t value) {
+    return (int16_t)std::clamp<int32_t>(value, -INT16_MAX, INT16_MAX);
+}
+
+#ifdef PIE_OP
+/*
+ * PIE vector paths for 16-byte aligned buffers, 128-bit loads and stores of 8 samples. The C
+ * loops stay the reference: the first call compares the two on a test block and keeps the C
+ * loops if they differ.
+ *
+ * q0-q3 are overwritten without being saved, and the compiler does not know they are used. This
+ * is safe only if the FreeRTOS port saves the PIE registers of a task that uses them on a context
+ * switch (lazily, as for the FPU), and only from tasks, never from an ISR. Nothing here has been
+ * built or run on an S3 or P4 yet, which is why CONFIG_AUDIO_PCM_SIMD is off by default.
+ */
+static inline bool IsAligned16(const void* p) {
+    return ((uintptr_t)p & 15) == 0;
+}
+
+// 16 stereo frames per block. In place works, a block is loaded before its first half is written
+static void TakeChannelStereoPie(const int16_t* src, int16_t* dest, size_t blocks, size_t channel) {
+    for (size_t i = 0; i < blocks; i++) {
+        if (channel == 0) {
+            asm volatile(
+                PIE_OP("vld.128.ip") " q0, %0, 16\n"
+                PIE_OP("vld.128.ip") " q1, %0, 16\n"
+                PIE_OP("vld.128.ip") " q2, %0, 16\n"
+                PIE_OP("vld.128.ip") " q3, %0, 16\n"
+                PIE_OP("vunzip.16") " q0, q1\n"
+                PIE_OP("vunzip.16") " q2, q3\n"
+                PIE_OP("vst.128.ip") " q0, %1, 16\n"
+                PIE_OP("vst.128.ip") " q2, %1, 16\n"
+                : "+r"(src), "+r"(dest) : : "memory");
+        } else {
+            asm volatile(
+                PIE_OP("vld.128.ip") " q0, %0, 16\n"
+                PIE_OP("vld.128.ip") " q1, %0, 16\n"
+                PIE_OP("vld.128.ip") " q2, %0, 16\n"
+                PIE_OP("vld.128.ip") " q3, %0, 16\n"
+                PIE_OP("vunzip.16") " q0, q1\n"
+                PIE_OP("vunzip.16") " q2, q3\n"
+                PIE_OP("vst.128.ip") " q1, %1, 16\n"
+                PIE_OP("vst.128.ip") " q3, %1, 16\n"
+                : "+r"(src), "+r"(dest) : : "memory");
+        }
+    }
+}
+
+// 16 words per block: split the low and high bytes, then interleave them the other way round
+static void ByteSwap16Pie(const uint16_t* src, uint16_t* dest, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        asm volatile(
+            PIE_OP("vld.128.ip") " q0, %0, 16\n"
+            PIE_OP("vld.128.ip") " q1, %0, 16\n"
+            PIE_OP("vunzip.8") " q0, q1\n"
+            PIE_OP("vzip.8") " q1, q0\n"
+            PIE_OP("vst.128.ip") " q1, %1, 16\n"
+            PIE_OP("vst.128.ip") " q0, %1, 16\n"
+            : "+r"(src), "+r"(dest) : : "memory");
+    }
+}
+
+static bool CheckPie() {
+    alignas(16) int16_t src[32];
+    alignas(16) int16_t dest[16];
+    for (int i = 0; i < 32; i++) {
+        src[i] = (int16_t)(i * 2311 - 30000);
+    }
+    bool ok = true;
+    for (size_t channel = 0; channel < 2; channel++) {
+        TakeChannelStereoPie(src, dest, 1, channel);
+        for (int i = 0; i < 16; i++) {
+            ok = ok && dest[i] == src[i * 2 + channel];
+        }
+    }
+    alignas(16) uint16_t swapped[16];
+    ByteSwap16Pie((const uint16_t*)src, swapped, 1);
+    for (int i = 0; i < 16; i++) {
+        ok = ok && swapped[i] == __builtin_bswap16((uint16_t)src[i]);
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "The PIE loops differ from the C loops, using the C loops");
+    }
+    return ok;
+}
+
+static bool PieUsable() {
+    // 0: not checked yet, 1: usable, 2: off. Two tasks may both run the check, with the same result
+    static std::atomic<int> state = 0;
+    int value = state.load(std::memory_order_relaxed);
+    if (value == 0) {
+        value = CheckPie() ? 1 : 2;
+        state.store(value, std::memory_order_relaxed);
+    }
+    return value == 1;
+}
+#endif // PIE_OP
+
+int32_t VolumeFactor(int volume) {
+    // Same value as pow(volume / 100.0, 2) * 65536 for every volume, without the float math per frame
+    volume = std::clamp(volume, 0, 100);
+    return volume * volume * 65536 / 10000;
+}
+
+void Int16ToInt32(const int16_t* src, int32_t* dest, size_t samples, int32_t factor) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t s0 = src[i], s1 = src[i + 1], s2 = src[i + 2], s3 = src[i + 3];
+        dest[i] = s0 * factor;
+        dest[i + 1] = s1 * factor;
+        dest[i + 2] = s2 * factor;
+        dest[i + 3] = s3 * factor;
+    }
+    for (; i < samples; i++) {
+        dest[i] = src[i] * factor;
+    }
+}
+
+void Int32ToInt16(const int32_t* src, int16_t* dest, size_t samples, int shift) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t s0 = src[i] >> shift, s1 = src[i + 1] >> shift, s2 = src[i + 2] >> shift, s3 = src[i + 3] >> shift;
+        dest[i] = Saturate(s0);
+        dest[i + 1] = Saturate(s1);
+        dest[i + 2] = Saturate(s2);
+        dest[i + 3] = Saturate(s3);
+    }
+    for (; i < samples; i++) {
+        dest[i] = Saturate(src[i] >> shift);
+    }
+}
+
+void Gain(const int16_t* src, int16_t* dest, size_t samples, int32_t gain) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t s0 = src[i] * gain, s1 = src[i + 1] * gain, s2 = src[i + 2] * gain, s3 = src[i + 3] * gain;
+        dest[i] = Saturate(s0);
+        dest[i + 1] = Saturate(s1);
+        dest[i + 2] = Saturate(s2);
+        dest[i + 3] = Saturate(s3);
+    }
+    for (; i < samples; i++) {
+        dest[i] = Saturate(src[i] * gain);
+    }
+}
+
+void TakeChannel(const int16_t* src, int16_t* dest, size_t frames, size_t channels, size_t channel) {
+    if (channels == 1) {
+        if (dest != src) {
+            std::copy(src, src + frames, dest);
+        }
+        return;
+    }
+
+    size_t i = 0;
+    if (channels == 2) {
+#ifdef PIE_OP
+        if (IsAligned16(src) && IsAligned16(dest) && PieUsable()) {
+            size_t blocks = frames / 16;
+            TakeChannelStereoPie(src, dest, blocks, channel);
+            i = blocks * 16;
+        }
+#endif
+        // Two stereo frames per 64-bit load (little endian, left in the low half), both are read
+        // before the in place writes can reach them. memcpy keeps the access within the aliasing rules
+        int shift = channel == 0 ? 0 : 16;
+        for (; i + 2 <= frames; i += 2) {
+            uint32_t words[2];
+            memcpy(words, src + i * 2, sizeof(words));
+            dest[i] = (int16_t)(words[0] >> shift);
+            dest[i + 1] = (int16_t)(words[1] >> shift);
+        }
+    }
+    for (; i < frames; i++) {
+        dest[i] = src[i * channels + channel];
+    }
+}
+
+void ByteSwap16(const uint16_t* src, uint16_t* dest, size_t count) {
+    size_t i = 0;
+#ifdef PIE_OP
+    if (IsAligned16(src) && IsAligned16(dest) && PieUsable()) {
+        size_t blocks = count / 16;
+        ByteSwap16Pie(src, dest, blocks);
+        i = blocks * 16;
+    }
+#endif
+    for (; i < count; i++) {
+        dest[i] = __builtin_bswap16(src[i]);
+    }
+}
+
+} // namespace pcm
@@ -0,0 +1,37 @@
+#ifndef PCM_KERNELS_H
+#define PCM_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample loops shared by the codecs and the audio consumers.
+ *
+ * Every kernel is bit-exact with the scalar loop it replaced. They work on plain pointers so that
+ * callers can pass AudioScratch buffers, and the ones marked in place accept dest == src.
+ * With CONFIG_AUDIO_PCM_SIMD (experimental, off by default) the ESP32-S3 / P4 run TakeChannel() on
+ * stereo and ByteSwap16() with the PIE vector instructions when both buffers are 16-byte aligned.
+ */
+namespace pcm {
+
+// Linear factor of a 0-100 volume for Int16ToInt32(): (volume / 100)^2 in 16.16
+int32_t VolumeFactor(int volume);
+
+// dest[i] = src[i] * factor, factor in [0, 65536] so the product always fits in 32 bits
+void Int16ToInt32(const int16_t* src, int32_t* dest, size_t samples, int32_t factor);
+
+// dest[i] = src[i] >> shift, saturated to +-32767
+void Int32ToInt16(const int32_t* src, int16_t* dest, size_t samples, int shift);
+
+// dest[i] = src[i] * gain, saturated to +-32767. In place
+void Gain(const int16_t* src, int16_t* dest, size_t samples, int32_t gain);
+
+// dest[i] = src[i * channels + channel]. In place when channel is 0
+void TakeChannel(const int16_t* src, int16_t* dest, size_t frames, size_t channels, size_t channel = 0);
+
+// Swaps the two bytes of every 16-bit word. In place
+void ByteSwap16(const uint16_t* src, uint16_t* dest, size_t count);
+
+} // namespace pcm
+
+#endif // PCM_KERNELS_H
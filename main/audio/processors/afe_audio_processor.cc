@@ -18,9 +18,14 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
     output_buffer_.reserve(frame_samples_);
 
     int ref_num = codec_->input_reference() ? 1 : 0;
+    int mic_num = codec_->input_channels() - ref_num;
+    if (UsesSoftwareReference(codec_)) {
+        // AudioService appends the played audio as the last channel
+        ref_num = 1;
+    }
 
     std::string input_format;
-    for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
+    for (int i = 0; i < mic_num; i++) {
         input_format.push_back('M');
     }
     for (int i = 0; i < ref_num; i++) {
@@ -66,6 +71,7 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
 
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
+    input_chunker_.Configure(afe_iface_->get_feed_chunksize(afe_data_) * input_format.size());
     
     xTaskCreate([](void* arg) {
         auto this_ = (AfeAudioProcessor*)arg;
@@ -88,7 +94,7 @@ size_t AfeAudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_);
 }
 
-void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
+void AfeAudioProcessor::Feed(std::span<const int16_t> data) {
     if (afe_data_ == nullptr) {
         return;
     }
@@ -98,12 +104,10 @@ void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
     if (!IsRunning()) {
         return;
     }
-    input_buffer_.insert(input_buffer_.end(), data.begin(), data.end());
-    size_t chunk_size = afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
-    while (input_buffer_.size() >= chunk_size) {
-        afe_iface_->feed(afe_data_, input_buffer_.data());
-        input_buffer_.erase(input_buffer_.begin(), input_buffer_.begin() + chunk_size);
-    }
+    input_chunker_.Feed(data, [this](std::span<const int16_t> chunk) {
+        afe_iface_->feed(afe_data_, chunk.data());
+        return true;
+    });
 }
 
 void AfeAudioProcessor::Start() {
@@ -117,14 +121,14 @@ void AfeAudioProcessor::Stop() {
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
     }
-    input_buffer_.clear();
+    input_chunker_.Clear();
 }
 
 bool AfeAudioProcessor::IsRunning() {
     return xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING;
 }
 
-void AfeAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+void AfeAudioProcessor::OnOutput(std::function<void(std::span<const int16_t> data)> callback) {
     output_callback_ = callback;
 }
 
@@ -169,23 +173,31 @@ void AfeAudioProcessor::AudioProcessorTask() {
             // Add data to buffer
             output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
             
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
+            // Output complete frames as views of the buffer, then shift the remainder once.
+            // The buffer keeps its capacity, so no frame allocates
+            size_t frame_samples = frame_samples_;
+            size_t offset = 0;
+            while (output_buffer_.size() - offset >= frame_samples) {
+                output_callback_(std::span<const int16_t>(output_buffer_.data() + offset, frame_samples));
+                offset += frame_samples;
             }
+            output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + offset);
         }
     }
 }
 
+bool AfeAudioProcessor::UsesSoftwareReference(const AudioCodec* codec) {
+#if CONFIG_USE_SOFTWARE_AEC_REFERENCE && CONFIG_USE_DEVICE_AEC
+    return !codec->input_reference();
+#else
+    return false;
+#endif
+}
+
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
 void AfeAudioProcessor::EnableDeviceAec(bool enable) {
     if (enable) {
 #if CONFIG_USE_DEVICE_AEC
@@ -10,9 +10,11 @@
 #include <vector>
 #include <functional>
 #include <mutex>
+#include <atomic>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "audio_chunker.h"
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
@@ -20,25 +22,29 @@ public:
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
-    void Feed(std::vector<int16_t>&& data) override;
+    void Feed(std::span<const int16_t> data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
-    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    void OnOutput(std::function<void(std::span<const int16_t> data)> callback) override;
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
+    void SetFrameDuration(int frame_duration_ms) override;
+
+    // The codec has no reference channel and the AFE is fed EchoReference's, appended by AudioService
+    static bool UsesSoftwareReference(const AudioCodec* codec);
 
 private:
     EventGroupHandle_t event_group_ = nullptr;
     const esp_afe_sr_iface_t* afe_iface_ = nullptr;
     esp_afe_sr_data_t* afe_data_ = nullptr;
-    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::function<void(std::span<const int16_t> data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
+    std::atomic<size_t> frame_samples_ = 0;
     bool is_speaking_ = false;
-    std::vector<int16_t> input_buffer_;
+    AudioChunker input_chunker_;
     std::mutex input_buffer_mutex_;
     std::vector<int16_t> output_buffer_;
 
@@ -2,6 +2,7 @@
 #define AUDIO_DEBUGGER_H
 
 #include <vector>
+#include <span>
 #include <cstdint>
 
 #include <sys/socket.h>
@@ -12,7 +13,7 @@ public:
     AudioDebugger();
     ~AudioDebugger();
 
-    void Feed(const std::vector<int16_t>& data);
+    void Feed(std::span<const int16_t> data);
 
 private:
     int udp_sockfd_ = -1;
@@ -0,0 +1,59 @@
+#include "energy_vad.h"
+
+#include <algorithm>
+
+bool EnergyVad::Process(const int16_t* data, size_t samples, size_t stride) {
+    for (size_t i = 0; i < samples; i++) {
+        int16_t sample = data[i * stride];
+        block_abs_ += sample < 0 ? -sample : sample;
+        block_crossings_ += (sample ^ last_sample_) < 0;
+        last_sample_ = sample;
+        if (++block_samples_ == ENERGY_VAD_BLOCK_SAMPLES) {
+            EndBlock();
+        }
+    }
+    return speaking_;
+}
+
+void EnergyVad::EndBlock() {
+    uint32_t level = block_abs_ / block_samples_;
+    // Crossings per block: voiced speech stays well below half the samples, hiss does not
+    bool noisy = block_crossings_ * 2 > block_samples_;
+    block_abs_ = 0;
+    block_crossings_ = 0;
+    block_samples_ = 0;
+
+    bool speech = level >= ENERGY_VAD_MIN_LEVEL && level > noise_level_ * 3 && (!noisy || level > noise_level_ * 6);
+
+    // Fast down, slow up, and slower still during speech
+    if (level < noise_level_) {
+        noise_level_ -= (noise_level_ - level + 3) / 4;
+    } else {
+        noise_level_ += (level - noise_level_) / (speech ? 1024 : 128);
+    }
+    noise_level_ = std::max<uint32_t>(noise_level_, 16);
+
+    int block_ms = ENERGY_VAD_BLOCK_SAMPLES / 16;
+    if (speech) {
+        speech_blocks_++;
+        silence_ms_ = 0;
+        if (speech_blocks_ >= ENERGY_VAD_ONSET_BLOCKS) {
+            speaking_ = true;
+        }
+    } else {
+        speech_blocks_ = 0;
+        silence_ms_ += block_ms;
+        if (silence_ms_ >= ENERGY_VAD_HANGOVER_MS) {
+            speaking_ = false;
+        }
+    }
+}
+
+void EnergyVad::Reset() {
+    block_abs_ = 0;
+    block_crossings_ = 0;
+    block_samples_ = 0;
+    speech_blocks_ = 0;
+    silence_ms_ = 0;
+    speaking_ = false;
+}
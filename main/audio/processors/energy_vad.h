@@ -0,0 +1,41 @@
+#ifndef ENERGY_VAD_H
+#define ENERGY_VAD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define ENERGY_VAD_BLOCK_SAMPLES 160    // 10ms at 16kHz
+#define ENERGY_VAD_MIN_LEVEL 120        // Mean amplitude below which nothing is speech
+#define ENERGY_VAD_ONSET_BLOCKS 3       // Consecutive speech blocks that start speech
+#define ENERGY_VAD_HANGOVER_MS 300      // Silence that ends speech, bridges the pauses between words
+
+/*
+ * Lightweight voice activity detector for the path without the AFE.
+ *
+ * Every 10ms block is compared with an adaptive noise floor: speech is about 10 dB above it.
+ * A block only a little above the floor also needs a zero-crossing rate below that of hiss
+ * and fan noise. The floor follows quieter blocks within a few blocks and louder ones within
+ * about a second, eight times slower while it hears speech, so a noise step is eventually
+ * absorbed without the floor following the speech.
+ */
+class EnergyVad {
+public:
+    // Mono 16kHz samples, stride apart. Returns the speech state after the last complete block
+    bool Process(const int16_t* data, size_t samples, size_t stride = 1);
+    bool speaking() const { return speaking_; }
+    void Reset();
+
+private:
+    uint32_t block_abs_ = 0;
+    uint32_t block_crossings_ = 0;
+    uint32_t block_samples_ = 0;
+    int16_t last_sample_ = 0;
+    uint32_t noise_level_ = ENERGY_VAD_MIN_LEVEL / 2;
+    int speech_blocks_ = 0;
+    int silence_ms_ = 0;
+    bool speaking_ = false;
+
+    void EndBlock();
+};
+
+#endif // ENERGY_VAD_H
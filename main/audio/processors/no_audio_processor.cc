@@ -6,26 +6,52 @@
 void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
+    output_buffer_.reserve(frame_samples_);
 }
 
-void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
+void NoAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
+void NoAudioProcessor::Feed(std::span<const int16_t> data) {
     if (!is_running_ || !output_callback_) {
         return;
     }
 
-    if (codec_->input_channels() == 2) {
-        // If input channels is 2, we need to fetch the left channel data
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
+    // Drop the partial frame and the VAD state left from the previous session, on the feeding task
+    if (discard_output_.exchange(false)) {
+        output_buffer_.clear();
+        vad_.Reset();
+        if (is_speaking_) {
+            is_speaking_ = false;
+            if (vad_state_change_callback_) {
+                vad_state_change_callback_(false);
+            }
+        }
+    }
+
+    // If input channels is 2, we only keep the left channel
+    size_t step = codec_->input_channels();
+    bool speaking = vad_.Process(data.data(), data.size() / step, step);
+    if (speaking != is_speaking_) {
+        is_speaking_ = speaking;
+        if (vad_state_change_callback_) {
+            vad_state_change_callback_(speaking);
+        }
+    }
+    size_t frame_samples = frame_samples_;
+    for (size_t i = 0; i < data.size(); i += step) {
+        output_buffer_.push_back(data[i]);
+        if (output_buffer_.size() >= frame_samples) {
+            // The buffer keeps its capacity, the receiver copies what it keeps
+            output_callback_(output_buffer_);
+            output_buffer_.clear();
         }
-        output_callback_(std::move(mono_data));
-    } else {
-        output_callback_(std::move(data));
     }
 }
 
 void NoAudioProcessor::Start() {
+    discard_output_ = true;
     is_running_ = true;
 }
 
@@ -37,7 +63,7 @@ bool NoAudioProcessor::IsRunning() {
     return is_running_;
 }
 
-void NoAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+void NoAudioProcessor::OnOutput(std::function<void(std::span<const int16_t> data)> callback) {
     output_callback_ = callback;
 }
 
@@ -7,6 +7,7 @@
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "energy_vad.h"
 
 class NoAudioProcessor : public AudioProcessor {
 public:
@@ -14,21 +15,26 @@ public:
     ~NoAudioProcessor() = default;
 
     void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
-    void Feed(std::vector<int16_t>&& data) override;
+    void Feed(std::span<const int16_t> data) override;
     void Start() override;
     void Stop() override;
     bool IsRunning() override;
-    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    void OnOutput(std::function<void(std::span<const int16_t> data)> callback) override;
     void OnVadStateChange(std::function<void(bool speaking)> callback) override;
     size_t GetFeedSize() override;
     void EnableDeviceAec(bool enable) override;
+    void SetFrameDuration(int frame_duration_ms) override;
 
 private:
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
-    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::atomic<int> frame_samples_ = 0;
+    std::vector<int16_t> output_buffer_;    // Mono, collects one frame from the 10ms reads
+    std::function<void(std::span<const int16_t> data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     std::atomic<bool> is_running_ = false;
+    std::atomic<bool> discard_output_ = false;
+    EnergyVad vad_;                         // Feeding task only
+    bool is_speaking_ = false;
 };
 
 #endif 
\ No newline at end of file
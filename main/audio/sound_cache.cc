@@ -0,0 +1,117 @@
+#include "sound_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "SoundCache"
+
+SoundClip::~SoundClip() {
+    if (pcm != nullptr) {
+        heap_caps_free(pcm);
+    }
+}
+
+void SoundCache::Configure(size_t max_clips, int sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_clips_ = max_clips;
+    sample_rate_ = sample_rate;
+    max_samples_ = (size_t)sample_rate / 1000 * SOUND_CACHE_MAX_CLIP_MS;
+    entries_.clear();
+    entries_.reserve(max_clips);
+}
+
+std::shared_ptr<const SoundClip> SoundCache::Find(const void* key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_clips_ == 0) {
+        return nullptr;
+    }
+    for (auto& entry : entries_) {
+        if (entry.clip->key == key) {
+            entry.last_used = ++clock_;
+            hits_++;
+            return entry.clip;
+        }
+    }
+    misses_++;
+    return nullptr;
+}
+
+void SoundCache::BeginRecording(const void* key) {
+    recording_key_ = key;
+    recording_ = max_clips_ > 0;
+    recording_pcm_.clear();
+}
+
+void SoundCache::Record(std::span<const int16_t> pcm) {
+    if (!recording_) {
+        return;
+    }
+    if (recording_pcm_.size() + pcm.size() > max_samples_) {
+        // Too long to keep resident
+        recording_ = false;
+        std::vector<int16_t>().swap(recording_pcm_);
+        return;
+    }
+    recording_pcm_.insert(recording_pcm_.end(), pcm.begin(), pcm.end());
+}
+
+void SoundCache::EndRecording() {
+    if (!recording_ || recording_pcm_.empty()) {
+        recording_ = false;
+        return;
+    }
+    recording_ = false;
+
+    auto clip = std::make_shared<SoundClip>();
+    size_t bytes = recording_pcm_.size() * sizeof(int16_t);
+    clip->pcm = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (clip->pcm == nullptr) {
+        clip->pcm = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+    if (clip->pcm == nullptr) {
+        ESP_LOGW(TAG, "No memory to cache a %u bytes sound", (unsigned)bytes);
+        std::vector<int16_t>().swap(recording_pcm_);
+        return;
+    }
+    memcpy(clip->pcm, recording_pcm_.data(), bytes);
+    clip->samples = recording_pcm_.size();
+    clip->key = recording_key_;
+    // The recording buffer is only needed again for the next new sound
+    std::vector<int16_t>().swap(recording_pcm_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries_) {
+        if (entry.clip->key == clip->key) {
+            // Played again before its first play was recorded
+            entry.clip = std::move(clip);
+            entry.last_used = ++clock_;
+            return;
+        }
+    }
+    if (entries_.size() >= max_clips_) {
+        auto oldest = entries_.begin();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->last_used < oldest->last_used) {
+                oldest = it;
+            }
+        }
+        entries_.erase(oldest);
+        evictions_++;
+    }
+    ESP_LOGI(TAG, "Cached a %u ms sound, %u bytes", (unsigned)(clip->samples * 1000 / sample_rate_), (unsigned)bytes);
+    entries_.push_back({std::move(clip), ++clock_});
+}
+
+SoundCache::Stats SoundCache::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = {};
+    stats.clips = entries_.size();
+    for (auto& entry : entries_) {
+        stats.bytes += entry.clip->samples * sizeof(int16_t);
+    }
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    return stats;
+}
@@ -0,0 +1,76 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <span>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#define SOUND_CACHE_MAX_CLIP_MS 3000    // Longer sounds are always decoded from Opus
+
+// A sound decoded once at the codec output rate, shared by the cache and the cues playing it
+struct SoundClip {
+    const void* key = nullptr;      // Address of the Ogg data in flash
+    int16_t* pcm = nullptr;         // In PSRAM when the board has it
+    size_t samples = 0;
+
+    ~SoundClip();
+};
+
+/*
+ * Pre-decoded PCM of the built-in UI sounds (Lang::Sounds::OGG_*).
+ *
+ * The first play of a sound is demuxed and decoded as usual, and the decode task records the PCM
+ * it produces. Later plays push the recorded clip to the cue voice directly. At most max_clips
+ * stay resident, the least recently played one is dropped first. A clip that is still playing
+ * stays alive until its last frame has been queued.
+ *
+ * Find() is called by PlaySound() callers, the recording functions by the decode task only.
+ */
+class SoundCache {
+public:
+    struct Stats {
+        uint32_t clips;
+        uint32_t bytes;
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+    };
+
+    void Configure(size_t max_clips, int sample_rate);
+    bool enabled() const { return max_clips_ > 0; }
+
+    // Returns the clip for this Ogg data, or nullptr when it has to be decoded
+    std::shared_ptr<const SoundClip> Find(const void* key);
+
+    void BeginRecording(const void* key);
+    void Record(std::span<const int16_t> pcm);
+    void EndRecording();
+
+    Stats GetStats();
+
+private:
+    struct Entry {
+        std::shared_ptr<const SoundClip> clip;
+        uint32_t last_used;
+    };
+
+    std::mutex mutex_;
+    std::vector<Entry> entries_;
+    size_t max_clips_ = 0;
+    size_t max_samples_ = 0;
+    int sample_rate_ = 16000;
+    uint32_t clock_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+    uint32_t evictions_ = 0;
+
+    // Decode task only
+    const void* recording_key_ = nullptr;
+    bool recording_ = false;
+    std::vector<int16_t> recording_pcm_;
+};
+
+#endif // SOUND_CACHE_H
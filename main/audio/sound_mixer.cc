@@ -0,0 +1,65 @@
+#include "sound_mixer.h"
+#include "audio_service.h"
+
+#include <algorithm>
+#include <cstring>
+
+void SoundMixer::Configure(int sample_rate) {
+    int ramp_samples = std::max(1, sample_rate / 1000 * SOUND_MIXER_RAMP_MS);
+    ramp_step_ = std::max(1, (32768 - SOUND_MIXER_DUCK_GAIN) / ramp_samples);
+}
+
+bool SoundMixer::NextFrame(AudioQueue<std::unique_ptr<AudioTask>>& cues) {
+    if (current_ != nullptr && offset_ < current_->pcm.size()) {
+        return true;
+    }
+    current_.reset();
+    offset_ = 0;
+    while (cues.Pop(current_)) {
+        if (!current_->pcm.empty()) {
+            if (!playing_) {
+                playing_ = true;
+                cues_started_++;
+            }
+            return true;
+        }
+    }
+    current_.reset();
+    playing_ = false;
+    return false;
+}
+
+void SoundMixer::Mix(int16_t* pcm, size_t samples, AudioQueue<std::unique_ptr<AudioTask>>& cues) {
+    size_t i = 0;
+    while (i < samples && NextFrame(cues)) {
+        const int16_t* cue = current_->pcm.data() + offset_;
+        size_t n = std::min(samples - i, current_->pcm.size() - offset_);
+        for (size_t j = 0; j < n; j++, i++) {
+            gain_ = std::max<int32_t>(gain_ - ramp_step_, SOUND_MIXER_DUCK_GAIN);
+            int32_t sample = ((pcm[i] * gain_) >> 15) + cue[j];
+            pcm[i] = std::clamp<int32_t>(sample, INT16_MIN, INT16_MAX);
+        }
+        offset_ += n;
+    }
+
+    // No cue for the rest, release the ducking
+    for (; i < samples && gain_ < 32768; i++) {
+        gain_ = std::min<int32_t>(gain_ + ramp_step_, 32768);
+        pcm[i] = (pcm[i] * gain_) >> 15;
+    }
+}
+
+size_t SoundMixer::Render(int16_t* pcm, size_t samples, AudioQueue<std::unique_ptr<AudioTask>>& cues) {
+    size_t written = 0;
+    while (written < samples && NextFrame(cues)) {
+        size_t n = std::min(samples - written, current_->pcm.size() - offset_);
+        memcpy(pcm + written, current_->pcm.data() + offset_, n * sizeof(int16_t));
+        offset_ += n;
+        written += n;
+    }
+    // Speech starting during the cue starts ducked
+    if (written > 0) {
+        gain_ = SOUND_MIXER_DUCK_GAIN;
+    }
+    return written;
+}
@@ -0,0 +1,46 @@
+#ifndef SOUND_MIXER_H
+#define SOUND_MIXER_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include "audio_queue.h"
+
+#define SOUND_MIXER_DUCK_GAIN 10362     // Q15, about -10dB on the speech while a cue plays
+#define SOUND_MIXER_RAMP_MS 10          // Duck / release ramp, avoids clicks
+
+struct AudioTask;
+
+/*
+ * The sound cue voice of the output path.
+ *
+ * Decoded cue frames (at the codec output rate) wait in their own queue and are added to whatever
+ * the output task plays, sample by sample, while the other voice is ducked. When nothing else plays
+ * the cue is rendered on its own. Only the output task calls Mix() / Render().
+ */
+class SoundMixer {
+public:
+    void Configure(int sample_rate);
+
+    // Adds the cue voice to pcm and ducks pcm while a cue plays
+    void Mix(int16_t* pcm, size_t samples, AudioQueue<std::unique_ptr<AudioTask>>& cues);
+    // Writes up to samples of the cue voice alone, returns the number written
+    size_t Render(int16_t* pcm, size_t samples, AudioQueue<std::unique_ptr<AudioTask>>& cues);
+
+    bool Pending(const AudioQueue<std::unique_ptr<AudioTask>>& cues) const { return playing_ || !cues.Empty(); }
+    uint32_t cues_started() const { return cues_started_; }
+
+private:
+    std::unique_ptr<AudioTask> current_;
+    size_t offset_ = 0;
+    std::atomic<bool> playing_ = false;     // Read by other tasks to know if a cue is still audible
+    int32_t gain_ = 32768;                  // Q15 gain of the other voice
+    int32_t ramp_step_ = 32768;
+    uint32_t cues_started_ = 0;
+
+    bool NextFrame(AudioQueue<std::unique_ptr<AudioTask>>& cues);
+};
+
+#endif // SOUND_MIXER_H
@@ -0,0 +1,440 @@
+#include "stream_player.h"
+#include "audio_service.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cinttypes>
+
+#define TAG "StreamPlayer"
+
+#define STREAM_PLAYER_TASK_STACK_SIZE (4096 * 2)
+#define STREAM_PLAYER_RETRY_DELAY_US 1000000
+
+namespace {
+
+// Duration of an Opus packet in tenths of a millisecond, from its TOC byte (RFC 6716 section 3.1)
+int OpusPacketDuration(const uint8_t* data, size_t size) {
+    static const int silk_frames[] = { 100, 200, 400, 600 };
+    static const int celt_frames[] = { 25, 50, 100, 200 };
+    if (size == 0) {
+        return 0;
+    }
+    int config = data[0] >> 3;
+    int frame = config < 12 ? silk_frames[config & 3] : config < 16 ? 100 * (1 + (config & 1)) : celt_frames[config & 3];
+    int frames = 1;
+    if ((data[0] & 3) == 3) {
+        frames = size > 1 ? data[1] & 0x3f : 0;
+    } else if ((data[0] & 3) != 0) {
+        frames = 2;
+    }
+    return frame * frames;
+}
+
+bool IsOpusSampleRate(int sample_rate) {
+    return sample_rate == 8000 || sample_rate == 12000 || sample_rate == 16000 ||
+        sample_rate == 24000 || sample_rate == 48000;
+}
+
+const char* StateName(StreamPlayerState state) {
+    switch (state) {
+        case kStreamPlayerPlaying: return "playing";
+        case kStreamPlayerPaused: return "paused";
+        default: return "stopped";
+    }
+}
+
+} // namespace
+
+StreamPlayer::StreamPlayer(AudioService& audio_service) : audio_service_(audio_service) {
+    demuxer_.EnableViews(true);
+    demuxer_.OnDemuxerFinished([this](const uint8_t* data, int sample_rate, size_t len, bool view) {
+        OnPacket(data, len);
+    });
+}
+
+StreamPlayer::~StreamPlayer() {
+    if (task_ != nullptr) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+        cv_.notify_all();
+        cv_.wait(lock, [this]() { return task_parked_; });
+        lock.unlock();
+        vTaskDelete(task_);
+    }
+}
+
+bool StreamPlayer::Play(const std::string& url) {
+    if (url.rfind("http://", 0) != 0 && url.rfind("https://", 0) != 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (task_ == nullptr) {
+        chunk_.resize(STREAM_PLAYER_CHUNK_BYTES);
+        xTaskCreate([](void* arg) {
+            auto this_ = (StreamPlayer*)arg;
+            this_->PlayerTask();
+            // Parked until the destructor deletes the task
+            while (true) {
+                vTaskDelay(portMAX_DELAY);
+            }
+        }, "stream_player", STREAM_PLAYER_TASK_STACK_SIZE, this, 2, &task_);
+        if (task_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to create the player task");
+            return false;
+        }
+    }
+    url_ = url;
+    position_ = 0;
+    content_length_ = 0;
+    page_position_ = 0;
+    generation_++;
+    state_ = kStreamPlayerPlaying;
+    request_time_us_ = esp_timer_get_time();
+    first_audio_ = false;
+    audio_started_ = false;
+    played_ms_ = 0;
+    connect_ms_ = 0;
+    first_audio_ms_ = 0;
+    underruns_ = 0;
+    underrun_ms_ = 0;
+    reconnects_ = 0;
+    skipped_packets_ = 0;
+    last_error_.clear();
+    cv_.notify_all();
+    ESP_LOGI(TAG, "Play %s%s", url.c_str(), held_ ? " (held until the device is idle)" : "");
+    return true;
+}
+
+void StreamPlayer::Pause() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == kStreamPlayerPlaying) {
+        state_ = kStreamPlayerPaused;
+        cv_.notify_all();
+    }
+}
+
+void StreamPlayer::Resume() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == kStreamPlayerPaused) {
+        state_ = kStreamPlayerPlaying;
+        request_time_us_ = esp_timer_get_time();
+        first_audio_ = false;
+        cv_.notify_all();
+    }
+}
+
+bool StreamPlayer::Seek(int percent) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == kStreamPlayerStopped || !audio_started_ || content_length_ == 0) {
+        return false;
+    }
+    percent = std::clamp(percent, 0, 99);
+    position_ = content_length_ * percent / 100;
+    page_position_ = position_;
+    generation_++;
+    request_time_us_ = esp_timer_get_time();
+    first_audio_ = false;
+    cv_.notify_all();
+    ESP_LOGI(TAG, "Seek to %d%% (byte %" PRIu64 ")", percent, position_);
+    return true;
+}
+
+void StreamPlayer::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != kStreamPlayerStopped) {
+        state_ = kStreamPlayerStopped;
+        position_ = 0;
+        generation_++;
+        cv_.notify_all();
+    }
+}
+
+void StreamPlayer::Hold(bool hold) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (held_ == hold) {
+        return;
+    }
+    held_ = hold;
+    if (!hold && state_ == kStreamPlayerPlaying) {
+        request_time_us_ = esp_timer_get_time();
+        first_audio_ = false;
+    }
+    cv_.notify_all();
+}
+
+bool StreamPlayer::IsActive() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_ == kStreamPlayerPlaying && !held_;
+}
+
+void StreamPlayer::PlayerTask() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return stop_ || (state_ == kStreamPlayerPlaying && !held_); });
+        if (stop_) {
+            break;
+        }
+        session_generation_ = generation_;
+        session_position_ = position_;
+        std::string url = url_;
+        session_running_ = true;
+        lock.unlock();
+        RunSession(url);
+        lock.lock();
+        session_running_ = false;
+    }
+    task_parked_ = true;
+    cv_.notify_all();
+}
+
+bool StreamPlayer::Interrupted() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stop_ || held_ || state_ != kStreamPlayerPlaying || generation_ != session_generation_;
+}
+
+bool StreamPlayer::WaitInterrupted(int64_t timeout_us) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, std::chrono::microseconds(timeout_us), [this]() {
+        return stop_ || held_ || state_ != kStreamPlayerPlaying || generation_ != session_generation_;
+    });
+}
+
+void StreamPlayer::RunSession(const std::string& url) {
+    /* A session reads from session_position_ until the end, an error or a command */
+    if (session_position_ == 0) {
+        demuxer_.Reset();
+    } else {
+        demuxer_.Resync(session_position_);
+    }
+    int output_sample_rate = Board::GetInstance().GetAudioCodec()->output_sample_rate();
+    decode_sample_rate_ = IsOpusSampleRate(output_sample_rate) ? output_sample_rate : 48000;
+    clock_start_us_ = 0;
+    queued_ms_ = 0;
+    aborted_ = false;
+    marks_head_ = 0;
+    marks_count_ = 0;
+
+    uint64_t read_position = session_position_;
+    uint64_t content_length = 0;
+    int retries = 0;
+    bool finished = false;
+    std::string error;
+    while (!finished && error.empty() && !Interrupted()) {
+        if (retries > 0) {
+            ESP_LOGW(TAG, "Reconnecting at byte %" PRIu64 " (%d/%d)", read_position, retries, STREAM_PLAYER_MAX_RETRIES);
+            std::lock_guard<std::mutex> lock(mutex_);
+            reconnects_++;
+        }
+        // Connection 3 is taken by the camera and screen uploads
+        auto http = Board::GetInstance().GetNetwork()->CreateHttp(4);
+        if (read_position > 0) {
+            http->SetHeader("Range", "bytes=" + std::to_string(read_position) + "-");
+        }
+        int64_t open_time = esp_timer_get_time();
+        if (!http->Open("GET", url)) {
+            if (++retries > STREAM_PLAYER_MAX_RETRIES) {
+                error = "Failed to open the URL";
+            } else {
+                WaitInterrupted(STREAM_PLAYER_RETRY_DELAY_US);
+            }
+            continue;
+        }
+        int status_code = http->GetStatusCode();
+        size_t body_length = http->GetBodyLength();
+        uint64_t skip = 0;
+        if (status_code == 206) {
+            content_length = body_length > 0 ? read_position + body_length : 0;
+        } else if (status_code == 200) {
+            /* The server ignores the range, read up to the position */
+            content_length = body_length;
+            skip = read_position;
+            if (skip > 0) {
+                ESP_LOGW(TAG, "Server does not support ranges, skipping %" PRIu64 " bytes", skip);
+            }
+        } else {
+            error = "Unexpected status code: " + std::to_string(status_code);
+            http->Close();
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connect_ms_ = (esp_timer_get_time() - open_time) / 1000;
+            content_length_ = content_length;
+        }
+
+        int ret = 0;
+        while (!aborted_ && !Interrupted()) {
+            ret = http->Read((char*)chunk_.data(), chunk_.size());
+            if (ret <= 0) {
+                break;
+            }
+            retries = 0;
+            const uint8_t* data = chunk_.data();
+            size_t size = ret;
+            if (skip > 0) {
+                size_t skipped = std::min<uint64_t>(skip, size);
+                skip -= skipped;
+                data += skipped;
+                size -= skipped;
+            }
+            demuxer_.Process(data, size);
+            read_position += size;
+        }
+        http->Close();
+        if (ret == 0 && (content_length == 0 || read_position >= content_length)) {
+            finished = true;
+        } else if (ret <= 0 && !aborted_ && ++retries > STREAM_PLAYER_MAX_RETRIES) {
+            error = "Connection lost";
+        }
+    }
+
+    /* At the end of the file, wait for the queued audio to play before reporting it stopped */
+    int64_t now = esp_timer_get_time();
+    if (finished && clock_start_us_ > 0) {
+        int64_t remaining_us = clock_start_us_ + queued_ms_ * 1000LL - now;
+        if (remaining_us > 0 && WaitInterrupted(remaining_us)) {
+            finished = false;
+        }
+        now = esp_timer_get_time();
+    }
+    uint32_t played_ms = 0;
+    if (clock_start_us_ > 0) {
+        played_ms = std::clamp<int64_t>((now - clock_start_us_) / 1000, 0, queued_ms_.load());
+    }
+
+    bool reset_decoder = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        played_ms_ += played_ms;
+        bool current = generation_ == session_generation_;
+        if (current && (finished || !error.empty())) {
+            state_ = kStreamPlayerStopped;
+            position_ = 0;
+            last_error_ = error;
+            if (error.empty()) {
+                ESP_LOGI(TAG, "Finished %s: played %" PRIu64 " ms, %" PRIu32 " underruns (%" PRIu32 " ms), %" PRIu32 " reconnects, %" PRIu32 " packets skipped",
+                    url.c_str(), played_ms_, underruns_, underrun_ms_, reconnects_, skipped_packets_);
+            } else {
+                ESP_LOGE(TAG, "Stopped %s at byte %" PRIu64 ": %s", url.c_str(), read_position, error.c_str());
+            }
+        } else if (current) {
+            /* Paused or held: restart from the page being heard */
+            position_ = ResumePosition(played_ms);
+            page_position_ = position_;
+        }
+        // A conversation resets the decoder itself, pause, seek and stop cut the queued audio here
+        reset_decoder = !held_ && !finished && error.empty() && clock_start_us_ > 0;
+    }
+    if (reset_decoder) {
+        audio_service_.ResetDecoder();
+    }
+}
+
+void StreamPlayer::OnPacket(const uint8_t* data, size_t size) {
+    if (aborted_) {
+        return;
+    }
+    int duration = OpusPacketDuration(data, size);
+    if (duration == 0 || duration % 10 != 0 || AS_OPUS_GET_FRAME_DRU_ENUM(duration / 10) == -1) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        skipped_packets_++;
+        return;
+    }
+    int frame_ms = duration / 10;
+
+    /* Queue at most the prefetch ahead of the speaker, the player clock starts with the first packet */
+    int64_t now = esp_timer_get_time();
+    if (clock_start_us_ == 0) {
+        clock_start_us_ = now;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!first_audio_) {
+            first_audio_ = true;
+            audio_started_ = true;
+            first_audio_ms_ = (now - request_time_us_) / 1000;
+            ESP_LOGI(TAG, "First audio after %" PRIu32 " ms (connect %" PRIu32 " ms)", first_audio_ms_, connect_ms_);
+        }
+    } else {
+        int64_t ahead_us = clock_start_us_ + queued_ms_ * 1000LL - now;
+        if (ahead_us < 0) {
+            /* The speaker ran out of stream audio, the clock restarts from here */
+            clock_start_us_ -= ahead_us;
+            std::lock_guard<std::mutex> lock(mutex_);
+            underruns_++;
+            underrun_ms_ += -ahead_us / 1000;
+            ESP_LOGW(TAG, "Underrun of %" PRId64 " ms at byte %" PRIu64, -ahead_us / 1000, demuxer_.page_position());
+        } else if (ahead_us > CONFIG_STREAM_PLAYER_PREFETCH_MS * 1000LL &&
+                   WaitInterrupted(ahead_us - CONFIG_STREAM_PLAYER_PREFETCH_MS * 1000LL)) {
+            aborted_ = true;
+            return;
+        }
+    }
+    if (Interrupted()) {
+        aborted_ = true;
+        return;
+    }
+
+    uint64_t page_position = demuxer_.page_position();
+    size_t newest = (marks_head_ + marks_count_ + STREAM_PLAYER_PAGE_MARKS - 1) % STREAM_PLAYER_PAGE_MARKS;
+    if (marks_count_ == 0 || marks_[newest].position != page_position) {
+        if (marks_count_ == STREAM_PLAYER_PAGE_MARKS) {
+            marks_head_ = (marks_head_ + 1) % STREAM_PLAYER_PAGE_MARKS;
+            marks_count_--;
+        }
+        marks_[(marks_head_ + marks_count_) % STREAM_PLAYER_PAGE_MARKS] = { page_position, queued_ms_ };
+        marks_count_++;
+        std::lock_guard<std::mutex> lock(mutex_);
+        page_position_ = page_position;
+    }
+
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->sample_rate = decode_sample_rate_;
+    packet->frame_duration = frame_ms;
+    AssignBuffer(packet->payload, data, size);
+    audio_service_.PushPacketToDecodeQueue(std::move(packet), true);
+    queued_ms_ += frame_ms;
+}
+
+uint64_t StreamPlayer::ResumePosition(uint32_t played_ms) {
+    /* The newest page that started playing, or the oldest one still known */
+    if (marks_count_ == 0) {
+        return session_position_;
+    }
+    for (size_t i = marks_count_; i > 0; i--) {
+        auto& mark = marks_[(marks_head_ + i - 1) % STREAM_PLAYER_PAGE_MARKS];
+        if (mark.start_ms <= played_ms) {
+            return mark.position;
+        }
+    }
+    return marks_[marks_head_].position;
+}
+
+cJSON* StreamPlayer::GetStatusJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "state", StateName(state_));
+    cJSON_AddBoolToObject(json, "held", held_);
+    cJSON_AddStringToObject(json, "url", url_.c_str());
+    cJSON_AddNumberToObject(json, "position", page_position_);
+    cJSON_AddNumberToObject(json, "content_length", content_length_);
+    if (content_length_ > 0) {
+        cJSON_AddNumberToObject(json, "position_percent", page_position_ * 100 / content_length_);
+    }
+    uint64_t played_ms = played_ms_;
+    int64_t clock_start_us = clock_start_us_;
+    if (session_running_ && clock_start_us > 0) {
+        played_ms += std::clamp<int64_t>((esp_timer_get_time() - clock_start_us) / 1000, 0, queued_ms_.load());
+    }
+    cJSON_AddNumberToObject(json, "played_ms", played_ms);
+    cJSON_AddNumberToObject(json, "connect_ms", connect_ms_);
+    cJSON_AddNumberToObject(json, "first_audio_ms", first_audio_ms_);
+    cJSON_AddNumberToObject(json, "underruns", underruns_);
+    cJSON_AddNumberToObject(json, "underrun_ms", underrun_ms_);
+    cJSON_AddNumberToObject(json, "reconnects", reconnects_);
+    cJSON_AddNumberToObject(json, "skipped_packets", skipped_packets_);
+    if (!last_error_.empty()) {
+        cJSON_AddStringToObject(json, "error", last_error_.c_str());
+    }
+    return json;
+}
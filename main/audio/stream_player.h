@@ -0,0 +1,114 @@
+#ifndef STREAM_PLAYER_H
+#define STREAM_PLAYER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <cJSON.h>
+
+#include "ogg_demuxer.h"
+
+#define STREAM_PLAYER_CHUNK_BYTES 4096      // Read from the connection at a time
+#define STREAM_PLAYER_PAGE_MARKS 16         // Pages queued to the decoder that playback can resume from
+#define STREAM_PLAYER_MAX_RETRIES 3         // Reconnections at the same byte before giving up
+
+class AudioService;
+
+enum StreamPlayerState {
+    kStreamPlayerStopped,
+    kStreamPlayerPlaying,
+    kStreamPlayerPaused,
+};
+
+/*
+ * Plays a long Ogg/Opus file from an HTTP URL through the speech decoder.
+ *
+ * The file is read in small chunks, demuxed as it arrives and queued to the decoder only
+ * CONFIG_STREAM_PLAYER_PREFETCH_MS ahead of the speaker, so memory stays flat whatever the
+ * length. The player keeps the byte position of the Ogg pages in flight: pause, a conversation
+ * (Hold()) or a dropped connection restart from the page being heard with an HTTP Range request,
+ * and seek starts at a byte offset and resynchronizes on the next page.
+ *
+ * The commands are called by any task, the stream is read by the player's own task.
+ */
+class StreamPlayer {
+public:
+    explicit StreamPlayer(AudioService& audio_service);
+    ~StreamPlayer();
+
+    bool Play(const std::string& url);
+    void Pause();
+    void Resume();
+    // Needs the content length, so it is refused until the first audio of the file
+    bool Seek(int percent);
+    void Stop();
+    // Playback only runs while the device is idle, a conversation holds it where it is
+    void Hold(bool hold);
+    bool IsActive();
+    cJSON* GetStatusJson();
+
+private:
+    struct PageMark {
+        uint64_t position;      // Byte of the page
+        uint32_t start_ms;      // Session audio queued before its first packet
+    };
+
+    AudioService& audio_service_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    TaskHandle_t task_ = nullptr;
+    bool stop_ = false;
+    bool task_parked_ = false;
+
+    // Commands, under mutex_
+    StreamPlayerState state_ = kStreamPlayerStopped;
+    bool held_ = true;              // The device starts outside the idle state
+    uint32_t generation_ = 0;       // Bumped when the position is moved, ends the session reading the old one
+    std::string url_;
+    uint64_t position_ = 0;         // Byte the next session starts from
+    uint64_t content_length_ = 0;   // 0 when unknown
+    uint64_t page_position_ = 0;    // Page being queued to the decoder
+    int64_t request_time_us_ = 0;   // Play, resume or seek waiting for its first audio
+    bool first_audio_ = false;
+    bool audio_started_ = false;    // Since Play()
+
+    // Player task
+    OggDemuxer demuxer_;
+    std::vector<uint8_t> chunk_;
+    uint32_t session_generation_ = 0;
+    uint64_t session_position_ = 0;
+    int decode_sample_rate_ = 0;
+    // Playback time of the session's first packet and the audio queued since, read by the status too
+    std::atomic<int64_t> clock_start_us_ = 0;
+    std::atomic<uint32_t> queued_ms_ = 0;
+    bool aborted_ = false;          // The session was interrupted inside Process()
+    PageMark marks_[STREAM_PLAYER_PAGE_MARKS] = {};
+    size_t marks_head_ = 0;
+    size_t marks_count_ = 0;
+
+    // Statistics, under mutex_
+    uint64_t played_ms_ = 0;        // Of the sessions before the running one
+    bool session_running_ = false;
+    uint32_t connect_ms_ = 0;
+    uint32_t first_audio_ms_ = 0;
+    uint32_t underruns_ = 0;
+    uint32_t underrun_ms_ = 0;
+    uint32_t reconnects_ = 0;
+    uint32_t skipped_packets_ = 0;
+    std::string last_error_;
+
+    void PlayerTask();
+    void RunSession(const std::string& url);
+    bool Interrupted();
+    bool WaitInterrupted(int64_t timeout_us);
+    void OnPacket(const uint8_t* data, size_t size);
+    uint64_t ResumePosition(uint32_t played_ms);
+};
+
+#endif // STREAM_PLAYER_H
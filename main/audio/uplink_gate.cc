@@ -0,0 +1,181 @@
+#include "uplink_gate.h"
+
+void UplinkGate::Configure(UplinkGatePolicy policy, int padding_ms, int keepalive_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+    padding_ms_ = padding_ms;
+    keepalive_ms_ = keepalive_ms;
+    preroll_.clear();
+    backlog_.clear();
+    if (policy_ != kUplinkGateSendAll) {
+        preroll_.resize(padding_ms_ / UPLINK_GATE_MIN_FRAME_MS + 1);
+        // The whole pre-roll plus the frame that opened the gate
+        backlog_.resize(preroll_.size() + 1);
+    }
+    preroll_head_ = 0;
+    preroll_count_ = 0;
+    preroll_ms_ = 0;
+    backlog_head_ = 0;
+    backlog_count_ = 0;
+}
+
+void UplinkGate::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    session_++;
+    preroll_head_ = 0;
+    preroll_count_ = 0;
+    preroll_ms_ = 0;
+    hold_ms_ = 0;
+    silence_sent_ms_ = 0;
+    stats_ = {};
+}
+
+UplinkGate::Stats UplinkGate::Finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    session_++;
+    while (preroll_count_ > 0) {
+        Drop(preroll_[preroll_head_]);
+        preroll_head_ = (preroll_head_ + 1) % preroll_.size();
+        preroll_count_--;
+    }
+    return stats_;
+}
+
+UplinkGate::Stats UplinkGate::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void UplinkGate::Drop(Frame& frame) {
+    int frame_ms = frame.pcm.size() / 16;
+    stats_.dropped_ms += frame_ms;
+    preroll_ms_ -= frame_ms;
+}
+
+void UplinkGate::OnSend(SendCallback callback) {
+    send_ = callback;
+}
+
+// Swaps the buffer in, so the pre-roll and the backlog trade their reserved capacity
+void UplinkGate::PushBacklog(std::vector<int16_t>& pcm, int64_t capture_time_us) {
+    auto& slot = backlog_[(backlog_head_ + backlog_count_) % backlog_.size()];
+    slot.pcm.swap(pcm);
+    slot.capture_time_us = capture_time_us;
+    backlog_count_++;
+}
+
+void UplinkGate::SendBacklog() {
+    if (backlog_session_ != session_.load(std::memory_order_relaxed)) {
+        // The session ended, Finish() already reported these frames
+        backlog_head_ = 0;
+        backlog_count_ = 0;
+        backlog_session_ = session_.load(std::memory_order_relaxed);
+        return;
+    }
+    // Everything the encoder takes at once, then at most one frame of waiting
+    bool waited = false;
+    while (backlog_count_ > 0) {
+        auto& frame = backlog_[backlog_head_];
+        if (!send_(frame.pcm, frame.capture_time_us, false)) {
+            if (waited) {
+                break;
+            }
+            waited = true;
+            send_(frame.pcm, frame.capture_time_us, true);
+        }
+        backlog_head_ = (backlog_head_ + 1) % backlog_.size();
+        backlog_count_--;
+    }
+}
+
+void UplinkGate::Process(std::span<const int16_t> pcm, int64_t capture_time_us, bool speaking) {
+    int frame_ms = pcm.size() / 16;
+    bool send = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (policy_ == kUplinkGateSendAll) {
+            stats_.sent_ms += frame_ms;
+            send = true;
+        } else {
+            send = Gate(pcm, capture_time_us, speaking, frame_ms);
+        }
+    }
+
+    /* Outside the lock, the callback may wait for the encoder */
+    SendBacklog();
+    if (!send) {
+        return;
+    }
+    if (backlog_count_ == 0) {
+        send_(pcm, capture_time_us, true);
+        return;
+    }
+    // Queued behind the backlog to keep the order, SendBacklog() always leaves room for one frame
+    auto& slot = backlog_[(backlog_head_ + backlog_count_) % backlog_.size()];
+    slot.pcm.assign(pcm.begin(), pcm.end());
+    slot.capture_time_us = capture_time_us;
+    backlog_count_++;
+}
+
+bool UplinkGate::Gate(std::span<const int16_t> pcm, int64_t capture_time_us, bool speaking, int frame_ms) {
+    if (speaking) {
+        hold_ms_ = padding_ms_;
+    }
+    if (speaking || hold_ms_ > 0) {
+        if (!speaking) {
+            hold_ms_ -= frame_ms;
+        }
+        /* Open: the pre-roll goes first, oldest frame first, through the backlog */
+        uint32_t session = session_.load(std::memory_order_relaxed);
+        if (backlog_session_ != session) {
+            backlog_head_ = 0;
+            backlog_count_ = 0;
+            backlog_session_ = session;
+        }
+        while (preroll_count_ > 0) {
+            auto& frame = preroll_[preroll_head_];
+            if (backlog_count_ < backlog_.size()) {
+                stats_.sent_ms += frame.pcm.size() / 16;
+                PushBacklog(frame.pcm, frame.capture_time_us);
+            } else {
+                Drop(frame);
+            }
+            preroll_head_ = (preroll_head_ + 1) % preroll_.size();
+            preroll_count_--;
+        }
+        preroll_ms_ = 0;
+        stats_.sent_ms += frame_ms;
+        silence_sent_ms_ = 0;
+        return true;
+    }
+
+    /* Closed: the frames older than the padding are dropped */
+    bool keepalive = false;
+    if (policy_ == kUplinkGateKeepalive) {
+        silence_sent_ms_ += frame_ms;
+        keepalive = silence_sent_ms_ >= keepalive_ms_;
+    }
+    while (preroll_count_ > 0 &&
+           (keepalive || preroll_ms_ + frame_ms > padding_ms_ || preroll_count_ == preroll_.size())) {
+        Drop(preroll_[preroll_head_]);
+        preroll_head_ = (preroll_head_ + 1) % preroll_.size();
+        preroll_count_--;
+    }
+    if (keepalive) {
+        // The older pre-roll was dropped above, so the server still gets the frames in order
+        silence_sent_ms_ = 0;
+        stats_.keepalive_frames++;
+        stats_.sent_ms += frame_ms;
+        return true;
+    }
+    if (frame_ms > padding_ms_) {
+        stats_.dropped_ms += frame_ms;
+        return false;
+    }
+    auto& slot = preroll_[(preroll_head_ + preroll_count_) % preroll_.size()];
+    slot.pcm.assign(pcm.begin(), pcm.end());
+    slot.capture_time_us = capture_time_us;
+    preroll_count_++;
+    preroll_ms_ += frame_ms;
+    return false;
+}
@@ -0,0 +1,93 @@
+#ifndef UPLINK_GATE_H
+#define UPLINK_GATE_H
+
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#define UPLINK_GATE_MIN_FRAME_MS 20     // Sizes the pre-roll ring, shorter frames keep less padding
+
+enum UplinkGatePolicy {
+    kUplinkGateSendAll,
+    kUplinkGateSpeech,      // Speech plus the padding before and after it
+    kUplinkGateKeepalive,   // Same, and one frame per keepalive interval during silence
+};
+
+/*
+ * Decides which processor output frames are encoded and sent.
+ *
+ * The frames before speech are held in a pre-roll ring of padding_ms and sent when speech
+ * starts, so the first syllable is not cut. After speech the gate stays open for padding_ms,
+ * which also gives the server the trailing silence its end of speech detection waits for.
+ * Every frame that leaves the pre-roll unsent is counted as saved.
+ *
+ * The send callback is never called with the lock held. The pre-roll is handed over without
+ * waiting: what the encoder does not take at once stays in a backlog, and every later frame
+ * waits for at most one backlog frame, so the capture task is never held up for the whole pre-roll.
+ *
+ * Process() is called by the task producing the frames, the other functions by any task.
+ */
+class UplinkGate {
+public:
+    struct Stats {
+        uint32_t sent_ms;
+        uint32_t dropped_ms;
+        uint32_t keepalive_frames;
+    };
+
+    // With wait false the callback returns false instead of blocking when the encoder is busy
+    using SendCallback = std::function<bool(std::span<const int16_t> pcm, int64_t capture_time_us, bool wait)>;
+
+    void Configure(UplinkGatePolicy policy, int padding_ms, int keepalive_ms);
+    UplinkGatePolicy policy() const { return policy_; }
+    int padding_ms() const { return padding_ms_; }
+
+    // Starts a session, the pre-roll and the session stats are cleared
+    void Start();
+    // Ends the session, what is left in the pre-roll and the backlog is dropped. Returns the session stats
+    Stats Finish();
+    Stats GetStats();
+
+    // Set before the first frame, called from Process() for every frame sent
+    void OnSend(SendCallback callback);
+    // One 16kHz mono frame, speaking is the VAD state when its last sample was processed
+    void Process(std::span<const int16_t> pcm, int64_t capture_time_us, bool speaking);
+
+private:
+    struct Frame {
+        std::vector<int16_t> pcm;
+        int64_t capture_time_us = 0;
+    };
+
+    std::mutex mutex_;
+    SendCallback send_;
+    std::atomic<uint32_t> session_ = 0;     // Changed by Start() and Finish(), a stale backlog is dropped
+    UplinkGatePolicy policy_ = kUplinkGateSendAll;
+    int padding_ms_ = 0;
+    int keepalive_ms_ = 0;
+    std::vector<Frame> preroll_;    // Ring of the frames since the gate closed
+    size_t preroll_head_ = 0;
+    size_t preroll_count_ = 0;
+    int preroll_ms_ = 0;
+    int hold_ms_ = 0;               // Padding left after the last speech frame
+    int silence_sent_ms_ = 0;       // Since the last frame sent in silence
+    Stats stats_ = {};
+
+    // Producer task only: frames taken from the pre-roll that the encoder has not accepted yet
+    std::vector<Frame> backlog_;
+    size_t backlog_head_ = 0;
+    size_t backlog_count_ = 0;
+    uint32_t backlog_session_ = 0;
+
+    void Drop(Frame& frame);
+    // Updates the pre-roll and the stats with the lock held, true when the frame is sent
+    bool Gate(std::span<const int16_t> pcm, int64_t capture_time_us, bool speaking, int frame_ms);
+    void PushBacklog(std::vector<int16_t>& pcm, int64_t capture_time_us);
+    void SendBacklog();
+};
+
+#endif // UPLINK_GATE_H
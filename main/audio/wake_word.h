@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <span>
 
 #include <model_path.h>
 #include "audio_codec.h"
@@ -13,12 +14,17 @@ public:
     virtual ~WakeWord() = default;
     
     virtual bool Initialize(AudioCodec* codec, srmodel_list_t* models_list) = 0;
-    virtual void Feed(const std::vector<int16_t>& data) = 0;
+    // Interleaved input at 16kHz, only valid during the call
+    virtual void Feed(std::span<const int16_t> data) = 0;
     virtual void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) = 0;
+    // Voice activity starting while the wake word is listened for, when the engine runs a VAD
+    virtual void OnSpeechStart(std::function<void()> callback) {}
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
-    virtual void EncodeWakeWordData() = 0;
+    // Frame duration of the wake word packets, lets a rolling pre-roll encode ahead
+    virtual void SetFrameDuration(int frame_duration_ms) {}
+    virtual void EncodeWakeWordData(int frame_duration_ms) = 0;
     virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
 };
@@ -59,7 +59,7 @@ void EspWakeWord::Stop() {
     input_buffer_.clear();
 }
 
-void EspWakeWord::Feed(const std::vector<int16_t>& data) {
+void EspWakeWord::Feed(std::span<const int16_t> data) {
     if (wakenet_data_ == nullptr) {
         return;
     }
@@ -79,7 +79,7 @@ void EspWakeWord::Feed(const std::vector<int16_t>& data) {
     }
 
     int chunksize = wakenet_iface_->get_samp_chunksize(wakenet_data_);
-    while (input_buffer_.size() >= chunksize) {
+    while (input_buffer_.size() >= (size_t)chunksize) {
         int res = wakenet_iface_->detect(wakenet_data_, input_buffer_.data());
         if (res > 0) {
             last_detected_wake_word_ = wakenet_iface_->get_word_name(wakenet_data_, res);
@@ -102,7 +102,7 @@ size_t EspWakeWord::GetFeedSize() {
     return wakenet_iface_->get_samp_chunksize(wakenet_data_);
 }
 
-void EspWakeWord::EncodeWakeWordData() {
+void EspWakeWord::EncodeWakeWordData(int frame_duration_ms) {
 }
 
 bool EspWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
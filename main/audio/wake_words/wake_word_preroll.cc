@@ -0,0 +1,280 @@
+#include "wake_word_preroll.h"
+#include "audio_service.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cstring>
+
+#define TAG "WakeWordPreroll"
+
+#define WAKE_WORD_PREROLL_TASK_STACK_SIZE (4096 * 7)
+
+WakeWordPreroll::WakeWordPreroll() : pcm_(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) {
+}
+
+WakeWordPreroll::~WakeWordPreroll() {
+    if (task_ != nullptr) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+        cv_.notify_all();
+        cv_.wait(lock, [this]() { return task_parked_; });
+        lock.unlock();
+        vTaskDelete(task_);
+    }
+    if (task_stack_ != nullptr) {
+        heap_caps_free(task_stack_);
+    }
+    if (task_buffer_ != nullptr) {
+        heap_caps_free(task_buffer_);
+    }
+}
+
+bool WakeWordPreroll::Initialize() {
+#if CONFIG_WAKE_WORD_ROLLING_PREROLL
+    rolling_ = true;
+#endif
+    if (pcm_.Reserve(WAKE_WORD_PREROLL_SAMPLES) == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the pre-roll buffer");
+        return false;
+    }
+
+    task_stack_ = (StackType_t*)heap_caps_malloc(WAKE_WORD_PREROLL_TASK_STACK_SIZE, MALLOC_CAP_SPIRAM);
+    task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+    assert(task_stack_ != nullptr && task_buffer_ != nullptr);
+    task_ = xTaskCreateStatic([](void* arg) {
+        auto this_ = (WakeWordPreroll*)arg;
+        this_->EncodeTask();
+        // Parked until the destructor deletes the task, the stack is ours
+        while (true) {
+            vTaskDelay(portMAX_DELAY);
+        }
+    }, "encode_wake_word", WAKE_WORD_PREROLL_TASK_STACK_SIZE, this, 2, task_stack_, task_buffer_);
+    ESP_LOGI(TAG, "Wake word pre-roll %d ms, %s encoding", WAKE_WORD_PREROLL_MS, rolling_ ? "rolling" : "on detection");
+    return true;
+}
+
+void WakeWordPreroll::SetFrameDuration(int frame_duration_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_duration_ms_ = frame_duration_ms;
+    cv_.notify_all();
+}
+
+void WakeWordPreroll::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pcm_start_ = pcm_write_;
+    pcm_read_ = pcm_write_;
+    generation_++;
+    ClearPackets();
+    draining_ = false;
+    delivering_ = false;
+    detected_time_us_ = 0;
+    cv_.notify_all();
+}
+
+void WakeWordPreroll::Store(std::span<const int16_t> pcm) {
+    if (pcm_.data() == nullptr || pcm.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t size = std::min<size_t>(pcm.size(), WAKE_WORD_PREROLL_SAMPLES);
+    const int16_t* data = pcm.data() + pcm.size() - size;
+    size_t offset = pcm_write_ % WAKE_WORD_PREROLL_SAMPLES;
+    size_t first = std::min(size, WAKE_WORD_PREROLL_SAMPLES - offset);
+    memcpy(pcm_.data() + offset, data, first * sizeof(int16_t));
+    memcpy(pcm_.data(), data + first, (size - first) * sizeof(int16_t));
+    pcm_write_ += pcm.size();
+    if (pcm_write_ - pcm_read_ > WAKE_WORD_PREROLL_SAMPLES) {
+        pcm_read_ = pcm_write_ - WAKE_WORD_PREROLL_SAMPLES;
+    }
+    if (rolling_) {
+        cv_.notify_all();
+    }
+}
+
+void WakeWordPreroll::MarkDetected() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    detected_time_us_ = esp_timer_get_time();
+}
+
+void WakeWordPreroll::Encode(int frame_duration_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = esp_timer_get_time();
+    if (detected_time_us_ == 0) {
+        detected_time_us_ = now;
+    }
+    frame_duration_ms_ = frame_duration_ms;
+    rolling_used_ = rolling_ && encoder_frame_duration_ms_ == frame_duration_ms;
+    if (!rolling_used_) {
+        // Encode the whole pre-roll from the oldest sample
+        ClearPackets();
+        uint64_t oldest = pcm_write_ > WAKE_WORD_PREROLL_SAMPLES ? pcm_write_ - WAKE_WORD_PREROLL_SAMPLES : 0;
+        pcm_read_ = std::max(pcm_start_, oldest);
+        generation_++;
+    } else {
+        // If the encoder fell behind, drop the oldest packets so the pre-roll stays 2 seconds long
+        size_t pending = (pcm_write_ - pcm_read_) / FrameSamples();
+        size_t limit = WAKE_WORD_PREROLL_MS / encoder_frame_duration_ms_;
+        while (packets_count_ > 0 && packets_count_ + pending > limit) {
+            packets_[packets_head_].clear();
+            packets_head_ = (packets_head_ + 1) % WAKE_WORD_PREROLL_MAX_PACKETS;
+            packets_count_--;
+        }
+    }
+    encode_start_time_us_ = now;
+    encoded_packets_ = packets_count_;
+    first_packet_logged_ = false;
+    draining_ = task_ != nullptr;
+    delivering_ = true;
+    cv_.notify_all();
+}
+
+bool WakeWordPreroll::GetOpus(std::vector<uint8_t>& opus) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() {
+        return !delivering_ || packets_count_ > 0 || !draining_;
+    });
+    if (!delivering_ || packets_count_ == 0) {
+        delivering_ = false;
+        return false;
+    }
+
+    // Swap keeps the capacity of both vectors, so neither side allocates
+    opus.swap(packets_[packets_head_]);
+    packets_[packets_head_].clear();
+    packets_head_ = (packets_head_ + 1) % WAKE_WORD_PREROLL_MAX_PACKETS;
+    packets_count_--;
+
+    if (!first_packet_logged_) {
+        first_packet_logged_ = true;
+        ESP_LOGI(TAG, "First wake word packet %ld ms after detection (%s)",
+            (long)((esp_timer_get_time() - detected_time_us_) / 1000), rolling_used_ ? "rolling" : "encoded on detection");
+    }
+    return true;
+}
+
+void WakeWordPreroll::PushPacket(const uint8_t* data, size_t size) {
+    // While listening the rolling pre-roll keeps the last 2 seconds only
+    size_t limit = delivering_ ? WAKE_WORD_PREROLL_MAX_PACKETS : WAKE_WORD_PREROLL_MS / encoder_frame_duration_ms_;
+    if (packets_count_ >= limit) {
+        packets_[packets_head_].clear();
+        packets_head_ = (packets_head_ + 1) % WAKE_WORD_PREROLL_MAX_PACKETS;
+        packets_count_--;
+    }
+    auto& slot = packets_[(packets_head_ + packets_count_) % WAKE_WORD_PREROLL_MAX_PACKETS];
+    slot.assign(data, data + size);
+    packets_count_++;
+}
+
+void WakeWordPreroll::ClearPackets() {
+    for (size_t i = 0; i < packets_count_; i++) {
+        packets_[(packets_head_ + i) % WAKE_WORD_PREROLL_MAX_PACKETS].clear();
+    }
+    packets_head_ = 0;
+    packets_count_ = 0;
+}
+
+void WakeWordPreroll::EncodeTask() {
+    void* encoder = nullptr;
+    AudioScratch<int16_t> frame;
+    std::vector<uint8_t> out;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (!rolling_ && !draining_) {
+            if (encoder != nullptr) {
+                // Only the rolling pre-roll keeps the encoder between detections
+                lock.unlock();
+                esp_opus_enc_close(encoder);
+                encoder = nullptr;
+                lock.lock();
+                encoder_frame_duration_ms_ = 0;
+                continue;
+            }
+            cv_.wait(lock);
+            continue;
+        }
+
+        if (encoder == nullptr || encoder_frame_duration_ms_ != frame_duration_ms_) {
+            int duration = frame_duration_ms_;
+            lock.unlock();
+            if (encoder != nullptr) {
+                esp_opus_enc_close(encoder);
+                encoder = nullptr;
+            }
+            esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG(duration);
+            auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &encoder);
+            if (encoder != nullptr) {
+                int frame_size = 0;
+                int outbuf_size = 0;
+                esp_opus_enc_get_frame_size(encoder, &frame_size, &outbuf_size);
+                out.resize(outbuf_size);
+                frame.Reserve(frame_size / sizeof(int16_t));
+            }
+            lock.lock();
+            if (encoder == nullptr) {
+                ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
+                // Without an encoder there is nothing to deliver, and no point rolling
+                rolling_ = false;
+                draining_ = false;
+                encoder_frame_duration_ms_ = 0;
+                cv_.notify_all();
+                continue;
+            }
+            if (encoder_frame_duration_ms_ != duration) {
+                // Packets of the previous frame duration can not be sent
+                ClearPackets();
+            }
+            encoder_frame_duration_ms_ = duration;
+            continue;
+        }
+
+        size_t frame_samples = FrameSamples();
+        if (pcm_write_ - pcm_read_ < frame_samples) {
+            if (draining_) {
+                // Caught up with the detection, the partial frame left is dropped
+                draining_ = false;
+                ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", encoded_packets_,
+                    (long)((esp_timer_get_time() - encode_start_time_us_) / 1000));
+                cv_.notify_all();
+                continue;
+            }
+            cv_.wait(lock);
+            continue;
+        }
+
+        size_t offset = pcm_read_ % WAKE_WORD_PREROLL_SAMPLES;
+        size_t first = std::min(frame_samples, WAKE_WORD_PREROLL_SAMPLES - offset);
+        memcpy(frame.data(), pcm_.data() + offset, first * sizeof(int16_t));
+        memcpy(frame.data() + first, pcm_.data(), (frame_samples - first) * sizeof(int16_t));
+        pcm_read_ += frame_samples;
+        uint32_t generation = generation_;
+        lock.unlock();
+
+        esp_audio_enc_in_frame_t in = {};
+        esp_audio_enc_out_frame_t enc_out = {};
+        in.buffer = (uint8_t*)frame.data();
+        in.len = (uint32_t)(frame_samples * sizeof(int16_t));
+        enc_out.buffer = out.data();
+        enc_out.len = (uint32_t)out.size();
+        auto ret = esp_opus_enc_process(encoder, &in, &enc_out);
+
+        lock.lock();
+        if (ret != ESP_AUDIO_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+        } else if (generation == generation_) {
+            PushPacket(out.data(), enc_out.encoded_bytes);
+            if (draining_) {
+                encoded_packets_++;
+            }
+            cv_.notify_all();
+        }
+    }
+    lock.unlock();
+
+    if (encoder != nullptr) {
+        esp_opus_enc_close(encoder);
+    }
+    lock.lock();
+    task_parked_ = true;
+    cv_.notify_all();
+}
@@ -0,0 +1,83 @@
+#ifndef WAKE_WORD_PREROLL_H
+#define WAKE_WORD_PREROLL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <span>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+#include "audio_scratch.h"
+
+#define WAKE_WORD_PREROLL_MS 2000
+#define WAKE_WORD_PREROLL_SAMPLES (16000 * WAKE_WORD_PREROLL_MS / 1000)
+#define WAKE_WORD_PREROLL_MAX_PACKETS (WAKE_WORD_PREROLL_MS / 20 + 2)
+
+/*
+ * The audio sent to the server ahead of a wake word: the last 2 seconds of 16kHz mono PCM in a
+ * fixed ring, encoded to Opus by a background task.
+ *
+ * By default the pre-roll is encoded after the detection, packet by packet, so the first packet is
+ * ready one frame encode after EncodeWakeWordData(). With CONFIG_WAKE_WORD_ROLLING_PREROLL the task
+ * keeps encoding while listening for the wake word and holds the last 2 seconds of Opus packets,
+ * so the packets are ready at the detection and only the last partial frame is encoded afterwards.
+ *
+ * Store() is called by the detection task, Encode() and GetOpus() by the application.
+ */
+class WakeWordPreroll {
+public:
+    WakeWordPreroll();
+    ~WakeWordPreroll();
+
+    bool Initialize();
+    void SetFrameDuration(int frame_duration_ms);
+    // Drops the pre-roll of the previous session and any packet not yet delivered
+    void Start();
+    void Store(std::span<const int16_t> pcm);
+    void MarkDetected();
+    void Encode(int frame_duration_ms);
+    // Blocks until the next packet is encoded, returns false after the last one
+    bool GetOpus(std::vector<uint8_t>& opus);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool rolling_ = false;
+    bool stop_ = false;
+    bool task_parked_ = false;
+    TaskHandle_t task_ = nullptr;
+    StaticTask_t* task_buffer_ = nullptr;
+    StackType_t* task_stack_ = nullptr;
+
+    // PCM ring, positions count samples since boot
+    AudioScratch<int16_t> pcm_;
+    uint64_t pcm_start_ = 0;    // Oldest sample of this session
+    uint64_t pcm_write_ = 0;
+    uint64_t pcm_read_ = 0;     // Next sample to encode
+    uint32_t generation_ = 0;   // Bumped when pcm_read_ moves back, drops the frame being encoded
+
+    // Opus packets, oldest first
+    std::vector<uint8_t> packets_[WAKE_WORD_PREROLL_MAX_PACKETS];
+    size_t packets_head_ = 0;
+    size_t packets_count_ = 0;
+
+    int frame_duration_ms_ = 60;    // Wanted by the next Encode()
+    int encoder_frame_duration_ms_ = 0;
+    bool draining_ = false;         // Encoding up to the detection
+    bool delivering_ = false;       // GetOpus() hands out packets
+    bool first_packet_logged_ = false;
+    bool rolling_used_ = false;
+    int64_t detected_time_us_ = 0;
+    int64_t encode_start_time_us_ = 0;
+    int encoded_packets_ = 0;
+
+    void EncodeTask();
+    void PushPacket(const uint8_t* data, size_t size);
+    void ClearPackets();
+    size_t FrameSamples() const { return encoder_frame_duration_ms_ * 16000 / 1000; }
+};
+
+#endif // WAKE_WORD_PREROLL_H
@@ -4,6 +4,7 @@
 #include "esp_log.h"
 #include "display.h"
 #include "ssid_manager.h"
+#include "pcm_kernels.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -41,12 +42,10 @@ namespace audio_wifi_config
                 continue;
             }
 
-            if (input_channels == 2) { // 如果是双声道输入，转换为单声道
-                auto mono_data = std::vector<int16_t>(audio_data.size() / 2);
-                for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                    mono_data[i] = audio_data[j];
-                }
-                audio_data = std::move(mono_data);
+            if (input_channels == 2) { // 如果是双声道输入，转换为单声道 (in place)
+                size_t frames = audio_data.size() / 2;
+                pcm::TakeChannel(audio_data.data(), audio_data.data(), frames, 2);
+                audio_data.resize(frames);
             }
             
             // Downsample the audio data
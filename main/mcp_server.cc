@@ -62,6 +62,59 @@ void McpServer::AddCommonTools() {
             codec->SetOutputVolume(properties["volume"].value<int>());
             return true;
         });
+
+#if CONFIG_USE_STREAM_PLAYER
+    auto& player = Application::GetInstance().GetStreamPlayer();
+    AddTool("self.audio_player.play",
+        "Play a long Ogg/Opus audio file (story, music, podcast) from an HTTP URL. "
+        "It starts when the conversation ends, and waits during later conversations.",
+        PropertyList({
+            Property("url", kPropertyTypeString)
+        }),
+        [&player](const PropertyList& properties) -> ReturnValue {
+            auto url = properties["url"].value<std::string>();
+            if (!player.Play(url)) {
+                throw std::runtime_error("Failed to play URL: " + url);
+            }
+            return true;
+        });
+
+    AddTool("self.audio_player.pause",
+        "Pause the audio playing from a URL.",
+        PropertyList(),
+        [&player](const PropertyList& properties) -> ReturnValue {
+            player.Pause();
+            return true;
+        });
+
+    AddTool("self.audio_player.resume",
+        "Resume the paused audio from where it was paused.",
+        PropertyList(),
+        [&player](const PropertyList& properties) -> ReturnValue {
+            player.Resume();
+            return true;
+        });
+
+    AddTool("self.audio_player.seek",
+        "Move the audio playing from a URL to a position, in percent of the file.",
+        PropertyList({
+            Property("position_percent", kPropertyTypeInteger, 0, 99)
+        }),
+        [&player](const PropertyList& properties) -> ReturnValue {
+            if (!player.Seek(properties["position_percent"].value<int>())) {
+                throw std::runtime_error("The audio can only seek after it starts playing");
+            }
+            return true;
+        });
+
+    AddTool("self.audio_player.stop",
+        "Stop the audio playing from a URL.",
+        PropertyList(),
+        [&player](const PropertyList& properties) -> ReturnValue {
+            player.Stop();
+            return true;
+        });
+#endif
     
     auto backlight = board.GetBacklight();
     if (backlight) {
@@ -135,6 +188,65 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.audio.get_stats",
+        "Get the audio pipeline statistics. fallback_allocs and buffer_allocs stay unchanged when no heap allocation happens per frame.",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetAudioService().GetStatsJson();
+        });
+
+    AddUserOnlyTool("self.audio.get_latency",
+        "Get the audio latency of every pipeline stage over the last one to two minutes: count, min, avg, p95 and max in ms. "
+        "Uplink: capture to processor output, encode, send queue, send, and total from capture to sent. "
+        "Downlink: packet arrival to decoded, playback queue, output, and total from arrival to played.",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetAudioService().GetLatencyJson();
+        });
+
+#if CONFIG_USE_STREAM_PLAYER
+    AddUserOnlyTool("self.audio_player.get_status",
+        "Get the state of the audio player, its byte position, the time from play, resume or seek to the first audio "
+        "(first_audio_ms) and the underruns of the stream.",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetStreamPlayer().GetStatusJson();
+        });
+#endif
+
+    AddUserOnlyTool("self.audio.codec_stress_test",
+        "Run the Opus encoder and decoder full-duplex (microphone looped back to a muted speaker) for a while. "
+        "The per-direction frames per second, codec time and deadline misses, the queue peaks and the heap allocations "
+        "of the run are logged and reported by `self.audio.get_stats` when it finishes.",
+        PropertyList({
+            Property("duration_seconds", kPropertyTypeInteger, 10, 1, 120)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto& app = Application::GetInstance();
+            if (app.GetDeviceState() != kDeviceStateIdle) {
+                throw std::runtime_error("Codec stress test can only run when the device is idle");
+            }
+            int duration_ms = properties["duration_seconds"].value<int>() * 1000;
+            if (!app.GetAudioService().StartCodecStressTest(duration_ms)) {
+                throw std::runtime_error("Audio service is busy");
+            }
+            return true;
+        });
+
+    AddUserOnlyTool("self.audio.set_frame_duration",
+        "Set the uplink Opus frame duration in milliseconds (20, 40 or 60). Shorter frames lower the latency and cost "
+        "more packets per second. It applies at once and is advertised in the hello of the next audio channel.",
+        PropertyList({
+            Property("frame_duration_ms", kPropertyTypeInteger, 60, 20, 60)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            int frame_duration_ms = properties["frame_duration_ms"].value<int>();
+            if (!Application::GetInstance().GetAudioService().SetFrameDuration(frame_duration_ms)) {
+                throw std::runtime_error("Frame duration must be 20, 40 or 60");
+            }
+            return true;
+        });
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
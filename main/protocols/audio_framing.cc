@@ -0,0 +1,121 @@
+#include "audio_framing.h"
+
+#include <arpa/inet.h>
+#include <cstring>
+
+namespace audio_framing {
+
+const uint8_t* WriteHeader(AudioStreamPacket& packet, int version, size_t& message_size) {
+    if (version == 2) {
+        auto bp2 = (BinaryProtocol2*)packet.PrependHeader(sizeof(BinaryProtocol2));
+        bp2->version = htons(version);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(packet.size());
+        message_size = sizeof(BinaryProtocol2) + packet.size();
+        return (const uint8_t*)bp2;
+    } else if (version == 3) {
+        auto bp3 = (BinaryProtocol3*)packet.PrependHeader(sizeof(BinaryProtocol3));
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(packet.size());
+        message_size = sizeof(BinaryProtocol3) + packet.size();
+        return (const uint8_t*)bp3;
+    }
+    message_size = packet.size();
+    return packet.data();
+}
+
+bool ReadFrame(const uint8_t* data, size_t size, int version, Frame& frame) {
+    if (version == 2) {
+        auto bp2 = (const BinaryProtocol2*)data;
+        if (size < sizeof(BinaryProtocol2) || ntohl(bp2->payload_size) > size - sizeof(BinaryProtocol2)) {
+            return false;
+        }
+        frame.payload = bp2->payload;
+        frame.size = ntohl(bp2->payload_size);
+        frame.timestamp = ntohl(bp2->timestamp);
+    } else if (version == 3) {
+        auto bp3 = (const BinaryProtocol3*)data;
+        if (size < sizeof(BinaryProtocol3) || ntohs(bp3->payload_size) > size - sizeof(BinaryProtocol3)) {
+            return false;
+        }
+        frame.payload = bp3->payload;
+        frame.size = ntohs(bp3->payload_size);
+        frame.timestamp = 0;
+    } else {
+        frame.payload = data;
+        frame.size = size;
+        frame.timestamp = 0;
+    }
+    return true;
+}
+
+bool ReadBatch(const uint8_t* data, size_t size, const std::function<void(const Frame& frame)>& on_frame) {
+    auto bp4 = (const BinaryProtocol4*)data;
+    if (size < sizeof(BinaryProtocol4) || ntohs(bp4->payload_size) > size - sizeof(BinaryProtocol4)) {
+        return false;
+    }
+    uint32_t timestamp = ntohl(bp4->timestamp);
+    const uint8_t* p = bp4->payload;
+    const uint8_t* end = p + ntohs(bp4->payload_size);
+    for (int i = 0; i < bp4->frame_count; i++) {
+        auto header = (const BinaryProtocol4Frame*)p;
+        if (end - p < (ptrdiff_t)sizeof(BinaryProtocol4Frame) ||
+                ntohs(header->size) > end - p - sizeof(BinaryProtocol4Frame)) {
+            return false;
+        }
+        Frame frame;
+        frame.payload = header->data;
+        frame.size = ntohs(header->size);
+        frame.timestamp = timestamp + ntohs(header->timestamp_offset);
+        on_frame(frame);
+        p = header->data + frame.size;
+    }
+    return true;
+}
+
+bool BatchWriter::Fits(const AudioStreamPacket& packet) const {
+    if (frames_ == 0) {
+        return true;
+    }
+    size_t payload_size = buffer_.size() - sizeof(BinaryProtocol4) + sizeof(BinaryProtocol4Frame) + packet.size();
+    return duration_ms_ + packet.frame_duration <= budget_ms_ && frames_ < UINT8_MAX &&
+        payload_size <= UINT16_MAX && packet.timestamp - timestamp_ <= UINT16_MAX;
+}
+
+void BatchWriter::Add(const AudioStreamPacket& packet) {
+    if (frames_ == 0) {
+        buffer_.resize(sizeof(BinaryProtocol4));
+        timestamp_ = packet.timestamp;
+    }
+    size_t offset = buffer_.size();
+    buffer_.resize(offset + sizeof(BinaryProtocol4Frame) + packet.size());
+    auto frame = (BinaryProtocol4Frame*)&buffer_[offset];
+    frame->timestamp_offset = htons(packet.timestamp - timestamp_);
+    frame->size = htons(packet.size());
+    if (packet.size() > 0) {
+        memcpy(frame->data, packet.data(), packet.size());
+    }
+    frames_++;
+    duration_ms_ += packet.frame_duration;
+}
+
+const uint8_t* BatchWriter::Finish(size_t& size) {
+    auto bp4 = (BinaryProtocol4*)buffer_.data();
+    bp4->type = 0;
+    bp4->frame_count = frames_;
+    bp4->payload_size = htons(buffer_.size() - sizeof(BinaryProtocol4));
+    bp4->timestamp = htonl(timestamp_);
+    size = buffer_.size();
+    Clear();
+    return buffer_.data();
+}
+
+void BatchWriter::Clear() {
+    frames_ = 0;
+    duration_ms_ = 0;
+}
+
+} // namespace audio_framing
@@ -0,0 +1,70 @@
+#ifndef AUDIO_FRAMING_H
+#define AUDIO_FRAMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "protocol.h"
+
+/*
+ * The binary audio messages of the websocket protocol, see BinaryProtocol2 / 3 / 4.
+ *
+ * Uplink headers are written into the packet headroom, so header and Opus data go out as one
+ * buffer. Downlink headers are read in place, the payload is left in the message.
+ */
+namespace audio_framing {
+
+// One Opus frame of a received message, pointing into the message
+struct Frame {
+    const uint8_t* payload = nullptr;
+    size_t size = 0;
+    uint32_t timestamp = 0;
+};
+
+// Writes the header of the protocol version in front of the packet data. Returns the message,
+// message_size bytes from the header to the end of the data. Version 1 sends the data alone
+const uint8_t* WriteHeader(AudioStreamPacket& packet, int version, size_t& message_size);
+
+// Reads a version 1-3 message. False when it is shorter than its header or than payload_size
+bool ReadFrame(const uint8_t* data, size_t size, int version, Frame& frame);
+
+// Reads a version 4 message, frame by frame. False when a frame runs past payload_size or the
+// message, the frames before it have been passed to on_frame
+bool ReadBatch(const uint8_t* data, size_t size, const std::function<void(const Frame& frame)>& on_frame);
+
+/*
+ * Packs version 4 uplink messages, up to budget_ms of audio each.
+ *
+ * Before Add(), Fits() tells whether the frame can join the batch: a frame over the budget, the
+ * 255 frames, the 16-bit payload_size or timestamp_offset needs the batch sent first. The buffer
+ * is kept between messages.
+ */
+class BatchWriter {
+public:
+    explicit BatchWriter(int budget_ms) : budget_ms_(budget_ms) {}
+
+    bool Fits(const AudioStreamPacket& packet) const;
+    void Add(const AudioStreamPacket& packet);
+    // The budget is used up, the batch should go out
+    bool Full() const { return duration_ms_ >= budget_ms_; }
+    // With frames() > 0, writes the header and returns the message of size bytes, valid until the
+    // next Add(). The next Add() starts a new batch
+    const uint8_t* Finish(size_t& size);
+    void Clear();
+
+    int frames() const { return frames_; }
+    int duration_ms() const { return duration_ms_; }
+
+private:
+    std::vector<uint8_t> buffer_;
+    int budget_ms_;
+    int frames_ = 0;
+    int duration_ms_ = 0;
+    uint32_t timestamp_ = 0;
+};
+
+} // namespace audio_framing
+
+#endif // AUDIO_FRAMING_H
@@ -0,0 +1,260 @@
+#include "control_message.h"
+
+#include <cstring>
+#include <cstdint>
+
+void ControlMessageParser::SkipSpace() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+        p_++;
+    }
+}
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool ReadHex4(const char* p, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = HexValue(p[i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+// Keys are matched ignoring ASCII case, as cJSON_GetObjectItem() does
+static bool KeyEquals(std::string_view key, const char* name) {
+    size_t i = 0;
+    for (; i < key.size() && name[i] != '\0'; i++) {
+        char c = key[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (c != name[i]) {
+            return false;
+        }
+    }
+    return i == key.size() && name[i] == '\0';
+}
+
+static bool IsControlType(std::string_view type) {
+    return type == "tts" || type == "stt" || type == "llm";
+}
+
+bool ControlMessageParser::ReadString(std::string_view& value) {
+    // p_ is on the opening quote
+    const char* start = ++p_;
+    while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+        p_++;
+    }
+    if (p_ >= end_) {
+        return false;
+    }
+    if (*p_ == '"') {
+        value = std::string_view(start, p_ - start);
+        p_++;
+        return true;
+    }
+
+    /* Escaped, decode into the scratch buffer */
+    size_t run = p_ - start;
+    if (scratch_used_ + run > sizeof(scratch_)) {
+        return false;
+    }
+    char* out = scratch_ + scratch_used_;
+    memcpy(out, start, run);
+    out += run;
+    char* out_end = scratch_ + sizeof(scratch_);
+    while (p_ < end_ && *p_ != '"') {
+        if (out + 4 > out_end) {
+            return false;
+        }
+        char c = *p_++;
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+        if (p_ >= end_) {
+            return false;
+        }
+        c = *p_++;
+        switch (c) {
+        case '"': case '\\': case '/': *out++ = c; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u': {
+            uint32_t code;
+            if (end_ - p_ < 4 || !ReadHex4(p_, code)) {
+                return false;
+            }
+            p_ += 4;
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                uint32_t low;
+                if (end_ - p_ < 6 || p_[0] != '\\' || p_[1] != 'u' || !ReadHex4(p_ + 2, low) ||
+                        low < 0xDC00 || low > 0xDFFF) {
+                    return false;
+                }
+                p_ += 6;
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                return false;
+            }
+            if (code < 0x80) {
+                *out++ = code;
+            } else if (code < 0x800) {
+                *out++ = 0xC0 | (code >> 6);
+                *out++ = 0x80 | (code & 0x3F);
+            } else if (code < 0x10000) {
+                *out++ = 0xE0 | (code >> 12);
+                *out++ = 0x80 | ((code >> 6) & 0x3F);
+                *out++ = 0x80 | (code & 0x3F);
+            } else {
+                *out++ = 0xF0 | (code >> 18);
+                *out++ = 0x80 | ((code >> 12) & 0x3F);
+                *out++ = 0x80 | ((code >> 6) & 0x3F);
+                *out++ = 0x80 | (code & 0x3F);
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    if (p_ >= end_) {
+        return false;
+    }
+    p_++;
+    value = std::string_view(scratch_ + scratch_used_, out - (scratch_ + scratch_used_));
+    scratch_used_ = out - scratch_;
+    return true;
+}
+
+bool ControlMessageParser::SkipValue() {
+    /* Numbers and literals run to the next delimiter, objects and arrays to their closing bracket */
+    int depth = 0;
+    while (p_ < end_) {
+        char c = *p_;
+        if (c == '"') {
+            p_++;
+            while (p_ < end_ && *p_ != '"') {
+                p_ += (*p_ == '\\') ? 2 : 1;
+            }
+            if (p_ >= end_) {
+                return false;
+            }
+            p_++;
+        } else if (c == '{' || c == '[') {
+            depth++;
+            p_++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return true;
+            }
+            depth--;
+            p_++;
+        } else if (c == ',' && depth == 0) {
+            return true;
+        } else {
+            p_++;
+        }
+        if (depth == 0 && (c == '"' || c == '}' || c == ']')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ControlMessageParser::Parse(const char* json, size_t length, ControlMessage& message) {
+    message = ControlMessage();
+    p_ = json;
+    end_ = json + length;
+    scratch_used_ = 0;
+
+    SkipSpace();
+    if (p_ >= end_ || *p_ != '{') {
+        return false;
+    }
+    p_++;
+    SkipSpace();
+    if (p_ < end_ && *p_ == '}') {
+        return false;
+    }
+
+    while (p_ < end_) {
+        std::string_view key;
+        SkipSpace();
+        if (p_ >= end_ || *p_ != '"' || !ReadString(key)) {
+            return false;
+        }
+        SkipSpace();
+        if (p_ >= end_ || *p_ != ':') {
+            return false;
+        }
+        p_++;
+        SkipSpace();
+        if (p_ >= end_) {
+            return false;
+        }
+
+        // The first occurrence in any case wins, like cJSON_GetObjectItem()
+        std::string_view* field = nullptr;
+        if (KeyEquals(key, "type")) {
+            field = &message.type;
+        } else if (KeyEquals(key, "state")) {
+            field = &message.state;
+        } else if (KeyEquals(key, "text")) {
+            field = &message.text;
+        } else if (KeyEquals(key, "emotion")) {
+            field = &message.emotion;
+        }
+        if (field != nullptr && field->data() != nullptr) {
+            field = nullptr;
+        }
+        if (field != nullptr && *p_ == '"') {
+            if (!ReadString(*field)) {
+                return false;
+            }
+            // Other types go to cJSON, no need to read the rest
+            if (field == &message.type && !IsControlType(message.type)) {
+                return false;
+            }
+        } else if (field != nullptr) {
+            // cJSON would see the first one as not a string, leave it to cJSON
+            return false;
+        } else if (!SkipValue()) {
+            return false;
+        }
+
+        SkipSpace();
+        if (p_ >= end_) {
+            return false;
+        }
+        if (*p_ == '}') {
+            break;
+        }
+        if (*p_ != ',') {
+            return false;
+        }
+        p_++;
+    }
+    if (p_ >= end_) {
+        return false;
+    }
+
+    return IsControlType(message.type);
+}
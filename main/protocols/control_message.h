@@ -0,0 +1,42 @@
+#ifndef CONTROL_MESSAGE_H
+#define CONTROL_MESSAGE_H
+
+#include <string_view>
+#include <cstddef>
+
+#define CONTROL_MESSAGE_SCRATCH_SIZE 1024   // Decoded escaped strings, a longer text falls back to cJSON
+
+// The fields of a server control message (tts, stt, llm) that the application acts on
+struct ControlMessage {
+    std::string_view type;
+    std::string_view state;
+    std::string_view text;
+    std::string_view emotion;
+};
+
+/*
+ * Reads a ControlMessage without building a cJSON tree.
+ *
+ * The server sends these several times per reply, a sentence_start for every sentence, and a
+ * tree costs an allocation per item and per string on the network task. Parse() walks the
+ * top-level object once, skips the values it does not need and keeps views of the four strings.
+ * A string without escapes points into the message, an escaped one is decoded into the scratch
+ * buffer. The views are valid until the next Parse() or until the message is released.
+ */
+class ControlMessageParser {
+public:
+    // False for other types (mcp, hello...) and for anything it cannot read, which is left to cJSON
+    bool Parse(const char* json, size_t length, ControlMessage& message);
+
+private:
+    const char* p_ = nullptr;
+    const char* end_ = nullptr;
+    char scratch_[CONTROL_MESSAGE_SCRATCH_SIZE];
+    size_t scratch_used_ = 0;
+
+    void SkipSpace();
+    bool ReadString(std::string_view& value);
+    bool SkipValue();
+};
+
+#endif // CONTROL_MESSAGE_H
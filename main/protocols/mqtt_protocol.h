@@ -3,10 +3,11 @@
 
 
 #include "protocol.h"
+#include "udp_audio_cipher.h"
+#include "udp_reorder_window.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
-#include <mbedtls/aes.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
@@ -22,6 +23,7 @@
 #define MQTT_RECONNECT_INTERVAL_MS 60000
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define MQTT_PROTOCOL_SERVER_HELLO_ERROR_EVENT (1 << 1)   // The hello cannot open the UDP channel
 
 class MqttProtocol : public Protocol {
 public:
@@ -33,6 +35,7 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel(bool send_goodbye = true) override;
     bool IsAudioChannelOpened() const override;
+    bool Prewarm() override;
 
 private:
     // Alive flag for safe scheduled callbacks - set to false in destructor
@@ -45,12 +48,15 @@ private:
     std::mutex channel_mutex_;
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
-    mbedtls_aes_context aes_ctx_;
+    UdpAudioCipher send_cipher_;
+    UdpAudioCipher recv_cipher_;
+    std::string aes_key_;
     std::string aes_nonce_;
+    std::string send_buffer_;   // The datagram, reused for every packet
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
-    uint32_t remote_sequence_;
+    UdpReorderWindow reorder_window_;
     esp_timer_handle_t reconnect_timer_;
 
     bool StartMqttClient(bool report_error=false);
@@ -4,10 +4,22 @@
 
 #define TAG "Protocol"
 
+uint8_t* AudioStreamPacket::PrependHeader(size_t header_size) {
+    if (headroom < header_size) {
+        payload.insert(payload.begin(), header_size - headroom, 0);
+        headroom = header_size;
+    }
+    return payload.data() + headroom - header_size;
+}
+
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
+void Protocol::OnIncomingControl(std::function<void(const ControlMessage& message)> callback) {
+    on_incoming_control_ = callback;
+}
+
 void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
     on_incoming_audio_ = callback;
 }
@@ -32,6 +44,15 @@ void Protocol::OnDisconnected(std::function<void()> callback) {
     on_disconnected_ = callback;
 }
 
+bool Protocol::ParseControlMessage(const char* data, size_t length) {
+    ControlMessage message;
+    if (on_incoming_control_ == nullptr || !control_parser_.Parse(data, length, message)) {
+        return false;
+    }
+    on_incoming_control_(message);
+    return true;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -5,13 +5,36 @@
 #include <string>
 #include <functional>
 #include <chrono>
+#include <memory>
 #include <vector>
 
+#include "control_message.h"
+#include "heap_caps_allocator.h"
+
+// Bytes kept free in front of an uplink payload, enough for the largest protocol header
+#define AUDIO_PACKET_HEADROOM 16
+
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
-    std::vector<uint8_t> payload;
+    uint32_t sequence = 0;      // Network order for the jitter buffer, 0 for local packets
+    int64_t origin_time_us = 0; // Capture (uplink) or arrival (downlink), for the audio latency stats
+    int64_t stage_time_us = 0;
+    AudioPayload payload;
+    uint16_t headroom = 0;      // Bytes at the front of payload reserved for a header, the Opus data follows
+
+    const uint8_t* data() const { return payload.data() + headroom; }
+    size_t size() const { return payload.size() - headroom; }
+    // The header_size bytes right before the Opus data, so the header and the data are sent as one
+    // buffer. The data is only moved when the packet was built with less headroom.
+    uint8_t* PrependHeader(size_t header_size);
+
+    // Packets are recycled through AudioPacketPool (audio/audio_pool.h)
+    AudioStreamPacket();
+    ~AudioStreamPacket();
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
 };
 
 struct BinaryProtocol2 {
@@ -30,6 +53,21 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+// Version 4 packs several Opus frames in one message, each behind a BinaryProtocol4Frame
+struct BinaryProtocol4 {
+    uint8_t type;           // Message type (0: OPUS)
+    uint8_t frame_count;
+    uint16_t payload_size;  // Bytes of the frames that follow
+    uint32_t timestamp;     // Timestamp of the first frame in milliseconds
+    uint8_t payload[];
+} __attribute__((packed));
+
+struct BinaryProtocol4Frame {
+    uint16_t timestamp_offset;  // Milliseconds after the message timestamp
+    uint16_t size;
+    uint8_t data[];
+} __attribute__((packed));
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -57,6 +95,8 @@ public:
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // tts, stt and llm messages, read without cJSON. The others go to OnIncomingJson
+    void OnIncomingControl(std::function<void(const ControlMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -67,6 +107,9 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel(bool send_goodbye = true) = 0;
     virtual bool IsAudioChannelOpened() const = 0;
+    // Connects ahead of OpenAudioChannel() when a conversation is likely, without reporting errors.
+    // Does not block the caller, false when the previous attempt failed.
+    virtual bool Prewarm() { return false; }
     virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
@@ -76,6 +119,7 @@ public:
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(const ControlMessage& message)> on_incoming_control_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
@@ -88,8 +132,11 @@ protected:
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    ControlMessageParser control_parser_;
 
     virtual bool SendText(const std::string& text) = 0;
+    // Called by the network task before cJSON, true when the message was handled
+    bool ParseControlMessage(const char* data, size_t length);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
 };
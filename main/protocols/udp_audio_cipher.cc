@@ -0,0 +1,65 @@
+#include "udp_audio_cipher.h"
+
+#include <arpa/inet.h>
+#include <cstring>
+
+UdpAudioCipher::UdpAudioCipher() {
+    mbedtls_aes_init(&aes_ctx_);
+}
+
+UdpAudioCipher::~UdpAudioCipher() {
+    mbedtls_aes_free(&aes_ctx_);
+}
+
+bool UdpAudioCipher::SetKey(const std::string& key, const std::string& nonce) {
+    if (key.size() != 16 || nonce.size() != UDP_AUDIO_NONCE_SIZE) {
+        return false;
+    }
+    memcpy(nonce_, nonce.data(), sizeof(nonce_));
+    return mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)key.data(), 128) == 0;
+}
+
+bool UdpAudioCipher::Encrypt(const uint8_t* data, size_t size, uint32_t timestamp, uint32_t sequence,
+    std::string& datagram) {
+    datagram.resize(UDP_AUDIO_NONCE_SIZE + size);
+    auto nonce = (uint8_t*)datagram.data();
+    memcpy(nonce, nonce_, sizeof(nonce_));
+    uint16_t payload_len = htons(size);
+    timestamp = htonl(timestamp);
+    sequence = htonl(sequence);
+    memcpy(nonce + 2, &payload_len, sizeof(payload_len));
+    memcpy(nonce + 8, &timestamp, sizeof(timestamp));
+    memcpy(nonce + 12, &sequence, sizeof(sequence));
+
+    // mbedtls advances the counter, the nonce in the datagram stays as sent
+    uint8_t counter[UDP_AUDIO_NONCE_SIZE];
+    memcpy(counter, nonce, sizeof(counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    return mbedtls_aes_crypt_ctr(&aes_ctx_, size, &nc_off, counter, stream_block, data,
+        nonce + UDP_AUDIO_NONCE_SIZE) == 0;
+}
+
+bool UdpAudioCipher::Decrypt(const uint8_t* datagram, size_t size, uint8_t* payload) {
+    if (size < UDP_AUDIO_NONCE_SIZE) {
+        return false;
+    }
+    uint8_t counter[UDP_AUDIO_NONCE_SIZE];
+    memcpy(counter, datagram, sizeof(counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    return mbedtls_aes_crypt_ctr(&aes_ctx_, size - UDP_AUDIO_NONCE_SIZE, &nc_off, counter, stream_block,
+        datagram + UDP_AUDIO_NONCE_SIZE, payload) == 0;
+}
+
+uint32_t UdpAudioCipher::Timestamp(const uint8_t* datagram) {
+    uint32_t timestamp;
+    memcpy(&timestamp, datagram + 8, sizeof(timestamp));
+    return ntohl(timestamp);
+}
+
+uint32_t UdpAudioCipher::Sequence(const uint8_t* datagram) {
+    uint32_t sequence;
+    memcpy(&sequence, datagram + 12, sizeof(sequence));
+    return ntohl(sequence);
+}
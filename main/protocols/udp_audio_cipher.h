@@ -0,0 +1,44 @@
+#ifndef UDP_AUDIO_CIPHER_H
+#define UDP_AUDIO_CIPHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <mbedtls/aes.h>
+
+#define UDP_AUDIO_NONCE_SIZE 16
+
+/*
+ * AES-128-CTR of the MQTT+UDP audio datagrams.
+ *
+ * A datagram is a 16-byte nonce followed by the encrypted Opus data. The nonce is the one of the
+ * server hello with the payload size, timestamp and sequence written in, and it is the initial
+ * counter of the payload:
+ * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
+ *
+ * One cipher per direction, the receive side runs on the UDP task.
+ */
+class UdpAudioCipher {
+public:
+    UdpAudioCipher();
+    ~UdpAudioCipher();
+    UdpAudioCipher(const UdpAudioCipher&) = delete;
+    UdpAudioCipher& operator=(const UdpAudioCipher&) = delete;
+
+    // The key and nonce of the server hello, 16 bytes each
+    bool SetKey(const std::string& key, const std::string& nonce);
+    // Writes the nonce and the encrypted data into datagram, which keeps its capacity between calls
+    bool Encrypt(const uint8_t* data, size_t size, uint32_t timestamp, uint32_t sequence, std::string& datagram);
+    // Decrypts the size - UDP_AUDIO_NONCE_SIZE bytes of payload, the datagram is not modified
+    bool Decrypt(const uint8_t* datagram, size_t size, uint8_t* payload);
+
+    static uint32_t Timestamp(const uint8_t* datagram);
+    static uint32_t Sequence(const uint8_t* datagram);
+
+private:
+    mbedtls_aes_context aes_ctx_;
+    uint8_t nonce_[UDP_AUDIO_NONCE_SIZE] = {};
+};
+
+#endif // UDP_AUDIO_CIPHER_H
@@ -0,0 +1,37 @@
+#ifndef UDP_REORDER_WINDOW_H
+#define UDP_REORDER_WINDOW_H
+
+#include <cstdint>
+
+#define UDP_REORDER_WINDOW 16   // Packets this far behind the newest are dropped, matches JITTER_BUFFER_CAPACITY
+
+/*
+ * Decides which received UDP audio packets go on to the jitter buffer.
+ *
+ * Reordered and duplicate packets are passed on, the jitter buffer puts them back in order while
+ * they are still in time and counts them. Only packets UDP_REORDER_WINDOW or more behind the
+ * newest one are dropped, the jitter buffer would take them for a sequence restart and flush.
+ * Sequences are compared with wrap-around, 0 means no packet yet.
+ */
+class UdpReorderWindow {
+public:
+    // False for a packet too far behind the newest one, a packet ahead of it becomes the newest
+    bool Accept(uint32_t sequence) {
+        int32_t offset = (int32_t)(sequence - newest_);
+        if (newest_ != 0 && offset <= -UDP_REORDER_WINDOW) {
+            return false;
+        }
+        if (newest_ == 0 || offset > 0) {
+            newest_ = sequence;
+        }
+        return true;
+    }
+
+    void Reset() { newest_ = 0; }
+    uint32_t newest() const { return newest_; }
+
+private:
+    uint32_t newest_ = 0;
+};
+
+#endif // UDP_REORDER_WINDOW_H
@@ -1,4 +1,5 @@
 #include "websocket_protocol.h"
+#include "audio_framing.h"
 #include "board.h"
 #include "system_info.h"
 #include "application.h"
@@ -14,9 +15,50 @@
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+
+    esp_timer_create_args_t batch_timer_args = {
+        .callback = [](void* arg) {
+            // Sent from the main loop, like the rest of the uplink
+            auto protocol = static_cast<WebsocketProtocol*>(arg);
+            Application::GetInstance().Schedule([protocol]() {
+                protocol->FlushAudioBatch();
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_batch",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&batch_timer_args, &batch_timer_);
+
+    esp_timer_create_args_t warm_timer_args = {
+        .callback = [](void* arg) {
+            auto protocol = static_cast<WebsocketProtocol*>(arg);
+            Application::GetInstance().Schedule([protocol]() {
+                protocol->CloseWarmConnection();
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_warm",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&warm_timer_args, &warm_timer_);
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    *alive_ = false;
+    if (prewarm_task_ != nullptr) {
+        xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_DONE_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    if (batch_timer_ != nullptr) {
+        esp_timer_stop(batch_timer_);
+        esp_timer_delete(batch_timer_);
+    }
+    if (warm_timer_ != nullptr) {
+        esp_timer_stop(warm_timer_);
+        esp_timer_delete(warm_timer_);
+    }
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -30,31 +72,50 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         return false;
     }
 
-    if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
-        bp2->version = htons(version_);
-        bp2->type = 0;
-        bp2->reserved = 0;
-        bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
+    if (batch_audio_) {
+        return BatchAudio(std::move(packet));
+    }
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
-        bp3->type = 0;
-        bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
+    /* The header is written into the packet headroom, the frame goes out without a copy */
+    size_t size;
+    auto message = audio_framing::WriteHeader(*packet, version_, size);
+    return SendAudioMessage(message, size, 1);
+}
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+bool WebsocketProtocol::SendAudioMessage(const void* data, size_t size, int frames) {
+    sent_frames_ += frames;
+    sent_messages_++;
+    sent_bytes_ += size;
+    return websocket_->Send(data, size, true);
+}
+
+bool WebsocketProtocol::BatchAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    /* A frame that does not fit in the budget or the header fields sends the batch before it */
+    if (!batch_.Fits(*packet) && !FlushAudioBatch()) {
+        return false;
+    }
+    if (batch_.frames() == 0) {
+        esp_timer_start_once(batch_timer_, CONFIG_WEBSOCKET_AUDIO_BATCH_MS * 1000);
+    }
+    batch_.Add(*packet);
+    if (batch_.Full()) {
+        return FlushAudioBatch();
     }
+    return true;
+}
+
+bool WebsocketProtocol::FlushAudioBatch() {
+    if (batch_.frames() == 0) {
+        return true;
+    }
+    esp_timer_stop(batch_timer_);
+    int frames = batch_.frames();
+    size_t size;
+    auto message = batch_.Finish(size);
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+    return SendAudioMessage(message, size, frames);
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
@@ -62,6 +123,9 @@ bool WebsocketProtocol::SendText(const std::string& text) {
         return false;
     }
 
+    // Batched audio goes first, the server sees it before a stop or abort
+    FlushAudioBatch();
+
     if (!websocket_->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
@@ -72,15 +136,160 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    return websocket_ != nullptr && websocket_->IsConnected() && !warm_ && !error_occurred_ && !IsTimeout();
+}
+
+bool WebsocketProtocol::Prewarm() {
+#if CONFIG_AUDIO_CHANNEL_PREWARM
+    FinishPrewarm(false);
+    if (prewarm_task_ != nullptr) {
+        return true;    // Still connecting
+    }
+    if (prewarm_failed_) {
+        prewarm_failed_ = false;
+        return false;
+    }
+    if (websocket_ != nullptr && websocket_->IsConnected()) {
+        if (warm_) {
+            esp_timer_stop(warm_timer_);
+            esp_timer_start_once(warm_timer_, CONFIG_AUDIO_CHANNEL_WARM_SECONDS * 1000000LL);
+        }
+        return true;
+    }
+
+    // Only the TCP and TLS handshakes are done ahead, OpenAudioChannel() is left with the hello.
+    // They take hundreds of milliseconds, so they run on a task and the main loop keeps going.
+    warm_ = true;
+    esp_timer_stop(warm_timer_);
+    websocket_.reset();
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_DONE_EVENT);
+    if (xTaskCreate([](void* arg) {
+        auto protocol = static_cast<WebsocketProtocol*>(arg);
+        protocol->PrewarmTask();
+        vTaskDelete(NULL);
+    }, "ws_prewarm", 4096 * 2, this, 2, &prewarm_task_) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create pre-warm task");
+        prewarm_task_ = nullptr;
+        warm_ = false;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void WebsocketProtocol::PrewarmTask() {
+    int64_t start_time = esp_timer_get_time();
+    prewarmed_websocket_ = Connect(false);
+    if (prewarmed_websocket_ != nullptr) {
+        ESP_LOGI(TAG, "Warm connection ready in %ld ms", (long)((esp_timer_get_time() - start_time) / 1000));
+    }
+    // The destructor waits for the event, after it only alive says whether this is still there
+    auto alive = alive_;
+    xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_DONE_EVENT);
+    Application::GetInstance().Schedule([this, alive]() {
+        if (*alive) {
+            FinishPrewarm(false);
+        }
+    });
+}
+
+// Takes the socket over from the pre-warm task. Without wait, a task still connecting is left alone.
+void WebsocketProtocol::FinishPrewarm(bool wait) {
+    if (prewarm_task_ == nullptr) {
+        return;
+    }
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_DONE_EVENT, pdTRUE,
+        pdFALSE, wait ? portMAX_DELAY : 0);
+    if (!(bits & WEBSOCKET_PROTOCOL_PREWARM_DONE_EVENT)) {
+        return;
+    }
+    prewarm_task_ = nullptr;
+    websocket_ = std::move(prewarmed_websocket_);
+    if (websocket_ == nullptr) {
+        // Reported by the next Prewarm(), the application waits before trying again
+        warm_ = false;
+        prewarm_failed_ = true;
+        return;
+    }
+    if (warm_) {
+        esp_timer_start_once(warm_timer_, CONFIG_AUDIO_CHANNEL_WARM_SECONDS * 1000000LL);
+    }
+}
+
+void WebsocketProtocol::CloseWarmConnection() {
+    if (!warm_ || prewarm_task_ != nullptr) {
+        return;
+    }
+    ESP_LOGI(TAG, "Closing unused warm connection");
+    // warm_ stays set until the socket is gone, its disconnect is not a closed channel
+    websocket_.reset();
+    warm_ = false;
 }
 
 void WebsocketProtocol::CloseAudioChannel(bool send_goodbye) {
     (void)send_goodbye;  // Websocket doesn't need to send goodbye message
+    FinishPrewarm(true);
+    esp_timer_stop(warm_timer_);
+    FlushAudioBatch();
+    if (sent_messages_ > 0) {
+        ESP_LOGI(TAG, "Uplink audio: %lu frames in %lu messages, %llu bytes", (unsigned long)sent_frames_,
+            (unsigned long)sent_messages_, (unsigned long long)sent_bytes_);
+    }
     websocket_.reset();
+    warm_ = false;
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    int64_t start_time = esp_timer_get_time();
+    // A pre-warm still connecting is further along than a new connection, wait for it
+    FinishPrewarm(true);
+    bool warm = warm_ && websocket_ != nullptr && websocket_->IsConnected();
+    esp_timer_stop(warm_timer_);
+    if (warm_ && !warm) {
+        websocket_.reset();  // Dropped by the server while warm
+    }
+    warm_ = false;
+
+    error_occurred_ = false;
+    batch_audio_ = false;
+    batch_.Clear();
+    sent_frames_ = 0;
+    sent_messages_ = 0;
+    sent_bytes_ = 0;
+
+    if (!warm) {
+        websocket_ = Connect(true);
+        if (websocket_ == nullptr) {
+            return false;
+        }
+    }
+
+    // Send hello message to describe the client
+    auto message = GetHelloMessage();
+    if (!SendText(message)) {
+        return false;
+    }
+
+    // Wait for server hello
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
+        ESP_LOGE(TAG, "Failed to receive server hello");
+        SetError(Lang::Strings::SERVER_TIMEOUT);
+        return false;
+    }
+    ESP_LOGI(TAG, "Audio channel opened in %ld ms on a %s connection",
+        (long)((esp_timer_get_time() - start_time) / 1000), warm ? "warm" : "new");
+
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+
+    return true;
+}
+
+std::unique_ptr<WebSocket> WebsocketProtocol::Connect(bool report_error) {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
@@ -89,13 +298,11 @@ bool WebsocketProtocol::OpenAudioChannel() {
         version_ = version;
     }
 
-    error_occurred_ = false;
-
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
-    if (websocket_ == nullptr) {
+    auto websocket = network->CreateWebSocket(1);
+    if (websocket == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
-        return false;
+        return nullptr;
     }
 
     if (!token.empty()) {
@@ -103,49 +310,43 @@ bool WebsocketProtocol::OpenAudioChannel() {
         if (token.find(" ") == std::string::npos) {
             token = "Bearer " + token;
         }
-        websocket_->SetHeader("Authorization", token.c_str());
+        websocket->SetHeader("Authorization", token.c_str());
     }
-    websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    websocket->SetHeader("Protocol-Version", std::to_string(version_.load()).c_str());
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+    websocket->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
+            if (on_incoming_audio_ != nullptr && batch_audio_) {
+                auto on_frame = [this](const audio_framing::Frame& frame) {
+                    auto packet = std::make_unique<AudioStreamPacket>();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->sequence = ++incoming_sequence_;
+                    packet->timestamp = frame.timestamp;
+                    AssignBuffer(packet->payload, frame.payload, frame.size);
+                    on_incoming_audio_(std::move(packet));
+                };
+                if (!audio_framing::ReadBatch((const uint8_t*)data, len, on_frame)) {
+                    ESP_LOGW(TAG, "Invalid audio batch of %u bytes", (unsigned)len);
+                }
+            } else if (on_incoming_audio_ != nullptr) {
+                /* The header is read in place, the payload is copied once into a pooled packet */
+                audio_framing::Frame frame;
+                if (!audio_framing::ReadFrame((const uint8_t*)data, len, version_, frame)) {
+                    ESP_LOGW(TAG, "Invalid audio frame of %u bytes", (unsigned)len);
                 } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
+                    auto packet = std::make_unique<AudioStreamPacket>();
+                    packet->sample_rate = server_sample_rate_;
+                    packet->frame_duration = server_frame_duration_;
+                    packet->sequence = ++incoming_sequence_;
+                    packet->timestamp = frame.timestamp;
+                    AssignBuffer(packet->payload, frame.payload, frame.size);
+                    on_incoming_audio_(std::move(packet));
                 }
             }
-        } else {
+        } else if (!ParseControlMessage(data, len)) {
             // Parse JSON data
             auto root = cJSON_Parse(data);
             auto type = cJSON_GetObjectItem(root, "type");
@@ -165,58 +366,48 @@ bool WebsocketProtocol::OpenAudioChannel() {
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    websocket->OnDisconnected([this]() {
+        if (warm_) {
+            ESP_LOGI(TAG, "Warm connection closed by the server");
+            return;
+        }
         ESP_LOGI(TAG, "Websocket disconnected");
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
 
-    ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
-        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket_->GetLastError());
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
-        return false;
-    }
-
-    // Send hello message to describe the client
-    auto message = GetHelloMessage();
-    if (!SendText(message)) {
-        return false;
-    }
-
-    // Wait for server hello
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
-    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
-        ESP_LOGE(TAG, "Failed to receive server hello");
-        SetError(Lang::Strings::SERVER_TIMEOUT);
-        return false;
-    }
-
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
+    ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_.load());
+    if (!websocket->Connect(url.c_str())) {
+        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket->GetLastError());
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        }
+        return nullptr;
     }
-
-    return true;
+    return websocket;
 }
 
 std::string WebsocketProtocol::GetHelloMessage() {
     // keys: message type, version, audio_params (format, sample_rate, channels)
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", version_);
+    cJSON_AddNumberToObject(root, "version", version_.load());
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_WEBSOCKET_AUDIO_BATCH_MS > 0
+    cJSON_AddBoolToObject(features, "audio_batch", true);
+#endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", Application::GetInstance().GetAudioService().GetFrameDuration());
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -238,6 +429,15 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
+#if CONFIG_WEBSOCKET_AUDIO_BATCH_MS > 0
+    // The server takes the batched protocol offered in the client hello
+    auto version = cJSON_GetObjectItem(root, "version");
+    batch_audio_ = cJSON_IsNumber(version) && version->valueint == 4;
+    if (batch_audio_) {
+        ESP_LOGI(TAG, "Audio batched up to %d ms", CONFIG_WEBSOCKET_AUDIO_BATCH_MS);
+    }
+#endif
+
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
         auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
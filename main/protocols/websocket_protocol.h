@@ -3,12 +3,19 @@
 
 
 #include "protocol.h"
+#include "audio_framing.h"
 
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+#include <vector>
+#include <atomic>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define WEBSOCKET_PROTOCOL_PREWARM_DONE_EVENT (1 << 1)
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -20,12 +27,46 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel(bool send_goodbye = true) override;
     bool IsAudioChannelOpened() const override;
+    bool Prewarm() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
-    int version_ = 1;
+    // Written by Connect(), which runs on the pre-warm task, read by the main loop and the network task
+    std::atomic<int> version_ = 1;
+    uint32_t incoming_sequence_ = 0;    // TCP keeps the order, so packets are numbered on arrival
+
+    // Version 4, accepted by the server hello. Uplink frames wait in batch_ up to
+    // CONFIG_WEBSOCKET_AUDIO_BATCH_MS of audio, the timer sends a batch the uplink stopped filling.
+    // Set by the hello on the network task, read by the main loop and the receive callback.
+    std::atomic<bool> batch_audio_ = false;
+    audio_framing::BatchWriter batch_{CONFIG_WEBSOCKET_AUDIO_BATCH_MS};
+    esp_timer_handle_t batch_timer_ = nullptr;
+
+    // Connected by Prewarm() without a hello. OpenAudioChannel() takes the socket over,
+    // the warm timer drops it when no conversation starts within CONFIG_AUDIO_CHANNEL_WARM_SECONDS.
+    std::atomic<bool> warm_ = false;
+    esp_timer_handle_t warm_timer_ = nullptr;
+
+    // The pre-warm connect runs on prewarm_task_, the main loop takes prewarmed_websocket_ over
+    // in FinishPrewarm() once WEBSOCKET_PROTOCOL_PREWARM_DONE_EVENT is set
+    TaskHandle_t prewarm_task_ = nullptr;
+    std::unique_ptr<WebSocket> prewarmed_websocket_;
+    bool prewarm_failed_ = false;
+    std::shared_ptr<std::atomic<bool>> alive_ = std::make_shared<std::atomic<bool>>(true);
+
+    // Uplink audio of the channel, logged when it closes
+    uint32_t sent_frames_ = 0;
+    uint32_t sent_messages_ = 0;
+    uint64_t sent_bytes_ = 0;
 
+    std::unique_ptr<WebSocket> Connect(bool report_error);
+    void PrewarmTask();
+    void FinishPrewarm(bool wait);
+    void CloseWarmConnection();
+    bool SendAudioMessage(const void* data, size_t size, int frames);
+    bool BatchAudio(std::unique_ptr<AudioStreamPacket> packet);
+    bool FlushAudioBatch();
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();